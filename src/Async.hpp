@@ -0,0 +1,296 @@
+#ifndef ASYNC_H_
+#define ASYNC_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#define ORION_HAS_COROUTINES 1
+#endif
+
+#include "Tensor.hpp"
+#include "ThreadPool.hpp"
+
+/*
+ * Asynchronous execution of tensor ops. Ops are enqueued on a Stream and
+ * return an AsyncTensor at once, a handle to a result buffer that is
+ * filled later on a worker thread. An op starts when the ops producing its
+ * inputs and the previous op of its stream are done, so ops on different
+ * streams overlap and the caller only blocks in get, wait or sync.
+ *
+ *     Stream s1, s2;
+ *     AsyncTensor<double> p = s1.matmul<double>(a, b); // these two
+ *     AsyncTensor<double> q = s2.matmul<double>(c, d); // run concurrently
+ *     auto r = s1.map([](auto const& x, auto const& y){ return tanh_t(x + y); }, p, q);
+ *     Tensor<double> out = r.get();
+ * */
+
+namespace Orion{
+
+    namespace detail{
+        /*
+         * Completion flag of one enqueued op with the callbacks waiting on it.
+         * */
+        class AsyncEvent{
+        public:
+            void complete(){
+                std::vector<std::function<void()>> waiters;
+                {
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_done = true;
+                    waiters.swap(m_waiters);
+                }
+                m_cv.notify_all();
+                for(auto& w : waiters) w();
+            }
+
+            // false if the event has completed already, f is then not kept
+            bool on_complete(std::function<void()> f){
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if(m_done) return false;
+                m_waiters.push_back(std::move(f));
+                return true;
+            }
+
+            bool ready() const{
+                std::lock_guard<std::mutex> lock(m_mutex);
+                return m_done;
+            }
+
+            void wait() const{
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cv.wait(lock, [&]{ return m_done; });
+            }
+
+        private:
+            mutable std::mutex m_mutex;
+            mutable std::condition_variable m_cv;
+            bool m_done = false;
+            std::vector<std::function<void()>> m_waiters;
+        };
+    } // namespace detail
+
+    /**
+     * Process wide scheduler behind all streams. Ops are handed to its
+     * thread pool once their dependencies are done.
+     * */
+    class AsyncRuntime{
+    public:
+        static AsyncRuntime& instance(){
+            static AsyncRuntime runtime;
+            return runtime;
+        }
+
+        /**
+         * Run work on a pool thread after every event in deps, then complete done.
+         * */
+        void launch(std::vector<std::shared_ptr<detail::AsyncEvent>> const& deps, std::function<void()> work,
+                    std::shared_ptr<detail::AsyncEvent> done){
+            m_outstanding.fetch_add(1);
+            auto node = std::make_shared<Node>();
+            node->work = std::move(work);
+            node->done = std::move(done);
+            // one extra count held until every dependency is registered
+            node->waiting.store(deps.size() + 1);
+            for(auto const& d : deps)
+                if(!d || !d->on_complete([this, node]{ release(node); })) release(node);
+            release(node);
+        }
+
+        /**
+         * Block until every op enqueued so far on any stream is done.
+         * */
+        void sync(){
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_idle.wait(lock, [&]{ return m_outstanding.load() == 0; });
+        }
+
+        u64 threads() const{ return m_pool.size() - 1; }
+
+    private:
+        struct Node{
+            std::function<void()> work;
+            std::shared_ptr<detail::AsyncEvent> done;
+            std::atomic<u64> waiting{0};
+        };
+
+        // ops run on pool threads only, the caller keeps enqueueing
+        AsyncRuntime() : m_pool(std::max(1u, std::thread::hardware_concurrency()) + 1){}
+
+        void release(std::shared_ptr<Node> const& node){
+            if(node->waiting.fetch_sub(1) != 1) return;
+            m_pool.submit([this, node]{
+                node->work();
+                node->work = nullptr; // drop captured inputs before dependents run
+                node->done->complete();
+                if(m_outstanding.fetch_sub(1) == 1){
+                    std::lock_guard<std::mutex> lock(m_mutex);
+                    m_idle.notify_all();
+                }
+            });
+        }
+
+        std::atomic<u64> m_outstanding{0};
+        std::mutex m_mutex;
+        std::condition_variable m_idle;
+        // last, so queued ops finish before the members they use are destroyed
+        ThreadPool m_pool;
+    };
+
+    /**
+     * Future like handle to a tensor produced by an op on a Stream. The
+     * shape and buffer exist as soon as the op is enqueued, the contents
+     * once it is done. Copies share the same result.
+     * */
+    template<typename dt>
+    class AsyncTensor{
+    public:
+        typedef dt value_type;
+
+        AsyncTensor() = default;
+
+        /**
+         * Handle to a tensor that is ready already, to feed existing
+         * tensors to streams. The buffer is shared, not copied.
+         * */
+        AsyncTensor(Tensor<dt> const& t) : m_tensor(t){}
+
+        inline const DimVec& dim() const{ return m_tensor.dim(); }
+        inline u64 rank() const{ return m_tensor.rank(); }
+        inline u64 nelem() const{ return m_tensor.nelem(); }
+
+        bool ready() const{ return !m_event || m_event->ready(); }
+
+        void wait() const{
+            if(m_event) m_event->wait();
+        }
+
+        /**
+         * Wait for the op and return its result.
+         * */
+        Tensor<dt> const& get() const{
+            wait();
+            return m_tensor;
+        }
+
+        // completion of the producing op, null for ready handles
+        std::shared_ptr<detail::AsyncEvent> const& event() const{ return m_event; }
+
+#ifdef ORION_HAS_COROUTINES
+        /*
+         * co_await on a handle suspends the coroutine until the op is done
+         * and resumes it on the pool thread that finished the op.
+         * */
+        bool await_ready() const{ return ready(); }
+        bool await_suspend(std::coroutine_handle<> h) const{
+            return m_event->on_complete([h]{ h.resume(); });
+        }
+        // by value, the awaited handle may be a temporary
+        Tensor<dt> await_resume() const{ return m_tensor; }
+#endif
+
+    private:
+        friend class Stream;
+
+        AsyncTensor(Tensor<dt> const& t, std::shared_ptr<detail::AsyncEvent> e) : m_tensor(t), m_event(std::move(e)){}
+
+        Tensor<dt> m_tensor;
+        std::shared_ptr<detail::AsyncEvent> m_event;
+    };
+
+    /**
+     * In order queue of asynchronous ops. Each op waits for the previous
+     * op of its stream and for the producers of its inputs, whichever
+     * stream they were enqueued on.
+     * */
+    class Stream{
+    public:
+        Stream() = default;
+        Stream(Stream const&) = delete;
+        Stream& operator=(Stream const&) = delete;
+
+        /**
+         * Enqueue f(out, inputs...) writing a new tensor of the given shape.
+         * f runs on a pool thread with the input tensors once they are ready.
+         * */
+        template<typename dt, typename F, typename... In>
+        AsyncTensor<dt> enqueue(DimVec const& dim, F f, AsyncTensor<In> const&... in){
+            Tensor<dt> out(dim);
+            auto done = std::make_shared<detail::AsyncEvent>();
+            std::vector<std::shared_ptr<detail::AsyncEvent>> deps{in.event()..., m_last};
+            AsyncRuntime::instance().launch(deps, [f, out, in...]() mutable{
+                f(out, in.get()...);
+            }, done);
+            m_last = done;
+            return AsyncTensor<dt>(out, done);
+        }
+
+        /**
+         * Enqueue a task without a tensor result, such as preparing data
+         * into an existing buffer. Later ops of this stream run after it.
+         * */
+        template<typename F, typename... In>
+        void run(F f, AsyncTensor<In> const&... in){
+            auto done = std::make_shared<detail::AsyncEvent>();
+            std::vector<std::shared_ptr<detail::AsyncEvent>> deps{in.event()..., m_last};
+            AsyncRuntime::instance().launch(deps, [f, in...]() mutable{
+                f(in.get()...);
+            }, done);
+            m_last = done;
+        }
+
+        /**
+         * Enqueue an element wise chain. f builds an expression of its
+         * tensor arguments, eg : [](auto const& a, auto const& b){ return a%b + 1.0; },
+         * and the expression is evaluated into a new tensor in one pass.
+         * */
+        template<typename F, typename In0, typename... In>
+        auto map(F f, AsyncTensor<In0> const& in0, AsyncTensor<In> const&... in){
+            // building the expression evaluates nothing, it only gives the shape
+            DimVec dim = f(in0.m_tensor, in.m_tensor...).dim();
+            return enqueue<In0>(dim, [f](Tensor<In0>& out, auto const&... args){
+                out.assign(f(args...));
+            }, in0, in...);
+        }
+
+        /**
+         * Enqueue the matrix product of a and b.
+         * */
+        template<typename dt>
+        AsyncTensor<dt> matmul(AsyncTensor<dt> const& a, AsyncTensor<dt> const& b){
+            assert(a.rank() == 2 && b.rank() == 2 && a.dim()[1] == b.dim()[0]);
+            return enqueue<dt>(DimVec{a.dim()[0], b.dim()[1]}, [](Tensor<dt>& c, Tensor<dt> const& x, Tensor<dt> const& y){
+                u64 m = x.dim()[0], k = x.dim()[1], n = y.dim()[1];
+                gemm(false, false, m, n, k, dt(1), x.data(), k, y.data(), n, dt(0), c.data(), n);
+            }, a, b);
+        }
+
+        /**
+         * Block until every op enqueued on this stream is done.
+         * */
+        void sync() const{
+            if(m_last) m_last->wait();
+        }
+
+    private:
+        std::shared_ptr<detail::AsyncEvent> m_last;
+    };
+
+    /**
+     * Block until every op enqueued on any stream is done.
+     * */
+    inline void sync(){
+        AsyncRuntime::instance().sync();
+    }
+
+} // namespace Orion
+
+#endif // ASYNC_H_
@@ -0,0 +1,229 @@
+#ifndef ATTENTION_H_
+#define ATTENTION_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Tensor.hpp"
+#include "Gemm.hpp"
+#include "VecMath.hpp"
+#include "Dispatch.hpp"
+
+/*
+ * Scaled dot product attention, softmax(scale q k^T + mask) v, computed
+ * in blocks of query and key rows. Scores of one block pair are a small
+ * tile that stays in cache, the softmax is accumulated online with a
+ * running max and sum per query row, and the full score matrix is never
+ * formed. The backward pass recomputes the tiles from the saved per row
+ * logsumexp instead of storing probabilities.
+ * */
+
+namespace Orion{
+
+    struct AttentionParams{
+        // query i only sees keys j <= i
+        bool causal = false;
+        // factor on the scores, 0 for 1/sqrt(head dimension)
+        double scale = 0;
+    };
+
+    namespace detail{
+        // query and key rows per tile, a tile of scores is 32 KB of doubles
+        constexpr u64 ATTENTION_BLOCK_Q = 64;
+        constexpr u64 ATTENTION_BLOCK_K = 64;
+
+        /*
+         * Sizes of one attention problem. q is {..., lq, d}, k {..., lk, d},
+         * v {..., lk, dv} and the output {..., lq, dv}, over batch leading
+         * entries.
+         * */
+        struct AttentionGeometry{
+            u64 batch, lq, lk, d, dv;
+            double scale;
+            bool causal;
+        };
+
+        inline AttentionGeometry attention_geometry(DimVec const& q, DimVec const& k, DimVec const& v, AttentionParams const& p){
+            assert(q.size() >= 2 && q.size() == k.size() && q.size() == v.size());
+            AttentionGeometry g;
+            u64 r = q.size();
+            g.batch = 1;
+            for(u64 i = 0; i + 2 < r; i++){
+                assert(q[i] == k[i] && q[i] == v[i]);
+                g.batch *= q[i];
+            }
+            g.lq = q[r - 2];
+            g.d = q[r - 1];
+            g.lk = k[r - 2];
+            g.dv = v[r - 1];
+            assert(k[r - 1] == g.d && v[r - 2] == g.lk);
+            g.scale = p.scale != 0 ? p.scale : 1/std::sqrt(static_cast<double>(g.d));
+            g.causal = p.causal;
+            return g;
+        }
+
+        /*
+         * Scores of query rows [i0, i0 + bq) against key rows [j0, j0 + bk)
+         * into s, bq x bk, with masked entries at -inf. mask is lq x lk with
+         * zeros at masked entries, or null.
+         * */
+        template<typename dt>
+        inline void attention_scores(AttentionGeometry const& g, const dt* q, const dt* k, const dt* mask,
+                                     u64 i0, u64 bq, u64 j0, u64 bk, dt* s){
+            gemm(false, true, bq, bk, g.d, static_cast<dt>(g.scale), q + i0*g.d, g.d, k + j0*g.d, g.d, dt(0), s, bk);
+            if(!g.causal && !mask) return;
+            const dt inf = std::numeric_limits<dt>::infinity();
+            for(u64 i = 0; i < bq; i++){
+                for(u64 j = 0; j < bk; j++){
+                    bool hidden = (g.causal && j0 + j > i0 + i) || (mask && mask[(i0 + i)*g.lk + j0 + j] == dt(0));
+                    if(hidden) s[i*bk + j] = -inf;
+                }
+            }
+        }
+
+        // key rows a causal query block ending before row i1 can see
+        inline u64 attention_keys(AttentionGeometry const& g, u64 i1){
+            return g.causal ? std::min(g.lk, i1) : g.lk;
+        }
+
+        /*
+         * One batch entry. out is the output rows, lse receives the
+         * logsumexp of the scaled scores of every query row, -inf for rows
+         * with every key masked, whose output is zero.
+         * */
+        template<typename dt>
+        void attention_forward(AttentionGeometry const& g, const dt* q, const dt* k, const dt* v, const dt* mask, dt* out, dt* lse){
+            const dt inf = std::numeric_limits<dt>::infinity();
+            thread_local std::vector<dt> tile;
+            tile.resize(ATTENTION_BLOCK_Q*ATTENTION_BLOCK_K);
+            dt* s = tile.data();
+            for(u64 i0 = 0; i0 < g.lq; i0 += ATTENTION_BLOCK_Q){
+                u64 bq = std::min(ATTENTION_BLOCK_Q, g.lq - i0);
+                dt* o = out + i0*g.dv;
+                dt* m = lse + i0;
+                std::fill(o, o + bq*g.dv, dt(0));
+                // running max in lse, running sum in l
+                dt l[ATTENTION_BLOCK_Q] = {};
+                std::fill(m, m + bq, -inf);
+                u64 keys = attention_keys(g, i0 + bq);
+                for(u64 j0 = 0; j0 < keys; j0 += ATTENTION_BLOCK_K){
+                    u64 bk = std::min(ATTENTION_BLOCK_K, keys - j0);
+                    attention_scores(g, q, k, mask, i0, bq, j0, bk, s);
+                    isa_dispatch([&]{
+                        for(u64 i = 0; i < bq; i++){
+                            dt* si = s + i*bk;
+                            dt bm = si[0];
+                            for(u64 j = 1; j < bk; j++) bm = std::max(bm, si[j]);
+                            dt nm = std::max(m[i], bm);
+                            if(nm == -inf){
+                                // nothing visible yet, the row contributes zeros
+                                std::fill(si, si + bk, dt(0));
+                                continue;
+                            }
+                            dt alpha = vexp(m[i] - nm);
+                            dt sum = 0;
+                            for(u64 j = 0; j < bk; j++){
+                                si[j] = vexp(si[j] - nm);
+                                sum += si[j];
+                            }
+                            l[i] = l[i]*alpha + sum;
+                            m[i] = nm;
+                            dt* oi = o + i*g.dv;
+                            for(u64 c = 0; c < g.dv; c++) oi[c] *= alpha;
+                        }
+                    });
+                    gemm(false, false, bq, g.dv, bk, dt(1), s, bk, v + j0*g.dv, g.dv, dt(1), o, g.dv);
+                }
+                for(u64 i = 0; i < bq; i++){
+                    if(l[i] == dt(0)){
+                        m[i] = -inf;
+                        continue;
+                    }
+                    dt inv = dt(1)/l[i];
+                    for(u64 c = 0; c < g.dv; c++) o[i*g.dv + c] *= inv;
+                    m[i] += std::log(l[i]);
+                }
+            }
+        }
+
+        /*
+         * Gradients of one batch entry from dout, accumulated into dq, dk
+         * and dv, null pointers skip an input. out and lse come from
+         * attention_forward.
+         * */
+        template<typename dt>
+        void attention_backward(AttentionGeometry const& g, const dt* q, const dt* k, const dt* v, const dt* mask,
+                                const dt* out, const dt* lse, const dt* dout, dt* dq, dt* dk, dt* dv){
+            const dt inf = std::numeric_limits<dt>::infinity();
+            const dt scale = static_cast<dt>(g.scale);
+            thread_local std::vector<dt> tiles;
+            tiles.resize(2*ATTENTION_BLOCK_Q*ATTENTION_BLOCK_K);
+            dt* p = tiles.data();
+            dt* dp = p + ATTENTION_BLOCK_Q*ATTENTION_BLOCK_K;
+            bool scores = dq || dk;
+            for(u64 i0 = 0; i0 < g.lq; i0 += ATTENTION_BLOCK_Q){
+                u64 bq = std::min(ATTENTION_BLOCK_Q, g.lq - i0);
+                // rowsum(dout % out), the softmax gradient term of each row
+                dt dsum[ATTENTION_BLOCK_Q];
+                for(u64 i = 0; i < bq; i++){
+                    dt acc = 0;
+                    for(u64 c = 0; c < g.dv; c++) acc += dout[(i0 + i)*g.dv + c]*out[(i0 + i)*g.dv + c];
+                    dsum[i] = acc;
+                }
+                u64 keys = attention_keys(g, i0 + bq);
+                for(u64 j0 = 0; j0 < keys; j0 += ATTENTION_BLOCK_K){
+                    u64 bk = std::min(ATTENTION_BLOCK_K, keys - j0);
+                    attention_scores(g, q, k, mask, i0, bq, j0, bk, p);
+                    isa_dispatch([&]{
+                        for(u64 i = 0; i < bq; i++){
+                            dt li = lse[i0 + i];
+                            dt* pi = p + i*bk;
+                            if(li == -inf) std::fill(pi, pi + bk, dt(0));
+                            else for(u64 j = 0; j < bk; j++) pi[j] = vexp(pi[j] - li);
+                        }
+                    });
+                    if(dv) gemm(true, false, bk, g.dv, bq, dt(1), p, bk, dout + i0*g.dv, g.dv, dt(1), dv + j0*g.dv, g.dv);
+                    if(!scores) continue;
+                    gemm(false, true, bq, bk, g.dv, dt(1), dout + i0*g.dv, g.dv, v + j0*g.dv, g.dv, dt(0), dp, bk);
+                    for(u64 i = 0; i < bq; i++)
+                        for(u64 j = 0; j < bk; j++) dp[i*bk + j] = p[i*bk + j]*(dp[i*bk + j] - dsum[i]);
+                    if(dq) gemm(false, false, bq, g.d, bk, scale, dp, bk, k + j0*g.d, g.d, dt(1), dq + i0*g.d, g.d);
+                    if(dk) gemm(true, false, bk, g.d, bq, scale, dp, bk, q + i0*g.d, g.d, dt(1), dk + j0*g.d, g.d);
+                }
+            }
+        }
+    } // namespace detail
+
+    /**
+     * softmax(scale q k^T + mask) v over the last two dimensions, leading
+     * dimensions are a batch.
+     * @param q queries {..., lq, d}.
+     * @param k keys {..., lk, d}.
+     * @param v values {..., lk, dv}.
+     * @param mask lq x lk, zero where a query must not see a key, or null.
+     * @param lse if not null receives the logsumexp of every query row,
+     * which is what the backward pass needs.
+     * @return {..., lq, dv}.
+     * */
+    template<typename dt>
+    inline Tensor<dt> attention(Tensor<dt> const& q, Tensor<dt> const& k, Tensor<dt> const& v, AttentionParams const& p = {},
+                                Tensor<dt> const* mask = nullptr, std::vector<dt>* lse = nullptr){
+        auto g = detail::attention_geometry(q.dim(), k.dim(), v.dim(), p);
+        assert(!mask || mask->nelem() == g.lq*g.lk);
+        DimVec od = q.dim();
+        od.back() = g.dv;
+        Tensor<dt> out(od);
+        std::vector<dt> own;
+        if(!lse) lse = &own;
+        lse->resize(g.batch*g.lq);
+        for(u64 b = 0; b < g.batch; b++)
+            detail::attention_forward(g, q.data() + b*g.lq*g.d, k.data() + b*g.lk*g.d, v.data() + b*g.lk*g.dv,
+                                      mask ? mask->data() : nullptr, out.data() + b*g.lq*g.dv, lse->data() + b*g.lq);
+        return out;
+    }
+
+} // namespace Orion
+
+#endif // ATTENTION_H_
@@ -0,0 +1,352 @@
+#ifndef AUTOTUNE_H_
+#define AUTOTUNE_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/stat.h>
+
+#include "Tensor.hpp"
+#include "ThreadPool.hpp"
+#include "Gemm.hpp"
+#include "Strassen.hpp"
+#include "Transpose.hpp"
+
+/*
+ * Tuning of block sizes and parallel thresholds for the host. autotune
+ * times candidate values of each parameter on small benchmarks and keeps
+ * the fastest, save_tuning writes the result to a cache file and
+ * load_tuning reads it back, for the same CPU only.
+ *
+ * Programs call init_tuning at startup to load the cache. With
+ * ORION_AUTOTUNE=1 in the environment a missing cache is tuned and written
+ * first, ORION_AUTOTUNE=0 leaves the built in defaults. The cache lives at
+ * $ORION_TUNE_CACHE, or else in $XDG_CACHE_HOME/orion or ~/.cache/orion.
+ * Without the call the built in defaults are used.
+ *
+ *     ThreadPool pool;
+ *     autotune(&pool);                 // a few seconds
+ *     save_tuning(tuning_cache_path());
+ * */
+
+namespace Orion{
+
+    /**
+     * Every tunable parameter.
+     * */
+    struct Tuning{
+        GemmBlocking gemm;
+        u64 strassen_cutoff = 0;
+        TransposeParams transpose;
+        EvalParams eval;
+    };
+
+    /**
+     * Parameters in use now.
+     * */
+    inline Tuning current_tuning(){
+        Tuning t;
+        t.gemm = gemm_blocking();
+        t.strassen_cutoff = strassen_cutoff();
+        t.transpose = transpose_params();
+        t.eval = eval_params();
+        return t;
+    }
+
+    inline void apply_tuning(Tuning const& t){
+        gemm_blocking() = t.gemm;
+        strassen_cutoff() = t.strassen_cutoff;
+        transpose_params() = t.transpose;
+        eval_params() = t.eval;
+    }
+
+    /**
+     * Benchmark sizes. The defaults take a few seconds in total, tests
+     * use smaller ones.
+     * */
+    struct AutotuneOptions{
+        // side of the square product timed for the gemm blocking
+        u64 gemm_size = 384;
+        // largest side tried as the Strassen cutoff
+        u64 strassen_max = 1024;
+        // side of the square matrix transposed
+        u64 transpose_size = 1024;
+        // largest tensor assigned when looking for the parallel threshold
+        u64 eval_max = u64(1) << 22;
+        // timings per candidate, the fastest counts
+        u64 reps = 3;
+    };
+
+    namespace detail{
+        template<typename F>
+        double tune_time(u64 reps, F f){
+            typedef std::chrono::steady_clock clock;
+            double best = 1e300;
+            for(u64 r = 0; r < std::max<u64>(reps, 1); r++){
+                auto t0 = clock::now();
+                f();
+                best = std::min(best, std::chrono::duration<double>(clock::now() - t0).count());
+            }
+            return best;
+        }
+
+        // the candidate of values with the smallest time(value)
+        template<typename F>
+        u64 tune_pick(std::vector<u64> const& values, F time){
+            u64 best = values[0];
+            double best_t = 1e300;
+            for(u64 v : values){
+                double t = time(v);
+                if(t < best_t){
+                    best_t = t;
+                    best = v;
+                }
+            }
+            return best;
+        }
+
+        inline Tensor<double> tune_matrix(u64 rows, u64 cols){
+            Tensor<double> x({rows, cols});
+            for(u64 i = 0; i < x.nelem(); i++) x.data()[i] = static_cast<double>(i%97)/97.0 - 0.5;
+            return x;
+        }
+
+        /*
+         * CPU model and thread count. A cache written on one machine is
+         * only loaded on a machine reporting the same.
+         * */
+        inline std::string tune_host(){
+            std::string model = "unknown";
+            std::ifstream in("/proc/cpuinfo");
+            for(std::string line; std::getline(in, line);){
+                if(line.compare(0, 10, "model name") == 0 || line.compare(0, 9, "Processor") == 0){
+                    size_t colon = line.find(':');
+                    if(colon != std::string::npos){
+                        model = line.substr(line.find_first_not_of(" \t", colon + 1));
+                        break;
+                    }
+                }
+            }
+            return model + " | " + std::to_string(std::thread::hardware_concurrency()) + " threads";
+        }
+    } // namespace detail
+
+    /**
+     * gemm_blocking by coordinate descent: kc first as it sets the size of
+     * the packed slivers in L1, then mc for L2, then nc for L3.
+     * */
+    inline void tune_gemm(AutotuneOptions const& opt = AutotuneOptions()){
+        u64 n = opt.gemm_size;
+        Tensor<double> a = detail::tune_matrix(n, n), b = detail::tune_matrix(n, n), c({n, n});
+        auto run = [&]{ gemm(false, false, n, n, n, 1.0, a.data(), n, b.data(), n, 0.0, c.data(), n); };
+        GemmBlocking& blk = gemm_blocking();
+        blk.kc = detail::tune_pick({64, 128, 192, 256, 384, 512}, [&](u64 v){ blk.kc = v; return detail::tune_time(opt.reps, run); });
+        blk.mc = detail::tune_pick({32, 48, 64, 96, 128, 192, 256}, [&](u64 v){ blk.mc = v; return detail::tune_time(opt.reps, run); });
+        blk.nc = detail::tune_pick({256, 512, 1024, 2048, 4096}, [&](u64 v){ blk.nc = v; return detail::tune_time(opt.reps, run); });
+    }
+
+    /**
+     * strassen_cutoff as the smallest power of two side, up to
+     * strassen_max, at which one Strassen level beats gemm. Above the
+     * range if none does. Run after tune_gemm, the crossover depends on it.
+     * */
+    inline void tune_strassen(AutotuneOptions const& opt = AutotuneOptions()){
+        u64 found = 2*opt.strassen_max;
+        for(u64 n = 64; n <= opt.strassen_max; n *= 2){
+            Tensor<double> a = detail::tune_matrix(n, n), b = detail::tune_matrix(n, n), c({n, n});
+            strassen_cutoff() = n;
+            double classical = detail::tune_time(opt.reps, [&]{ gemm(false, false, n, n, n, 1.0, a.data(), n, b.data(), n, 0.0, c.data(), n); });
+            double fast = detail::tune_time(opt.reps, [&]{ strassen(n, n, n, a.data(), n, b.data(), n, c.data(), n); });
+            if(fast < classical){
+                found = n;
+                break;
+            }
+        }
+        strassen_cutoff() = found;
+    }
+
+    /**
+     * transpose_params: the leaf side on one thread, and with a pool the
+     * smallest matrix that gains from it.
+     * */
+    inline void tune_transpose(ThreadPool* pool = nullptr, AutotuneOptions const& opt = AutotuneOptions()){
+        u64 n = opt.transpose_size;
+        Tensor<double> a = detail::tune_matrix(n, n), b({n, n});
+        TransposeParams& tp = transpose_params();
+        tp.leaf = detail::tune_pick({8, 16, 32, 64, 128, 256}, [&](u64 v){
+            tp.leaf = v;
+            return detail::tune_time(opt.reps, [&]{ transpose(n, n, a.data(), n, b.data(), n); });
+        });
+        if(pool == nullptr || pool->size() < 2) return;
+        u64 threshold = n*n + 1;
+        for(u64 s = 64; s <= n; s *= 2){
+            tp.parallel_min = 0;
+            double par = detail::tune_time(opt.reps, [&]{ transpose(s, s, a.data(), s, b.data(), s, pool); });
+            double seq = detail::tune_time(opt.reps, [&]{ transpose(s, s, a.data(), s, b.data(), s); });
+            if(par < seq){
+                threshold = s*s;
+                break;
+            }
+        }
+        tp.parallel_min = threshold;
+    }
+
+    /**
+     * eval_params: the block given to each task, then the smallest tensor
+     * that gains from splitting an assignment over the pool. Nothing to
+     * tune without a pool of several threads.
+     * */
+    inline void tune_eval(ThreadPool* pool, AutotuneOptions const& opt = AutotuneOptions()){
+        if(pool == nullptr || pool->size() < 2) return;
+        u64 n = opt.eval_max;
+        Tensor<double> a = detail::tune_matrix(1, n), b = detail::tune_matrix(1, n), c({1, n});
+        EvalParams& ep = eval_params();
+        ep.parallel_min = 0;
+        ep.grain = detail::tune_pick({u64(1) << 12, u64(1) << 14, u64(1) << 16, u64(1) << 18}, [&](u64 v){
+            ep.grain = v;
+            return detail::tune_time(opt.reps, [&]{ c.assign(exp_t(a)%b + a, *pool); });
+        });
+        u64 threshold = n + 1;
+        for(u64 s = u64(1) << 10; s <= n; s *= 2){
+            Tensor<double> x({s}, a.data()), y({s}, b.data()), z({s}, c.data());
+            double par = detail::tune_time(opt.reps, [&]{ z.assign(exp_t(x)%y + x, *pool); });
+            double seq = detail::tune_time(opt.reps, [&]{ z.assign(exp_t(x)%y + x); });
+            if(par < seq){
+                threshold = s;
+                break;
+            }
+        }
+        ep.parallel_min = threshold;
+    }
+
+    /**
+     * Tune every parameter for this host and apply the result.
+     * @param pool threads the parallel thresholds are measured with, or null.
+     * */
+    inline Tuning autotune(ThreadPool* pool = nullptr, AutotuneOptions const& opt = AutotuneOptions()){
+        tune_gemm(opt);
+        tune_strassen(opt);
+        tune_transpose(pool, opt);
+        tune_eval(pool, opt);
+        return current_tuning();
+    }
+
+    /**
+     * Default cache file, empty when no location is known.
+     * */
+    inline std::string tuning_cache_path(){
+        if(const char* p = std::getenv("ORION_TUNE_CACHE")) return p;
+        if(const char* p = std::getenv("XDG_CACHE_HOME")) return std::string(p) + "/orion/tuning";
+        if(const char* p = std::getenv("HOME")) return std::string(p) + "/.cache/orion/tuning";
+        return "";
+    }
+
+    /**
+     * Write the parameters in use, with the host they were tuned on.
+     * Missing directories are created.
+     * */
+    inline bool save_tuning(std::string const& path){
+        if(path.empty()) return false;
+        for(size_t s = path.find('/', 1); s != std::string::npos; s = path.find('/', s + 1))
+            ::mkdir(path.substr(0, s).c_str(), 0755);
+        std::ofstream out(path);
+        if(!out) return false;
+        Tuning t = current_tuning();
+        out << "# orion autotune\n"
+            << "host " << detail::tune_host() << "\n"
+            << "gemm.mc " << t.gemm.mc << "\n"
+            << "gemm.kc " << t.gemm.kc << "\n"
+            << "gemm.nc " << t.gemm.nc << "\n"
+            << "strassen.cutoff " << t.strassen_cutoff << "\n"
+            << "transpose.leaf " << t.transpose.leaf << "\n"
+            << "transpose.parallel_min " << t.transpose.parallel_min << "\n"
+            << "eval.parallel_min " << t.eval.parallel_min << "\n"
+            << "eval.grain " << t.eval.grain << "\n";
+        return bool(out);
+    }
+
+    /**
+     * Apply the parameters saved at path. Values out of the range a
+     * parameter accepts, eg. a zero gemm block, are skipped and the value
+     * in use is kept, the built in default at startup.
+     * @return false, changing nothing, when the file is missing, was
+     * written on another host or is malformed.
+     * */
+    inline bool load_tuning(std::string const& path){
+        if(path.empty()) return false;
+        std::ifstream in(path);
+        if(!in) return false;
+        Tuning t = current_tuning();
+        struct Entry{ const char* key; u64* value; u64 lo, hi; };
+        const u64 any = ~u64(0);
+        const Entry entries[] = {
+            {"gemm.mc", &t.gemm.mc, detail::GEMM_MR, 4096},
+            {"gemm.kc", &t.gemm.kc, 1, 4096},
+            {"gemm.nc", &t.gemm.nc, detail::GEMM_NR, u64(1) << 16},
+            // Strassen recursion needs a few levels of gemm below it
+            {"strassen.cutoff", &t.strassen_cutoff, 16, any},
+            {"transpose.leaf", &t.transpose.leaf, detail::transpose_tile, 4096},
+            {"transpose.parallel_min", &t.transpose.parallel_min, 0, any},
+            {"eval.parallel_min", &t.eval.parallel_min, 0, any},
+            {"eval.grain", &t.eval.grain, 1, any},
+        };
+        bool host = false;
+        for(std::string line; std::getline(in, line);){
+            if(line.empty() || line[0] == '#') continue;
+            size_t sp = line.find(' ');
+            if(sp == std::string::npos) return false;
+            std::string key = line.substr(0, sp), value = line.substr(sp + 1);
+            if(key == "host"){
+                if(value != detail::tune_host()) return false;
+                host = true;
+                continue;
+            }
+            char* end = nullptr;
+            u64 v = std::strtoull(value.c_str(), &end, 10);
+            if(end == value.c_str() || *end != 0) return false;
+            // keys of other versions are skipped
+            for(Entry const& e : entries){
+                if(key != e.key) continue;
+                if(v >= e.lo && v <= e.hi) *e.value = v;
+                break;
+            }
+        }
+        if(!host) return false;
+        apply_tuning(t);
+        return true;
+    }
+
+    namespace detail{
+        inline bool autotune_startup(){
+            const char* mode = std::getenv("ORION_AUTOTUNE");
+            if(mode && std::string(mode) == "0") return false;
+            std::string path = tuning_cache_path();
+            if(load_tuning(path)) return true;
+            if(!mode || std::string(mode) != "1") return false;
+            ThreadPool pool;
+            autotune(&pool);
+            return save_tuning(path);
+        }
+    } // namespace detail
+
+    /**
+     * Load the tuning cache as configured by the environment, tuning
+     * first with ORION_AUTOTUNE=1. Only the first call does anything,
+     * later ones return its result.
+     * @return whether a cached or fresh tuning is in use.
+     * */
+    inline bool init_tuning(){
+        static const bool loaded = detail::autotune_startup();
+        return loaded;
+    }
+
+} // namespace Orion
+
+#endif // AUTOTUNE_H_
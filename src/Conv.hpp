@@ -0,0 +1,680 @@
+#ifndef CONV_H_
+#define CONV_H_
+
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+#include "Tensor.hpp"
+
+namespace Orion{
+
+    /**
+     * Memory layout of image tensors.
+     * NCHW keeps every channel as a contiguous plane and uses (C_out, C_in, KH, KW) weights.
+     * NHWC keeps the channels of a pixel contiguous and uses (C_out, KH, KW, C_in) weights.
+     * Either way the weight is a C_out x (C_in*KH*KW) matrix in the order patches
+     * are unrolled, so neither forward nor backward needs to transpose any data.
+     * Rank 3 tensors of the 1D ops follow the same convention without H.
+     * */
+    enum class Layout{ NCHW, NHWC };
+
+    /**
+     * Convolution algorithm. Auto runs the direct kernel for small patches
+     * where unrolling into a column matrix costs more than it saves, and
+     * im2col + gemm otherwise.
+     * */
+    enum class ConvAlgo{ Auto, Im2col, Direct };
+
+    // patches (C_in*KH*KW) smaller than this use the direct kernel under ConvAlgo::Auto
+    constexpr u64 CONV_DIRECT_MAX_PATCH = 64;
+
+    struct Conv2dParams{
+        u64 stride_h = 1, stride_w = 1;
+        u64 pad_h = 0, pad_w = 0;
+        u64 dilation_h = 1, dilation_w = 1;
+        ConvAlgo algo = ConvAlgo::Auto;
+    };
+
+    struct Conv1dParams{
+        u64 stride = 1;
+        u64 pad = 0;
+        u64 dilation = 1;
+        ConvAlgo algo = ConvAlgo::Auto;
+    };
+
+    /**
+     * Pooling window. A stride of 0 means stride equal to the window size.
+     * */
+    struct Pool2dParams{
+        u64 kh = 2, kw = 2;
+        u64 stride_h = 0, stride_w = 0;
+        u64 pad_h = 0, pad_w = 0;
+    };
+
+    struct Pool1dParams{
+        u64 k = 2;
+        u64 stride = 0;
+        u64 pad = 0;
+    };
+
+    namespace detail{
+        /*
+         * Sizes of one convolution or pooling problem, 1D problems have h = kh = 1.
+         * For pooling co equals c and there is no weight.
+         * */
+        struct ConvGeometry{
+            u64 n, c, h, w;
+            u64 co, kh, kw;
+            u64 oh, ow;
+            u64 sh, sw, ph, pw, dh, dw;
+            Layout layout;
+            ConvAlgo algo;
+
+            u64 patch() const{ return c*kh*kw; }
+            u64 pixels() const{ return oh*ow; }
+            u64 in_size() const{ return c*h*w; }
+            u64 out_size() const{ return co*oh*ow; }
+            // 1x1 kernels without stride or padding read the input as the column matrix
+            bool pointwise() const{ return kh == 1 && kw == 1 && sh == 1 && sw == 1 && ph == 0 && pw == 0; }
+            bool direct() const{
+                if(algo == ConvAlgo::Auto) return !pointwise() && patch() < CONV_DIRECT_MAX_PATCH;
+                return algo == ConvAlgo::Direct;
+            }
+            DimVec out_dim(bool one_d) const{
+                if(one_d) return layout == Layout::NCHW ? DimVec{n, co, ow} : DimVec{n, ow, co};
+                return layout == Layout::NCHW ? DimVec{n, co, oh, ow} : DimVec{n, oh, ow, co};
+            }
+        };
+
+        inline u64 conv_out_size(u64 in, u64 k, u64 s, u64 p, u64 d){
+            u64 span = d*(k - 1) + 1;
+            assert(s > 0 && in + 2*p >= span);
+            return (in + 2*p - span)/s + 1;
+        }
+
+        inline void conv_finish(ConvGeometry& g){
+            g.oh = conv_out_size(g.h, g.kh, g.sh, g.ph, g.dh);
+            g.ow = conv_out_size(g.w, g.kw, g.sw, g.pw, g.dw);
+        }
+
+        inline ConvGeometry conv2d_geometry(DimVec const& x, DimVec const& w, Conv2dParams const& p, Layout layout){
+            assert(x.size() == 4 && w.size() == 4);
+            ConvGeometry g;
+            bool nchw = layout == Layout::NCHW;
+            g.n = x[0];
+            g.c = nchw ? x[1] : x[3];
+            g.h = nchw ? x[2] : x[1];
+            g.w = nchw ? x[3] : x[2];
+            g.co = w[0];
+            g.kh = nchw ? w[2] : w[1];
+            g.kw = nchw ? w[3] : w[2];
+            assert((nchw ? w[1] : w[3]) == g.c && "conv2d: input channels of weight and input differ");
+            g.sh = p.stride_h; g.sw = p.stride_w;
+            g.ph = p.pad_h; g.pw = p.pad_w;
+            g.dh = p.dilation_h; g.dw = p.dilation_w;
+            g.layout = layout;
+            g.algo = p.algo;
+            conv_finish(g);
+            return g;
+        }
+
+        inline ConvGeometry conv1d_geometry(DimVec const& x, DimVec const& w, Conv1dParams const& p, Layout layout){
+            assert(x.size() == 3 && w.size() == 3);
+            bool nchw = layout == Layout::NCHW;
+            Conv2dParams p2;
+            p2.stride_w = p.stride;
+            p2.pad_w = p.pad;
+            p2.dilation_w = p.dilation;
+            p2.algo = p.algo;
+            DimVec x4 = nchw ? DimVec{x[0], x[1], 1, x[2]} : DimVec{x[0], 1, x[1], x[2]};
+            DimVec w4 = nchw ? DimVec{w[0], w[1], 1, w[2]} : DimVec{w[0], 1, w[1], w[2]};
+            return conv2d_geometry(x4, w4, p2, layout);
+        }
+
+        inline ConvGeometry pool_geometry(DimVec const& x, Pool2dParams const& p, Layout layout){
+            bool nchw = layout == Layout::NCHW;
+            DimVec x4 = x;
+            if(x.size() == 3) x4 = nchw ? DimVec{x[0], x[1], 1, x[2]} : DimVec{x[0], 1, x[1], x[2]};
+            assert(x4.size() == 4);
+            ConvGeometry g;
+            g.n = x4[0];
+            g.c = nchw ? x4[1] : x4[3];
+            g.h = nchw ? x4[2] : x4[1];
+            g.w = nchw ? x4[3] : x4[2];
+            g.co = g.c;
+            g.kh = p.kh; g.kw = p.kw;
+            g.sh = p.stride_h ? p.stride_h : p.kh;
+            g.sw = p.stride_w ? p.stride_w : p.kw;
+            g.ph = p.pad_h; g.pw = p.pad_w;
+            g.dh = 1; g.dw = 1;
+            g.layout = layout;
+            g.algo = ConvAlgo::Direct;
+            conv_finish(g);
+            return g;
+        }
+
+        inline Pool2dParams pool1d_params(Pool1dParams const& p){
+            Pool2dParams p2;
+            p2.kh = 1;
+            p2.kw = p.k;
+            p2.stride_h = 1;
+            p2.stride_w = p.stride;
+            p2.pad_w = p.pad;
+            return p2;
+        }
+
+        // input coordinate of output position o and kernel tap k, negative or >= size if in padding
+        inline i64 conv_src(u64 o, u64 k, u64 s, u64 d, u64 p){
+            return static_cast<i64>(o*s + k*d) - static_cast<i64>(p);
+        }
+
+        /*
+         * Unroll the patches of one image into a column matrix.
+         * NCHW gives a patch x pixels matrix, NHWC a pixels x patch matrix.
+         * */
+        template<typename dt>
+        inline void im2col(ConvGeometry const& g, const dt* x, dt* col){
+            i64 H = static_cast<i64>(g.h), W = static_cast<i64>(g.w);
+            if(g.layout == Layout::NCHW){
+                u64 P = g.pixels();
+                for(u64 ci = 0; ci < g.c; ci++){
+                    for(u64 kh = 0; kh < g.kh; kh++){
+                        for(u64 kw = 0; kw < g.kw; kw++){
+                            dt* dst = col + ((ci*g.kh + kh)*g.kw + kw)*P;
+                            for(u64 oh = 0; oh < g.oh; oh++){
+                                i64 ih = conv_src(oh, kh, g.sh, g.dh, g.ph);
+                                dt* row = dst + oh*g.ow;
+                                if(ih < 0 || ih >= H){
+                                    std::fill(row, row + g.ow, dt(0));
+                                    continue;
+                                }
+                                const dt* src = x + (ci*g.h + static_cast<u64>(ih))*g.w;
+                                for(u64 ow = 0; ow < g.ow; ow++){
+                                    i64 iw = conv_src(ow, kw, g.sw, g.dw, g.pw);
+                                    row[ow] = (iw < 0 || iw >= W) ? dt(0) : src[iw];
+                                }
+                            }
+                        }
+                    }
+                }
+            }else{
+                u64 K = g.patch();
+                for(u64 oh = 0; oh < g.oh; oh++){
+                    for(u64 ow = 0; ow < g.ow; ow++){
+                        dt* dst = col + (oh*g.ow + ow)*K;
+                        for(u64 kh = 0; kh < g.kh; kh++){
+                            i64 ih = conv_src(oh, kh, g.sh, g.dh, g.ph);
+                            for(u64 kw = 0; kw < g.kw; kw++, dst += g.c){
+                                i64 iw = conv_src(ow, kw, g.sw, g.dw, g.pw);
+                                if(ih < 0 || ih >= H || iw < 0 || iw >= W){
+                                    std::fill(dst, dst + g.c, dt(0));
+                                    continue;
+                                }
+                                const dt* src = x + (static_cast<u64>(ih)*g.w + static_cast<u64>(iw))*g.c;
+                                std::copy(src, src + g.c, dst);
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        /*
+         * Scatter-add a column matrix back onto an image, the adjoint of im2col.
+         * */
+        template<typename dt>
+        inline void col2im(ConvGeometry const& g, const dt* col, dt* x){
+            i64 H = static_cast<i64>(g.h), W = static_cast<i64>(g.w);
+            if(g.layout == Layout::NCHW){
+                u64 P = g.pixels();
+                for(u64 ci = 0; ci < g.c; ci++){
+                    for(u64 kh = 0; kh < g.kh; kh++){
+                        for(u64 kw = 0; kw < g.kw; kw++){
+                            const dt* src = col + ((ci*g.kh + kh)*g.kw + kw)*P;
+                            for(u64 oh = 0; oh < g.oh; oh++){
+                                i64 ih = conv_src(oh, kh, g.sh, g.dh, g.ph);
+                                if(ih < 0 || ih >= H) continue;
+                                const dt* row = src + oh*g.ow;
+                                dt* dst = x + (ci*g.h + static_cast<u64>(ih))*g.w;
+                                for(u64 ow = 0; ow < g.ow; ow++){
+                                    i64 iw = conv_src(ow, kw, g.sw, g.dw, g.pw);
+                                    if(iw >= 0 && iw < W) dst[iw] += row[ow];
+                                }
+                            }
+                        }
+                    }
+                }
+            }else{
+                u64 K = g.patch();
+                for(u64 oh = 0; oh < g.oh; oh++){
+                    for(u64 ow = 0; ow < g.ow; ow++){
+                        const dt* src = col + (oh*g.ow + ow)*K;
+                        for(u64 kh = 0; kh < g.kh; kh++){
+                            i64 ih = conv_src(oh, kh, g.sh, g.dh, g.ph);
+                            for(u64 kw = 0; kw < g.kw; kw++, src += g.c){
+                                i64 iw = conv_src(ow, kw, g.sw, g.dw, g.pw);
+                                if(ih < 0 || ih >= H || iw < 0 || iw >= W) continue;
+                                dt* dst = x + (static_cast<u64>(ih)*g.w + static_cast<u64>(iw))*g.c;
+                                for(u64 ci = 0; ci < g.c; ci++) dst[ci] += src[ci];
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        // output rows processed together by the direct NCHW kernel, sized to stay in L1
+        constexpr u64 CONV_ROW_BLOCK = 8;
+
+        /*
+         * Direct convolution of one image without unrolling.
+         * NCHW accumulates whole output rows per weight tap, the inner loop is a
+         * unit stride axpy for stride 1. NHWC computes per pixel dot products
+         * over contiguous input channels. y must be zero or hold the bias.
+         * */
+        template<typename dt>
+        inline void conv_direct(ConvGeometry const& g, const dt* x, const dt* w, dt* y){
+            i64 H = static_cast<i64>(g.h), W = static_cast<i64>(g.w);
+            if(g.layout == Layout::NCHW){
+                for(u64 oh0 = 0; oh0 < g.oh; oh0 += CONV_ROW_BLOCK){
+                    u64 oh1 = std::min(g.oh, oh0 + CONV_ROW_BLOCK);
+                    for(u64 co = 0; co < g.co; co++){
+                        dt* yp = y + co*g.pixels();
+                        for(u64 ci = 0; ci < g.c; ci++){
+                            for(u64 kh = 0; kh < g.kh; kh++){
+                                for(u64 kw = 0; kw < g.kw; kw++){
+                                    dt wv = w[((co*g.c + ci)*g.kh + kh)*g.kw + kw];
+                                    // valid output columns for this tap
+                                    i64 off = static_cast<i64>(kw*g.dw) - static_cast<i64>(g.pw);
+                                    i64 s = static_cast<i64>(g.sw);
+                                    i64 lo = off >= 0 ? 0 : (-off + s - 1)/s;
+                                    i64 hi = W - off <= 0 ? 0 : (W - off - 1)/s + 1;
+                                    u64 ow0 = static_cast<u64>(lo);
+                                    u64 ow1 = std::min(g.ow, static_cast<u64>(std::max(hi, lo)));
+                                    for(u64 oh = oh0; oh < oh1; oh++){
+                                        i64 ih = conv_src(oh, kh, g.sh, g.dh, g.ph);
+                                        if(ih < 0 || ih >= H) continue;
+                                        const dt* src = x + (ci*g.h + static_cast<u64>(ih))*g.w;
+                                        dt* dst = yp + oh*g.ow;
+                                        if(g.sw == 1){
+                                            for(u64 ow = ow0; ow < ow1; ow++) dst[ow] += wv*src[static_cast<i64>(ow) + off];
+                                        }else{
+                                            for(u64 ow = ow0; ow < ow1; ow++)
+                                                dst[ow] += wv*src[static_cast<i64>(ow*g.sw) + off];
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                }
+            }else{
+                u64 K = g.patch();
+                for(u64 oh = 0; oh < g.oh; oh++){
+                    for(u64 ow = 0; ow < g.ow; ow++){
+                        dt* dst = y + (oh*g.ow + ow)*g.co;
+                        for(u64 kh = 0; kh < g.kh; kh++){
+                            i64 ih = conv_src(oh, kh, g.sh, g.dh, g.ph);
+                            if(ih < 0 || ih >= H) continue;
+                            for(u64 kw = 0; kw < g.kw; kw++){
+                                i64 iw = conv_src(ow, kw, g.sw, g.dw, g.pw);
+                                if(iw < 0 || iw >= W) continue;
+                                const dt* src = x + (static_cast<u64>(ih)*g.w + static_cast<u64>(iw))*g.c;
+                                const dt* wp = w + (kh*g.kw + kw)*g.c;
+                                for(u64 co = 0; co < g.co; co++){
+                                    const dt* wc = wp + co*K;
+                                    dt s = 0;
+                                    for(u64 ci = 0; ci < g.c; ci++) s += wc[ci]*src[ci];
+                                    dst[co] += s;
+                                }
+                            }
+                        }
+                    }
+                }
+            }
+        }
+
+        template<typename dt>
+        inline void conv_forward(ConvGeometry const& g, const dt* x, const dt* w, const dt* b, dt* y){
+            u64 P = g.pixels(), K = g.patch();
+            thread_local std::vector<dt> col;
+            bool unroll = !g.direct() && !g.pointwise();
+            if(unroll && col.size() < K*P) col.resize(K*P);
+
+            for(u64 n = 0; n < g.n; n++){
+                const dt* xn = x + n*g.in_size();
+                dt* yn = y + n*g.out_size();
+                // start from the bias so that both paths simply accumulate
+                for(u64 co = 0; co < g.co; co++){
+                    dt bv = b ? b[co] : dt(0);
+                    if(g.layout == Layout::NCHW) std::fill(yn + co*P, yn + (co + 1)*P, bv);
+                    else for(u64 p = 0; p < P; p++) yn[p*g.co + co] = bv;
+                }
+                if(g.direct()){
+                    conv_direct(g, xn, w, yn);
+                    continue;
+                }
+                const dt* cm = xn;
+                if(unroll){
+                    im2col(g, xn, col.data());
+                    cm = col.data();
+                }
+                if(g.layout == Layout::NCHW) gemm(false, false, g.co, P, K, dt(1), w, K, cm, P, dt(1), yn, P);
+                else gemm(false, true, P, g.co, K, dt(1), cm, K, w, K, dt(1), yn, g.co);
+            }
+        }
+
+        // dx += dconv/dx^T dy
+        template<typename dt>
+        inline void conv_backward_input(ConvGeometry const& g, const dt* dy, const dt* w, dt* dx){
+            u64 P = g.pixels(), K = g.patch();
+            thread_local std::vector<dt> col;
+            if(!g.pointwise() && col.size() < K*P) col.resize(K*P);
+
+            for(u64 n = 0; n < g.n; n++){
+                const dt* dyn = dy + n*g.out_size();
+                dt* dxn = dx + n*g.in_size();
+                // 1x1 kernels accumulate straight into dx
+                dt* dcol = g.pointwise() ? dxn : col.data();
+                dt beta = g.pointwise() ? dt(1) : dt(0);
+                if(g.layout == Layout::NCHW) gemm(true, false, K, P, g.co, dt(1), w, K, dyn, P, beta, dcol, P);
+                else gemm(false, false, P, K, g.co, dt(1), dyn, g.co, w, K, beta, dcol, K);
+                if(!g.pointwise()) col2im(g, dcol, dxn);
+            }
+        }
+
+        // dw += dconv/dw^T dy
+        template<typename dt>
+        inline void conv_backward_weight(ConvGeometry const& g, const dt* dy, const dt* x, dt* dw){
+            u64 P = g.pixels(), K = g.patch();
+            thread_local std::vector<dt> col;
+            if(!g.pointwise() && col.size() < K*P) col.resize(K*P);
+
+            for(u64 n = 0; n < g.n; n++){
+                const dt* dyn = dy + n*g.out_size();
+                const dt* cm = x + n*g.in_size();
+                if(!g.pointwise()){
+                    im2col(g, cm, col.data());
+                    cm = col.data();
+                }
+                if(g.layout == Layout::NCHW) gemm(false, true, g.co, K, P, dt(1), dyn, P, cm, P, dt(1), dw, K);
+                else gemm(true, false, g.co, K, P, dt(1), dyn, g.co, cm, K, dt(1), dw, K);
+            }
+        }
+
+        template<typename dt>
+        inline void conv_backward_bias(ConvGeometry const& g, const dt* dy, dt* db){
+            u64 P = g.pixels();
+            for(u64 n = 0; n < g.n; n++){
+                const dt* dyn = dy + n*g.out_size();
+                if(g.layout == Layout::NCHW){
+                    for(u64 co = 0; co < g.co; co++){
+                        dt s = 0;
+                        for(u64 p = 0; p < P; p++) s += dyn[co*P + p];
+                        db[co] += s;
+                    }
+                }else{
+                    for(u64 p = 0; p < P; p++)
+                        for(u64 co = 0; co < g.co; co++) db[co] += dyn[p*g.co + co];
+                }
+            }
+        }
+
+        // offset of element (c, h, w) of image n
+        inline u64 conv_index(ConvGeometry const& g, u64 n, u64 c, u64 h, u64 w){
+            if(g.layout == Layout::NCHW) return ((n*g.c + c)*g.h + h)*g.w + w;
+            return ((n*g.h + h)*g.w + w)*g.c + c;
+        }
+        inline u64 pool_out_index(ConvGeometry const& g, u64 n, u64 c, u64 oh, u64 ow){
+            if(g.layout == Layout::NCHW) return ((n*g.c + c)*g.oh + oh)*g.ow + ow;
+            return ((n*g.oh + oh)*g.ow + ow)*g.c + c;
+        }
+
+        /*
+         * Visit every pooling window, calling f(out_index, in_index) for each
+         * element of the window that lies inside the image.
+         * */
+        template<typename Begin, typename Visit, typename End>
+        inline void pool_windows(ConvGeometry const& g, Begin begin, Visit visit, End end){
+            i64 H = static_cast<i64>(g.h), W = static_cast<i64>(g.w);
+            for(u64 n = 0; n < g.n; n++){
+                for(u64 oh = 0; oh < g.oh; oh++){
+                    for(u64 ow = 0; ow < g.ow; ow++){
+                        for(u64 c = 0; c < g.c; c++){
+                            u64 o = pool_out_index(g, n, c, oh, ow);
+                            begin(o);
+                            for(u64 kh = 0; kh < g.kh; kh++){
+                                i64 ih = conv_src(oh, kh, g.sh, 1, g.ph);
+                                if(ih < 0 || ih >= H) continue;
+                                for(u64 kw = 0; kw < g.kw; kw++){
+                                    i64 iw = conv_src(ow, kw, g.sw, 1, g.pw);
+                                    if(iw < 0 || iw >= W) continue;
+                                    visit(o, conv_index(g, n, c, static_cast<u64>(ih), static_cast<u64>(iw)));
+                                }
+                            }
+                            end(o);
+                        }
+                    }
+                }
+            }
+        }
+
+        // argmax of a window lying entirely in the padding
+        constexpr u64 POOL_NO_ARGMAX = ~u64(0);
+
+        /*
+         * Writes every output, argmax if not null receives the selected input
+         * offsets. A window entirely in the padding gives -inf and
+         * POOL_NO_ARGMAX.
+         * */
+        template<typename dt>
+        inline void max_pool_forward(ConvGeometry const& g, const dt* xd, dt* yd, u64* argmax){
+            u64 best = POOL_NO_ARGMAX;
+            pool_windows(g,
+                [&](u64 o){ yd[o] = -std::numeric_limits<dt>::infinity(); best = POOL_NO_ARGMAX; },
+                [&](u64 o, u64 i){ if(best == POOL_NO_ARGMAX || xd[i] > yd[o]){ yd[o] = xd[i]; best = i; } },
+                [&](u64 o){ if(argmax) argmax[o] = best; });
+        }
+
+        template<typename dt>
+        inline void avg_pool_forward(ConvGeometry const& g, const dt* xd, dt* yd){
+            u64 count = 0;
+            pool_windows(g,
+                [&](u64 o){ yd[o] = 0; count = 0; },
+                [&](u64 o, u64 i){ yd[o] += xd[i]; count++; },
+                [&](u64 o){ if(count) yd[o] /= static_cast<dt>(count); });
+        }
+
+        template<typename dt>
+        inline Tensor<dt> max_pool(ConvGeometry const& g, Tensor<dt> const& x, std::vector<u64>* argmax, bool one_d){
+            Tensor<dt> y(g.out_dim(one_d));
+            if(argmax) argmax->assign(y.nelem(), POOL_NO_ARGMAX);
+            max_pool_forward(g, x.data(), y.data(), argmax ? argmax->data() : nullptr);
+            return y;
+        }
+
+        template<typename dt>
+        inline Tensor<dt> avg_pool(ConvGeometry const& g, Tensor<dt> const& x, bool one_d){
+            Tensor<dt> y(g.out_dim(one_d));
+            avg_pool_forward(g, x.data(), y.data());
+            return y;
+        }
+
+        template<typename dt>
+        inline void avg_pool_backward(ConvGeometry const& g, Tensor<dt> const& dy, Tensor<dt>& dx){
+            const dt* dyd = dy.data();
+            dt* dxd = dx.data();
+            // windows are walked twice, once to count the valid elements and once to scatter
+            u64 count = 0;
+            std::vector<u64> idx;
+            pool_windows(g,
+                [&](u64){ count = 0; idx.clear(); },
+                [&](u64, u64 i){ idx.push_back(i); count++; },
+                [&](u64 o){
+                    if(!count) return;
+                    dt v = dyd[o]/static_cast<dt>(count);
+                    for(u64 i : idx) dxd[i] += v;
+                });
+        }
+    } // namespace detail
+
+    /**
+     * 2D convolution (cross correlation) of a batch of images.
+     *
+     * @param x input of shape (N, C, H, W) or (N, H, W, C) depending on layout.
+     * @param w weights of shape (C_out, C, KH, KW) or (C_out, KH, KW, C).
+     * @return output of shape (N, C_out, OH, OW) or (N, OH, OW, C_out).
+     * */
+    template<typename dt>
+    inline Tensor<dt> conv2d(Tensor<dt> const& x, Tensor<dt> const& w, Conv2dParams const& p = {}, Layout layout = Layout::NCHW){
+        auto g = detail::conv2d_geometry(x.dim(), w.dim(), p, layout);
+        Tensor<dt> y(g.out_dim(false));
+        detail::conv_forward(g, x.data(), w.data(), static_cast<const dt*>(nullptr), y.data());
+        return y;
+    }
+
+    /**
+     * 2D convolution with a per output channel bias of shape (C_out).
+     * */
+    template<typename dt>
+    inline Tensor<dt> conv2d(Tensor<dt> const& x, Tensor<dt> const& w, Tensor<dt> const& b, Conv2dParams const& p = {}, Layout layout = Layout::NCHW){
+        auto g = detail::conv2d_geometry(x.dim(), w.dim(), p, layout);
+        assert(b.nelem() == g.co);
+        Tensor<dt> y(g.out_dim(false));
+        detail::conv_forward(g, x.data(), w.data(), b.data(), y.data());
+        return y;
+    }
+
+    /**
+     * Accumulate the gradient of conv2d with respect to its input, dx += dL/dx.
+     * */
+    template<typename dt>
+    inline void conv2d_backward_input(Tensor<dt> const& dy, Tensor<dt> const& w, Tensor<dt>& dx, Conv2dParams const& p = {}, Layout layout = Layout::NCHW){
+        auto g = detail::conv2d_geometry(dx.dim(), w.dim(), p, layout);
+        detail::conv_backward_input(g, dy.data(), w.data(), dx.data());
+    }
+
+    /**
+     * Accumulate the gradient of conv2d with respect to its weights, dw += dL/dw.
+     * */
+    template<typename dt>
+    inline void conv2d_backward_weight(Tensor<dt> const& dy, Tensor<dt> const& x, Tensor<dt>& dw, Conv2dParams const& p = {}, Layout layout = Layout::NCHW){
+        auto g = detail::conv2d_geometry(x.dim(), dw.dim(), p, layout);
+        detail::conv_backward_weight(g, dy.data(), x.data(), dw.data());
+    }
+
+    /**
+     * Accumulate the gradient of a convolution with respect to its bias, db += dL/db.
+     * Works for the output of both conv1d and conv2d.
+     * */
+    template<typename dt>
+    inline void conv_backward_bias(Tensor<dt> const& dy, Tensor<dt>& db, Layout layout = Layout::NCHW){
+        auto const& d = dy.dim();
+        assert(d.size() == 3 || d.size() == 4);
+        detail::ConvGeometry g;
+        bool nchw = layout == Layout::NCHW;
+        g.n = d[0];
+        g.co = nchw ? d[1] : d.back();
+        g.oh = d.size() == 4 ? d[nchw ? 2 : 1] : 1;
+        g.ow = nchw ? d.back() : d[d.size() - 2];
+        g.layout = layout;
+        detail::conv_backward_bias(g, dy.data(), db.data());
+    }
+
+    /**
+     * 1D convolution of a batch of sequences.
+     *
+     * @param x input of shape (N, C, L) or (N, L, C) depending on layout.
+     * @param w weights of shape (C_out, C, K) or (C_out, K, C).
+     * */
+    template<typename dt>
+    inline Tensor<dt> conv1d(Tensor<dt> const& x, Tensor<dt> const& w, Conv1dParams const& p = {}, Layout layout = Layout::NCHW){
+        auto g = detail::conv1d_geometry(x.dim(), w.dim(), p, layout);
+        Tensor<dt> y(g.out_dim(true));
+        detail::conv_forward(g, x.data(), w.data(), static_cast<const dt*>(nullptr), y.data());
+        return y;
+    }
+
+    template<typename dt>
+    inline Tensor<dt> conv1d(Tensor<dt> const& x, Tensor<dt> const& w, Tensor<dt> const& b, Conv1dParams const& p = {}, Layout layout = Layout::NCHW){
+        auto g = detail::conv1d_geometry(x.dim(), w.dim(), p, layout);
+        assert(b.nelem() == g.co);
+        Tensor<dt> y(g.out_dim(true));
+        detail::conv_forward(g, x.data(), w.data(), b.data(), y.data());
+        return y;
+    }
+
+    template<typename dt>
+    inline void conv1d_backward_input(Tensor<dt> const& dy, Tensor<dt> const& w, Tensor<dt>& dx, Conv1dParams const& p = {}, Layout layout = Layout::NCHW){
+        auto g = detail::conv1d_geometry(dx.dim(), w.dim(), p, layout);
+        detail::conv_backward_input(g, dy.data(), w.data(), dx.data());
+    }
+
+    template<typename dt>
+    inline void conv1d_backward_weight(Tensor<dt> const& dy, Tensor<dt> const& x, Tensor<dt>& dw, Conv1dParams const& p = {}, Layout layout = Layout::NCHW){
+        auto g = detail::conv1d_geometry(x.dim(), dw.dim(), p, layout);
+        detail::conv_backward_weight(g, dy.data(), x.data(), dw.data());
+    }
+
+    /**
+     * 2D max pooling. Padding never wins the max, a window entirely in the
+     * padding gives -inf.
+     *
+     * @param argmax if not null receives, for every output element, the
+     * offset of the selected input element for use by pool_backward_max,
+     * detail::POOL_NO_ARGMAX for windows entirely in the padding.
+     * */
+    template<typename dt>
+    inline Tensor<dt> max_pool2d(Tensor<dt> const& x, Pool2dParams const& p = {}, Layout layout = Layout::NCHW, std::vector<u64>* argmax = nullptr){
+        assert(x.rank() == 4);
+        return detail::max_pool(detail::pool_geometry(x.dim(), p, layout), x, argmax, false);
+    }
+
+    template<typename dt>
+    inline Tensor<dt> max_pool1d(Tensor<dt> const& x, Pool1dParams const& p = {}, Layout layout = Layout::NCHW, std::vector<u64>* argmax = nullptr){
+        assert(x.rank() == 3);
+        return detail::max_pool(detail::pool_geometry(x.dim(), detail::pool1d_params(p), layout), x, argmax, true);
+    }
+
+    /**
+     * Accumulate the gradient of max pooling, dx[argmax[i]] += dy[i].
+     * Windows entirely in the padding pass no gradient.
+     * */
+    template<typename dt>
+    inline void pool_backward_max(Tensor<dt> const& dy, std::vector<u64> const& argmax, Tensor<dt>& dx){
+        assert(argmax.size() == dy.nelem());
+        const dt* dyd = dy.data();
+        dt* dxd = dx.data();
+        for(u64 i = 0; i < argmax.size(); i++)
+            if(argmax[i] != detail::POOL_NO_ARGMAX) dxd[argmax[i]] += dyd[i];
+    }
+
+    /**
+     * 2D average pooling, padded elements are excluded from the average.
+     * */
+    template<typename dt>
+    inline Tensor<dt> avg_pool2d(Tensor<dt> const& x, Pool2dParams const& p = {}, Layout layout = Layout::NCHW){
+        assert(x.rank() == 4);
+        return detail::avg_pool(detail::pool_geometry(x.dim(), p, layout), x, false);
+    }
+
+    template<typename dt>
+    inline Tensor<dt> avg_pool1d(Tensor<dt> const& x, Pool1dParams const& p = {}, Layout layout = Layout::NCHW){
+        assert(x.rank() == 3);
+        return detail::avg_pool(detail::pool_geometry(x.dim(), detail::pool1d_params(p), layout), x, true);
+    }
+
+    template<typename dt>
+    inline void avg_pool2d_backward(Tensor<dt> const& dy, Tensor<dt>& dx, Pool2dParams const& p = {}, Layout layout = Layout::NCHW){
+        detail::avg_pool_backward(detail::pool_geometry(dx.dim(), p, layout), dy, dx);
+    }
+
+    template<typename dt>
+    inline void avg_pool1d_backward(Tensor<dt> const& dy, Tensor<dt>& dx, Pool1dParams const& p = {}, Layout layout = Layout::NCHW){
+        detail::avg_pool_backward(detail::pool_geometry(dx.dim(), detail::pool1d_params(p), layout), dy, dx);
+    }
+
+} // namespace Orion
+
+#endif // CONV_H_
@@ -0,0 +1,134 @@
+#ifndef DISPATCH_H_
+#define DISPATCH_H_
+
+#include <cstdlib>
+#include <cstring>
+
+#include "Typedefs.hpp"
+
+/*
+ * Runtime selection of the instruction set used by the hot kernels.
+ *
+ * The build targets baseline x86-64. Kernels that vectorize well are
+ * instead run through isa_dispatch, which compiles its callable once per
+ * instruction set level and calls the best version the CPU supports, so a
+ * single binary uses SSE4.2, AVX2 + FMA or AVX-512 where available:
+ *
+ *     isa_dispatch([&]{ for(u64 i = 0; i < n; i++) y[i] = vexp(x[i]); });
+ *
+ * Each version is flattened, so everything the callable calls must be
+ * visible and inlinable for its loops to use the wider instructions.
+ *
+ * The level is detected once at startup. ORION_ISA=generic, sse4.2, avx2
+ * or avx512 in the environment lowers it, for testing or comparing
+ * versions, and active_isa() can be lowered at runtime the same way.
+ * Defining ORION_NO_MULTIVERSION compiles the baseline version only.
+ * */
+
+#if !defined(ORION_NO_MULTIVERSION) && defined(__GNUC__) && !defined(__clang__) && (defined(__x86_64__) || defined(__i386__))
+#define ORION_MULTIVERSION 1
+#define ORION_TARGET_SSE42 __attribute__((target("sse4.2,popcnt")))
+#define ORION_TARGET_AVX2 __attribute__((target("avx2,fma,bmi,bmi2,popcnt")))
+#define ORION_TARGET_AVX512 __attribute__((target("avx512f,avx512vl,avx512bw,avx512dq,avx2,fma,bmi,bmi2,popcnt,prefer-vector-width=512")))
+#else
+#define ORION_MULTIVERSION 0
+#define ORION_TARGET_SSE42
+#define ORION_TARGET_AVX2
+#define ORION_TARGET_AVX512
+#endif
+
+namespace Orion{
+
+    /**
+     * Instruction set levels kernels are compiled for, in increasing order.
+     * */
+    enum class Isa{ generic, sse42, avx2, avx512 };
+
+    inline const char* isa_name(Isa isa){
+        switch(isa){
+            case Isa::sse42: return "sse4.2";
+            case Isa::avx2: return "avx2";
+            case Isa::avx512: return "avx512";
+            default: return "generic";
+        }
+    }
+
+    /**
+     * Level named s as printed by isa_name, fallback if s is not one.
+     * */
+    inline Isa isa_from_name(const char* s, Isa fallback){
+        for(Isa isa : {Isa::generic, Isa::sse42, Isa::avx2, Isa::avx512})
+            if(std::strcmp(s, isa_name(isa)) == 0) return isa;
+        return fallback;
+    }
+
+    /**
+     * Highest level this CPU and operating system support.
+     * */
+    inline Isa detected_isa(){
+#if ORION_MULTIVERSION
+        static const Isa isa = []{
+            __builtin_cpu_init();
+            if(__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512vl") &&
+               __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq") &&
+               __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("bmi2"))
+                return Isa::avx512;
+            if(__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("bmi2"))
+                return Isa::avx2;
+            if(__builtin_cpu_supports("sse4.2") && __builtin_cpu_supports("popcnt"))
+                return Isa::sse42;
+            return Isa::generic;
+        }();
+        return isa;
+#else
+        return Isa::generic;
+#endif
+    }
+
+    /**
+     * Process wide level used by isa_dispatch, detected_isa() lowered to
+     * ORION_ISA if set. Must never be raised above detected_isa().
+     * */
+    inline Isa& active_isa(){
+        static Isa isa = []{
+            Isa best = detected_isa();
+            const char* env = std::getenv("ORION_ISA");
+            if(!env) return best;
+            Isa wanted = isa_from_name(env, best);
+            return wanted < best ? wanted : best;
+        }();
+        return isa;
+    }
+
+    namespace detail{
+        template<typename F>
+        ORION_VEC_FLATTEN void isa_run_generic(F& f){ f(); }
+#if ORION_MULTIVERSION
+        template<typename F>
+        ORION_TARGET_SSE42 ORION_VEC_FLATTEN void isa_run_sse42(F& f){ f(); }
+        template<typename F>
+        ORION_TARGET_AVX2 ORION_VEC_FLATTEN void isa_run_avx2(F& f){ f(); }
+        template<typename F>
+        ORION_TARGET_AVX512 ORION_VEC_FLATTEN void isa_run_avx512(F& f){ f(); }
+#endif
+    } // namespace detail
+
+    /**
+     * Call f compiled for active_isa().
+     * */
+    template<typename F>
+    inline void isa_dispatch(F&& f){
+#if ORION_MULTIVERSION
+        switch(active_isa()){
+            case Isa::avx512: detail::isa_run_avx512(f); return;
+            case Isa::avx2: detail::isa_run_avx2(f); return;
+            case Isa::sse42: detail::isa_run_sse42(f); return;
+            default: break;
+        }
+#endif
+        detail::isa_run_generic(f);
+    }
+
+} // namespace Orion
+
+#endif // DISPATCH_H_
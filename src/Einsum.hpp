@@ -0,0 +1,323 @@
+#ifndef EINSUM_H_
+#define EINSUM_H_
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Tensor.hpp"
+
+namespace Orion{
+
+    namespace detail{
+        /*
+         * Parsed einsum specification, one label string per operand
+         * and the label string of the result.
+         * */
+        struct EinsumSpec{
+            std::vector<std::string> inputs;
+            std::string output;
+        };
+
+        /*
+         * Parse "ij,jk->ik". Without "->" the output is every label that
+         * appears exactly once across the inputs, in alphabetical order.
+         * */
+        inline EinsumSpec parse_einsum(std::string const& spec){
+            EinsumSpec res;
+            std::string lhs = spec, rhs;
+            bool explicit_output = false;
+            size_t arrow = spec.find("->");
+            if(arrow != std::string::npos){
+                lhs = spec.substr(0, arrow);
+                rhs = spec.substr(arrow + 2);
+                explicit_output = true;
+            }
+
+            std::string cur;
+            for(char c : lhs){
+                if(c == ' ') continue;
+                if(c == ','){
+                    res.inputs.push_back(cur);
+                    cur.clear();
+                    continue;
+                }
+                assert(((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) && "einsum: labels must be letters");
+                cur.push_back(c);
+            }
+            res.inputs.push_back(cur);
+
+            if(explicit_output){
+                for(char c : rhs)
+                    if(c != ' ') res.output.push_back(c);
+            }else{
+                std::map<char, u64> count;
+                for(auto const& in : res.inputs)
+                    for(char c : in) count[c]++;
+                for(auto const& kv : count)
+                    if(kv.second == 1) res.output.push_back(kv.first);
+            }
+            return res;
+        }
+
+        /*
+         * Strided view of an einsum operand. Every label appears once,
+         * repeated labels of the spec (diagonals) have their strides summed.
+         * */
+        template<typename dt>
+        struct EinsumOperand{
+            std::string labels;
+            std::vector<u64> strides;
+            const dt* data = nullptr;
+            Tensor<dt> owner;
+
+            u64 stride(char l) const{
+                size_t pos = labels.find(l);
+                return pos == std::string::npos ? 0 : strides[pos];
+            }
+        };
+
+        // one merged loop of a pairwise contraction with its stride in A, B and C
+        struct EinsumDim{
+            u64 size;
+            u64 sa, sb, sc;
+        };
+
+        /*
+         * Merge dimensions that are contiguous with respect to each other in
+         * every operand, then split off the largest one as the gemm dimension.
+         * Remaining dimensions are appended to loops.
+         * */
+        inline EinsumDim einsum_fuse(std::vector<EinsumDim> dims, std::vector<EinsumDim>& loops){
+            bool merged = true;
+            while(merged){
+                merged = false;
+                for(size_t x = 0; x < dims.size() && !merged; x++){
+                    for(size_t y = 0; y < dims.size() && !merged; y++){
+                        if(x == y) continue;
+                        EinsumDim const& dx = dims[x];
+                        EinsumDim const& dy = dims[y];
+                        if(dx.sa == dy.sa*dy.size && dx.sb == dy.sb*dy.size && dx.sc == dy.sc*dy.size){
+                            EinsumDim f{dx.size*dy.size, dy.sa, dy.sb, dy.sc};
+                            dims.erase(dims.begin() + static_cast<i64>(std::max(x, y)));
+                            dims.erase(dims.begin() + static_cast<i64>(std::min(x, y)));
+                            dims.push_back(f);
+                            merged = true;
+                        }
+                    }
+                }
+            }
+            if(dims.empty()) return {1, 0, 0, 0};
+            auto big = std::max_element(dims.begin(), dims.end(), [](EinsumDim const& p, EinsumDim const& q){ return p.size < q.size; });
+            EinsumDim res = *big;
+            dims.erase(big);
+            loops.insert(loops.end(), dims.begin(), dims.end());
+            return res;
+        }
+
+        /*
+         * Contract two operands into a new contiguous operand laid out in
+         * the order of out. Labels are classified as batch (in a, b and out),
+         * free (in one input and out) or summed (not in out). Free labels of
+         * a become M, free labels of b become N, summed labels become K and
+         * every batch index runs one strided gemm directly on the input
+         * layouts, so no operand is ever permuted or copied.
+         * */
+        template<typename dt>
+        inline EinsumOperand<dt> einsum_contract(EinsumOperand<dt> const& a, EinsumOperand<dt> const& b,
+                                                 std::string const& out, std::map<char, u64> const& extent){
+            EinsumOperand<dt> c;
+            c.labels = out;
+            DimVec cdim;
+            for(char l : out) cdim.push_back(extent.at(l));
+            c.strides.assign(out.size(), 1);
+            for(size_t i = out.size(); i-- > 1;) c.strides[i - 1] = c.strides[i]*cdim[i];
+            if(cdim.empty()) cdim.push_back(1);
+            c.owner = Tensor<dt>(cdim);
+            c.owner.fill(dt(0));
+            c.data = c.owner.data();
+
+            std::vector<EinsumDim> loops, mdims, ndims, kdims;
+            std::string all = a.labels + b.labels + out;
+            std::string seen;
+            for(char l : all){
+                if(seen.find(l) != std::string::npos) continue;
+                seen.push_back(l);
+                u64 size = extent.at(l);
+                if(size == 1) continue;
+                bool ina = a.labels.find(l) != std::string::npos;
+                bool inb = b.labels.find(l) != std::string::npos;
+                bool inc = out.find(l) != std::string::npos;
+                EinsumDim d{size, a.stride(l), b.stride(l), c.stride(l)};
+                if(inc && ina && inb) loops.push_back(d);
+                else if(inc && ina) mdims.push_back(d);
+                else if(inc) ndims.push_back(d);
+                else kdims.push_back(d);
+            }
+            EinsumDim m = einsum_fuse(mdims, loops);
+            EinsumDim n = einsum_fuse(ndims, loops);
+            EinsumDim k = einsum_fuse(kdims, loops);
+
+            // odometer over the batch and non fusable loops
+            std::vector<u64> idx(loops.size(), 0);
+            u64 oa = 0, ob = 0, oc = 0;
+            dt* cdata = c.owner.data();
+            while(true){
+                gemm_strided(m.size, n.size, k.size, dt(1),
+                             a.data + oa, m.sa, k.sa,
+                             b.data + ob, k.sb, n.sb,
+                             dt(1), cdata + oc, m.sc, n.sc);
+                size_t d = 0;
+                for(; d < loops.size(); d++){
+                    oa += loops[d].sa;
+                    ob += loops[d].sb;
+                    oc += loops[d].sc;
+                    if(++idx[d] < loops[d].size) break;
+                    oa -= loops[d].sa*loops[d].size;
+                    ob -= loops[d].sb*loops[d].size;
+                    oc -= loops[d].sc*loops[d].size;
+                    idx[d] = 0;
+                }
+                if(d == loops.size()) break;
+            }
+            return c;
+        }
+
+        inline u64 einsum_cost(std::string const& labels, std::map<char, u64> const& extent){
+            u64 cost = 1;
+            for(char l : labels) cost *= extent.at(l);
+            return cost;
+        }
+
+        /*
+         * Labels of the contraction of a and b that are still needed, either by
+         * the final result or by one of the other operands. Ordered as
+         * batch labels, then free labels of a, then free labels of b.
+         * */
+        template<typename dt>
+        inline std::string einsum_keep(std::vector<EinsumOperand<dt>> const& ops, size_t i, size_t j, std::string const& output){
+            auto needed = [&](char l){
+                if(output.find(l) != std::string::npos) return true;
+                for(size_t o = 0; o < ops.size(); o++)
+                    if(o != i && o != j && ops[o].labels.find(l) != std::string::npos) return true;
+                return false;
+            };
+            std::string const& la = ops[i].labels;
+            std::string const& lb = ops[j].labels;
+            std::string batch, fa, fb;
+            for(char l : la){
+                if(!needed(l)) continue;
+                if(lb.find(l) != std::string::npos) batch.push_back(l);
+                else fa.push_back(l);
+            }
+            for(char l : lb)
+                if(needed(l) && la.find(l) == std::string::npos) fb.push_back(l);
+            return batch + fa + fb;
+        }
+    } // namespace detail
+
+    /**
+     * Einstein summation over any number of tensors.
+     * eg : einsum("bij,bjk->bik", a, b) is a batched matmul,
+     * einsum("ii->", a) is the trace and einsum("ij->ji", a) a transpose.
+     *
+     * Multi operand expressions are contracted pairwise, greedily picking
+     * the pair with the cheapest contraction first. Each pairwise contraction
+     * runs as strided gemm calls on the original layouts.
+     *
+     * @param spec comma separated operand labels, optionally followed by "->" and output labels.
+     * @param ops operands, one per label group of spec.
+     * */
+    template<typename dt>
+    inline Tensor<dt> einsum(std::string const& spec, std::vector<Tensor<dt>> const& ops){
+        using namespace detail;
+        EinsumSpec s = parse_einsum(spec);
+        assert(s.inputs.size() == ops.size() && "einsum: operand count does not match spec");
+
+        std::map<char, u64> extent;
+        std::vector<EinsumOperand<dt>> cur;
+        for(size_t o = 0; o < ops.size(); o++){
+            std::string const& labels = s.inputs[o];
+            Tensor<dt> t = ops[o];
+            assert(labels.size() == t.rank() && "einsum: label count does not match tensor rank");
+
+            EinsumOperand<dt> op;
+            op.owner = t;
+            if(t.rank() == 0){
+                op.owner = Tensor<dt>(DimVec{1});
+                op.owner.data()[0] = t.value();
+            }
+            op.data = op.owner.data();
+            u64 stride = 1;
+            for(size_t i = labels.size(); i-- > 0;){
+                char l = labels[i];
+                u64 size = t.dim()[i];
+                auto it = extent.find(l);
+                if(it == extent.end()) extent[l] = size;
+                else assert(it->second == size && "einsum: inconsistent label extent");
+
+                size_t pos = op.labels.find(l);
+                if(pos == std::string::npos){
+                    op.labels.insert(op.labels.begin(), l);
+                    op.strides.insert(op.strides.begin(), stride);
+                }else{
+                    op.strides[pos] += stride;
+                }
+                stride *= size;
+            }
+            cur.push_back(op);
+        }
+        for(char l : s.output)
+            assert(extent.count(l) && "einsum: output label not present in inputs");
+
+        // a single operand is contracted against a scalar one
+        if(cur.size() == 1){
+            EinsumOperand<dt> one;
+            one.owner = Tensor<dt>(DimVec{1});
+            one.owner.data()[0] = dt(1);
+            one.data = one.owner.data();
+            cur.push_back(one);
+        }
+
+        while(cur.size() > 1){
+            size_t bi = 0, bj = 1;
+            u64 best_cost = 0, best_size = 0;
+            for(size_t i = 0; i < cur.size(); i++){
+                for(size_t j = i + 1; j < cur.size(); j++){
+                    std::string all = cur[i].labels;
+                    for(char l : cur[j].labels)
+                        if(all.find(l) == std::string::npos) all.push_back(l);
+                    u64 cost = einsum_cost(all, extent);
+                    u64 size = einsum_cost(einsum_keep(cur, i, j, s.output), extent);
+                    if((i == 0 && j == 1) || cost < best_cost || (cost == best_cost && size < best_size)){
+                        bi = i;
+                        bj = j;
+                        best_cost = cost;
+                        best_size = size;
+                    }
+                }
+            }
+            std::string out = cur.size() == 2 ? s.output : einsum_keep(cur, bi, bj, s.output);
+            EinsumOperand<dt> c = einsum_contract(cur[bi], cur[bj], out, extent);
+            cur.erase(cur.begin() + static_cast<i64>(bj));
+            cur.erase(cur.begin() + static_cast<i64>(bi));
+            cur.push_back(c);
+        }
+
+        Tensor<dt> res = cur[0].owner;
+        if(s.output.empty()) return res(0);
+        return res;
+    }
+
+    template<typename E, typename... Es>
+    inline auto einsum(std::string const& spec, TensorBase<E> const& first, TensorBase<Es> const&... rest){
+        typedef typename E::value_type dt;
+        static_assert((std::is_same<dt, typename Es::value_type>::value && ...), "einsum: Different element types!");
+        std::vector<Tensor<dt>> ops{Tensor<dt>(static_cast<E const&>(first)), Tensor<dt>(static_cast<Es const&>(rest))...};
+        return einsum(spec, ops);
+    }
+
+} // namespace Orion
+
+#endif // EINSUM_H_
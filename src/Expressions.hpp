@@ -5,14 +5,45 @@
 
 namespace Orion
 {
+    namespace detail{
+        /*
+         * Leaves of an expression are tensors, held by reference and owned
+         * by the caller. Interior nodes are temporaries returned by the
+         * operators, so a node keeps its sub-expressions and its functor by
+         * value and a complete tree can be stored and evaluated later, on
+         * another thread too, as long as its leaf tensors are alive.
+         * */
+        template<typename E>
+        struct expr_leaf : std::false_type{};
+        template<typename dt>
+        struct expr_leaf<Tensor<dt>> : std::true_type{};
+
+        template<typename E>
+        using expr_operand = std::conditional_t<expr_leaf<E>::value, E const&, E>;
+
+        // real type of an element, the part type of complex elements
+        template<typename T>
+        struct real_of{ typedef T type; };
+        template<typename T>
+        struct real_of<std::complex<T>>{ typedef T type; };
+
+        /*
+         * Element type of a unary expression. Functors keep the type of
+         * their operand unless they specialize this, as the functors
+         * taking parts of complex numbers do.
+         * */
+        template<typename E, typename Callable>
+        struct unary_value_type{ typedef typename E::value_type type; };
+    } // namespace detail
+
     template<typename E1, typename E2, typename Callable>
     class BinaryExpr : public TensorBase<BinaryExpr<E1, E2, Callable>>{
         static_assert(std::is_same<typename E1::value_type,typename E2::value_type>::value, "Cannot evaluate expression of different tensor elements.");
         
         
-        E1 const& _u;
-        E2 const& _v;
-        Callable const&  callable;
+        detail::expr_operand<E1> _u;
+        detail::expr_operand<E2> _v;
+        Callable callable;
         public:
             typedef typename E1::value_type value_type;
 
@@ -33,13 +64,13 @@ namespace Orion
             const DimVec& dim() const{ return _u.dim(); } 
     };
 
-    template<typename E1, typename Scalar, typename Callable, std::enable_if_t<std::is_scalar<Scalar>::value, bool> = true>
+    template<typename E1, typename Scalar, typename Callable, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
     class BinaryScalarExpr : public TensorBase<BinaryScalarExpr<E1, Scalar, Callable>>{
         static_assert(std::is_same<typename E1::value_type, Scalar>::value, "Cannot evaluate expression of different tensor elements.");
 
-        E1 const& _u;
+        detail::expr_operand<E1> _u;
         Scalar _v;
-        Callable const& callable;
+        Callable callable;
 
         public:
             typedef typename E1::value_type value_type;
@@ -58,11 +89,11 @@ namespace Orion
 
     template<typename E1, typename Callable>
     class UnaryExpr : public TensorBase<UnaryExpr<E1, Callable>>{
-        E1 const& _u;
+        detail::expr_operand<E1> _u;
         Callable callable;
 
         public:
-            typedef typename E1::value_type value_type;
+            typedef typename detail::unary_value_type<E1, Callable>::type value_type;
 
             UnaryExpr(E1 const& u, Callable const& func) : _u(u), callable(func) 
             {}
@@ -75,5 +106,24 @@ namespace Orion
             }
             const DimVec & dim() const{ return _u.dim(); } 
     };
+
+    namespace detail{
+        template<typename dt>
+        struct expr_ops<Tensor<dt>>{
+            static constexpr u64 value = 0;
+        };
+        template<typename E1, typename E2, typename Callable>
+        struct expr_ops<BinaryExpr<E1, E2, Callable>>{
+            static constexpr u64 value = 1 + expr_ops<E1>::value + expr_ops<E2>::value;
+        };
+        template<typename E1, typename Scalar, typename Callable>
+        struct expr_ops<BinaryScalarExpr<E1, Scalar, Callable>>{
+            static constexpr u64 value = 1 + expr_ops<E1>::value;
+        };
+        template<typename E1, typename Callable>
+        struct expr_ops<UnaryExpr<E1, Callable>>{
+            static constexpr u64 value = 1 + expr_ops<E1>::value;
+        };
+    } // namespace detail
 } // namespace Orion
 #endif
\ No newline at end of file
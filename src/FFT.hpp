@@ -0,0 +1,487 @@
+#ifndef FFT_H_
+#define FFT_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include <vector>
+
+#include "Tensor.hpp"
+#include "ThreadPool.hpp"
+
+/*
+ * Discrete Fourier transforms of complex tensors along any axes.
+ *
+ *     Tensor<std::complex<double>> X = fft(x);          // along the last axis
+ *     Tensor<std::complex<double>> y = ifft(X);         // y == x
+ *     auto S = fft2(image, &pool);                      // last two axes, rows in parallel
+ *     Tensor<double> c = fft_convolve(a, b);            // full linear convolution
+ *
+ * Lengths are split into radix 4, 2, 3 and 5 passes and other small primes,
+ * run as a Stockham autosort FFT, so every pass reads and writes whole
+ * contiguous runs and no bit reversal is needed. Lengths with a prime
+ * factor above 32 go through Bluestein's algorithm on a power of two.
+ * Plans hold the factorization and twiddles and are cached per length.
+ * The forward transform is unnormalized and the inverse divides by n.
+ * */
+
+namespace Orion{
+
+    namespace detail{
+        // largest prime handled as one pass, longer lengths use Bluestein
+        constexpr u64 fft_generic_max = 32;
+        // columns of a strided axis gathered into contiguous lines together
+        constexpr u64 fft_gather = 8;
+        // elements below which a transform stays on the calling thread
+        constexpr u64 fft_parallel_min = u64(1) << 14;
+
+        // a*b without the NaN recovery of std::complex multiplication, which keeps butterflies inline
+        template<typename T>
+        ORION_VEC_INLINE std::complex<T> cmul(std::complex<T> a, std::complex<T> b){
+            return std::complex<T>(a.real()*b.real() - a.imag()*b.imag(), a.real()*b.imag() + a.imag()*b.real());
+        }
+
+        // -i*a
+        template<typename T>
+        ORION_VEC_INLINE std::complex<T> mul_neg_i(std::complex<T> a){
+            return std::complex<T>(a.imag(), -a.real());
+        }
+
+        template<typename T>
+        inline std::complex<T> unit_root(u64 k, u64 n){
+            // angle reduced in integers first, so large n keeps full precision
+            const double pi = std::acos(-1.0);
+            double a = -2.0*pi*static_cast<double>(k%n)/static_cast<double>(n);
+            return std::complex<T>(static_cast<T>(std::cos(a)), static_cast<T>(std::sin(a)));
+        }
+
+        /*
+         * Forward DFT of P values in place. The inverse is the same
+         * butterfly with outputs 1..P-1 read in reverse order.
+         * */
+        template<u64 P, typename T>
+        ORION_VEC_INLINE void butterfly(std::complex<T>* a){
+            typedef std::complex<T> cx;
+            if constexpr(P == 2){
+                cx t = a[0];
+                a[0] = t + a[1];
+                a[1] = t - a[1];
+            }else if constexpr(P == 3){
+                const T c = T(-0.5), s = T(0.86602540378443864676);
+                cx t1 = a[1] + a[2], t2 = a[1] - a[2];
+                cx m = a[0] + t1*c;
+                cx u = mul_neg_i(t2)*s;
+                a[0] = a[0] + t1;
+                a[1] = m + u;
+                a[2] = m - u;
+            }else if constexpr(P == 4){
+                cx t0 = a[0] + a[2], t1 = a[0] - a[2];
+                cx t2 = a[1] + a[3], t3 = mul_neg_i(a[1] - a[3]);
+                a[0] = t0 + t2;
+                a[2] = t0 - t2;
+                a[1] = t1 + t3;
+                a[3] = t1 - t3;
+            }else if constexpr(P == 5){
+                const T c1 = T(0.30901699437494742410), c2 = T(-0.80901699437494742410);
+                const T s1 = T(0.95105651629515357212), s2 = T(0.58778525229247312917);
+                cx t1 = a[1] + a[4], t2 = a[2] + a[3];
+                cx t3 = a[1] - a[4], t4 = a[2] - a[3];
+                cx m1 = a[0] + t1*c1 + t2*c2, m2 = a[0] + t1*c2 + t2*c1;
+                cx n1 = mul_neg_i(t3*s1 + t4*s2), n2 = mul_neg_i(t3*s2 - t4*s1);
+                a[0] = a[0] + t1 + t2;
+                a[1] = m1 + n1;
+                a[4] = m1 - n1;
+                a[2] = m2 + n2;
+                a[3] = m2 - n2;
+            }
+        }
+
+        /*
+         * One Stockham pass of radix P. The input holds r*P interleaved
+         * transforms of length L, element k of transform s at s*L + k, and
+         * the output r transforms of length P*L, element k of transform s
+         * at s*P*L + k. The inner loop runs over k, contiguous in both.
+         * */
+        template<u64 P, bool Inverse, typename T>
+        ORION_VEC_FLATTEN void fft_pass(const std::complex<T>* src, std::complex<T>* dst, const std::complex<T>* tw, u64 L, u64 r){
+            typedef std::complex<T> cx;
+            if(L == 1){
+                for(u64 s = 0; s < r; s++){
+                    cx a[P];
+                    for(u64 q = 0; q < P; q++) a[q] = src[s + q*r];
+                    butterfly<P>(a);
+                    for(u64 t = 0; t < P; t++) dst[s*P + t] = a[Inverse ? (P - t)%P : t];
+                }
+                return;
+            }
+            for(u64 s = 0; s < r; s++){
+                const cx* in = src + s*L;
+                cx* out = dst + s*P*L;
+                for(u64 k = 0; k < L; k++){
+                    cx a[P];
+                    a[0] = in[k];
+                    for(u64 q = 1; q < P; q++) a[q] = cmul(in[q*r*L + k], tw[(q - 1)*L + k]);
+                    butterfly<P>(a);
+                    for(u64 t = 0; t < P; t++) out[k + L*t] = a[Inverse ? (P - t)%P : t];
+                }
+            }
+        }
+
+        // pass of any radix p through its p roots of unity
+        template<bool Inverse, typename T>
+        void fft_pass_generic(const std::complex<T>* src, std::complex<T>* dst, const std::complex<T>* tw,
+                              const std::complex<T>* roots, u64 p, u64 L, u64 r){
+            typedef std::complex<T> cx;
+            cx a[fft_generic_max];
+            for(u64 s = 0; s < r; s++){
+                const cx* in = src + s*L;
+                cx* out = dst + s*p*L;
+                for(u64 k = 0; k < L; k++){
+                    a[0] = in[k];
+                    for(u64 q = 1; q < p; q++) a[q] = L == 1 ? in[q*r*L + k] : cmul(in[q*r*L + k], tw[(q - 1)*L + k]);
+                    for(u64 t = 0; t < p; t++){
+                        cx b = a[0];
+                        for(u64 q = 1; q < p; q++) b += cmul(a[q], roots[(q*t)%p]);
+                        out[k + L*(Inverse ? (p - t)%p : t)] = b;
+                    }
+                }
+            }
+        }
+    } // namespace detail
+
+    /**
+     * Factorization and twiddle factors of transforms of one length.
+     * Plans are immutable, so one plan serves any number of threads.
+     * */
+    template<typename dt>
+    class FFTPlan{
+        static_assert(std::is_floating_point<dt>::value, "FFTPlan: dt is the real type of the complex elements.");
+    public:
+        typedef std::complex<dt> cx;
+
+        explicit FFTPlan(u64 n);
+
+        u64 size() const{ return m_n; }
+
+        /**
+         * Elements of the work buffer transform needs.
+         * */
+        u64 work_size() const{ return m_inner ? 3*m_conv : 2*m_n; }
+
+        /**
+         * out = DFT of in, or the inverse DFT without the 1/n scaling.
+         * in and out may be the same buffer, work holds work_size() elements.
+         * */
+        void transform(const cx* in, cx* out, cx* work, bool inverse) const{
+            if(m_inner) bluestein(in, out, work, inverse);
+            else if(inverse) stockham<true>(in, out, work);
+            else stockham<false>(in, out, work);
+        }
+
+    private:
+        struct Pass{
+            u64 radix, L, r;
+            std::vector<cx> tw, twi, roots;
+        };
+
+        template<bool Inverse>
+        void stockham(const cx* in, cx* out, cx* work) const{
+            if(m_passes.empty()){
+                if(in != out) out[0] = in[0];
+                return;
+            }
+            // the input is copied aside when it is also the output, then
+            // passes alternate between out and work so the last one writes out
+            const cx* src = in;
+            if(in == out){
+                std::memcpy(static_cast<void*>(work + m_n), in, m_n*sizeof(cx));
+                src = work + m_n;
+            }
+            u64 np = m_passes.size();
+            for(u64 i = 0; i < np; i++){
+                cx* dst = (np - 1 - i)%2 == 0 ? out : work;
+                Pass const& p = m_passes[i];
+                const cx* tw = Inverse ? p.twi.data() : p.tw.data();
+                switch(p.radix){
+                    case 2: detail::fft_pass<2, Inverse>(src, dst, tw, p.L, p.r); break;
+                    case 3: detail::fft_pass<3, Inverse>(src, dst, tw, p.L, p.r); break;
+                    case 4: detail::fft_pass<4, Inverse>(src, dst, tw, p.L, p.r); break;
+                    case 5: detail::fft_pass<5, Inverse>(src, dst, tw, p.L, p.r); break;
+                    default: detail::fft_pass_generic<Inverse>(src, dst, tw, p.roots.data(), p.radix, p.L, p.r);
+                }
+                src = dst;
+            }
+        }
+
+        /*
+         * X_k = w_k sum_j (x_j w_j) conj(w_{k-j}) with w_k = exp(-i pi k^2/n),
+         * a circular convolution of length m_conv done with two power of two
+         * transforms. The inverse is conj(forward(conj(x))).
+         * */
+        void bluestein(const cx* in, cx* out, cx* work, bool inverse) const{
+            u64 M = m_conv;
+            cx* y = work;
+            for(u64 k = 0; k < m_n; k++){
+                cx x = inverse ? std::conj(in[k]) : in[k];
+                y[k] = detail::cmul(x, m_chirp[k]);
+            }
+            std::fill(y + m_n, y + M, cx(0));
+            m_inner->transform(y, y, work + M, false);
+            for(u64 k = 0; k < M; k++) y[k] = detail::cmul(y[k], m_kernel[k]);
+            m_inner->transform(y, y, work + M, true);
+            for(u64 k = 0; k < m_n; k++){
+                cx z = detail::cmul(y[k], m_chirp[k]);
+                out[k] = inverse ? std::conj(z) : z;
+            }
+        }
+
+        u64 m_n;
+        std::vector<Pass> m_passes;
+
+        // Bluestein only
+        u64 m_conv = 0;
+        std::vector<cx> m_chirp;
+        std::vector<cx> m_kernel; // transform of the conjugate chirp, divided by m_conv
+        std::shared_ptr<const FFTPlan> m_inner;
+    };
+
+    /**
+     * Shared plan for transforms of length n, built on first use.
+     * */
+    template<typename dt>
+    std::shared_ptr<const FFTPlan<dt>> fft_plan(u64 n){
+        static std::mutex mutex;
+        static std::map<u64, std::shared_ptr<const FFTPlan<dt>>> cache;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = cache.find(n);
+            if(it != cache.end()) return it->second;
+        }
+        // built unlocked, a Bluestein plan asks for its inner plan
+        auto plan = std::make_shared<const FFTPlan<dt>>(n);
+        std::lock_guard<std::mutex> lock(mutex);
+        return cache.emplace(n, plan).first->second;
+    }
+
+    template<typename dt>
+    FFTPlan<dt>::FFTPlan(u64 n) : m_n(n){
+        assert(n > 0 && "FFTPlan: empty transform");
+        std::vector<u64> radices;
+        u64 m = n;
+        while(m%4 == 0){ radices.push_back(4); m /= 4; }
+        while(m%2 == 0){ radices.push_back(2); m /= 2; }
+        for(u64 p = 3; p <= detail::fft_generic_max && m > 1; p += 2)
+            while(m%p == 0){
+                radices.push_back(p);
+                m /= p;
+            }
+
+        if(m > 1){
+            // a large prime factor, convolve over a power of two of at least 2n - 1
+            m_conv = 1;
+            while(m_conv < 2*n - 1) m_conv *= 2;
+            m_inner = fft_plan<dt>(m_conv);
+            m_chirp.resize(n);
+            // exp(-i pi k^2/n) is root k^2 of 2n, with k^2 kept modulo 2n
+            for(u64 k = 0, e = 0; k < n; e = (e + 2*k + 1)%(2*n), k++)
+                m_chirp[k] = detail::unit_root<dt>(e, 2*n);
+            std::vector<cx> b(m_conv, cx(0)), w(m_inner->work_size());
+            b[0] = std::conj(m_chirp[0]);
+            for(u64 k = 1; k < n; k++) b[k] = b[m_conv - k] = std::conj(m_chirp[k]);
+            m_kernel.resize(m_conv);
+            m_inner->transform(b.data(), m_kernel.data(), w.data(), false);
+            dt scale = dt(1)/static_cast<dt>(m_conv);
+            for(auto& v : m_kernel) v *= scale;
+            return;
+        }
+
+        u64 L = 1;
+        for(u64 p : radices){
+            Pass pass;
+            pass.radix = p;
+            pass.L = L;
+            pass.r = n/(L*p);
+            if(L > 1){
+                pass.tw.resize((p - 1)*L);
+                for(u64 q = 1; q < p; q++)
+                    for(u64 k = 0; k < L; k++) pass.tw[(q - 1)*L + k] = detail::unit_root<dt>(q*k, p*L);
+                pass.twi.resize(pass.tw.size());
+                for(u64 i = 0; i < pass.tw.size(); i++) pass.twi[i] = std::conj(pass.tw[i]);
+            }
+            if(p > 5){
+                pass.roots.resize(p);
+                for(u64 q = 0; q < p; q++) pass.roots[q] = detail::unit_root<dt>(q, p);
+            }
+            m_passes.push_back(std::move(pass));
+            L *= p;
+        }
+    }
+
+    namespace detail{
+        /*
+         * Transform every line of t along axis in place. Lines of the last
+         * axis are contiguous and run one per task. Lines of other axes are
+         * gathered fft_gather at a time, reading rows of adjacent columns.
+         * */
+        template<typename dt>
+        void fft_axis(Tensor<std::complex<dt>>& t, u64 axis, bool inverse, ThreadPool* pool){
+            typedef std::complex<dt> cx;
+            assert(axis < t.rank());
+            u64 n = t.dim()[axis], outer = 1, inner = 1;
+            for(u64 i = 0; i < axis; i++) outer *= t.dim()[i];
+            for(u64 i = axis + 1; i < t.rank(); i++) inner *= t.dim()[i];
+            if(n == 0 || outer*inner == 0) return;
+            auto plan = fft_plan<dt>(n);
+            dt scale = inverse ? dt(1)/static_cast<dt>(n) : dt(1);
+            cx* data = t.data();
+            u64 groups = (inner + fft_gather - 1)/fft_gather;
+            u64 tasks = inner == 1 ? outer : outer*groups;
+
+            auto task = [&](u64 i){
+                thread_local std::vector<cx> work, lines;
+                if(work.size() < plan->work_size()) work.resize(plan->work_size());
+                if(inner == 1){
+                    cx* line = data + i*n;
+                    plan->transform(line, line, work.data(), inverse);
+                    if(inverse) for(u64 k = 0; k < n; k++) line[k] *= scale;
+                    return;
+                }
+                u64 o = i/groups, c0 = (i%groups)*fft_gather, g = std::min(fft_gather, inner - c0);
+                cx* base = data + o*n*inner + c0;
+                if(lines.size() < n*fft_gather) lines.resize(n*fft_gather);
+                for(u64 k = 0; k < n; k++)
+                    for(u64 j = 0; j < g; j++) lines[j*n + k] = base[k*inner + j];
+                for(u64 j = 0; j < g; j++) plan->transform(lines.data() + j*n, lines.data() + j*n, work.data(), inverse);
+                for(u64 k = 0; k < n; k++)
+                    for(u64 j = 0; j < g; j++) base[k*inner + j] = lines[j*n + k]*scale;
+            };
+            if(pool && pool->size() > 1 && tasks > 1 && t.nelem() >= fft_parallel_min) pool->parallel_for(tasks, task);
+            else for(u64 i = 0; i < tasks; i++) task(i);
+        }
+
+        template<typename dt>
+        Tensor<std::complex<dt>> fft_copy(Tensor<std::complex<dt>> const& x){
+            Tensor<std::complex<dt>> res(x.dim());
+            if(x.nelem()) std::memcpy(static_cast<void*>(res.data()), x.data(), x.nelem()*sizeof(std::complex<dt>));
+            return res;
+        }
+
+        template<typename dt>
+        Tensor<std::complex<dt>> fft_axes(Tensor<std::complex<dt>> const& x, DimVec const& axes, bool inverse, ThreadPool* pool){
+            assert(x.rank() > 0 && "fft: transform of a scalar");
+            Tensor<std::complex<dt>> res = fft_copy(x);
+            for(u64 a : axes) fft_axis(res, a, inverse, pool);
+            return res;
+        }
+
+        inline DimVec fft_last_axes(u64 rank, u64 count){
+            assert(rank >= count && "fft: tensor has too few axes");
+            DimVec axes;
+            for(u64 a = rank - count; a < rank; a++) axes.push_back(a);
+            return axes;
+        }
+    } // namespace detail
+
+    /**
+     * DFT of x along one axis, the last by default.
+     * @param pool threads transforming lines in parallel, or null.
+     * */
+    template<typename dt>
+    Tensor<std::complex<dt>> fft(Tensor<std::complex<dt>> const& x, u64 axis, ThreadPool* pool = nullptr){
+        return detail::fft_axes(x, DimVec{axis}, false, pool);
+    }
+    template<typename dt>
+    Tensor<std::complex<dt>> fft(Tensor<std::complex<dt>> const& x, ThreadPool* pool = nullptr){
+        return fft(x, x.rank() - 1, pool);
+    }
+
+    /**
+     * DFT of a real tensor, taken as complex with zero imaginary parts.
+     * */
+    template<typename dt, std::enable_if_t<std::is_floating_point<dt>::value, bool> = true>
+    Tensor<std::complex<dt>> fft(Tensor<dt> const& x, ThreadPool* pool = nullptr){
+        Tensor<std::complex<dt>> c = complex_t(x);
+        return fft(c, pool);
+    }
+
+    /**
+     * Inverse DFT along one axis, the last by default, divided by its length.
+     * */
+    template<typename dt>
+    Tensor<std::complex<dt>> ifft(Tensor<std::complex<dt>> const& x, u64 axis, ThreadPool* pool = nullptr){
+        return detail::fft_axes(x, DimVec{axis}, true, pool);
+    }
+    template<typename dt>
+    Tensor<std::complex<dt>> ifft(Tensor<std::complex<dt>> const& x, ThreadPool* pool = nullptr){
+        return ifft(x, x.rank() - 1, pool);
+    }
+
+    /**
+     * 2D DFT and its inverse over the last two axes, every leading index a separate image.
+     * */
+    template<typename dt>
+    Tensor<std::complex<dt>> fft2(Tensor<std::complex<dt>> const& x, ThreadPool* pool = nullptr){
+        return detail::fft_axes(x, detail::fft_last_axes(x.rank(), 2), false, pool);
+    }
+    template<typename dt>
+    Tensor<std::complex<dt>> ifft2(Tensor<std::complex<dt>> const& x, ThreadPool* pool = nullptr){
+        return detail::fft_axes(x, detail::fft_last_axes(x.rank(), 2), true, pool);
+    }
+
+    /**
+     * N-D DFT and its inverse over every axis.
+     * */
+    template<typename dt>
+    Tensor<std::complex<dt>> fftn(Tensor<std::complex<dt>> const& x, ThreadPool* pool = nullptr){
+        return detail::fft_axes(x, detail::fft_last_axes(x.rank(), x.rank()), false, pool);
+    }
+    template<typename dt>
+    Tensor<std::complex<dt>> ifftn(Tensor<std::complex<dt>> const& x, ThreadPool* pool = nullptr){
+        return detail::fft_axes(x, detail::fft_last_axes(x.rank(), x.rank()), true, pool);
+    }
+
+    /**
+     * Smallest length of at least n with no prime factor above 5, the
+     * lengths transformed fastest.
+     * */
+    inline u64 fft_fast_size(u64 n){
+        for(u64 m = std::max<u64>(n, 1); ; m++){
+            u64 r = m;
+            for(u64 p : {2, 3, 5})
+                while(r%p == 0) r /= p;
+            if(r == 1) return m;
+        }
+    }
+
+    /**
+     * Full linear convolution of two real vectors, of length
+     * a.nelem() + b.nelem() - 1, through transforms of a fast length.
+     * */
+    template<typename dt>
+    Tensor<dt> fft_convolve(Tensor<dt> const& a, Tensor<dt> const& b){
+        assert(a.rank() == 1 && b.rank() == 1 && a.nelem() > 0 && b.nelem() > 0);
+        typedef std::complex<dt> cx;
+        u64 len = a.nelem() + b.nelem() - 1, n = fft_fast_size(len);
+        auto plan = fft_plan<dt>(n);
+        std::vector<cx> fa(n, cx(0)), fb(n, cx(0)), work(plan->work_size());
+        for(u64 i = 0; i < a.nelem(); i++) fa[i] = cx(a[i]);
+        for(u64 i = 0; i < b.nelem(); i++) fb[i] = cx(b[i]);
+        plan->transform(fa.data(), fa.data(), work.data(), false);
+        plan->transform(fb.data(), fb.data(), work.data(), false);
+        for(u64 i = 0; i < n; i++) fa[i] = detail::cmul(fa[i], fb[i]);
+        plan->transform(fa.data(), fa.data(), work.data(), true);
+        Tensor<dt> res(DimVec{len});
+        dt scale = dt(1)/static_cast<dt>(n);
+        for(u64 i = 0; i < len; i++) res.data()[i] = fa[i].real()*scale;
+        return res;
+    }
+
+} // namespace Orion
+
+#endif // FFT_H_
@@ -0,0 +1,245 @@
+#ifndef FIXEDTENSOR_H_
+#define FIXEDTENSOR_H_
+
+#include <cassert>
+#include <initializer_list>
+#include <type_traits>
+#include <utility>
+
+#include "Tensor.hpp"
+
+namespace Orion{
+
+    namespace detail{
+        // largest element count evaluated as one unrolled statement list,
+        // bigger fixed tensors fall back to a constant trip count loop
+        constexpr u64 fixed_unroll_limit = 64;
+
+        template<typename dt, typename E, size_t... I>
+        ORION_VEC_INLINE void fixed_eval(dt* out, E const& e, std::index_sequence<I...>){
+            ((out[I] = static_cast<dt>(e[I])), ...);
+        }
+
+        template<typename dt, u64 N, typename E>
+        ORION_VEC_INLINE void fixed_eval(dt* out, E const& e){
+            if constexpr(N <= fixed_unroll_limit){
+                fixed_eval(out, e, std::make_index_sequence<N>{});
+            }else{
+                for(u64 i = 0; i < N; i++) out[i] = static_cast<dt>(e[i]);
+            }
+        }
+    } // namespace detail
+
+    /**
+     * Tensor with its shape fixed at compile time and its elements stored
+     * inline, eg : FixedTensor<double, 3, 3> is a 3x3 matrix of 72 bytes.
+     * Nothing is allocated, so small transforms and covariances can live on
+     * the stack or inside other objects.
+     *
+     * It is a TensorBase like Tensor, so both mix freely in expressions.
+     * Evaluating an expression into a fixed tensor runs over a constant
+     * element count and is unrolled for small shapes.
+     *
+     *     FixedTensor<double, 3, 3> r = {...};
+     *     FixedTensor<double, 3> p = {1, 2, 3};
+     *     FixedTensor<double, 3, 3> s = r*r.transposed() + 1.0;
+     *     Tensor<double> d = s % dynamic;   // dynamic is any 3x3 Tensor
+     * */
+    template<typename dt, u64... Dims>
+    class FixedTensor : public TensorBase<FixedTensor<dt, Dims...>>{
+        static_assert(sizeof...(Dims) > 0, "FixedTensor needs at least one dimension.");
+        static_assert(((Dims > 0) && ...), "FixedTensor dimensions must be non zero.");
+    public:
+        typedef dt value_type;
+
+        static constexpr u64 Rank = sizeof...(Dims);
+        static constexpr u64 Size = (Dims * ... * u64(1));
+
+        /**
+         * All elements are zero.
+         * */
+        FixedTensor() : m_data{}{}
+
+        /**
+         * Elements in row major order, missing trailing ones are zero.
+         * */
+        FixedTensor(std::initializer_list<dt> values) : m_data{}{
+            assert(values.size() <= Size);
+            u64 i = 0;
+            for(dt v : values) m_data[i++] = v;
+        }
+
+        /**
+         * Evaluate an expression of the same shape, fixed or dynamic.
+         * */
+        template<typename E>
+        FixedTensor(const TensorBase<E>& expr){
+            check_dim(expr);
+            detail::fixed_eval<dt, Size>(m_data, static_cast<E const&>(expr));
+        }
+
+        template<typename E>
+        FixedTensor& operator=(const TensorBase<E>& expr){
+            check_dim(expr);
+            // evaluated through a copy, expr may read this tensor in another order
+            dt tmp[Size];
+            detail::fixed_eval<dt, Size>(tmp, static_cast<E const&>(expr));
+            for(u64 i = 0; i < Size; i++) m_data[i] = tmp[i];
+            return *this;
+        }
+
+        template<typename E>
+        FixedTensor& operator+=(const TensorBase<E>& other){
+            return *this = *this + other;
+        }
+        template<typename E>
+        FixedTensor& operator-=(const TensorBase<E>& other){
+            return *this = *this - other;
+        }
+        template<typename E>
+        FixedTensor& operator%=(const TensorBase<E>& other){
+            return *this = *this % other;
+        }
+
+        template<typename Scalar, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
+        FixedTensor& operator+=(Scalar other){
+            for(u64 i = 0; i < Size; i++) m_data[i] += other;
+            return *this;
+        }
+        template<typename Scalar, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
+        FixedTensor& operator-=(Scalar other){
+            for(u64 i = 0; i < Size; i++) m_data[i] -= other;
+            return *this;
+        }
+        template<typename Scalar, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
+        FixedTensor& operator%=(Scalar other){
+            for(u64 i = 0; i < Size; i++) m_data[i] *= other;
+            return *this;
+        }
+
+        inline void zeroes(){
+            for(u64 i = 0; i < Size; i++) m_data[i] = dt(0);
+        }
+
+        inline void fill(dt x){
+            for(u64 i = 0; i < Size; i++) m_data[i] = x;
+        }
+
+        /**
+         * Get dimension vector of this FixedTensor, shared by all tensors of this type.
+         * @return DimVec
+         * */
+        static const DimVec& dim(){
+            static const DimVec d{Dims...};
+            return d;
+        }
+
+        static constexpr u64 rank(){ return Rank; }
+        static constexpr u64 nelem(){ return Size; }
+
+        inline dt* data(){ return m_data; }
+        inline const dt* data() const{ return m_data; }
+
+        inline dt operator[](size_t i) const{ return m_data[i]; }
+        inline dt& operator[](size_t i){ return m_data[i]; }
+
+        /**
+         * Element at a full index, eg : m(1, 2) of a matrix.
+         * */
+        template<typename... index_t>
+        inline dt& operator()(index_t... index){
+            return m_data[offset(index...)];
+        }
+        template<typename... index_t>
+        inline dt operator()(index_t... index) const{
+            return m_data[offset(index...)];
+        }
+
+        /**
+         * Tensor sharing the inline storage of this one, for the routines
+         * that take a Tensor. It is valid as long as this object is.
+         * */
+        inline Tensor<dt> view(){
+            return Tensor<dt>(dim(), m_data);
+        }
+
+        /**
+         * Transposed copy of a matrix.
+         * */
+        inline auto transposed() const;
+
+    private:
+        template<typename E>
+        static void check_dim(const TensorBase<E>& expr){
+            assert(expr.rank() == Rank);
+            constexpr u64 dims[] = {Dims...};
+            const DimVec& d = expr.dim();
+            for(u64 i = 0; i < Rank; i++)
+                assert(d[i] == dims[i]);
+            static_cast<void>(dims);
+            static_cast<void>(d);
+        }
+
+        template<typename... index_t>
+        static constexpr u64 offset(index_t... index){
+            static_assert(sizeof...(index_t) == Rank, "FixedTensor: index every dimension.");
+            u64 off = 0;
+            ((off = off*Dims + static_cast<u64>(index)), ...);
+            return off;
+        }
+
+        dt m_data[Size];
+    };
+
+    template<typename dt, u64... Dims>
+    inline auto FixedTensor<dt, Dims...>::transposed() const{
+        static_assert(Rank == 2, "FixedTensor: transpose of a matrix only.");
+        constexpr u64 dims[] = {Dims...};
+        FixedTensor<dt, dims[1], dims[0]> t;
+        for(u64 i = 0; i < dims[0]; i++)
+            for(u64 j = 0; j < dims[1]; j++)
+                t[j*dims[0] + i] = m_data[i*dims[1] + j];
+        return t;
+    }
+
+    /**
+     * Matrix product of fixed matrices. Every loop bound is a constant, the
+     * inner loop runs along rows of b and the result so it vectorizes.
+     * */
+    template<typename dt, u64 M, u64 K, u64 N>
+    inline FixedTensor<dt, M, N> operator*(FixedTensor<dt, M, K> const& a, FixedTensor<dt, K, N> const& b){
+        FixedTensor<dt, M, N> c;
+        for(u64 i = 0; i < M; i++)
+            for(u64 k = 0; k < K; k++){
+                dt aik = a[i*K + k];
+                for(u64 j = 0; j < N; j++) c[i*N + j] += aik*b[k*N + j];
+            }
+        return c;
+    }
+
+    /**
+     * Matrix vector product of fixed tensors.
+     * */
+    template<typename dt, u64 M, u64 K>
+    inline FixedTensor<dt, M> operator*(FixedTensor<dt, M, K> const& a, FixedTensor<dt, K> const& x){
+        FixedTensor<dt, M> y;
+        for(u64 i = 0; i < M; i++){
+            dt s = 0;
+            for(u64 k = 0; k < K; k++) s += a[i*K + k]*x[k];
+            y[i] = s;
+        }
+        return y;
+    }
+
+    namespace detail{
+        template<typename dt, u64... Dims>
+        struct expr_ops<FixedTensor<dt, Dims...>>{
+            static constexpr u64 value = 0;
+        };
+        template<typename dt, u64... Dims>
+        struct expr_leaf<FixedTensor<dt, Dims...>> : std::true_type{};
+    } // namespace detail
+
+} // namespace Orion
+
+#endif // FIXEDTENSOR_H_
@@ -0,0 +1,188 @@
+#ifndef GEMM_H_
+#define GEMM_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "Typedefs.hpp"
+#include "Profiler.hpp"
+#include "Dispatch.hpp"
+
+namespace Orion{
+
+    /**
+     * Cache blocking used by gemm.
+     * A mc x kc block of A is packed to stay resident in L2, a kc x nc
+     * panel of B is packed to stay resident in L3.
+     * */
+    struct GemmBlocking{
+        u64 mc = 96;
+        u64 kc = 256;
+        u64 nc = 2048;
+    };
+
+    /**
+     * Process wide gemm blocking parameters.
+     * */
+    inline GemmBlocking& gemm_blocking(){
+        static GemmBlocking blocking;
+        return blocking;
+    }
+
+    namespace detail{
+        // register tile computed by the micro kernel
+        constexpr u64 GEMM_MR = 4;
+        constexpr u64 GEMM_NR = 8;
+
+        /*
+         * Pack a mc x kc block of A into slivers of GEMM_MR rows.
+         * Element (i, p) of the block is A[i*rs + p*cs]. Each sliver is
+         * stored column by column so that the micro kernel reads it linearly.
+         * Rows past mc are zero padded.
+         * */
+        template<typename dt>
+        inline void gemm_pack_a(const dt* A, u64 rs, u64 cs, u64 mc, u64 kc, dt* buf){
+            for(u64 i = 0; i < mc; i += GEMM_MR){
+                u64 mr = std::min(GEMM_MR, mc - i);
+                for(u64 p = 0; p < kc; p++){
+                    for(u64 r = 0; r < GEMM_MR; r++){
+                        if(r < mr) *buf++ = A[(i + r)*rs + p*cs];
+                        else *buf++ = dt(0);
+                    }
+                }
+            }
+        }
+
+        /*
+         * Pack a kc x nc panel of B into slivers of GEMM_NR columns.
+         * Element (p, j) of the panel is B[p*rs + j*cs]. Each sliver is
+         * stored row by row. Columns past nc are zero padded.
+         * */
+        template<typename dt>
+        inline void gemm_pack_b(const dt* B, u64 rs, u64 cs, u64 kc, u64 nc, dt* buf){
+            for(u64 j = 0; j < nc; j += GEMM_NR){
+                u64 nr = std::min(GEMM_NR, nc - j);
+                for(u64 p = 0; p < kc; p++){
+                    for(u64 c = 0; c < GEMM_NR; c++){
+                        if(c < nr) *buf++ = B[p*rs + (j + c)*cs];
+                        else *buf++ = dt(0);
+                    }
+                }
+            }
+        }
+
+        /*
+         * C[0:mr, 0:nr] += alpha * a * b where a and b are packed slivers.
+         * The accumulator stays in registers for the whole kc loop.
+         * */
+        template<typename dt>
+        inline void gemm_micro_kernel(u64 kc, const dt* a, const dt* b, dt alpha, dt* C, u64 rsc, u64 csc, u64 mr, u64 nr){
+            dt acc[GEMM_MR][GEMM_NR] = {};
+            for(u64 p = 0; p < kc; p++){
+                for(u64 r = 0; r < GEMM_MR; r++){
+                    dt ar = a[p*GEMM_MR + r];
+                    for(u64 c = 0; c < GEMM_NR; c++)
+                        acc[r][c] += ar*b[p*GEMM_NR + c];
+                }
+            }
+            for(u64 r = 0; r < mr; r++)
+                for(u64 c = 0; c < nr; c++)
+                    C[r*rsc + c*csc] += alpha*acc[r][c];
+        }
+    } // namespace detail
+
+    /**
+     * General matrix multiply on arbitrarily strided buffers.
+     * C = alpha * A * B + beta * C
+     * where element (i, j) of a matrix X is X[i*rsx + j*csx]. Operands are
+     * packed before use, so any layout including transposed or permuted
+     * tensor views runs at the speed of the contiguous case.
+     *
+     * @param M rows of A and C.
+     * @param N columns of B and C.
+     * @param K columns of A and rows of B.
+     * */
+    template<typename dt>
+    inline void gemm_strided(u64 M, u64 N, u64 K,
+                             dt alpha, const dt* A, u64 rsa, u64 csa,
+                             const dt* B, u64 rsb, u64 csb,
+                             dt beta, dt* C, u64 rsc, u64 csc){
+        using namespace detail;
+        ORION_PROFILE_SCOPE(prof, "gemm", "gemm");
+        ORION_PROFILE_SHAPE(prof, (DimVec{M, K}));
+        ORION_PROFILE_SHAPE(prof, (DimVec{K, N}));
+        ORION_PROFILE_FLOPS(prof, 2*M*N*K);
+
+        if(beta != dt(1)){
+            for(u64 i = 0; i < M; i++){
+                for(u64 j = 0; j < N; j++){
+                    dt& c = C[i*rsc + j*csc];
+                    c = beta == dt(0) ? dt(0) : beta*c;
+                }
+            }
+        }
+        if(M == 0 || N == 0 || K == 0 || alpha == dt(0)) return;
+
+        GemmBlocking const& blk = gemm_blocking();
+        u64 MC = std::max(GEMM_MR, blk.mc - blk.mc%GEMM_MR);
+        u64 NC = std::max(GEMM_NR, blk.nc - blk.nc%GEMM_NR);
+        u64 KC = std::max<u64>(1, blk.kc);
+
+        // packing buffers are reused across calls to keep gemm allocation free
+        thread_local std::vector<dt> abuf, bbuf;
+        if(abuf.size() < MC*KC) abuf.resize(MC*KC);
+        if(bbuf.size() < KC*NC) bbuf.resize(KC*NC);
+
+        // packing and micro kernel compiled for the best instruction set of the CPU
+        dt* ab = abuf.data();
+        dt* bb = bbuf.data();
+        isa_dispatch([&]{
+            for(u64 jc = 0; jc < N; jc += NC){
+                u64 nc = std::min(NC, N - jc);
+                for(u64 pc = 0; pc < K; pc += KC){
+                    u64 kc = std::min(KC, K - pc);
+                    gemm_pack_b(B + pc*rsb + jc*csb, rsb, csb, kc, nc, bb);
+
+                    for(u64 ic = 0; ic < M; ic += MC){
+                        u64 mc = std::min(MC, M - ic);
+                        gemm_pack_a(A + ic*rsa + pc*csa, rsa, csa, mc, kc, ab);
+
+                        for(u64 jr = 0; jr < nc; jr += GEMM_NR){
+                            u64 nr = std::min(GEMM_NR, nc - jr);
+                            const dt* bp = bb + jr*kc;
+                            for(u64 ir = 0; ir < mc; ir += GEMM_MR){
+                                u64 mr = std::min(GEMM_MR, mc - ir);
+                                const dt* ap = ab + ir*kc;
+                                gemm_micro_kernel(kc, ap, bp, alpha, C + (ic + ir)*rsc + (jc + jr)*csc, rsc, csc, mr, nr);
+                            }
+                        }
+                    }
+                }
+            }
+        });
+    }
+
+    /**
+     * General matrix multiply on row major buffers.
+     * C = alpha * op(A) * op(B) + beta * C
+     *
+     * @param transA use A^T instead of A, A is then stored as K x M.
+     * @param transB use B^T instead of B, B is then stored as N x K.
+     * @param M rows of op(A) and C.
+     * @param N columns of op(B) and C.
+     * @param K columns of op(A) and rows of op(B).
+     * @param lda, ldb, ldc row strides (leading dimensions) of A, B and C.
+     * */
+    template<typename dt>
+    inline void gemm(bool transA, bool transB, u64 M, u64 N, u64 K,
+                     dt alpha, const dt* A, u64 lda, const dt* B, u64 ldb,
+                     dt beta, dt* C, u64 ldc){
+        gemm_strided(M, N, K, alpha,
+                     A, transA ? 1 : lda, transA ? lda : 1,
+                     B, transB ? 1 : ldb, transB ? ldb : 1,
+                     beta, C, ldc, u64(1));
+    }
+
+} // namespace Orion
+
+#endif // GEMM_H_
@@ -0,0 +1,544 @@
+#ifndef LINALG_H_
+#define LINALG_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <vector>
+
+#include "Tensor.hpp"
+
+namespace Orion{
+
+    /**
+     * Result of QR factorization A = Q * R.
+     * */
+    template<typename dt>
+    struct QR{
+        Tensor<dt> Q;
+        Tensor<dt> R;
+    };
+
+    /**
+     * Result of symmetric eigendecomposition A = V * diag(values) * V^T.
+     * values are sorted in ascending order and column i of vectors
+     * is the eigenvector for values[i].
+     * */
+    template<typename dt>
+    struct Eigh{
+        Tensor<dt> values;
+        Tensor<dt> vectors;
+    };
+
+    /**
+     * Result of singular value decomposition A = U * diag(S) * Vt.
+     * For an m x n matrix and k = min(m, n), U is m x k, S has k
+     * values in descending order and Vt is k x n.
+     * */
+    template<typename dt>
+    struct SVD{
+        Tensor<dt> U;
+        Tensor<dt> S;
+        Tensor<dt> Vt;
+    };
+
+    // panel width of blocked householder QR
+    constexpr u64 QR_BLOCK = 32;
+
+    namespace detail{
+        /*
+         * Householder block reflector H = I - V T V^T in compact WY form.
+         * V is rows x nb and unit lower trapezoidal, T is nb x nb upper triangular.
+         * The reflector acts on rows [offset, offset + rows).
+         * */
+        template<typename dt>
+        struct BlockReflector{
+            u64 offset;
+            u64 rows;
+            u64 nb;
+            std::vector<dt> V;
+            std::vector<dt> T;
+        };
+
+        /*
+         * C = (I - V op(T) V^T) C for a h.rows x ncols block C with row stride ldc.
+         * trans = true applies H^T. All work is done by three gemm calls.
+         * */
+        template<typename dt>
+        inline void apply_block_reflector(BlockReflector<dt> const& h, bool trans, dt* C, u64 ncols, u64 ldc, std::vector<dt>& work){
+            if(ncols == 0) return;
+            u64 nb = h.nb;
+            work.resize(2*nb*ncols);
+            dt* W = work.data();
+            dt* W2 = W + nb*ncols;
+            gemm(true, false, nb, ncols, h.rows, dt(1), h.V.data(), nb, C, ldc, dt(0), W, ncols);
+            gemm(trans, false, nb, ncols, nb, dt(1), h.T.data(), nb, W, ncols, dt(0), W2, ncols);
+            gemm(false, false, h.rows, ncols, nb, dt(-1), h.V.data(), nb, W2, ncols, dt(1), C, ldc);
+        }
+
+        /*
+         * Unblocked householder QR of panel A[j0:m, j0:j0+nb] with row stride lda.
+         * R is left in the upper triangle of the panel and the reflectors are
+         * returned in compact WY form.
+         * */
+        template<typename dt>
+        inline BlockReflector<dt> householder_panel(dt* A, u64 m, u64 lda, u64 j0, u64 nb){
+            BlockReflector<dt> h;
+            h.offset = j0;
+            h.rows = m - j0;
+            h.nb = nb;
+            h.V.assign(h.rows*nb, dt(0));
+            h.T.assign(nb*nb, dt(0));
+            std::vector<dt> tau(nb, dt(0));
+            dt* V = h.V.data();
+
+            for(u64 c = 0; c < nb; c++){
+                u64 j = j0 + c;
+                dt alpha = A[j*lda + j];
+                dt xnorm = 0;
+                for(u64 i = j + 1; i < m; i++) xnorm += A[i*lda + j]*A[i*lda + j];
+                xnorm = std::sqrt(xnorm);
+
+                V[c*nb + c] = dt(1);
+                if(xnorm != dt(0)){
+                    dt beta = -std::copysign(std::hypot(alpha, xnorm), alpha);
+                    tau[c] = (beta - alpha)/beta;
+                    dt scale = dt(1)/(alpha - beta);
+                    for(u64 i = j + 1; i < m; i++){
+                        A[i*lda + j] *= scale;
+                        V[(i - j0)*nb + c] = A[i*lda + j];
+                        A[i*lda + j] = dt(0);
+                    }
+                    A[j*lda + j] = beta;
+                }
+
+                // apply H_c to the remaining columns of the panel
+                for(u64 k = j + 1; k < j0 + nb; k++){
+                    dt w = A[j*lda + k];
+                    for(u64 i = j + 1; i < m; i++) w += V[(i - j0)*nb + c]*A[i*lda + k];
+                    w *= tau[c];
+                    A[j*lda + k] -= w;
+                    for(u64 i = j + 1; i < m; i++) A[i*lda + k] -= w*V[(i - j0)*nb + c];
+                }
+            }
+
+            // forward accumulation of T such that H_0 H_1 ... H_nb-1 = I - V T V^T
+            dt* T = h.T.data();
+            std::vector<dt> w(nb);
+            for(u64 i = 0; i < nb; i++){
+                T[i*nb + i] = tau[i];
+                if(i == 0 || tau[i] == dt(0)) continue;
+                for(u64 r = 0; r < i; r++){
+                    dt s = 0;
+                    for(u64 k = i; k < h.rows; k++) s += V[k*nb + r]*V[k*nb + i];
+                    w[r] = s;
+                }
+                for(u64 r = 0; r < i; r++){
+                    dt s = 0;
+                    for(u64 q = r; q < i; q++) s += T[r*nb + q]*w[q];
+                    T[r*nb + i] = -tau[i]*s;
+                }
+            }
+            return h;
+        }
+
+        template<typename dt>
+        inline Tensor<dt> take_columns(Tensor<dt> const& a, u64 k){
+            u64 m = a.dim()[0];
+            u64 n = a.dim()[1];
+            Tensor<dt> res({m, k});
+            for(u64 i = 0; i < m; i++)
+                std::copy(a.data() + i*n, a.data() + i*n + k, res.data() + i*k);
+            return res;
+        }
+    } // namespace detail
+
+    /**
+     * Blocked householder QR factorization of an m x n matrix.
+     * Panels of QR_BLOCK columns are factored and the trailing matrix is
+     * updated with the compact WY representation, so most of the flops are
+     * spent in gemm.
+     *
+     * @param a rank 2 tensor to factorize.
+     * @param economy if true Q is m x min(m, n) and R is min(m, n) x n,
+     * otherwise Q is m x m and R is m x n.
+     * */
+    template<typename dt>
+    inline QR<dt> qr(Tensor<dt> const& a, bool economy = true){
+        assert(a.rank() == 2);
+        u64 m = a.dim()[0];
+        u64 n = a.dim()[1];
+        u64 k = std::min(m, n);
+
+        std::vector<dt> A(a.data(), a.data() + m*n);
+        std::vector<detail::BlockReflector<dt>> reflectors;
+        std::vector<dt> work;
+        for(u64 j0 = 0; j0 < k; j0 += QR_BLOCK){
+            u64 nb = std::min(QR_BLOCK, k - j0);
+            reflectors.push_back(detail::householder_panel(A.data(), m, n, j0, nb));
+            detail::apply_block_reflector(reflectors.back(), true, A.data() + j0*n + j0 + nb, n - j0 - nb, n, work);
+        }
+
+        // Q = H_0 H_1 ... applied to identity, blocks applied last to first
+        u64 qc = economy ? k : m;
+        Tensor<dt> Q({m, qc});
+        Q.fill(0);
+        for(u64 i = 0; i < std::min(m, qc); i++) Q.data()[i*qc + i] = dt(1);
+        for(auto h = reflectors.rbegin(); h != reflectors.rend(); ++h){
+            detail::apply_block_reflector(*h, false, Q.data() + h->offset*qc + h->offset, qc - h->offset, qc, work);
+        }
+
+        u64 rr = economy ? k : m;
+        Tensor<dt> R({rr, n});
+        R.fill(0);
+        for(u64 i = 0; i < k; i++)
+            for(u64 j = i; j < n; j++)
+                R.data()[i*n + j] = A[i*n + j];
+
+        return {Q, R};
+    }
+
+    /**
+     * Least squares solution of min ||A X - B|| through QR.
+     *
+     * @param a m x n matrix with m >= n and full column rank.
+     * @param b right hand side, either a vector of length m or an m x r matrix.
+     * @return X with shape n or n x r matching b.
+     * */
+    template<typename dt>
+    inline Tensor<dt> lstsq(Tensor<dt> const& a, Tensor<dt> const& b){
+        assert(a.rank() == 2 && (b.rank() == 1 || b.rank() == 2));
+        u64 m = a.dim()[0];
+        u64 n = a.dim()[1];
+        assert(m >= n && b.dim()[0] == m);
+        u64 r = b.rank() == 1 ? 1 : b.dim()[1];
+
+        QR<dt> f = qr(a);
+        Tensor<dt> x(b.rank() == 1 ? DimVec{n} : DimVec{n, r});
+        gemm(true, false, n, r, m, dt(1), f.Q.data(), n, b.data(), r, dt(0), x.data(), r);
+
+        // back substitution with upper triangular R
+        const dt* R = f.R.data();
+        dt* X = x.data();
+        for(u64 ii = n; ii-- > 0;){
+            for(u64 j = ii + 1; j < n; j++)
+                for(u64 c = 0; c < r; c++)
+                    X[ii*r + c] -= R[ii*n + j]*X[j*r + c];
+            for(u64 c = 0; c < r; c++)
+                X[ii*r + c] /= R[ii*n + ii];
+        }
+        return x;
+    }
+
+    /**
+     * Eigendecomposition of a real symmetric matrix.
+     * The matrix is reduced to tridiagonal form with householder
+     * transformations and the tridiagonal problem is solved with implicitly
+     * shifted QL iteration, accumulating the transformations into the
+     * eigenvectors.
+     *
+     * @param a n x n symmetric matrix.
+     * */
+    template<typename dt>
+    inline Eigh<dt> eigh(Tensor<dt> const& a){
+        assert(a.rank() == 2 && a.dim()[0] == a.dim()[1]);
+        i64 n = static_cast<i64>(a.dim()[0]);
+        u64 un = a.dim()[0];
+        std::vector<dt> Vbuf(a.data(), a.data() + un*un);
+        std::vector<dt> d(un), e(un);
+        auto V = [&](i64 i, i64 j) -> dt& { return Vbuf[static_cast<u64>(i*n + j)]; };
+        auto D = [&](i64 i) -> dt& { return d[static_cast<u64>(i)]; };
+        auto E = [&](i64 i) -> dt& { return e[static_cast<u64>(i)]; };
+
+        if(n == 0) return {Tensor<dt>(DimVec{0}), Tensor<dt>(DimVec{0, 0})};
+
+        // householder tridiagonalization
+        for(i64 j = 0; j < n; j++) D(j) = V(n - 1, j);
+        for(i64 i = n - 1; i > 0; i--){
+            dt scale = 0, h = 0;
+            for(i64 k = 0; k < i; k++) scale += std::abs(D(k));
+            if(scale == dt(0)){
+                E(i) = D(i - 1);
+                for(i64 j = 0; j < i; j++){
+                    D(j) = V(i - 1, j);
+                    V(i, j) = 0;
+                    V(j, i) = 0;
+                }
+            }else{
+                for(i64 k = 0; k < i; k++){
+                    D(k) /= scale;
+                    h += D(k)*D(k);
+                }
+                dt f = D(i - 1);
+                dt g = std::sqrt(h);
+                if(f > 0) g = -g;
+                E(i) = scale*g;
+                h = h - f*g;
+                D(i - 1) = f - g;
+                for(i64 j = 0; j < i; j++) E(j) = 0;
+                for(i64 j = 0; j < i; j++){
+                    f = D(j);
+                    V(j, i) = f;
+                    g = E(j) + V(j, j)*f;
+                    for(i64 k = j + 1; k <= i - 1; k++){
+                        g += V(k, j)*D(k);
+                        E(k) += V(k, j)*f;
+                    }
+                    E(j) = g;
+                }
+                f = 0;
+                for(i64 j = 0; j < i; j++){
+                    E(j) /= h;
+                    f += E(j)*D(j);
+                }
+                dt hh = f/(h + h);
+                for(i64 j = 0; j < i; j++) E(j) -= hh*D(j);
+                for(i64 j = 0; j < i; j++){
+                    f = D(j);
+                    g = E(j);
+                    for(i64 k = j; k <= i - 1; k++) V(k, j) -= (f*E(k) + g*D(k));
+                    D(j) = V(i - 1, j);
+                    V(i, j) = 0;
+                }
+            }
+            D(i) = h;
+        }
+        for(i64 i = 0; i < n - 1; i++){
+            V(n - 1, i) = V(i, i);
+            V(i, i) = 1;
+            dt h = D(i + 1);
+            if(h != dt(0)){
+                for(i64 k = 0; k <= i; k++) D(k) = V(k, i + 1)/h;
+                for(i64 j = 0; j <= i; j++){
+                    dt g = 0;
+                    for(i64 k = 0; k <= i; k++) g += V(k, i + 1)*V(k, j);
+                    for(i64 k = 0; k <= i; k++) V(k, j) -= g*D(k);
+                }
+            }
+            for(i64 k = 0; k <= i; k++) V(k, i + 1) = 0;
+        }
+        for(i64 j = 0; j < n; j++){
+            D(j) = V(n - 1, j);
+            V(n - 1, j) = 0;
+        }
+        V(n - 1, n - 1) = 1;
+        E(0) = 0;
+
+        // implicit QL iteration on the tridiagonal matrix
+        for(i64 i = 1; i < n; i++) E(i - 1) = E(i);
+        E(n - 1) = 0;
+        dt f = 0, tst1 = 0;
+        const dt eps = std::numeric_limits<dt>::epsilon();
+        for(i64 l = 0; l < n; l++){
+            tst1 = std::max(tst1, std::abs(D(l)) + std::abs(E(l)));
+            i64 m = l;
+            while(m < n - 1){
+                if(std::abs(E(m)) <= eps*tst1) break;
+                m++;
+            }
+            if(m > l){
+                do{
+                    dt g = D(l);
+                    dt p = (D(l + 1) - g)/(dt(2)*E(l));
+                    dt r = std::hypot(p, dt(1));
+                    if(p < 0) r = -r;
+                    D(l) = E(l)/(p + r);
+                    D(l + 1) = E(l)*(p + r);
+                    dt dl1 = D(l + 1);
+                    dt h = g - D(l);
+                    for(i64 i = l + 2; i < n; i++) D(i) -= h;
+                    f += h;
+
+                    p = D(m);
+                    dt c = 1, c2 = 1, c3 = 1;
+                    dt el1 = E(l + 1);
+                    dt s = 0, s2 = 0;
+                    for(i64 i = m - 1; i >= l; i--){
+                        c3 = c2;
+                        c2 = c;
+                        s2 = s;
+                        g = c*E(i);
+                        h = c*p;
+                        r = std::hypot(p, E(i));
+                        E(i + 1) = s*r;
+                        s = E(i)/r;
+                        c = p/r;
+                        p = c*D(i) - s*g;
+                        D(i + 1) = h + s*(c*g + s*D(i));
+                        for(i64 k = 0; k < n; k++){
+                            h = V(k, i + 1);
+                            V(k, i + 1) = s*V(k, i) + c*h;
+                            V(k, i) = c*V(k, i) - s*h;
+                        }
+                    }
+                    p = -s*s2*c3*el1*E(l)/dl1;
+                    E(l) = s*p;
+                    D(l) = c*p;
+                }while(std::abs(E(l)) > eps*tst1);
+            }
+            D(l) += f;
+            E(l) = 0;
+        }
+
+        std::vector<u64> order(un);
+        std::iota(order.begin(), order.end(), u64(0));
+        std::sort(order.begin(), order.end(), [&](u64 x, u64 y){ return d[x] < d[y]; });
+
+        Tensor<dt> values(DimVec{un});
+        Tensor<dt> vectors({un, un});
+        for(u64 j = 0; j < un; j++){
+            values.data()[j] = d[order[j]];
+            for(u64 i = 0; i < un; i++)
+                vectors.data()[i*un + j] = Vbuf[i*un + order[j]];
+        }
+        return {values, vectors};
+    }
+
+    /**
+     * Thin singular value decomposition.
+     * The matrix is first reduced to a square triangular factor with QR and
+     * one sided Jacobi rotations are applied to that factor until its columns
+     * are mutually orthogonal, which gives singular values to high relative
+     * accuracy. Left singular vectors of zero singular values are zero.
+     *
+     * @param a rank 2 tensor of shape m x n.
+     * */
+    template<typename dt>
+    inline SVD<dt> svd(Tensor<dt> const& a){
+        assert(a.rank() == 2);
+        u64 m = a.dim()[0];
+        u64 n = a.dim()[1];
+        if(m < n){
+            SVD<dt> s = svd(Tensor<dt>(a).t());
+            return {s.Vt.t(), s.S, s.U.t()};
+        }
+
+        QR<dt> f = qr(a);
+        // rows of W are the columns of R, rows of Vt the columns of V
+        std::vector<dt> W(n*n), Vt(n*n, dt(0));
+        for(u64 i = 0; i < n; i++){
+            Vt[i*n + i] = dt(1);
+            for(u64 j = 0; j < n; j++)
+                W[j*n + i] = f.R.data()[i*n + j];
+        }
+
+        const dt eps = std::numeric_limits<dt>::epsilon();
+        for(int sweep = 0; sweep < 64; sweep++){
+            bool rotated = false;
+            for(u64 p = 0; p + 1 < n; p++){
+                for(u64 q = p + 1; q < n; q++){
+                    dt* wp = W.data() + p*n;
+                    dt* wq = W.data() + q*n;
+                    dt alpha = 0, beta = 0, gamma = 0;
+                    for(u64 i = 0; i < n; i++){
+                        alpha += wp[i]*wp[i];
+                        beta += wq[i]*wq[i];
+                        gamma += wp[i]*wq[i];
+                    }
+                    if(gamma == dt(0) || std::abs(gamma) <= eps*std::sqrt(alpha*beta)) continue;
+                    rotated = true;
+
+                    dt zeta = (beta - alpha)/(dt(2)*gamma);
+                    dt t = std::copysign(dt(1), zeta)/(std::abs(zeta) + std::sqrt(dt(1) + zeta*zeta));
+                    dt c = dt(1)/std::sqrt(dt(1) + t*t);
+                    dt s = c*t;
+                    dt* vp = Vt.data() + p*n;
+                    dt* vq = Vt.data() + q*n;
+                    for(u64 i = 0; i < n; i++){
+                        dt x = wp[i], y = wq[i];
+                        wp[i] = c*x - s*y;
+                        wq[i] = s*x + c*y;
+                        x = vp[i];
+                        y = vq[i];
+                        vp[i] = c*x - s*y;
+                        vq[i] = s*x + c*y;
+                    }
+                }
+            }
+            if(!rotated) break;
+        }
+
+        std::vector<dt> sigma(n);
+        for(u64 j = 0; j < n; j++){
+            dt s = 0;
+            for(u64 i = 0; i < n; i++) s += W[j*n + i]*W[j*n + i];
+            sigma[j] = std::sqrt(s);
+        }
+        std::vector<u64> order(n);
+        std::iota(order.begin(), order.end(), u64(0));
+        std::sort(order.begin(), order.end(), [&](u64 x, u64 y){ return sigma[x] > sigma[y]; });
+
+        Tensor<dt> S(DimVec{n});
+        Tensor<dt> V({n, n});
+        std::vector<dt> Wn(n*n);
+        for(u64 j = 0; j < n; j++){
+            u64 o = order[j];
+            S.data()[j] = sigma[o];
+            dt inv = sigma[o] > dt(0) ? dt(1)/sigma[o] : dt(0);
+            for(u64 i = 0; i < n; i++){
+                Wn[j*n + i] = W[o*n + i]*inv;
+                V.data()[j*n + i] = Vt[o*n + i];
+            }
+        }
+
+        // U = Q * Wn^T
+        Tensor<dt> U({m, n});
+        gemm(false, true, m, n, n, dt(1), f.Q.data(), n, Wn.data(), n, dt(0), U.data(), n);
+        return {U, S, V};
+    }
+
+    /**
+     * Randomized truncated SVD returning only the top k singular triplets.
+     * A gaussian sketch of the range of A is refined with power iterations
+     * and the SVD of the small projected matrix is lifted back, so the cost is
+     * dominated by a few gemm passes over A instead of a full decomposition.
+     *
+     * @param a rank 2 tensor of shape m x n.
+     * @param k number of singular triplets to keep.
+     * @param oversample extra sketch columns used to improve accuracy.
+     * @param power_iters subspace iterations, more helps slowly decaying spectra.
+     * @param seed seed for the gaussian test matrix.
+     * */
+    template<typename dt>
+    inline SVD<dt> svd_randomized(Tensor<dt> const& a, u64 k, u64 oversample = 10, u64 power_iters = 2, u64 seed = 0){
+        assert(a.rank() == 2);
+        u64 m = a.dim()[0];
+        u64 n = a.dim()[1];
+        k = std::min(k, std::min(m, n));
+        u64 l = std::min(k + oversample, std::min(m, n));
+
+        std::mt19937_64 gen(seed);
+        std::normal_distribution<double> normal;
+        Tensor<dt> omega({n, l});
+        for(u64 i = 0; i < n*l; i++) omega.data()[i] = static_cast<dt>(normal(gen));
+
+        Tensor<dt> Y({m, l});
+        gemm(false, false, m, l, n, dt(1), a.data(), n, omega.data(), l, dt(0), Y.data(), l);
+        Tensor<dt> Q = qr(Y).Q;
+        Tensor<dt> Z({n, l});
+        for(u64 it = 0; it < power_iters; it++){
+            gemm(true, false, n, l, m, dt(1), a.data(), n, Q.data(), l, dt(0), Z.data(), l);
+            Tensor<dt> Qz = qr(Z).Q;
+            gemm(false, false, m, l, n, dt(1), a.data(), n, Qz.data(), l, dt(0), Y.data(), l);
+            Q = qr(Y).Q;
+        }
+
+        // B = Q^T A is small, its SVD gives the top singular triplets of A
+        Tensor<dt> B({l, n});
+        gemm(true, false, l, n, m, dt(1), Q.data(), l, a.data(), n, dt(0), B.data(), n);
+        SVD<dt> sb = svd(B);
+        Tensor<dt> U({m, l});
+        gemm(false, false, m, l, l, dt(1), Q.data(), l, sb.U.data(), l, dt(0), U.data(), l);
+
+        Tensor<dt> S(DimVec{k});
+        Tensor<dt> Vt({k, n});
+        std::copy(sb.S.data(), sb.S.data() + k, S.data());
+        std::copy(sb.Vt.data(), sb.Vt.data() + k*n, Vt.data());
+        return {detail::take_columns(U, k), S, Vt};
+    }
+
+} // namespace Orion
+
+#endif // LINALG_H_
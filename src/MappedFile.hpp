@@ -0,0 +1,56 @@
+#ifndef MAPPEDFILE_H_
+#define MAPPEDFILE_H_
+
+#include <cassert>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Typedefs.hpp"
+
+namespace Orion{
+
+    /**
+     * Read only memory mapping of a whole file, unmapped with the last owner.
+     * */
+    class MappedFile{
+    public:
+        MappedFile(std::string const& path){
+            int fd = ::open(path.c_str(), O_RDONLY);
+            assert(fd >= 0 && "MappedFile: cannot open file");
+            struct stat st;
+            ::fstat(fd, &st);
+            m_size = static_cast<u64>(st.st_size);
+            if(m_size){
+                m_data = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+                assert(m_data != MAP_FAILED && "MappedFile: mmap failed");
+            }
+            ::close(fd);
+        }
+        ~MappedFile(){
+            if(m_size) ::munmap(m_data, m_size);
+        }
+        MappedFile(MappedFile const&) = delete;
+        MappedFile& operator=(MappedFile const&) = delete;
+
+        const unsigned char* data() const{
+            return static_cast<const unsigned char*>(m_data);
+        }
+        u64 size() const{
+            return m_size;
+        }
+        // hint the kernel about the access pattern of upcoming reads
+        void advise(bool random) const{
+            if(m_size) ::madvise(m_data, m_size, random ? MADV_RANDOM : MADV_SEQUENTIAL);
+        }
+    private:
+        void* m_data = nullptr;
+        u64 m_size = 0;
+    };
+
+} // namespace Orion
+
+#endif // MAPPEDFILE_H_
@@ -0,0 +1,358 @@
+#ifndef MEMORY_H_
+#define MEMORY_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "Typedefs.hpp"
+#include "Profiler.hpp"
+
+namespace Orion{
+
+    class PeakWindow;
+
+    // alignment in bytes of every tensor buffer, one cache line
+    constexpr u64 BUFFER_ALIGN = 64;
+
+    /**
+     * Snapshot of tensor buffer usage, counting tensor payload bytes only.
+     * */
+    struct MemoryStats{
+        u64 live_bytes = 0;
+        u64 peak_bytes = 0;
+        u64 live_buffers = 0;
+        u64 allocations = 0;
+        u64 frees = 0;
+        u64 allocated_bytes = 0;
+        // live bytes when the last backward pass started and its high water mark
+        u64 backward_start_bytes = 0;
+        u64 backward_peak_bytes = 0;
+        // backward passes recorded and the highest of their marks, since reset_peak
+        u64 backward_passes = 0;
+        u64 backward_max_peak_bytes = 0;
+    };
+
+    /**
+     * Allocation totals of one tag and shape.
+     * */
+    struct MemorySite{
+        std::string tag;
+        DimVec shape;
+        u64 allocations = 0;
+        u64 bytes = 0;
+        u64 live_bytes = 0;
+        u64 live_buffers = 0;
+    };
+
+    /**
+     * Process wide accounting of tensor buffers. Live and peak bytes are
+     * always tracked with a few atomics per allocation. Per site totals
+     * take a lock on every allocation and are only kept after
+     * track_sites(true).
+     * */
+    class MemoryTracker{
+    public:
+        static MemoryTracker& instance(){
+            static MemoryTracker tracker;
+            return tracker;
+        }
+
+        void track_sites(bool on = true){ m_track_sites.store(on, std::memory_order_relaxed); }
+        bool tracking_sites() const{ return m_track_sites.load(std::memory_order_relaxed); }
+
+        /**
+         * Allocate an uninitialized buffer of n elements aligned to
+         * BUFFER_ALIGN. The buffer is released and accounted for when the
+         * last owner goes away.
+         *
+         * @param shape recorded with the current MemoryTag when sites are tracked.
+         * */
+        template<typename dt>
+        inline std::shared_ptr<dt> allocate(u64 n, DimVec const& shape);
+
+        MemoryStats stats() const{
+            MemoryStats s;
+            s.live_bytes = m_live.load(std::memory_order_relaxed);
+            s.peak_bytes = m_peak.load(std::memory_order_relaxed);
+            s.live_buffers = m_live_buffers.load(std::memory_order_relaxed);
+            s.allocations = m_allocs.load(std::memory_order_relaxed);
+            s.frees = m_frees.load(std::memory_order_relaxed);
+            s.allocated_bytes = m_allocated.load(std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(m_backward_mutex);
+            s.backward_start_bytes = m_backward_start;
+            s.backward_peak_bytes = m_backward_peak;
+            s.backward_passes = m_backward_passes;
+            s.backward_max_peak_bytes = m_backward_max_peak;
+            return s;
+        }
+
+        /**
+         * Per tag and shape totals, largest live bytes first.
+         * */
+        std::vector<MemorySite> sites() const{
+            std::vector<MemorySite> res;
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                for(auto const& kv : m_sites) res.push_back(kv.second);
+            }
+            std::sort(res.begin(), res.end(), [](MemorySite const& a, MemorySite const& b){
+                return a.live_bytes != b.live_bytes ? a.live_bytes > b.live_bytes : a.bytes > b.bytes;
+            });
+            return res;
+        }
+
+        /**
+         * Restart the process peak from the current live bytes and forget
+         * the backward passes recorded so far.
+         * */
+        void reset_peak(){
+            m_peak.store(m_live.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(m_backward_mutex);
+            m_backward_passes = 0;
+            m_backward_max_peak = 0;
+        }
+
+        /**
+         * Keep the window of a finished backward pass. The last pass is
+         * kept as a whole and the highest peak of all of them, passes may
+         * run concurrently, eg. the replicas of DataParallel.
+         * */
+        void record_backward(u64 start_bytes, u64 peak_bytes){
+            std::lock_guard<std::mutex> lock(m_backward_mutex);
+            m_backward_start = start_bytes;
+            m_backward_peak = peak_bytes;
+            m_backward_passes++;
+            m_backward_max_peak = std::max(m_backward_max_peak, peak_bytes);
+        }
+
+        /**
+         * Write totals followed by one line per tracked site.
+         * */
+        inline void write_report(std::ostream& out) const;
+
+    private:
+        friend class PeakWindow;
+
+        struct Deleter{
+            u64 bytes;
+            MemorySite* site;
+            void operator()(void* p) const{
+                MemoryTracker::instance().release(bytes, site);
+                std::free(p);
+            }
+        };
+
+        // peak of one open PeakWindow, claimed by open_window
+        struct WindowSlot{
+            std::atomic<bool> open{false};
+            std::atomic<u64> peak{0};
+        };
+        // windows open at the same time over all threads
+        static constexpr u64 MAX_WINDOWS = 256;
+
+        MemoryTracker() = default;
+
+        inline MemorySite* acquire(u64 bytes, DimVec const& shape);
+        inline void release(u64 bytes, MemorySite* site);
+        inline WindowSlot* open_window();
+        inline void close_window(WindowSlot* slot);
+
+        static void raise(std::atomic<u64>& a, u64 v){
+            u64 cur = a.load(std::memory_order_relaxed);
+            while(cur < v && !a.compare_exchange_weak(cur, v, std::memory_order_relaxed));
+        }
+
+        std::atomic<bool> m_track_sites{false};
+        std::atomic<u64> m_live{0}, m_peak{0}, m_live_buffers{0};
+        std::atomic<u64> m_allocs{0}, m_frees{0}, m_allocated{0};
+        // allocations raise the peaks of the open slots below m_window_slots
+        // while any window is open, without taking a lock
+        std::atomic<u64> m_open_windows{0}, m_window_slots{0};
+        WindowSlot m_windows[MAX_WINDOWS];
+        u64 m_backward_start = 0, m_backward_peak = 0, m_backward_passes = 0, m_backward_max_peak = 0;
+        mutable std::mutex m_mutex, m_backward_mutex;
+        std::map<std::pair<std::string, DimVec>, MemorySite> m_sites;
+    };
+
+    /**
+     * Names the allocations made by this thread while in scope, eg :
+     * MemoryTag tag("forward", "MatMul"). Tags nest, the innermost wins.
+     * */
+    class MemoryTag{
+    public:
+        MemoryTag(const char* category, const char* name) : m_prev(current()){
+            current() = {category, name};
+        }
+        ~MemoryTag(){ current() = m_prev; }
+        MemoryTag(MemoryTag const&) = delete;
+        MemoryTag& operator=(MemoryTag const&) = delete;
+
+        static std::pair<const char*, const char*>& current(){
+            thread_local std::pair<const char*, const char*> tag{nullptr, nullptr};
+            return tag;
+        }
+    private:
+        std::pair<const char*, const char*> m_prev;
+    };
+
+    /**
+     * Tags this thread's allocations as the backward pass of op name
+     * while in scope, including those of the ops run to build it, eg :
+     * the gradient graph of an op under create_graph. Scopes nest, the
+     * innermost wins.
+     * */
+    class BackwardTag{
+    public:
+        explicit BackwardTag(const char* name) : m_tag("backward", name), m_prev(op()){
+            op() = name;
+        }
+        ~BackwardTag(){ op() = m_prev; }
+        BackwardTag(BackwardTag const&) = delete;
+        BackwardTag& operator=(BackwardTag const&) = delete;
+
+        // op whose backward pass this thread is in, nullptr outside of one
+        static const char*& op(){
+            thread_local const char* name = nullptr;
+            return name;
+        }
+    private:
+        MemoryTag m_tag;
+        const char* m_prev;
+    };
+
+    /**
+     * High water mark of live tensor bytes while in scope, eg : the peak
+     * of one training step to size batches against. Every window keeps
+     * its own peak, windows may nest or overlap across threads. An
+     * allocation racing with the opening of a window may or may not
+     * count towards it.
+     * */
+    class PeakWindow{
+    public:
+        PeakWindow() : m_slot(MemoryTracker::instance().open_window()){
+            MemoryTracker& t = MemoryTracker::instance();
+            m_start = t.m_live.load(std::memory_order_relaxed);
+            if(m_slot) MemoryTracker::raise(m_slot->peak, m_start);
+        }
+        ~PeakWindow(){
+            if(m_slot) MemoryTracker::instance().close_window(m_slot);
+        }
+        PeakWindow(PeakWindow const&) = delete;
+        PeakWindow& operator=(PeakWindow const&) = delete;
+
+        u64 start_bytes() const{ return m_start; }
+        // the process peak bounds the window if no slot was free
+        u64 peak_bytes() const{
+            return m_slot ? m_slot->peak.load(std::memory_order_relaxed)
+                          : MemoryTracker::instance().m_peak.load(std::memory_order_relaxed);
+        }
+    private:
+        MemoryTracker::WindowSlot* m_slot;
+        u64 m_start;
+    };
+
+    template<typename dt>
+    inline std::shared_ptr<dt> MemoryTracker::allocate(u64 n, DimVec const& shape){
+        u64 bytes = sizeof(dt)*n;
+        ORION_PROFILE_ALLOC(bytes);
+        MemorySite* site = acquire(bytes, shape);
+        dt* p = reinterpret_cast<dt*>(std::aligned_alloc(BUFFER_ALIGN, (bytes + BUFFER_ALIGN - 1)/BUFFER_ALIGN*BUFFER_ALIGN));
+        return std::shared_ptr<dt>(p, Deleter{bytes, site});
+    }
+
+    inline MemorySite* MemoryTracker::acquire(u64 bytes, DimVec const& shape){
+        u64 live = m_live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+        raise(m_peak, live);
+        if(m_open_windows.load(std::memory_order_relaxed)){
+            u64 slots = m_window_slots.load(std::memory_order_acquire);
+            for(u64 i = 0; i < slots; i++)
+                if(m_windows[i].open.load(std::memory_order_relaxed)) raise(m_windows[i].peak, live);
+        }
+        m_live_buffers.fetch_add(1, std::memory_order_relaxed);
+        m_allocs.fetch_add(1, std::memory_order_relaxed);
+        m_allocated.fetch_add(bytes, std::memory_order_relaxed);
+        if(!tracking_sites()) return nullptr;
+
+        auto const& tag = MemoryTag::current();
+        std::string name = tag.first ? std::string(tag.first) + ' ' + tag.second : std::string("untagged");
+        std::lock_guard<std::mutex> lock(m_mutex);
+        MemorySite& s = m_sites[{name, shape}];
+        if(s.allocations == 0){
+            s.tag = name;
+            s.shape = shape;
+        }
+        s.allocations++;
+        s.bytes += bytes;
+        s.live_bytes += bytes;
+        s.live_buffers++;
+        return &s;
+    }
+
+    inline void MemoryTracker::release(u64 bytes, MemorySite* site){
+        m_live.fetch_sub(bytes, std::memory_order_relaxed);
+        m_live_buffers.fetch_sub(1, std::memory_order_relaxed);
+        m_frees.fetch_add(1, std::memory_order_relaxed);
+        if(!site) return;
+        std::lock_guard<std::mutex> lock(m_mutex);
+        site->live_bytes -= bytes;
+        site->live_buffers--;
+    }
+
+    inline MemoryTracker::WindowSlot* MemoryTracker::open_window(){
+        for(u64 i = 0; i < MAX_WINDOWS; i++){
+            bool closed = false;
+            if(m_windows[i].open.load(std::memory_order_relaxed) ||
+               !m_windows[i].open.compare_exchange_strong(closed, true, std::memory_order_acquire))
+                continue;
+            m_windows[i].peak.store(0, std::memory_order_relaxed);
+            raise(m_window_slots, i + 1);
+            m_open_windows.fetch_add(1, std::memory_order_relaxed);
+            return &m_windows[i];
+        }
+        assert(false && "MemoryTracker: too many open PeakWindows");
+        return nullptr;
+    }
+
+    inline void MemoryTracker::close_window(WindowSlot* slot){
+        m_open_windows.fetch_sub(1, std::memory_order_relaxed);
+        slot->open.store(false, std::memory_order_release);
+    }
+
+    inline void MemoryTracker::write_report(std::ostream& out) const{
+        MemoryStats s = stats();
+        char line[200];
+        auto mb = [](u64 b){ return static_cast<double>(b)/1048576.0; };
+        std::snprintf(line, sizeof(line), "live %.3f MB in %llu buffers, peak %.3f MB, backward peak %.3f MB, %.3f MB over %llu passes\n",
+                      mb(s.live_bytes), static_cast<unsigned long long>(s.live_buffers), mb(s.peak_bytes), mb(s.backward_peak_bytes),
+                      mb(s.backward_max_peak_bytes), static_cast<unsigned long long>(s.backward_passes));
+        out << line;
+        std::snprintf(line, sizeof(line), "%llu allocations, %llu frees, %.3f MB allocated in total\n",
+                      static_cast<unsigned long long>(s.allocations), static_cast<unsigned long long>(s.frees), mb(s.allocated_bytes));
+        out << line;
+
+        std::vector<MemorySite> all = sites();
+        if(all.empty()) return;
+        size_t width = 3;
+        for(auto const& site : all) width = std::max(width, site.tag.size() + 1 + detail::format_shape(site.shape).size());
+        out << "tag" << std::string(width - 3, ' ') << "   allocs    total MB     live MB  live bufs\n";
+        for(auto const& site : all){
+            std::string name = site.tag + ' ' + detail::format_shape(site.shape);
+            std::snprintf(line, sizeof(line), " %8llu %11.3f %11.3f %10llu\n", static_cast<unsigned long long>(site.allocations),
+                          mb(site.bytes), mb(site.live_bytes), static_cast<unsigned long long>(site.live_buffers));
+            out << name << std::string(width - name.size(), ' ') << line;
+        }
+    }
+
+} // namespace Orion
+
+#endif // MEMORY_H_
@@ -0,0 +1,356 @@
+#ifndef NORM_H_
+#define NORM_H_
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+#include "Tensor.hpp"
+#include "Conv.hpp"
+#include "Dispatch.hpp"
+
+/*
+ * Layer and batch normalization. Statistics come from one Welford pass
+ * over the input, which stays accurate for data with a large mean where
+ * E[x^2] - E[x]^2 cancels, and a second pass normalizes and applies the
+ * affine transform. The backward passes read the input and the output
+ * gradient once for the two sums they need and once more to write the
+ * input gradient.
+ * */
+
+namespace Orion{
+
+    /**
+     * Count, mean and sum of squared deviations of a set of values.
+     * */
+    template<typename dt>
+    struct Moments{
+        dt n = 0;
+        dt mean = 0;
+        dt m2 = 0;
+
+        // population variance
+        dt var() const{ return n > 0 ? m2/n : dt(0); }
+
+        // the moments of the union of both sets (Chan et al.)
+        void merge(Moments const& o){
+            dt total = n + o.n;
+            if(o.n == 0) return;
+            dt d = o.mean - mean;
+            mean += d*o.n/total;
+            m2 += o.m2 + d*d*n*o.n/total;
+            n = total;
+        }
+    };
+
+    namespace detail{
+        // interleaved Welford accumulators, independent so the update vectorizes
+        constexpr u64 WELFORD_LANES = 8;
+
+        template<typename dt>
+        ORION_VEC_INLINE Moments<dt> run_moments(const dt* x, u64 n){
+            dt mean[WELFORD_LANES] = {}, m2[WELFORD_LANES] = {};
+            u64 full = n/WELFORD_LANES;
+            for(u64 i = 0; i < full; i++){
+                dt inv = dt(1)/static_cast<dt>(i + 1);
+                for(u64 l = 0; l < WELFORD_LANES; l++){
+                    dt v = x[i*WELFORD_LANES + l];
+                    dt d = v - mean[l];
+                    mean[l] += d*inv;
+                    m2[l] += d*(v - mean[l]);
+                }
+            }
+            Moments<dt> m;
+            for(u64 l = 0; l < WELFORD_LANES; l++) m.merge(Moments<dt>{static_cast<dt>(full), mean[l], m2[l]});
+            for(u64 i = full*WELFORD_LANES; i < n; i++) m.merge(Moments<dt>{dt(1), x[i], dt(0)});
+            return m;
+        }
+
+        /*
+         * Rows of length n. Per row mean and 1/sqrt(var + eps) go to mean
+         * and rstd, y = (x - mean)*rstd*gamma + beta.
+         * */
+        template<typename dt>
+        void layer_norm_forward(u64 rows, u64 n, const dt* x, const dt* gamma, const dt* beta, dt eps, dt* y, dt* mean, dt* rstd){
+            isa_dispatch([&]{
+                for(u64 r = 0; r < rows; r++){
+                    const dt* xr = x + r*n;
+                    dt* yr = y + r*n;
+                    Moments<dt> m = run_moments(xr, n);
+                    dt rs = dt(1)/std::sqrt(m.var() + eps);
+                    for(u64 i = 0; i < n; i++) yr[i] = (xr[i] - m.mean)*rs*gamma[i] + beta[i];
+                    mean[r] = m.mean;
+                    rstd[r] = rs;
+                }
+            });
+        }
+
+        /*
+         * Gradients of layer_norm_forward, accumulated, null pointers skip
+         * an input. With xh = (x - mean)*rstd and g = dy*gamma,
+         * dx = rstd*(g - mean(g) - xh*mean(g*xh)).
+         * */
+        template<typename dt>
+        void layer_norm_backward(u64 rows, u64 n, const dt* x, const dt* gamma, const dt* mean, const dt* rstd, const dt* dy,
+                                 dt* dx, dt* dgamma, dt* dbeta){
+            isa_dispatch([&]{
+                for(u64 r = 0; r < rows; r++){
+                    const dt* xr = x + r*n;
+                    const dt* gr = dy + r*n;
+                    dt mu = mean[r], rs = rstd[r];
+                    dt sg = 0, sgx = 0;
+                    for(u64 i = 0; i < n; i++){
+                        dt xh = (xr[i] - mu)*rs;
+                        dt g = gr[i]*gamma[i];
+                        sg += g;
+                        sgx += g*xh;
+                        if(dgamma) dgamma[i] += gr[i]*xh;
+                        if(dbeta) dbeta[i] += gr[i];
+                    }
+                    if(!dx) continue;
+                    dt inv = dt(1)/static_cast<dt>(n);
+                    sg *= inv;
+                    sgx *= inv;
+                    dt* dr = dx + r*n;
+                    for(u64 i = 0; i < n; i++){
+                        dt xh = (xr[i] - mu)*rs;
+                        dr[i] += rs*(gr[i]*gamma[i] - sg - xh*sgx);
+                    }
+                }
+            });
+        }
+
+        /*
+         * A batch norm input seen as outer x channels x inner, statistics
+         * are per channel over outer and inner. NCHW has outer = N and
+         * inner = H*W, NHWC has outer = N*H*W and inner = 1.
+         * */
+        struct NormGeometry{
+            u64 outer, channels, inner;
+            u64 count() const{ return outer*inner; }
+        };
+
+        inline NormGeometry norm_geometry(DimVec const& x, Layout layout){
+            assert(x.size() >= 2);
+            NormGeometry g;
+            u64 spatial = 1;
+            if(layout == Layout::NCHW || x.size() == 2){
+                for(u64 i = 2; i < x.size(); i++) spatial *= x[i];
+                g = {x[0], x[1], spatial};
+            }else{
+                for(u64 i = 1; i + 1 < x.size(); i++) spatial *= x[i];
+                g = {x[0]*spatial, x.back(), 1};
+            }
+            return g;
+        }
+
+        // per channel moments of x in one pass
+        template<typename dt>
+        void channel_moments(NormGeometry const& g, const dt* x, std::vector<Moments<dt>>& m){
+            m.assign(g.channels, Moments<dt>());
+            isa_dispatch([&]{
+                if(g.inner > 1){
+                    for(u64 o = 0; o < g.outer; o++)
+                        for(u64 c = 0; c < g.channels; c++)
+                            m[c].merge(run_moments(x + (o*g.channels + c)*g.inner, g.inner));
+                    return;
+                }
+                // channels contiguous, a Welford step over a whole row of channels at once
+                thread_local std::vector<dt> mean, m2;
+                mean.assign(g.channels, dt(0));
+                m2.assign(g.channels, dt(0));
+                for(u64 o = 0; o < g.outer; o++){
+                    const dt* xr = x + o*g.channels;
+                    dt inv = dt(1)/static_cast<dt>(o + 1);
+                    for(u64 c = 0; c < g.channels; c++){
+                        dt d = xr[c] - mean[c];
+                        mean[c] += d*inv;
+                        m2[c] += d*(xr[c] - mean[c]);
+                    }
+                }
+                for(u64 c = 0; c < g.channels; c++) m[c] = Moments<dt>{static_cast<dt>(g.outer), mean[c], m2[c]};
+            });
+        }
+
+        // y = x*scale[c] + shift[c] per channel
+        template<typename dt>
+        void channel_affine(NormGeometry const& g, const dt* x, const dt* scale, const dt* shift, dt* y){
+            isa_dispatch([&]{
+                for(u64 o = 0; o < g.outer; o++){
+                    for(u64 c = 0; c < g.channels; c++){
+                        u64 base = (o*g.channels + c)*g.inner;
+                        dt a = scale[c], b = shift[c];
+                        for(u64 i = 0; i < g.inner; i++) y[base + i] = x[base + i]*a + b;
+                    }
+                }
+            });
+        }
+
+        /*
+         * Per channel sums of dy and dy*(x - mean) in one pass.
+         * */
+        template<typename dt>
+        void channel_grad_sums(NormGeometry const& g, const dt* x, const dt* mean, const dt* dy, dt* sdy, dt* sdyx){
+            std::fill(sdy, sdy + g.channels, dt(0));
+            std::fill(sdyx, sdyx + g.channels, dt(0));
+            isa_dispatch([&]{
+                for(u64 o = 0; o < g.outer; o++){
+                    for(u64 c = 0; c < g.channels; c++){
+                        u64 base = (o*g.channels + c)*g.inner;
+                        dt mu = mean[c], s = 0, sx = 0;
+                        for(u64 i = 0; i < g.inner; i++){
+                            s += dy[base + i];
+                            sx += dy[base + i]*(x[base + i] - mu);
+                        }
+                        sdy[c] += s;
+                        sdyx[c] += sx;
+                    }
+                }
+            });
+        }
+
+        /*
+         * Gradients of batch normalization, accumulated, null pointers
+         * skip an input. In training mode mean and rstd are the batch
+         * statistics and the gradient flows through them,
+         * dx = gamma*rstd*(dy - mean(dy) - xh*mean(dy*xh)), otherwise they
+         * are constants and dx = gamma*rstd*dy.
+         * */
+        template<typename dt>
+        void batch_norm_backward(NormGeometry const& g, bool training, const dt* x, const dt* gamma, const dt* mean, const dt* rstd,
+                                 const dt* dy, dt* dx, dt* dgamma, dt* dbeta){
+            std::vector<dt> sdy(g.channels), sdyx(g.channels);
+            channel_grad_sums(g, x, mean, dy, sdy.data(), sdyx.data());
+            for(u64 c = 0; c < g.channels; c++){
+                if(dgamma) dgamma[c] += sdyx[c]*rstd[c];
+                if(dbeta) dbeta[c] += sdy[c];
+            }
+            if(!dx) return;
+            dt inv = dt(1)/static_cast<dt>(g.count());
+            isa_dispatch([&]{
+                for(u64 o = 0; o < g.outer; o++){
+                    for(u64 c = 0; c < g.channels; c++){
+                        u64 base = (o*g.channels + c)*g.inner;
+                        dt k = gamma[c]*rstd[c], mu = mean[c];
+                        dt a = training ? sdy[c]*inv : dt(0);
+                        dt b = training ? sdyx[c]*inv*rstd[c]*rstd[c] : dt(0);
+                        for(u64 i = 0; i < g.inner; i++)
+                            dx[base + i] += k*(dy[base + i] - a - (x[base + i] - mu)*b);
+                    }
+                }
+            });
+        }
+    } // namespace detail
+
+    /**
+     * Normalization over the last dimension.
+     * @param gamma, beta scale and shift, one per element of a row.
+     * @param mean, rstd if not null receive the mean and 1/sqrt(var + eps)
+     * of every row, which is what the backward pass needs.
+     * */
+    template<typename dt>
+    inline Tensor<dt> layer_norm(Tensor<dt> const& x, Tensor<dt> const& gamma, Tensor<dt> const& beta, dt eps = dt(1e-5),
+                                 std::vector<dt>* mean = nullptr, std::vector<dt>* rstd = nullptr){
+        assert(x.rank() >= 1);
+        u64 n = x.dim().back(), rows = n ? x.nelem()/n : 0;
+        assert(gamma.nelem() == n && beta.nelem() == n);
+        std::vector<dt> m, r;
+        if(!mean) mean = &m;
+        if(!rstd) rstd = &r;
+        mean->resize(rows);
+        rstd->resize(rows);
+        Tensor<dt> y(x.dim());
+        detail::layer_norm_forward(rows, n, x.data(), gamma.data(), beta.data(), eps, y.data(), mean->data(), rstd->data());
+        return y;
+    }
+
+    /**
+     * Running statistics of a batch normalization layer, updated by every
+     * training batch and used alone for inference.
+     * */
+    template<typename dt>
+    struct BatchNormState{
+        Tensor<dt> running_mean;
+        Tensor<dt> running_var;
+        // weight of the newest batch in the running averages
+        dt momentum = dt(0.1);
+        dt eps = dt(1e-5);
+
+        BatchNormState() = default;
+        explicit BatchNormState(u64 channels) : running_mean({channels}), running_var({channels}){
+            running_mean.fill(0);
+            running_var.fill(1);
+        }
+    };
+
+    namespace detail{
+        /*
+         * Statistics batch normalization runs with. Training uses those of
+         * x and folds them into the running averages, the variance unbiased
+         * there, inference uses the running averages.
+         * */
+        template<typename dt>
+        void batch_norm_stats(NormGeometry const& g, const dt* x, BatchNormState<dt>& st, bool training, dt* mean, dt* rstd){
+            assert(st.running_mean.nelem() == g.channels && st.running_var.nelem() == g.channels);
+            dt* rm = st.running_mean.data();
+            dt* rv = st.running_var.data();
+            if(!training){
+                for(u64 c = 0; c < g.channels; c++){
+                    mean[c] = rm[c];
+                    rstd[c] = dt(1)/std::sqrt(rv[c] + st.eps);
+                }
+                return;
+            }
+            std::vector<Moments<dt>> m;
+            channel_moments(g, x, m);
+            for(u64 c = 0; c < g.channels; c++){
+                mean[c] = m[c].mean;
+                rstd[c] = dt(1)/std::sqrt(m[c].var() + st.eps);
+                dt unbiased = m[c].n > 1 ? m[c].m2/(m[c].n - 1) : m[c].var();
+                rm[c] += st.momentum*(m[c].mean - rm[c]);
+                rv[c] += st.momentum*(unbiased - rv[c]);
+            }
+        }
+
+        // statistics and the affine transform folded into one scale and shift per channel
+        template<typename dt>
+        void batch_norm_forward(NormGeometry const& g, const dt* x, const dt* gamma, const dt* beta, BatchNormState<dt>& st, bool training,
+                                dt* y, dt* mean, dt* rstd){
+            batch_norm_stats(g, x, st, training, mean, rstd);
+            std::vector<dt> scale(g.channels), shift(g.channels);
+            for(u64 c = 0; c < g.channels; c++){
+                scale[c] = gamma[c]*rstd[c];
+                shift[c] = beta[c] - mean[c]*scale[c];
+            }
+            channel_affine(g, x, scale.data(), shift.data(), y);
+        }
+    } // namespace detail
+
+    /**
+     * Normalization per channel over the batch and spatial dimensions.
+     * @param x {N, C} or an image tensor in the given layout.
+     * @param gamma, beta scale and shift, one per channel.
+     * @param training normalize with the statistics of x and update the
+     * running ones in st, otherwise normalize with the running ones.
+     * @param mean, rstd if not null receive the statistics used per
+     * channel, which is what the backward pass needs.
+     * */
+    template<typename dt>
+    inline Tensor<dt> batch_norm(Tensor<dt> const& x, Tensor<dt> const& gamma, Tensor<dt> const& beta, BatchNormState<dt>& st,
+                                 bool training, Layout layout = Layout::NCHW,
+                                 std::vector<dt>* mean = nullptr, std::vector<dt>* rstd = nullptr){
+        auto g = detail::norm_geometry(x.dim(), layout);
+        assert(gamma.nelem() == g.channels && beta.nelem() == g.channels);
+        std::vector<dt> m, r;
+        if(!mean) mean = &m;
+        if(!rstd) rstd = &r;
+        mean->resize(g.channels);
+        rstd->resize(g.channels);
+        Tensor<dt> y(x.dim());
+        detail::batch_norm_forward(g, x.data(), gamma.data(), beta.data(), st, training, y.data(), mean->data(), rstd->data());
+        return y;
+    }
+
+} // namespace Orion
+
+#endif // NORM_H_
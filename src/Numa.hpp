@@ -0,0 +1,289 @@
+#ifndef NUMA_H_
+#define NUMA_H_
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "Tensor.hpp"
+#include "ThreadPool.hpp"
+
+/*
+ * NUMA placement of tensor buffers and pinning of pool threads.
+ *
+ * Pages of a fresh buffer are placed on the node of the thread that first
+ * writes them. numa_first_touch and parallel_assign split a tensor into
+ * page aligned shares, share t always handled by pool thread t, and pinned
+ * threads keep that node fixed, so every share stays local to the thread
+ * working on it:
+ *
+ *     ThreadPool pool;
+ *     pin_threads(pool);
+ *     Tensor<double> x(dim);
+ *     numa_first_touch(x, pool);
+ *     parallel_assign(x, a%b + c, pool);    // each thread writes its own pages
+ *
+ * Buffers can also be placed explicitly with numa_bind / numa_interleave.
+ * Topology comes from sysfs and placement uses the mbind system call
+ * directly, so no libnuma is needed. Elsewhere everything is a single node
+ * and placement calls return false.
+ * */
+
+namespace Orion{
+
+    /**
+     * Nodes of the machine and the CPUs this process may run on in each.
+     * */
+    class NumaTopology{
+    public:
+        static NumaTopology const& instance(){
+            static NumaTopology topology;
+            return topology;
+        }
+
+        u64 nodes() const{ return m_cpus.size(); }
+        std::vector<int> const& cpus(u64 node) const{ return m_cpus[node]; }
+
+        // node of a CPU, 0 for unknown CPUs
+        u64 node_of_cpu(int cpu) const{
+            for(u64 n = 0; n < m_cpus.size(); n++)
+                if(std::find(m_cpus[n].begin(), m_cpus[n].end(), cpu) != m_cpus[n].end()) return n;
+            return 0;
+        }
+
+        /**
+         * CPU for pool thread t. Threads are dealt to nodes in turn so a
+         * pool of any size spreads over all memory controllers.
+         * */
+        int cpu_for_thread(u64 t) const{
+            return m_order[t%m_order.size()];
+        }
+        u64 node_for_thread(u64 t) const{
+            return node_of_cpu(cpu_for_thread(t));
+        }
+
+    private:
+        NumaTopology(){
+            std::vector<int> allowed;
+#if defined(__linux__)
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            if(sched_getaffinity(0, sizeof(set), &set) == 0)
+                for(int c = 0; c < CPU_SETSIZE; c++)
+                    if(CPU_ISSET(c, &set)) allowed.push_back(c);
+            for(u64 n = 0; ; n++){
+                std::string path = "/sys/devices/system/node/node" + std::to_string(n) + "/cpulist";
+                std::FILE* f = std::fopen(path.c_str(), "r");
+                if(!f) break;
+                char buf[4096];
+                size_t len = std::fread(buf, 1, sizeof(buf) - 1, f);
+                std::fclose(f);
+                buf[len] = 0;
+                std::vector<int> cpus;
+                for(int c : parse_cpulist(buf))
+                    if(std::find(allowed.begin(), allowed.end(), c) != allowed.end()) cpus.push_back(c);
+                m_cpus.push_back(cpus);
+            }
+            // memory only nodes have no CPUs to run threads on
+            m_cpus.erase(std::remove_if(m_cpus.begin(), m_cpus.end(), [](std::vector<int> const& c){ return c.empty(); }), m_cpus.end());
+#endif
+            if(m_cpus.empty()){
+                if(allowed.empty()) allowed.push_back(0);
+                m_cpus.push_back(allowed);
+            }
+            for(u64 k = 0; m_order.size() < count(); k++)
+                for(auto const& c : m_cpus)
+                    if(k < c.size()) m_order.push_back(c[k]);
+        }
+
+        u64 count() const{
+            u64 n = 0;
+            for(auto const& c : m_cpus) n += c.size();
+            return n;
+        }
+
+        // "0-3,8,10-11"
+        static std::vector<int> parse_cpulist(const char* s){
+            std::vector<int> res;
+            while(*s){
+                char* end;
+                long lo = std::strtol(s, &end, 10);
+                if(end == s) break;
+                long hi = lo;
+                s = end;
+                if(*s == '-'){
+                    hi = std::strtol(s + 1, &end, 10);
+                    s = end;
+                }
+                for(long c = lo; c <= hi; c++) res.push_back(static_cast<int>(c));
+                while(*s == ',' || *s == '\n') s++;
+            }
+            return res;
+        }
+
+        std::vector<std::vector<int>> m_cpus;
+        std::vector<int> m_order;
+    };
+
+    /**
+     * Restrict the calling thread to one CPU.
+     * @return false where affinity is not supported or not allowed.
+     * */
+    inline bool pin_current_thread(int cpu){
+#if defined(__linux__)
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+        static_cast<void>(cpu);
+        return false;
+#endif
+    }
+
+    /**
+     * Pin every thread of the pool, the calling thread included as it is
+     * thread 0, to NumaTopology::cpu_for_thread.
+     * @return true if all threads were pinned.
+     * */
+    inline bool pin_threads(ThreadPool& pool){
+        std::vector<char> ok(pool.size(), 0);
+        NumaTopology const& topo = NumaTopology::instance();
+        pool.for_each_thread([&](u64 t){ ok[t] = pin_current_thread(topo.cpu_for_thread(t)); });
+        return std::all_of(ok.begin(), ok.end(), [](char c){ return c != 0; });
+    }
+
+    namespace detail{
+        constexpr int MPOL_BIND_MODE = 2;
+        constexpr int MPOL_INTERLEAVE_MODE = 3;
+        constexpr unsigned MPOL_MF_MOVE_FLAG = 1u << 1;
+
+        inline u64 page_size(){
+#if defined(__linux__)
+            static const u64 size = static_cast<u64>(sysconf(_SC_PAGESIZE));
+            return size;
+#else
+            return 4096;
+#endif
+        }
+
+        // whole pages inside [p, p + bytes)
+        inline bool mbind_pages(void* p, u64 bytes, int mode, unsigned long mask){
+#if defined(__linux__) && defined(SYS_mbind)
+            u64 page = page_size();
+            u64 lo = (reinterpret_cast<std::uintptr_t>(p) + page - 1)/page*page;
+            u64 hi = (reinterpret_cast<std::uintptr_t>(p) + bytes)/page*page;
+            if(hi <= lo) return true;
+            // maxnode counts one past the highest node bit, as the kernel drops the last bit
+            long r = syscall(SYS_mbind, lo, hi - lo, mode, &mask, sizeof(mask)*8 + 1, MPOL_MF_MOVE_FLAG);
+            return r == 0;
+#else
+            static_cast<void>(p);
+            static_cast<void>(bytes);
+            static_cast<void>(mode);
+            static_cast<void>(mask);
+            return false;
+#endif
+        }
+
+        // node bit set for the at most 64 nodes addressed here
+        inline unsigned long node_mask(u64 node){
+            return node < 64 ? 1ul << node : 0ul;
+        }
+    } // namespace detail
+
+    /**
+     * Share t of parts of n elements of buffer data. Boundaries fall on
+     * page boundaries of the actual addresses, so shares never split a
+     * page and each page has a single owner.
+     * */
+    template<typename dt>
+    inline std::pair<u64, u64> numa_partition(const dt* data, u64 n, u64 t, u64 parts){
+        u64 page = detail::page_size();
+        std::uintptr_t base = reinterpret_cast<std::uintptr_t>(data);
+        auto cut = [&](u64 k){
+            if(k == 0) return u64(0);
+            if(k >= parts) return n;
+            std::uintptr_t addr = base + n*k/parts*sizeof(dt);
+            addr = (addr + page - 1)/page*page;
+            return std::min(n, static_cast<u64>(addr - base)/sizeof(dt));
+        };
+        return {cut(t), cut(t + 1)};
+    }
+
+    /**
+     * Move the pages of [p, p + bytes) to a node and keep them there.
+     * @return false where binding is not supported or failed.
+     * */
+    inline bool numa_bind(void* p, u64 bytes, u64 node){
+        return detail::mbind_pages(p, bytes, detail::MPOL_BIND_MODE, detail::node_mask(node));
+    }
+
+    /**
+     * Spread the pages of [p, p + bytes) round robin over all nodes, for
+     * buffers read by every thread such as shared weights.
+     * */
+    inline bool numa_interleave(void* p, u64 bytes){
+        unsigned long mask = 0;
+        for(u64 n = 0; n < NumaTopology::instance().nodes(); n++) mask |= detail::node_mask(n);
+        return detail::mbind_pages(p, bytes, detail::MPOL_INTERLEAVE_MODE, mask);
+    }
+
+    /**
+     * Zero a fresh tensor with every pool thread writing its own share,
+     * which places the pages of each share on the node of its thread.
+     * Must come before anything else writes the buffer.
+     * */
+    template<typename dt>
+    void numa_first_touch(Tensor<dt>& t, ThreadPool& pool){
+        pool.for_each_thread([&](u64 k){
+            auto r = numa_partition(t.data(), t.nelem(), k, pool.size());
+            std::fill(t.data() + r.first, t.data() + r.second, dt(0));
+        });
+    }
+
+    /**
+     * Bind the share of every pool thread to the node of its CPU, moving
+     * pages already placed elsewhere.
+     * @return false where binding is not supported or failed.
+     * */
+    template<typename dt>
+    bool numa_bind_shares(Tensor<dt>& t, ThreadPool& pool){
+        bool ok = true;
+        NumaTopology const& topo = NumaTopology::instance();
+        for(u64 k = 0; k < pool.size(); k++){
+            auto r = numa_partition(t.data(), t.nelem(), k, pool.size());
+            ok = numa_bind(t.data() + r.first, (r.second - r.first)*sizeof(dt), topo.node_for_thread(k)) && ok;
+        }
+        return ok;
+    }
+
+    /**
+     * t.assign(expr) split over the pool, every thread evaluating the
+     * share it first touched. Below eval_params().parallel_min elements
+     * the calling thread evaluates everything.
+     * */
+    template<typename dt, typename E>
+    Tensor<dt>& parallel_assign(Tensor<dt>& t, TensorBase<E> const& expr, ThreadPool& pool){
+        if(t.nelem() < eval_params().parallel_min) return t.assign(expr);
+        pool.for_each_thread([&](u64 k){
+            auto r = numa_partition(t.data(), t.nelem(), k, pool.size());
+            t.assign(expr, r.first, r.second);
+        });
+        return t;
+    }
+
+} // namespace Orion
+
+#endif // NUMA_H_
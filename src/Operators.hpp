@@ -2,9 +2,13 @@
 #define OPERATOR_H
 
 #include "Expressions.hpp"
+#include "Gemm.hpp"
+#include "Strassen.hpp"
+#include "VecMath.hpp"
 
 #include <functional>
 #include <cmath>
+#include <complex>
 
 namespace Orion{
 
@@ -13,12 +17,12 @@ namespace Orion{
         return BinaryExpr(*static_cast<const E1*>(&u), *static_cast<const E2*>(&v), std::plus<>{});
     }
 
-    template<typename E1, typename Scalar, std::enable_if_t<std::is_scalar<Scalar>::value, bool> = true>
+    template<typename E1, typename Scalar, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
     inline auto operator+(TensorBase<E1> const& u, Scalar v){
     return BinaryScalarExpr(*static_cast<const E1*>(&u), v, std::plus{});
     }
 
-    template<typename E1, typename Scalar, std::enable_if_t<std::is_scalar<Scalar>::value, bool> = true>
+    template<typename E1, typename Scalar, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
     inline auto operator+(Scalar v, TensorBase<E1> const& u){
         return u + v;
     }
@@ -41,23 +45,23 @@ namespace Orion{
         return BinaryExpr(*static_cast<const E1*>(&u), *static_cast<const E2*>(&v), std::multiplies<>{});
     }
 
-    template<typename E1, typename Scalar, std::enable_if_t<std::is_scalar<Scalar>::value, bool> = true>
+    template<typename E1, typename Scalar, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
     inline auto operator%(TensorBase<E1> const& u, Scalar v){
         return BinaryScalarExpr(*static_cast<const E1*>(&u), v, std::multiplies<>{});
     }
-    template<typename E1, typename Scalar, std::enable_if_t<std::is_scalar<Scalar>::value, bool> = true>
+    template<typename E1, typename Scalar, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
     inline auto operator%(Scalar v, TensorBase<E1> const& u){
         return u*v;
     }
 
     using namespace std::placeholders;
-    template<typename E1, typename Scalar, std::enable_if_t<std::is_scalar<Scalar>::value, bool> = true>
+    template<typename E1, typename Scalar, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
     inline auto operator-(TensorBase<E1> const& u, Scalar v){
         auto minus_scalar = std::bind(std::minus<>{}, _1, v);
         return UnaryExpr(*static_cast<const E1*>(&u), minus_scalar);
     }
 
-    template<typename Scalar, typename E1, std::enable_if_t<std::is_scalar<Scalar>::value, bool> = true>
+    template<typename Scalar, typename E1, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
     inline auto operator-(Scalar u, TensorBase<E1> const& v){
         auto minus_scalar = std::bind(std::minus<>{}, u, _1);
         return UnaryExpr(*static_cast<const E1*>(&v), minus_scalar);
@@ -86,8 +90,8 @@ namespace Orion{
     
     struct expo{
         template<typename T>
-        inline auto operator()(const T& x) const{
-            return std::exp(x);
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return vexp(x);
         }
     };
 
@@ -96,13 +100,97 @@ namespace Orion{
         return UnaryExpr(*static_cast<const E1*>(&u), expo{});
     }
 
+    struct log_f{
+        template<typename T>
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return vlog(x);
+        }
+    };
+
+    template<typename E1>
+    inline auto log_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), log_f{});
+    }
+
+    struct tanh_f{
+        template<typename T>
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return vtanh(x);
+        }
+    };
+
+    template<typename E1>
+    inline auto tanh_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), tanh_f{});
+    }
+
+    struct sigmoid_f{
+        template<typename T>
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return vsigmoid(x);
+        }
+    };
+
+    template<typename E1>
+    inline auto sigmoid_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), sigmoid_f{});
+    }
+
+    struct erf_f{
+        template<typename T>
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return verf(x);
+        }
+    };
+
+    template<typename E1>
+    inline auto erf_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), erf_f{});
+    }
+
+    struct gelu_f{
+        template<typename T>
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return vgelu(x);
+        }
+    };
+
+    template<typename E1>
+    inline auto gelu_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), gelu_f{});
+    }
+
+    struct sqrt_f{
+        template<typename T>
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return vsqrt(x);
+        }
+    };
+
+    template<typename E1>
+    inline auto sqrt_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), sqrt_f{});
+    }
+
+    struct rsqrt_f{
+        template<typename T>
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return vrsqrt(x);
+        }
+    };
+
+    template<typename E1>
+    inline auto rsqrt_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), rsqrt_f{});
+    }
+
     struct pow_t{
         int _p;
         pow_t(int p) : _p(p){}
 
         template<typename T>
-        inline auto operator()(const T& x) const{
-            return std::pow(x, _p);
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return ipow(x, _p);
         }
     };
 
@@ -111,6 +199,92 @@ namespace Orion{
         return UnaryExpr(*static_cast<const E1*>(&u), pow_t(p));
     }
 
+    template<int N>
+    struct ipow_t{
+        template<typename T>
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return ipow<N>(x);
+        }
+    };
+
+    /**
+     * Power with the exponent known at compile time, eg : pow<2>(x).
+     * Expands to a fixed chain of multiplications.
+     * */
+    template<int N, typename E1>
+    inline auto pow(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), ipow_t<N>{});
+    }
+
+    /*
+     * Parts of complex elements. real_t, imag_t and abs_t give real
+     * tensors, complex_t turns a real tensor complex. On real elements
+     * real_t and conj_t are the identity and abs_t the absolute value.
+     * */
+    struct real_f{
+        template<typename T>
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return std::real(x);
+        }
+    };
+    struct imag_f{
+        template<typename T>
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return std::imag(x);
+        }
+    };
+    struct abs_f{
+        template<typename T>
+        ORION_VEC_INLINE auto operator()(const T& x) const{
+            return std::abs(x);
+        }
+    };
+    struct conj_f{
+        template<typename T>
+        ORION_VEC_INLINE T operator()(const T& x) const{
+            if constexpr(std::is_same<T, typename detail::real_of<T>::type>::value) return x;
+            else return T(x.real(), -x.imag());
+        }
+    };
+    struct complex_f{
+        template<typename T>
+        ORION_VEC_INLINE std::complex<T> operator()(const T& x) const{
+            return std::complex<T>(x);
+        }
+    };
+
+    namespace detail{
+        template<typename E>
+        struct unary_value_type<E, real_f>{ typedef typename real_of<typename E::value_type>::type type; };
+        template<typename E>
+        struct unary_value_type<E, imag_f>{ typedef typename real_of<typename E::value_type>::type type; };
+        template<typename E>
+        struct unary_value_type<E, abs_f>{ typedef typename real_of<typename E::value_type>::type type; };
+        template<typename E>
+        struct unary_value_type<E, complex_f>{ typedef std::complex<typename E::value_type> type; };
+    } // namespace detail
+
+    template<typename E1>
+    inline auto real_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), real_f{});
+    }
+    template<typename E1>
+    inline auto imag_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), imag_f{});
+    }
+    template<typename E1>
+    inline auto abs_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), abs_f{});
+    }
+    template<typename E1>
+    inline auto conj_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), conj_f{});
+    }
+    template<typename E1>
+    inline auto complex_t(TensorBase<E1> const& u){
+        return UnaryExpr(*static_cast<const E1*>(&u), complex_f{});
+    }
+
     template<typename E1, typename E2>
     inline auto operator*(TensorBase<E1> const& u, TensorBase<E2> const& v){
         assert(u.rank() == 2 && v.rank() == 2);
@@ -118,17 +292,16 @@ namespace Orion{
         auto& s2 = v.dim();
         assert(s1[1] == s2[0]);
         static_assert(std::is_same<typename E1::value_type,typename E2::value_type>::value, "Matmul: Different element types!");
-        Tensor<typename E1::value_type> t({s1[0], s2[1]});
-        auto data = t.data();
-        for(u64 i = 0; i < s1[0]; i++){
-            for(u64 j = 0; j < s2[1];j++){
-                u64 pos = i*s2[1]+j;
-                data[pos] = 0;
-                for(u64 k = 0; k < s1[1]; k++){
-                    data[pos] += u[i*s1[1] + k]*v[k*s2[1]+j];
-                }
-            }
-        }
+        typedef typename E1::value_type dt;
+
+        // expressions are materialized once instead of being re-evaluated per product term
+        Tensor<dt> a = static_cast<E1 const&>(u);
+        Tensor<dt> b = static_cast<E2 const&>(v);
+        Tensor<dt> t({s1[0], s2[1]});
+        if(matmul_algorithm() == MatmulAlgorithm::Strassen)
+            strassen(s1[0], s2[1], s1[1], a.data(), s1[1], b.data(), s2[1], t.data(), s2[1]);
+        else
+            gemm(false, false, s1[0], s2[1], s1[1], dt(1), a.data(), s1[1], b.data(), s2[1], dt(0), t.data(), s2[1]);
         return t;
     }
 
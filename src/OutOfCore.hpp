@@ -0,0 +1,372 @@
+#ifndef OUTOFCORE_H_
+#define OUTOFCORE_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Tensor.hpp"
+#include "ThreadPool.hpp"
+#include "Gemm.hpp"
+
+/*
+ * Matrices larger than memory, stored in a file as square tiles. Only the
+ * tiles in use are held in memory, and the file is read and written by a
+ * background thread while the caller computes, so work on them is bound by
+ * disk bandwidth rather than stalled by it.
+ *
+ *     TiledTensor<double> a("a.bin", m, k), b("b.bin", k, n), c("c.bin", m, n);
+ *     ...fill a and b with write_tile or from_tensor...
+ *     ooc_gemm(c, a, b, u64(4) << 30);                 // in 4 GB of tiles
+ *     ooc_map(c, [](auto const& x){ return tanh_t(x); }, c);
+ * */
+
+namespace Orion{
+
+    namespace detail{
+        constexpr char tiled_magic[8] = {'O', 'R', 'I', 'O', 'N', 'T', 'T', '1'};
+        // tiles start after one page holding the header, so they stay page aligned
+        constexpr u64 tiled_header = 4096;
+
+        struct TiledHeader{
+            char magic[8];
+            u64 rows;
+            u64 cols;
+            u64 tile;
+            u64 elem_size;
+        };
+
+        /*
+         * Open file of a tiled tensor, closed with its last handle.
+         * */
+        class TileFile{
+        public:
+            TileFile(std::string const& path, bool create){
+                m_fd = ::open(path.c_str(), create ? O_RDWR | O_CREAT | O_TRUNC : O_RDWR, 0644);
+                assert(m_fd >= 0 && "TiledTensor: cannot open file");
+            }
+            ~TileFile(){
+                if(m_fd >= 0) ::close(m_fd);
+            }
+            TileFile(TileFile const&) = delete;
+            TileFile& operator=(TileFile const&) = delete;
+
+            // whole transfers, short reads and writes are continued
+            void read(void* buf, u64 bytes, u64 offset) const{
+                char* p = static_cast<char*>(buf);
+                while(bytes){
+                    ssize_t r = ::pread(m_fd, p, bytes, static_cast<off_t>(offset));
+                    assert(r > 0 && "TiledTensor: read failed");
+                    if(r <= 0) return;
+                    p += r;
+                    bytes -= static_cast<u64>(r);
+                    offset += static_cast<u64>(r);
+                }
+            }
+            void write(const void* buf, u64 bytes, u64 offset) const{
+                const char* p = static_cast<const char*>(buf);
+                while(bytes){
+                    ssize_t r = ::pwrite(m_fd, p, bytes, static_cast<off_t>(offset));
+                    assert(r > 0 && "TiledTensor: write failed");
+                    if(r <= 0) return;
+                    p += r;
+                    bytes -= static_cast<u64>(r);
+                    offset += static_cast<u64>(r);
+                }
+            }
+            void resize(u64 bytes) const{
+                int r = ::ftruncate(m_fd, static_cast<off_t>(bytes));
+                assert(r == 0 && "TiledTensor: cannot size file");
+                static_cast<void>(r);
+            }
+            u64 size() const{
+                struct stat st;
+                ::fstat(m_fd, &st);
+                return static_cast<u64>(st.st_size);
+            }
+
+        private:
+            int m_fd = -1;
+        };
+
+        /*
+         * Background thread doing the file transfers of one out of core op
+         * in the order they were queued, so reads ahead and writes behind
+         * overlap the computation on the calling thread.
+         * */
+        class TileIO{
+        public:
+            TileIO() : m_pool(2){}
+
+            std::shared_future<void> submit(std::function<void()> f){
+                auto done = std::make_shared<std::promise<void>>();
+                std::shared_future<void> res = done->get_future().share();
+                m_pool.submit([f, done]{
+                    f();
+                    done->set_value();
+                });
+                return res;
+            }
+
+        private:
+            ThreadPool m_pool;
+        };
+    } // namespace detail
+
+    /**
+     * Matrix kept in a file as tile x tile blocks, each block stored row
+     * major and contiguous so it is one sequential read. Edge blocks are
+     * stored full size, the part outside the matrix is unused. Copies
+     * share the same file.
+     * */
+    template<typename dt>
+    class TiledTensor{
+    public:
+        typedef dt value_type;
+
+        /**
+         * Create the file at path, all elements zero.
+         * */
+        TiledTensor(std::string const& path, u64 rows, u64 cols, u64 tile = 1024)
+            : m_file(std::make_shared<detail::TileFile>(path, true)), m_rows(rows), m_cols(cols), m_tile(tile){
+            assert(tile > 0);
+            detail::TiledHeader h{};
+            std::memcpy(h.magic, detail::tiled_magic, sizeof(h.magic));
+            h.rows = rows;
+            h.cols = cols;
+            h.tile = tile;
+            h.elem_size = sizeof(dt);
+            m_file->resize(detail::tiled_header + tile_rows()*tile_cols()*tile_bytes());
+            m_file->write(&h, sizeof(h), 0);
+        }
+
+        /**
+         * Open a file written by a TiledTensor of the same element type.
+         * */
+        explicit TiledTensor(std::string const& path) : m_file(std::make_shared<detail::TileFile>(path, false)){
+            detail::TiledHeader h{};
+            m_file->read(&h, sizeof(h), 0);
+            assert(std::memcmp(h.magic, detail::tiled_magic, sizeof(h.magic)) == 0 && "TiledTensor: not a tiled tensor file");
+            assert(h.elem_size == sizeof(dt) && "TiledTensor: element type differs");
+            m_rows = h.rows;
+            m_cols = h.cols;
+            m_tile = h.tile;
+            assert(m_file->size() >= detail::tiled_header + tile_rows()*tile_cols()*tile_bytes() && "TiledTensor: file truncated");
+        }
+
+        inline u64 rows() const{ return m_rows; }
+        inline u64 cols() const{ return m_cols; }
+        inline u64 tile() const{ return m_tile; }
+        inline DimVec dim() const{ return DimVec{m_rows, m_cols}; }
+
+        // tiles along each axis
+        inline u64 tile_rows() const{ return (m_rows + m_tile - 1)/m_tile; }
+        inline u64 tile_cols() const{ return (m_cols + m_tile - 1)/m_tile; }
+        // rows and columns of tile (ti, tj) inside the matrix
+        inline u64 tile_height(u64 ti) const{ return std::min(m_tile, m_rows - ti*m_tile); }
+        inline u64 tile_width(u64 tj) const{ return std::min(m_tile, m_cols - tj*m_tile); }
+        inline u64 tile_elems() const{ return m_tile*m_tile; }
+        inline u64 tile_bytes() const{ return tile_elems()*sizeof(dt); }
+
+        /**
+         * Read tile (ti, tj) into buf of tile_elems() elements, row stride tile().
+         * */
+        void read_tile(u64 ti, u64 tj, dt* buf) const{
+            m_file->read(buf, tile_bytes(), offset(ti, tj));
+        }
+
+        /**
+         * Write tile (ti, tj) from buf of tile_elems() elements, row stride tile().
+         * */
+        void write_tile(u64 ti, u64 tj, const dt* buf) const{
+            m_file->write(buf, tile_bytes(), offset(ti, tj));
+        }
+
+        /**
+         * Copy a matrix of the same shape in memory to the file.
+         * */
+        void from_tensor(Tensor<dt> const& t) const{
+            assert(t.rank() == 2 && t.dim()[0] == m_rows && t.dim()[1] == m_cols);
+            std::vector<dt> buf(tile_elems(), dt(0));
+            for(u64 ti = 0; ti < tile_rows(); ti++)
+                for(u64 tj = 0; tj < tile_cols(); tj++){
+                    u64 h = tile_height(ti), w = tile_width(tj);
+                    for(u64 i = 0; i < h; i++)
+                        std::memcpy(buf.data() + i*m_tile, t.data() + (ti*m_tile + i)*m_cols + tj*m_tile, w*sizeof(dt));
+                    write_tile(ti, tj, buf.data());
+                }
+        }
+
+        /**
+         * Whole matrix in memory, for results that fit.
+         * */
+        Tensor<dt> to_tensor() const{
+            Tensor<dt> t(dim());
+            std::vector<dt> buf(tile_elems());
+            for(u64 ti = 0; ti < tile_rows(); ti++)
+                for(u64 tj = 0; tj < tile_cols(); tj++){
+                    read_tile(ti, tj, buf.data());
+                    u64 h = tile_height(ti), w = tile_width(tj);
+                    for(u64 i = 0; i < h; i++)
+                        std::memcpy(t.data() + (ti*m_tile + i)*m_cols + tj*m_tile, buf.data() + i*m_tile, w*sizeof(dt));
+                }
+            return t;
+        }
+
+    private:
+        inline u64 offset(u64 ti, u64 tj) const{
+            assert(ti < tile_rows() && tj < tile_cols());
+            return detail::tiled_header + (ti*tile_cols() + tj)*tile_bytes();
+        }
+
+        std::shared_ptr<detail::TileFile> m_file;
+        u64 m_rows = 0;
+        u64 m_cols = 0;
+        u64 m_tile = 0;
+    };
+
+    /**
+     * out = f(in...) tile by tile, f building an element wise expression
+     * of tile x tile tensors, eg : [](auto const& a, auto const& b){ return a%b + 1.0; }.
+     * Every operand has the shape and tile size of out, and out may be
+     * one of the inputs. Two tiles of every operand are in memory, the
+     * next ones are read and the previous result written while one is
+     * evaluated.
+     * */
+    template<typename dt, typename F, typename... In>
+    void ooc_map(TiledTensor<dt> const& out, F f, TiledTensor<In> const&... in){
+        bool same[] = {true, (in.rows() == out.rows() && in.cols() == out.cols() && in.tile() == out.tile())...};
+        for(bool s : same) assert(s && "ooc_map: operands differ in shape or tile size");
+        static_cast<void>(same);
+
+        u64 tiles = out.tile_rows()*out.tile_cols(), tc = out.tile_cols();
+        if(tiles == 0) return;
+        DimVec tdim{out.tile(), out.tile()};
+        std::vector<Tensor<dt>> res{Tensor<dt>(tdim), Tensor<dt>(tdim)};
+        std::tuple<std::vector<Tensor<In>>...> bufs{std::vector<Tensor<In>>{Tensor<In>(tdim), Tensor<In>(tdim)}...};
+        std::shared_future<void> loaded[2], stored[2];
+
+        detail::TileIO io;
+        auto load = [&](u64 k){
+            u64 s = k%2;
+            loaded[s] = io.submit([&, k, s]{
+                std::apply([&](auto&... b){ (in.read_tile(k/tc, k%tc, b[s].data()), ...); }, bufs);
+            });
+        };
+        load(0);
+        for(u64 k = 0; k < tiles; k++){
+            u64 s = k%2;
+            if(k + 1 < tiles) load(k + 1);
+            loaded[s].wait();
+            if(stored[s].valid()) stored[s].wait();
+            std::apply([&](auto&... b){ res[s].assign(f(b[s]...)); }, bufs);
+            stored[s] = io.submit([&, k, s]{ out.write_tile(k/tc, k%tc, res[s].data()); });
+        }
+        for(auto& w : stored)
+            if(w.valid()) w.wait();
+    }
+
+    /**
+     * C = A * B on tiled matrices of the same tile size, using at most
+     * memory bytes of tiles.
+     *
+     * C is computed in blocks of bm x bn tiles held in memory, as large
+     * and as square as the budget allows: A is then read tile_cols(C)/bn
+     * times and B tile_rows(C)/bm times, the least traffic for the budget.
+     * For every block the panels of A and B along K are streamed in,
+     * the next panel being read while the current one is multiplied. Two
+     * blocks of C are kept, so a finished block is written while the next
+     * one is computed in the other.
+     *
+     * @param memory bytes of tiles to use, at least six tiles.
+     * @param pool threads multiplying the tiles of a block, or null.
+     * */
+    template<typename dt>
+    void ooc_gemm(TiledTensor<dt> const& C, TiledTensor<dt> const& A, TiledTensor<dt> const& B, u64 memory, ThreadPool* pool = nullptr){
+        assert(A.cols() == B.rows() && C.rows() == A.rows() && C.cols() == B.cols());
+        assert(A.tile() == C.tile() && B.tile() == C.tile() && "ooc_gemm: tile sizes differ");
+        u64 T = C.tile(), Mt = C.tile_rows(), Nt = C.tile_cols(), Kt = A.tile_cols();
+        if(Mt == 0 || Nt == 0) return;
+
+        // two blocks of bm*bn tiles and two panels of bm + bn tiles
+        u64 budget = std::max<u64>(6, memory/C.tile_bytes());
+        assert(memory/C.tile_bytes() >= 6 && "ooc_gemm: memory below six tiles");
+        u64 b = 1;
+        while(2*(b + 1)*(b + 1) + 4*(b + 1) <= budget) b++;
+        u64 bm = std::min(b, Mt);
+        u64 bn = std::max<u64>(1, std::min(Nt, (budget - 2*bm)/(2*bm + 2)));
+
+        std::vector<dt> cbuf[2];
+        for(auto& c : cbuf) c.resize(bm*bn*C.tile_elems());
+        std::vector<dt> panel[2];
+        for(auto& p : panel) p.resize((bm + bn)*C.tile_elems());
+        std::shared_future<void> loaded[2], stored[2];
+
+        // blocks in row major order of C, every block running over all of K
+        struct Step{ u64 i0, j0, h, w, kt; };
+        std::vector<Step> steps;
+        for(u64 i0 = 0; i0 < Mt; i0 += bm)
+            for(u64 j0 = 0; j0 < Nt; j0 += bn)
+                for(u64 kt = 0; kt < std::max<u64>(Kt, 1); kt++)
+                    steps.push_back({i0, j0, std::min(bm, Mt - i0), std::min(bn, Nt - j0), kt});
+
+        detail::TileIO io;
+        auto load = [&](u64 s){
+            Step st = steps[s];
+            dt* p = panel[s%2].data();
+            loaded[s%2] = io.submit([&A, &B, &C, st, p, Kt]{
+                if(Kt == 0) return;
+                for(u64 i = 0; i < st.h; i++) A.read_tile(st.i0 + i, st.kt, p + i*C.tile_elems());
+                for(u64 j = 0; j < st.w; j++) B.read_tile(st.kt, st.j0 + j, p + (st.h + j)*C.tile_elems());
+            });
+        };
+
+        load(0);
+        u64 block = 0;
+        for(u64 s = 0; s < steps.size(); s++){
+            Step st = steps[s];
+            if(s + 1 < steps.size()) load(s + 1);
+            std::vector<dt>& cb = cbuf[block%2];
+            if(st.kt == 0){
+                // the block before last is written from this buffer before it is cleared
+                if(stored[block%2].valid()) stored[block%2].wait();
+                std::fill(cb.begin(), cb.end(), dt(0));
+            }
+            loaded[s%2].wait();
+            if(Kt > 0){
+                const dt* p = panel[s%2].data();
+                u64 kd = A.tile_width(st.kt);
+                auto multiply = [&](u64 t){
+                    u64 i = t/st.w, j = t%st.w;
+                    gemm(false, false, C.tile_height(st.i0 + i), C.tile_width(st.j0 + j), kd,
+                         dt(1), p + i*C.tile_elems(), T, p + (st.h + j)*C.tile_elems(), T,
+                         dt(1), cb.data() + t*C.tile_elems(), T);
+                };
+                if(pool) pool->parallel_for(st.h*st.w, multiply);
+                else for(u64 t = 0; t < st.h*st.w; t++) multiply(t);
+            }
+            if(st.kt + 1 >= std::max<u64>(Kt, 1)){
+                const dt* c = cb.data();
+                stored[block%2] = io.submit([&C, st, c]{
+                    for(u64 t = 0; t < st.h*st.w; t++) C.write_tile(st.i0 + t/st.w, st.j0 + t%st.w, c + t*C.tile_elems());
+                });
+                block++;
+            }
+        }
+        for(auto& w : stored)
+            if(w.valid()) w.wait();
+    }
+
+} // namespace Orion
+
+#endif // OUTOFCORE_H_
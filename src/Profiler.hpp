@@ -0,0 +1,302 @@
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+#include <cstdlib>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <unordered_map>
+
+#if defined(__GNUC__)
+#include <cxxabi.h>
+#endif
+
+#include "Typedefs.hpp"
+
+/*
+ * Op profiler, enabled by defining ORION_ENABLE_PROFILER before including
+ * any Orion header. Every autograd forward and backward call, gemm and
+ * expression materialization opens a ProfileScope recording its wall time,
+ * the bytes of tensors allocated inside it, its flops and operand shapes.
+ * Without the define the ORION_PROFILE_* macros expand to nothing and their
+ * arguments are never evaluated.
+ *
+ *     Profiler::instance().write_chrome_trace(file); // load in chrome://tracing
+ *     Profiler::instance().write_summary(std::cout);
+ * */
+
+namespace Orion{
+
+    namespace detail{
+        // "[2, 3]"
+        inline std::string format_shape(DimVec const& d){
+            std::string s = "[";
+            for(size_t i = 0; i < d.size(); i++){
+                if(i) s += ", ";
+                s += std::to_string(d[i]);
+            }
+            return s + "]";
+        }
+
+        /*
+         * Readable name of a type for profiles and memory tags, demangled
+         * where the compiler allows it and without the Orion:: qualification.
+         * Names are cached per thread so each type is demangled once.
+         * */
+        inline std::string const& profile_name(std::type_info const& t){
+            thread_local std::unordered_map<std::type_index, std::string> cache;
+            auto it = cache.find(t);
+            if(it != cache.end()) return it->second;
+
+            std::string name = t.name();
+#if defined(__GNUC__)
+            int status = 0;
+            char* dem = abi::__cxa_demangle(t.name(), nullptr, nullptr, &status);
+            if(status == 0 && dem) name = dem;
+            std::free(dem);
+#endif
+            const std::string ns = "Orion::";
+            for(size_t pos; (pos = name.find(ns)) != std::string::npos;)
+                name.erase(pos, ns.size());
+            return cache.emplace(t, std::move(name)).first->second;
+        }
+    } // namespace detail
+
+} // namespace Orion
+
+#ifdef ORION_ENABLE_PROFILER
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+namespace Orion{
+
+    /**
+     * One completed profiled region. Times are in nanoseconds relative to
+     * the creation of the profiler, bytes and flops include nested regions.
+     * */
+    struct ProfileEvent{
+        std::string name;
+        const char* category;
+        std::string shape;
+        u64 start_ns;
+        u64 dur_ns;
+        u64 self_ns; // dur_ns minus the time spent in nested regions
+        u64 bytes;
+        u64 flops;
+        u32 tid;
+    };
+
+    /**
+     * Process wide collector of profile events.
+     * */
+    class Profiler{
+    public:
+        static Profiler& instance(){
+            static Profiler profiler;
+            return profiler;
+        }
+
+        /**
+         * Recording is on by default when the profiler is compiled in.
+         * */
+        void enable(bool on = true){ m_enabled.store(on, std::memory_order_relaxed); }
+        bool enabled() const{ return m_enabled.load(std::memory_order_relaxed); }
+
+        void clear(){
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_events.clear();
+        }
+
+        std::vector<ProfileEvent> events() const{
+            std::lock_guard<std::mutex> lock(m_mutex);
+            return m_events;
+        }
+
+        void record(ProfileEvent&& e){
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_events.push_back(std::move(e));
+        }
+
+        u64 now_ns() const{
+            return static_cast<u64>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - m_epoch).count());
+        }
+
+        // small sequential id of the calling thread, stable for its lifetime
+        u32 thread_id(){
+            thread_local u32 id = m_next_tid.fetch_add(1, std::memory_order_relaxed);
+            return id;
+        }
+
+        /**
+         * Write all events in the Chrome trace event format, viewable in
+         * chrome://tracing or Perfetto.
+         * */
+        inline void write_chrome_trace(std::ostream& out) const;
+
+        /**
+         * Write a table aggregated by op name, sorted by self time.
+         * */
+        inline void write_summary(std::ostream& out) const;
+
+    private:
+        Profiler() : m_epoch(std::chrono::steady_clock::now()){}
+
+        std::chrono::steady_clock::time_point m_epoch;
+        std::atomic<bool> m_enabled{true};
+        std::atomic<u32> m_next_tid{0};
+        mutable std::mutex m_mutex;
+        std::vector<ProfileEvent> m_events;
+    };
+
+    /**
+     * RAII region recorded into the Profiler when it goes out of scope.
+     * Scopes nest per thread, a closing scope hands its time, allocations
+     * and flops to the enclosing one.
+     * */
+    class ProfileScope{
+    public:
+        ProfileScope(std::string name, const char* category) : m_name(std::move(name)), m_category(category){
+            Profiler& p = Profiler::instance();
+            m_active = p.enabled();
+            if(!m_active) return;
+            m_parent = current();
+            current() = this;
+            m_start = p.now_ns();
+        }
+        ~ProfileScope(){
+            if(!m_active) return;
+            Profiler& p = Profiler::instance();
+            u64 dur = p.now_ns() - m_start;
+            current() = m_parent;
+            if(m_parent){
+                m_parent->m_child_ns += dur;
+                m_parent->m_bytes += m_bytes;
+                m_parent->m_flops += m_flops;
+            }
+            p.record(ProfileEvent{std::move(m_name), m_category, std::move(m_shape), m_start, dur,
+                                  dur - std::min(dur, m_child_ns), m_bytes, m_flops, p.thread_id()});
+        }
+        ProfileScope(ProfileScope const&) = delete;
+        ProfileScope& operator=(ProfileScope const&) = delete;
+
+        void shape(std::string const& s){
+            if(!m_shape.empty()) m_shape += ", ";
+            m_shape += s;
+        }
+        void shape(DimVec const& d){ shape(detail::format_shape(d)); }
+        void flops(u64 n){ m_flops += n; }
+
+        // charge an allocation to the innermost open scope of this thread
+        static void alloc(u64 bytes){
+            if(ProfileScope* s = current()) s->m_bytes += bytes;
+        }
+
+    private:
+        static ProfileScope*& current(){
+            thread_local ProfileScope* scope = nullptr;
+            return scope;
+        }
+
+        std::string m_name;
+        const char* m_category;
+        std::string m_shape;
+        ProfileScope* m_parent = nullptr;
+        bool m_active = false;
+        u64 m_start = 0;
+        u64 m_child_ns = 0;
+        u64 m_bytes = 0;
+        u64 m_flops = 0;
+    };
+
+    namespace detail{
+        inline void json_escape(std::ostream& out, std::string const& s){
+            for(char c : s){
+                if(c == '"' || c == '\\') out << '\\' << c;
+                else if(static_cast<unsigned char>(c) < 0x20){
+                    char buf[8];
+                    std::snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned>(c));
+                    out << buf;
+                }
+                else out << c;
+            }
+        }
+    } // namespace detail
+
+    inline void Profiler::write_chrome_trace(std::ostream& out) const{
+        std::vector<ProfileEvent> evs = events();
+        auto flags = out.flags();
+        out << std::fixed;
+        out.precision(3);
+        out << "{\"traceEvents\":[";
+        for(size_t i = 0; i < evs.size(); i++){
+            ProfileEvent const& e = evs[i];
+            out << (i ? ",\n" : "\n") << "{\"name\":\"";
+            detail::json_escape(out, e.name);
+            out << "\",\"cat\":\"" << e.category << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << e.tid
+                << ",\"ts\":" << static_cast<double>(e.start_ns)/1e3
+                << ",\"dur\":" << static_cast<double>(e.dur_ns)/1e3
+                << ",\"args\":{\"shape\":\"";
+            detail::json_escape(out, e.shape);
+            out << "\",\"bytes\":" << e.bytes << ",\"flops\":" << e.flops << "}}";
+        }
+        out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+        out.flags(flags);
+    }
+
+    inline void Profiler::write_summary(std::ostream& out) const{
+        struct Row{
+            u64 calls = 0, total_ns = 0, self_ns = 0, bytes = 0, flops = 0;
+        };
+        std::map<std::string, Row> rows;
+        for(ProfileEvent const& e : events()){
+            Row& r = rows[std::string(e.category) + ' ' + e.name];
+            r.calls++;
+            r.total_ns += e.dur_ns;
+            r.self_ns += e.self_ns;
+            r.bytes += e.bytes;
+            r.flops += e.flops;
+        }
+        std::vector<std::pair<std::string, Row>> sorted(rows.begin(), rows.end());
+        std::sort(sorted.begin(), sorted.end(), [](auto const& a, auto const& b){ return a.second.self_ns > b.second.self_ns; });
+
+        size_t width = 4;
+        for(auto const& r : sorted) width = std::max(width, r.first.size());
+        char line[160];
+        out << std::string(width, ' ').replace(0, 2, "op")
+            << "     calls   total ms    self ms     avg us      alloc MB   GFLOP/s\n";
+        for(auto const& kv : sorted){
+            Row const& r = kv.second;
+            double total_ms = static_cast<double>(r.total_ns)/1e6;
+            double gflops = r.total_ns ? static_cast<double>(r.flops)/static_cast<double>(r.total_ns) : 0.0;
+            std::snprintf(line, sizeof(line), " %9llu %10.3f %10.3f %10.2f %13.3f %9.2f\n",
+                          static_cast<unsigned long long>(r.calls), total_ms, static_cast<double>(r.self_ns)/1e6,
+                          total_ms*1e3/static_cast<double>(r.calls), static_cast<double>(r.bytes)/1048576.0, gflops);
+            out << kv.first << std::string(width - kv.first.size(), ' ') << line;
+        }
+    }
+
+} // namespace Orion
+
+#define ORION_PROFILE_SCOPE(var, name, category) ::Orion::ProfileScope var((name), (category))
+#define ORION_PROFILE_SHAPE(var, shp) (var).shape(shp)
+#define ORION_PROFILE_FLOPS(var, n) (var).flops(n)
+#define ORION_PROFILE_ALLOC(bytes) ::Orion::ProfileScope::alloc(bytes)
+
+#else
+
+#define ORION_PROFILE_SCOPE(var, name, category) static_cast<void>(0)
+#define ORION_PROFILE_SHAPE(var, shp) static_cast<void>(0)
+#define ORION_PROFILE_FLOPS(var, n) static_cast<void>(0)
+#define ORION_PROFILE_ALLOC(bytes) static_cast<void>(0)
+
+#endif // ORION_ENABLE_PROFILER
+
+#endif // PROFILER_H_
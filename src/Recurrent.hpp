@@ -0,0 +1,220 @@
+#ifndef RECURRENT_H_
+#define RECURRENT_H_
+
+#include <algorithm>
+#include <cstring>
+
+#include "Tensor.hpp"
+#include "Gemm.hpp"
+#include "VecMath.hpp"
+#include "Dispatch.hpp"
+
+/*
+ * Fused LSTM and GRU cells. The pre-activations of all gates come from a
+ * single gemm into one {batch, gates*hidden} buffer with the bias written
+ * first, then one elementwise pass applies every nonlinearity and forms
+ * the new state, so a step allocates nothing per gate.
+ *
+ * Gate blocks are laid out side by side in the columns of the weights,
+ * i, f, g, o for the LSTM and r, z, n for the GRU.
+ * */
+
+namespace Orion{
+
+    namespace detail{
+        // out[r] = bias for every row, the gemm then accumulates onto it
+        template<typename dt>
+        inline void fill_rows(dt* out, const dt* bias, u64 rows, u64 cols){
+            for(u64 r = 0; r < rows; r++) std::memcpy(out + r*cols, bias, cols*sizeof(dt));
+        }
+
+        // acc[c] += sum over rows of x[r, c]
+        template<typename dt>
+        inline void add_column_sums(const dt* x, u64 rows, u64 cols, dt* acc){
+            for(u64 r = 0; r < rows; r++)
+                for(u64 c = 0; c < cols; c++) acc[c] += x[r*cols + c];
+        }
+
+        /*
+         * LSTM step for batch rows of input width n and hidden width h.
+         * state and out hold [h | c] per row, w is (n + h) x 4h and b is 4h.
+         * xh receives [x | h] (batch x (n + h)), gates the activated gates
+         * and tc tanh of the new cell, which is all the backward pass needs.
+         * */
+        template<typename dt>
+        void lstm_forward(u64 batch, u64 n, u64 h, const dt* x, const dt* state, const dt* w, const dt* b,
+                          dt* xh, dt* gates, dt* tc, dt* out){
+            u64 k = n + h;
+            for(u64 r = 0; r < batch; r++){
+                std::memcpy(xh + r*k, x + r*n, n*sizeof(dt));
+                std::memcpy(xh + r*k + n, state + r*2*h, h*sizeof(dt));
+            }
+            fill_rows(gates, b, batch, 4*h);
+            gemm(false, false, batch, 4*h, k, dt(1), xh, k, w, 4*h, dt(1), gates, 4*h);
+            isa_dispatch([&]{
+                for(u64 r = 0; r < batch; r++){
+                    dt* g = gates + r*4*h;
+                    const dt* c = state + r*2*h + h;
+                    dt* o = out + r*2*h;
+                    for(u64 j = 0; j < h; j++){
+                        dt ig = vsigmoid(g[j]), fg = vsigmoid(g[h + j]), gg = vtanh(g[2*h + j]), og = vsigmoid(g[3*h + j]);
+                        dt cn = fg*c[j] + ig*gg;
+                        dt t = vtanh(cn);
+                        g[j] = ig;
+                        g[h + j] = fg;
+                        g[2*h + j] = gg;
+                        g[3*h + j] = og;
+                        tc[r*h + j] = t;
+                        o[j] = og*t;
+                        o[h + j] = cn;
+                    }
+                }
+            });
+        }
+
+        /*
+         * Gradients of lstm_forward from dout, the gradient of its output
+         * state. Results are accumulated, null pointers skip an input.
+         * dgates is batch x 4h and dxh batch x (n + h) scratch.
+         * */
+        template<typename dt>
+        void lstm_backward(u64 batch, u64 n, u64 h, const dt* state, const dt* w, const dt* xh, const dt* gates, const dt* tc,
+                           const dt* dout, dt* dgates, dt* dxh, dt* dx, dt* dstate, dt* dw, dt* db){
+            u64 k = n + h;
+            isa_dispatch([&]{
+                for(u64 r = 0; r < batch; r++){
+                    const dt* g = gates + r*4*h;
+                    const dt* c = state + r*2*h + h;
+                    const dt* dh = dout + r*2*h;
+                    dt* dg = dgates + r*4*h;
+                    for(u64 j = 0; j < h; j++){
+                        dt ig = g[j], fg = g[h + j], gg = g[2*h + j], og = g[3*h + j], t = tc[r*h + j];
+                        dt dc = dh[h + j] + dh[j]*og*(dt(1) - t*t);
+                        dg[j] = dc*gg*ig*(dt(1) - ig);
+                        dg[h + j] = dc*c[j]*fg*(dt(1) - fg);
+                        dg[2*h + j] = dc*ig*(dt(1) - gg*gg);
+                        dg[3*h + j] = dh[j]*t*og*(dt(1) - og);
+                        if(dstate) dstate[r*2*h + h + j] += dc*fg;
+                    }
+                }
+            });
+            if(dw) gemm(true, false, k, 4*h, batch, dt(1), xh, k, dgates, 4*h, dt(1), dw, 4*h);
+            if(db) add_column_sums(dgates, batch, 4*h, db);
+            if(!dx && !dstate) return;
+            gemm(false, true, batch, k, 4*h, dt(1), dgates, 4*h, w, 4*h, dt(0), dxh, k);
+            for(u64 r = 0; r < batch; r++){
+                if(dx) for(u64 j = 0; j < n; j++) dx[r*n + j] += dxh[r*k + j];
+                if(dstate) for(u64 j = 0; j < h; j++) dstate[r*2*h + j] += dxh[r*k + n + j];
+            }
+        }
+
+        /*
+         * GRU step for batch rows of input width n and hidden width h,
+         * h' = (1 - z) n + z h with n = tanh(x wx_n + bx_n + r (h wh_n + bh_n)).
+         * wx is n x 3h, wh is h x 3h. The reset gate multiplies the hidden
+         * part of the candidate only, so x and h take one gemm each, into
+         * gx and gh (batch x 3h). gx receives the activated r, z, n and gh
+         * keeps h wh_n + bh_n for the backward pass.
+         * */
+        template<typename dt>
+        void gru_forward(u64 batch, u64 n, u64 h, const dt* x, const dt* hs, const dt* wx, const dt* wh, const dt* bx, const dt* bh,
+                         dt* gx, dt* gh, dt* out){
+            fill_rows(gx, bx, batch, 3*h);
+            fill_rows(gh, bh, batch, 3*h);
+            gemm(false, false, batch, 3*h, n, dt(1), x, n, wx, 3*h, dt(1), gx, 3*h);
+            gemm(false, false, batch, 3*h, h, dt(1), hs, h, wh, 3*h, dt(1), gh, 3*h);
+            isa_dispatch([&]{
+                for(u64 r = 0; r < batch; r++){
+                    dt* a = gx + r*3*h;
+                    const dt* u = gh + r*3*h;
+                    const dt* hp = hs + r*h;
+                    for(u64 j = 0; j < h; j++){
+                        dt rg = vsigmoid(a[j] + u[j]), zg = vsigmoid(a[h + j] + u[h + j]);
+                        dt ng = vtanh(a[2*h + j] + rg*u[2*h + j]);
+                        a[j] = rg;
+                        a[h + j] = zg;
+                        a[2*h + j] = ng;
+                        out[r*h + j] = (dt(1) - zg)*ng + zg*hp[j];
+                    }
+                }
+            });
+        }
+
+        /*
+         * Gradients of gru_forward from dout, accumulated, null pointers
+         * skip an input. dgx and dgh are batch x 3h scratch.
+         * */
+        template<typename dt>
+        void gru_backward(u64 batch, u64 n, u64 h, const dt* x, const dt* hs, const dt* wx, const dt* wh, const dt* gx, const dt* gh,
+                          const dt* dout, dt* dgx, dt* dgh, dt* dx, dt* dh, dt* dwx, dt* dwh, dt* dbx, dt* dbh){
+            isa_dispatch([&]{
+                for(u64 r = 0; r < batch; r++){
+                    const dt* a = gx + r*3*h;
+                    const dt* u = gh + r*3*h;
+                    const dt* hp = hs + r*h;
+                    const dt* d = dout + r*h;
+                    dt* ex = dgx + r*3*h;
+                    dt* eh = dgh + r*3*h;
+                    for(u64 j = 0; j < h; j++){
+                        dt rg = a[j], zg = a[h + j], ng = a[2*h + j];
+                        dt dn = d[j]*(dt(1) - zg)*(dt(1) - ng*ng);
+                        dt dr = dn*u[2*h + j]*rg*(dt(1) - rg);
+                        dt dz = d[j]*(hp[j] - ng)*zg*(dt(1) - zg);
+                        ex[j] = eh[j] = dr;
+                        ex[h + j] = eh[h + j] = dz;
+                        ex[2*h + j] = dn;
+                        eh[2*h + j] = dn*rg;
+                        if(dh) dh[r*h + j] += d[j]*zg;
+                    }
+                }
+            });
+            if(dwx) gemm(true, false, n, 3*h, batch, dt(1), x, n, dgx, 3*h, dt(1), dwx, 3*h);
+            if(dwh) gemm(true, false, h, 3*h, batch, dt(1), hs, h, dgh, 3*h, dt(1), dwh, 3*h);
+            if(dbx) add_column_sums(dgx, batch, 3*h, dbx);
+            if(dbh) add_column_sums(dgh, batch, 3*h, dbh);
+            if(dx) gemm(false, true, batch, n, 3*h, dt(1), dgx, 3*h, wx, 3*h, dt(1), dx, n);
+            if(dh) gemm(false, true, batch, h, 3*h, dt(1), dgh, 3*h, wh, 3*h, dt(1), dh, h);
+        }
+    } // namespace detail
+
+    /**
+     * One LSTM step.
+     * @param x input, batch x n.
+     * @param state hidden and cell state side by side, batch x 2h.
+     * @param w stacked input and hidden weights, (n + h) x 4h.
+     * @param b bias, 4h.
+     * @return the new state, batch x 2h.
+     * */
+    template<typename dt>
+    inline Tensor<dt> lstm_cell(Tensor<dt> const& x, Tensor<dt> const& state, Tensor<dt> const& w, Tensor<dt> const& b){
+        assert(x.rank() == 2 && state.rank() == 2 && w.rank() == 2);
+        u64 batch = x.dim()[0], n = x.dim()[1], h = state.dim()[1]/2;
+        assert(state.dim()[0] == batch && w.dim()[0] == n + h && w.dim()[1] == 4*h && b.nelem() == 4*h);
+        Tensor<dt> xh({batch, n + h}), gates({batch, 4*h}), tc({batch, h}), out({batch, 2*h});
+        detail::lstm_forward(batch, n, h, x.data(), state.data(), w.data(), b.data(), xh.data(), gates.data(), tc.data(), out.data());
+        return out;
+    }
+
+    /**
+     * One GRU step.
+     * @param x input, batch x n.
+     * @param hs hidden state, batch x h.
+     * @param wx, wh input and hidden weights, n x 3h and h x 3h.
+     * @param bx, bh input and hidden biases, 3h each.
+     * @return the new hidden state, batch x h.
+     * */
+    template<typename dt>
+    inline Tensor<dt> gru_cell(Tensor<dt> const& x, Tensor<dt> const& hs, Tensor<dt> const& wx, Tensor<dt> const& wh,
+                               Tensor<dt> const& bx, Tensor<dt> const& bh){
+        assert(x.rank() == 2 && hs.rank() == 2 && wx.rank() == 2 && wh.rank() == 2);
+        u64 batch = x.dim()[0], n = x.dim()[1], h = hs.dim()[1];
+        assert(hs.dim()[0] == batch && wx.dim()[0] == n && wx.dim()[1] == 3*h && wh.dim()[0] == h && wh.dim()[1] == 3*h);
+        assert(bx.nelem() == 3*h && bh.nelem() == 3*h);
+        Tensor<dt> gx({batch, 3*h}), gh({batch, 3*h}), out({batch, h});
+        detail::gru_forward(batch, n, h, x.data(), hs.data(), wx.data(), wh.data(), bx.data(), bh.data(), gx.data(), gh.data(), out.data());
+        return out;
+    }
+
+} // namespace Orion
+
+#endif // RECURRENT_H_
@@ -0,0 +1,219 @@
+#ifndef SMALLVECTOR_H_
+#define SMALLVECTOR_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+namespace Orion{
+
+    /**
+     * Vector of trivially copyable elements keeping up to N of them inline.
+     * Only longer vectors allocate, so short ones like tensor shapes are
+     * created, copied and sliced without touching the heap.
+     *
+     * Mirrors the parts of std::vector the library uses and converts from
+     * and to it.
+     * */
+    template<typename T, size_t N>
+    class SmallVector{
+        static_assert(std::is_trivially_copyable<T>::value, "SmallVector holds trivially copyable elements only.");
+    public:
+        typedef T value_type;
+        typedef size_t size_type;
+        typedef T* iterator;
+        typedef const T* const_iterator;
+        typedef T& reference;
+        typedef const T& const_reference;
+
+        SmallVector() = default;
+
+        explicit SmallVector(size_t n, T const& v = T()){
+            resize(n, v);
+        }
+
+        SmallVector(std::initializer_list<T> init){
+            assign(init.begin(), init.end());
+        }
+
+        template<typename It, typename = typename std::iterator_traits<It>::iterator_category>
+        SmallVector(It first, It last){
+            assign(first, last);
+        }
+
+        SmallVector(std::vector<T> const& v){
+            assign(v.begin(), v.end());
+        }
+
+        SmallVector(SmallVector const& o){
+            assign(o.begin(), o.end());
+        }
+
+        SmallVector(SmallVector&& o) noexcept{
+            steal(o);
+        }
+
+        ~SmallVector(){
+            if(m_data != m_inline) std::free(m_data);
+        }
+
+        SmallVector& operator=(SmallVector const& o){
+            if(this != &o) assign(o.begin(), o.end());
+            return *this;
+        }
+
+        SmallVector& operator=(SmallVector&& o) noexcept{
+            if(this != &o){
+                if(m_data != m_inline) std::free(m_data);
+                steal(o);
+            }
+            return *this;
+        }
+
+        SmallVector& operator=(std::initializer_list<T> init){
+            assign(init.begin(), init.end());
+            return *this;
+        }
+
+        operator std::vector<T>() const{
+            return std::vector<T>(begin(), end());
+        }
+
+        template<typename It>
+        void assign(It first, It last){
+            m_size = 0;
+            reserve(static_cast<size_t>(std::distance(first, last)));
+            for(; first != last; ++first) m_data[m_size++] = *first;
+        }
+
+        inline size_t size() const{ return m_size; }
+        inline bool empty() const{ return m_size == 0; }
+        inline size_t capacity() const{ return m_cap; }
+        // true while the elements live in the inline buffer
+        inline bool is_inline() const{ return m_data == m_inline; }
+
+        inline T* data(){ return m_data; }
+        inline const T* data() const{ return m_data; }
+        inline T* begin(){ return m_data; }
+        inline T* end(){ return m_data + m_size; }
+        inline const T* begin() const{ return m_data; }
+        inline const T* end() const{ return m_data + m_size; }
+
+        inline T& operator[](size_t i){ return m_data[i]; }
+        inline T const& operator[](size_t i) const{ return m_data[i]; }
+        inline T& front(){ return m_data[0]; }
+        inline T const& front() const{ return m_data[0]; }
+        inline T& back(){ return m_data[m_size - 1]; }
+        inline T const& back() const{ return m_data[m_size - 1]; }
+
+        void reserve(size_t n){
+            if(n <= m_cap) return;
+            size_t cap = std::max(n, 2*m_cap);
+            T* p = static_cast<T*>(std::malloc(cap*sizeof(T)));
+            if(p == nullptr) throw std::bad_alloc();
+            if(m_size) std::memcpy(p, m_data, m_size*sizeof(T));
+            if(m_data != m_inline) std::free(m_data);
+            m_data = p;
+            m_cap = cap;
+        }
+
+        void resize(size_t n, T const& v = T()){
+            reserve(n);
+            for(size_t i = m_size; i < n; i++) m_data[i] = v;
+            m_size = n;
+        }
+
+        void push_back(T const& v){
+            if(m_size == m_cap){
+                T copy = v; // v may be an element of this vector
+                reserve(m_size + 1);
+                m_data[m_size++] = copy;
+                return;
+            }
+            m_data[m_size++] = v;
+        }
+
+        void pop_back(){
+            assert(m_size > 0);
+            m_size--;
+        }
+
+        void clear(){ m_size = 0; }
+
+        T* insert(const T* pos, T const& v){
+            size_t at = static_cast<size_t>(pos - m_data);
+            T copy = v;
+            reserve(m_size + 1);
+            std::memmove(m_data + at + 1, m_data + at, (m_size - at)*sizeof(T));
+            m_data[at] = copy;
+            m_size++;
+            return m_data + at;
+        }
+
+        template<typename It, typename = typename std::iterator_traits<It>::iterator_category>
+        T* insert(const T* pos, It first, It last){
+            size_t at = static_cast<size_t>(pos - m_data);
+            size_t n = static_cast<size_t>(std::distance(first, last));
+            // copied out first, the range may point into this vector
+            SmallVector tmp(first, last);
+            reserve(m_size + n);
+            std::memmove(m_data + at + n, m_data + at, (m_size - at)*sizeof(T));
+            if(n) std::memcpy(m_data + at, tmp.data(), n*sizeof(T));
+            m_size += n;
+            return m_data + at;
+        }
+
+        T* erase(const T* first, const T* last){
+            size_t at = static_cast<size_t>(first - m_data);
+            size_t n = static_cast<size_t>(last - first);
+            std::memmove(m_data + at, m_data + at + n, (m_size - at - n)*sizeof(T));
+            m_size -= n;
+            return m_data + at;
+        }
+
+        T* erase(const T* pos){
+            return erase(pos, pos + 1);
+        }
+
+        friend bool operator==(SmallVector const& a, SmallVector const& b){
+            return a.m_size == b.m_size && std::equal(a.begin(), a.end(), b.begin());
+        }
+        friend bool operator!=(SmallVector const& a, SmallVector const& b){
+            return !(a == b);
+        }
+        friend bool operator<(SmallVector const& a, SmallVector const& b){
+            return std::lexicographical_compare(a.begin(), a.end(), b.begin(), b.end());
+        }
+
+    private:
+        void steal(SmallVector& o){
+            if(o.m_data == o.m_inline){
+                m_data = m_inline;
+                m_cap = N;
+                std::memcpy(m_inline, o.m_inline, o.m_size*sizeof(T));
+            }else{
+                m_data = o.m_data;
+                m_cap = o.m_cap;
+            }
+            m_size = o.m_size;
+            o.m_data = o.m_inline;
+            o.m_cap = N;
+            o.m_size = 0;
+        }
+
+        T m_inline[N];
+        T* m_data = m_inline;
+        size_t m_size = 0;
+        size_t m_cap = N;
+    };
+
+} // namespace Orion
+
+#endif // SMALLVECTOR_H_
@@ -0,0 +1,200 @@
+#ifndef SOFTMAX_H_
+#define SOFTMAX_H_
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "Tensor.hpp"
+#include "VecMath.hpp"
+
+namespace Orion{
+
+    namespace detail{
+        // elements per block of the online max + sum, each block costs one rescale
+        constexpr u64 SOFTMAX_BLOCK = 64;
+
+        /*
+         * log(sum(exp(x))) of one row in a single pass. The max is tracked per
+         * block and the running sum is rescaled whenever it grows, so every
+         * element costs one exp and the inner loops carry no branches.
+         * Blocks of -inf add nothing, a row of -inf gives -inf.
+         * */
+        template<typename dt>
+        inline dt row_logsumexp(const dt* x, u64 n){
+            const dt inf = std::numeric_limits<dt>::infinity();
+            dt m = -inf;
+            dt s = 0;
+            for(u64 b = 0; b < n; b += SOFTMAX_BLOCK){
+                u64 e = std::min(n, b + SOFTMAX_BLOCK);
+                dt bm = x[b];
+                for(u64 i = b + 1; i < e; i++) bm = std::max(bm, x[i]);
+                if(bm == -inf) continue;
+                if(bm > m){
+                    s *= vexp(m - bm);
+                    m = bm;
+                }
+                dt bs = 0;
+                for(u64 i = b; i < e; i++) bs += vexp(x[i] - m);
+                s += bs;
+            }
+            return m + std::log(s);
+        }
+
+        /*
+         * Softmax of one row. Exponentials are written to y relative to the
+         * running max of their block during the single reduction pass, then a
+         * second pass only multiplies each block by its correction factor.
+         * A row of -inf has no mass anywhere and gives zeros, as a fully
+         * masked row of attention does.
+         * */
+        template<typename dt>
+        inline void row_softmax(const dt* x, dt* y, u64 n){
+            const dt inf = std::numeric_limits<dt>::infinity();
+            thread_local std::vector<dt> block_max;
+            block_max.resize((n + SOFTMAX_BLOCK - 1)/SOFTMAX_BLOCK);
+            dt m = -inf;
+            dt s = 0;
+            for(u64 b = 0; b < n; b += SOFTMAX_BLOCK){
+                u64 e = std::min(n, b + SOFTMAX_BLOCK);
+                dt bm = x[b];
+                for(u64 i = b + 1; i < e; i++) bm = std::max(bm, x[i]);
+                block_max[b/SOFTMAX_BLOCK] = -inf;
+                if(bm == -inf){
+                    std::fill(y + b, y + e, dt(0));
+                    continue;
+                }
+                if(bm > m){
+                    s *= vexp(m - bm);
+                    m = bm;
+                }
+                dt bs = 0;
+                for(u64 i = b; i < e; i++){
+                    y[i] = vexp(x[i] - m);
+                    bs += y[i];
+                }
+                s += bs;
+                block_max[b/SOFTMAX_BLOCK] = m;
+            }
+            if(m == -inf) return;
+            for(u64 b = 0; b < n; b += SOFTMAX_BLOCK){
+                u64 e = std::min(n, b + SOFTMAX_BLOCK);
+                dt scale = vexp(block_max[b/SOFTMAX_BLOCK] - m)/s;
+                for(u64 i = b; i < e; i++) y[i] *= scale;
+            }
+        }
+
+        /*
+         * Log softmax of one row, x - logsumexp(x). A row of -inf gives
+         * -inf, the log of the zeros of row_softmax.
+         * */
+        template<typename dt>
+        inline void row_log_softmax(const dt* x, dt* y, u64 n){
+            const dt inf = std::numeric_limits<dt>::infinity();
+            dt lse = row_logsumexp(x, n);
+            if(lse == -inf) std::fill(y, y + n, -inf);
+            else for(u64 i = 0; i < n; i++) y[i] = x[i] - lse;
+        }
+
+        // rows and row length of a tensor reduced over its last dimension
+        template<typename dt>
+        inline void softmax_shape(Tensor<dt> const& x, u64& rows, u64& cols){
+            assert(x.rank() >= 1);
+            cols = x.dim().back();
+            rows = cols ? x.nelem()/cols : 0;
+        }
+    } // namespace detail
+
+    /**
+     * Numerically stable softmax over the last dimension. Rows that are
+     * entirely -inf come out as zeros.
+     * */
+    template<typename dt>
+    inline Tensor<dt> softmax(Tensor<dt> const& x){
+        u64 rows, cols;
+        detail::softmax_shape(x, rows, cols);
+        Tensor<dt> y(x.dim());
+        isa_dispatch([&]{
+            for(u64 r = 0; r < rows; r++)
+                detail::row_softmax(x.data() + r*cols, y.data() + r*cols, cols);
+        });
+        return y;
+    }
+
+    /**
+     * Numerically stable log softmax over the last dimension, x - logsumexp(x).
+     * Rows that are entirely -inf come out as -inf.
+     * */
+    template<typename dt>
+    inline Tensor<dt> log_softmax(Tensor<dt> const& x){
+        u64 rows, cols;
+        detail::softmax_shape(x, rows, cols);
+        Tensor<dt> y(x.dim());
+        isa_dispatch([&]{
+            for(u64 r = 0; r < rows; r++)
+                detail::row_log_softmax(x.data() + r*cols, y.data() + r*cols, cols);
+        });
+        return y;
+    }
+
+    /**
+     * Mean cross entropy between softmax(logits) and integer class targets,
+     * computed as logsumexp(row) - row[target] without forming the softmax.
+     * A row that is entirely -inf puts no probability on its target and
+     * makes the loss +inf, its gradient is -onehot.
+     *
+     * @param logits scores with classes along the last dimension.
+     * @param targets one class index per row.
+     * @param lse if not null receives the logsumexp of every row, which is all
+     * the backward pass needs.
+     * */
+    template<typename dt>
+    inline dt cross_entropy(Tensor<dt> const& logits, std::vector<u64> const& targets, std::vector<dt>* lse = nullptr){
+        u64 rows, cols;
+        detail::softmax_shape(logits, rows, cols);
+        assert(targets.size() == rows);
+        if(lse) lse->resize(rows);
+        const dt inf = std::numeric_limits<dt>::infinity();
+        dt loss = 0;
+        isa_dispatch([&]{
+            for(u64 r = 0; r < rows; r++){
+                const dt* xr = logits.data() + r*cols;
+                assert(targets[r] < cols);
+                dt l = detail::row_logsumexp(xr, cols);
+                if(lse) (*lse)[r] = l;
+                loss += l == -inf ? inf : l - xr[targets[r]];
+            }
+        });
+        return rows ? loss/static_cast<dt>(rows) : loss;
+    }
+
+    /**
+     * Accumulate the gradient of mean cross entropy into dlogits in one pass,
+     * dlogits += scale * (softmax(logits) - onehot(targets)) / rows.
+     *
+     * @param lse per row logsumexp as returned by cross_entropy.
+     * @param scale upstream gradient of the loss.
+     * */
+    template<typename dt>
+    inline void cross_entropy_backward(Tensor<dt> const& logits, std::vector<u64> const& targets, std::vector<dt> const& lse,
+                                       dt scale, Tensor<dt>& dlogits){
+        u64 rows, cols;
+        detail::softmax_shape(logits, rows, cols);
+        if(rows == 0) return;
+        const dt inf = std::numeric_limits<dt>::infinity();
+        dt g = scale/static_cast<dt>(rows);
+        isa_dispatch([&]{
+            for(u64 r = 0; r < rows; r++){
+                const dt* xr = logits.data() + r*cols;
+                dt* dr = dlogits.data() + r*cols;
+                dt l = lse[r];
+                if(l != -inf) for(u64 i = 0; i < cols; i++) dr[i] += g*vexp(xr[i] - l);
+                dr[targets[r]] -= g;
+            }
+        });
+    }
+
+} // namespace Orion
+
+#endif // SOFTMAX_H_
@@ -0,0 +1,328 @@
+#ifndef STRASSEN_H_
+#define STRASSEN_H_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <vector>
+
+#include "Typedefs.hpp"
+#include "Profiler.hpp"
+#include "ThreadPool.hpp"
+#include "Gemm.hpp"
+
+/*
+ * Strassen-Winograd matrix multiply: 7 half size products and 15 additions
+ * per level instead of 8 products, recursing until a side falls below
+ * strassen_cutoff() and finishing with the blocked gemm. Odd sides are
+ * peeled off and handled by gemm, so any shape works.
+ *
+ * It trades accuracy for speed, the error bound grows by a constant factor
+ * per level instead of staying componentwise, so it is opt in:
+ *
+ *     matmul_algorithm() = MatmulAlgorithm::Strassen;   // operator* on large matrices
+ *     StrassenReport r = strassen_report(a, b);         // error against gemm
+ * */
+
+namespace Orion{
+
+    template <typename dt>
+    class Tensor;
+
+    /**
+     * Algorithm behind operator* on matrices.
+     * */
+    enum class MatmulAlgorithm{ Classical, Strassen };
+
+    /**
+     * Process wide choice of matmul algorithm, classical by default.
+     * */
+    inline MatmulAlgorithm& matmul_algorithm(){
+        static MatmulAlgorithm algo = MatmulAlgorithm::Classical;
+        return algo;
+    }
+
+    /**
+     * Side below which products go to gemm. Under about 512 the additions
+     * and their memory traffic cost as much as the product they save,
+     * measured on doubles with the default gemm blocking.
+     * */
+    inline u64& strassen_cutoff(){
+        static u64 cutoff = 512;
+        return cutoff;
+    }
+
+    namespace detail{
+        inline bool strassen_splits(u64 m, u64 n, u64 k){
+            u64 c = std::max<u64>(strassen_cutoff(), 2);
+            return m >= c && n >= c && k >= c;
+        }
+
+        /*
+         * Elements of workspace the sequential recursion needs: at every
+         * level X of (m/2) x max(k/2, n/2) and Y of (k/2) x (n/2).
+         * */
+        inline u64 strassen_seq_workspace(u64 m, u64 n, u64 k){
+            if(!strassen_splits(m, n, k)) return 0;
+            u64 m2 = m/2, n2 = n/2, k2 = k/2;
+            return m2*std::max(k2, n2) + k2*n2 + strassen_seq_workspace(m2, n2, k2);
+        }
+
+        // three products beside the four held in C, then per product its operands and recursion
+        inline u64 strassen_par_workspace(u64 m, u64 n, u64 k){
+            u64 m2 = m/2, n2 = n/2, k2 = k/2;
+            return 3*m2*n2 + 7*(m2*k2 + k2*n2 + strassen_seq_workspace(m2, n2, k2));
+        }
+
+        // C(i, j) = f(i, j) over an m x n block
+        template<typename dt, typename F>
+        ORION_VEC_FLATTEN void strassen_set(u64 m, u64 n, dt* C, u64 ldc, F f){
+            for(u64 i = 0; i < m; i++){
+                dt* c = C + i*ldc;
+                for(u64 j = 0; j < n; j++) c[j] = f(i, j);
+            }
+        }
+
+        /*
+         * Odd rows, columns and inner index left by the even part. The even
+         * part C[0:m2, 0:n2] = A[0:m2, 0:k2] B[0:k2, 0:n2] is done already.
+         * */
+        template<typename dt>
+        void strassen_peel(u64 m, u64 n, u64 k, const dt* A, u64 lda, const dt* B, u64 ldb, dt* C, u64 ldc){
+            u64 m2 = m & ~u64(1), n2 = n & ~u64(1), k2 = k & ~u64(1);
+            if(k != k2) gemm(false, false, m2, n2, k - k2, dt(1), A + k2, lda, B + k2*ldb, ldb, dt(1), C, ldc);
+            if(n != n2) gemm(false, false, m2, n - n2, k, dt(1), A, lda, B + n2, ldb, dt(0), C + n2, ldc);
+            if(m != m2) gemm(false, false, m - m2, n, k, dt(1), A + m2*lda, lda, B, ldb, dt(0), C + m2*ldc, ldc);
+        }
+
+        /*
+         * C = A B with two temporaries per level, products written into the
+         * quadrants of C and combined in place (Douglas et al. schedule).
+         * */
+        template<typename dt>
+        void strassen_rec(u64 m, u64 n, u64 k, const dt* A, u64 lda, const dt* B, u64 ldb, dt* C, u64 ldc, dt* ws){
+            if(!strassen_splits(m, n, k)){
+                gemm(false, false, m, n, k, dt(1), A, lda, B, ldb, dt(0), C, ldc);
+                return;
+            }
+            u64 m2 = m/2, n2 = n/2, k2 = k/2;
+            const dt *A11 = A, *A12 = A + k2, *A21 = A + m2*lda, *A22 = A21 + k2;
+            const dt *B11 = B, *B12 = B + n2, *B21 = B + k2*ldb, *B22 = B21 + n2;
+            dt *C11 = C, *C12 = C + n2, *C21 = C + m2*ldc, *C22 = C21 + n2;
+            dt* X = ws;
+            dt* Y = X + m2*std::max(k2, n2);
+            dt* next = Y + k2*n2;
+
+            // M7 = (A11 - A21)(B22 - B12) into C21
+            strassen_set(m2, k2, X, k2, [&](u64 i, u64 j){ return A11[i*lda + j] - A21[i*lda + j]; });
+            strassen_set(k2, n2, Y, n2, [&](u64 i, u64 j){ return B22[i*ldb + j] - B12[i*ldb + j]; });
+            strassen_rec(m2, n2, k2, X, k2, Y, n2, C21, ldc, next);
+            // M5 = S1 T1 into C22, S1 = A21 + A22, T1 = B12 - B11
+            strassen_set(m2, k2, X, k2, [&](u64 i, u64 j){ return A21[i*lda + j] + A22[i*lda + j]; });
+            strassen_set(k2, n2, Y, n2, [&](u64 i, u64 j){ return B12[i*ldb + j] - B11[i*ldb + j]; });
+            strassen_rec(m2, n2, k2, X, k2, Y, n2, C22, ldc, next);
+            // M6 = S2 T2 into C12, S2 = S1 - A11, T2 = B22 - T1
+            strassen_set(m2, k2, X, k2, [&](u64 i, u64 j){ return X[i*k2 + j] - A11[i*lda + j]; });
+            strassen_set(k2, n2, Y, n2, [&](u64 i, u64 j){ return B22[i*ldb + j] - Y[i*n2 + j]; });
+            strassen_rec(m2, n2, k2, X, k2, Y, n2, C12, ldc, next);
+            // M3 = S4 B22 into C11, S4 = A12 - S2
+            strassen_set(m2, k2, X, k2, [&](u64 i, u64 j){ return A12[i*lda + j] - X[i*k2 + j]; });
+            strassen_rec(m2, n2, k2, X, k2, B22, ldb, C11, ldc, next);
+            // M1 = A11 B11 into X
+            strassen_rec(m2, n2, k2, A11, lda, B11, ldb, X, n2, next);
+            // C12 = M1 + M6 + M5 + M3, C21 = M1 + M6 + M7 and C22 = C21 + M5
+            for(u64 i = 0; i < m2; i++){
+                const dt* x = X + i*n2;
+                dt *c11 = C11 + i*ldc, *c12 = C12 + i*ldc, *c21 = C21 + i*ldc, *c22 = C22 + i*ldc;
+                for(u64 j = 0; j < n2; j++){
+                    dt u2 = x[j] + c12[j];
+                    dt u3 = u2 + c21[j];
+                    c12[j] = u2 + c22[j] + c11[j];
+                    c21[j] = u3;
+                    c22[j] = u3 + c22[j];
+                }
+            }
+            // M4 = A22 T4 into C11, T4 = T2 - B21, then C21 -= M4
+            strassen_set(k2, n2, Y, n2, [&](u64 i, u64 j){ return Y[i*n2 + j] - B21[i*ldb + j]; });
+            strassen_rec(m2, n2, k2, A22, lda, Y, n2, C11, ldc, next);
+            strassen_set(m2, n2, C21, ldc, [&](u64 i, u64 j){ return C21[i*ldc + j] - C11[i*ldc + j]; });
+            // C11 = M2 + M1, M2 = A12 B21
+            strassen_rec(m2, n2, k2, A12, lda, B21, ldb, C11, ldc, next);
+            strassen_set(m2, n2, C11, ldc, [&](u64 i, u64 j){ return C11[i*ldc + j] + X[i*n2 + j]; });
+
+            strassen_peel(m, n, k, A, lda, B, ldb, C, ldc);
+        }
+
+        /*
+         * Top level with the seven products run as independent tasks, each
+         * forming its own operands and recursing sequentially. M2..M5 land
+         * in the quadrants of C, M1, M6 and M7 in the workspace.
+         * */
+        template<typename dt>
+        void strassen_par(u64 m, u64 n, u64 k, const dt* A, u64 lda, const dt* B, u64 ldb, dt* C, u64 ldc, dt* ws, ThreadPool& pool){
+            u64 m2 = m/2, n2 = n/2, k2 = k/2;
+            const dt *A11 = A, *A12 = A + k2, *A21 = A + m2*lda, *A22 = A21 + k2;
+            const dt *B11 = B, *B12 = B + n2, *B21 = B + k2*ldb, *B22 = B21 + n2;
+            dt *C11 = C, *C12 = C + n2, *C21 = C + m2*ldc, *C22 = C21 + n2;
+            dt *P1 = ws, *P6 = P1 + m2*n2, *P7 = P6 + m2*n2;
+            u64 task_ws = m2*k2 + k2*n2 + strassen_seq_workspace(m2, n2, k2);
+            dt* tasks = P7 + m2*n2;
+
+            pool.parallel_for(7, [&](u64 t){
+                dt* S = tasks + t*task_ws;
+                dt* T = S + m2*k2;
+                dt* next = T + k2*n2;
+                auto lhs = [&](auto f){ strassen_set(m2, k2, S, k2, [&](u64 i, u64 j){ return f(i*lda + j); }); };
+                auto rhs = [&](auto f){ strassen_set(k2, n2, T, n2, [&](u64 i, u64 j){ return f(i*ldb + j); }); };
+                switch(t){
+                    case 0: // M1 = A11 B11
+                        strassen_rec(m2, n2, k2, A11, lda, B11, ldb, P1, n2, next);
+                        break;
+                    case 1: // M2 = A12 B21
+                        strassen_rec(m2, n2, k2, A12, lda, B21, ldb, C11, ldc, next);
+                        break;
+                    case 2: // M3 = S4 B22, S4 = A11 + A12 - A21 - A22
+                        lhs([&](u64 o){ return A11[o] + A12[o] - A21[o] - A22[o]; });
+                        strassen_rec(m2, n2, k2, S, k2, B22, ldb, C12, ldc, next);
+                        break;
+                    case 3: // M4 = A22 T4, T4 = B11 - B12 - B21 + B22
+                        rhs([&](u64 o){ return B11[o] - B12[o] - B21[o] + B22[o]; });
+                        strassen_rec(m2, n2, k2, A22, lda, T, n2, C21, ldc, next);
+                        break;
+                    case 4: // M5 = S1 T1
+                        lhs([&](u64 o){ return A21[o] + A22[o]; });
+                        rhs([&](u64 o){ return B12[o] - B11[o]; });
+                        strassen_rec(m2, n2, k2, S, k2, T, n2, C22, ldc, next);
+                        break;
+                    case 5: // M6 = S2 T2, S2 = A21 + A22 - A11, T2 = B11 - B12 + B22
+                        lhs([&](u64 o){ return A21[o] + A22[o] - A11[o]; });
+                        rhs([&](u64 o){ return B11[o] - B12[o] + B22[o]; });
+                        strassen_rec(m2, n2, k2, S, k2, T, n2, P6, n2, next);
+                        break;
+                    default: // M7 = S3 T3
+                        lhs([&](u64 o){ return A11[o] - A21[o]; });
+                        rhs([&](u64 o){ return B22[o] - B12[o]; });
+                        strassen_rec(m2, n2, k2, S, k2, T, n2, P7, n2, next);
+                }
+            });
+
+            pool.parallel_for(m2, [&](u64 i){
+                const dt *p1 = P1 + i*n2, *p6 = P6 + i*n2, *p7 = P7 + i*n2;
+                dt *c11 = C11 + i*ldc, *c12 = C12 + i*ldc, *c21 = C21 + i*ldc, *c22 = C22 + i*ldc;
+                for(u64 j = 0; j < n2; j++){
+                    dt u2 = p1[j] + p6[j];
+                    dt u3 = u2 + p7[j];
+                    c11[j] += p1[j];
+                    c12[j] += u2 + c22[j];
+                    c21[j] = u3 - c21[j];
+                    c22[j] += u3;
+                }
+            });
+            strassen_peel(m, n, k, A, lda, B, ldb, C, ldc);
+        }
+    } // namespace detail
+
+    /**
+     * Levels of recursion a product of this shape goes through.
+     * */
+    inline u64 strassen_levels(u64 m, u64 n, u64 k){
+        u64 levels = 0;
+        for(; detail::strassen_splits(m, n, k); levels++){
+            m /= 2;
+            n /= 2;
+            k /= 2;
+        }
+        return levels;
+    }
+
+    /**
+     * Elements of workspace strassen needs for this shape, to allocate once
+     * and pass to many calls.
+     * */
+    inline u64 strassen_workspace(u64 m, u64 n, u64 k, ThreadPool* pool = nullptr){
+        if(!detail::strassen_splits(m, n, k)) return 0;
+        if(pool && pool->size() > 1) return detail::strassen_par_workspace(m, n, k);
+        return detail::strassen_seq_workspace(m, n, k);
+    }
+
+    /**
+     * C = A B with Strassen-Winograd, row major with row strides lda, ldb
+     * and ldc. C must not overlap A or B.
+     *
+     * @param pool threads running the seven top level products, or null.
+     * @param ws at least strassen_workspace(m, n, k, pool) elements, or
+     * null for a buffer kept per thread and grown as needed.
+     * */
+    template<typename dt>
+    void strassen(u64 m, u64 n, u64 k, const dt* A, u64 lda, const dt* B, u64 ldb, dt* C, u64 ldc,
+                  ThreadPool* pool = nullptr, dt* ws = nullptr){
+        ORION_PROFILE_SCOPE(prof, "strassen", "gemm");
+        ORION_PROFILE_SHAPE(prof, (DimVec{m, k}));
+        ORION_PROFILE_SHAPE(prof, (DimVec{k, n}));
+        u64 need = strassen_workspace(m, n, k, pool);
+        thread_local std::vector<dt> buf;
+        if(ws == nullptr){
+            if(buf.size() < need) buf.resize(need);
+            ws = buf.data();
+        }
+        if(pool && pool->size() > 1 && detail::strassen_splits(m, n, k))
+            detail::strassen_par(m, n, k, A, lda, B, ldb, C, ldc, ws, *pool);
+        else
+            detail::strassen_rec(m, n, k, A, lda, B, ldb, C, ldc, ws);
+    }
+
+    /**
+     * Error of strassen against gemm on one product.
+     * */
+    struct StrassenReport{
+        u64 levels = 0;
+        // largest |C_strassen - C_gemm|
+        double max_abs_error = 0;
+        // ||C_strassen - C_gemm||_F / ||C_gemm||_F
+        double rel_frobenius_error = 0;
+        // max_abs_error / (k max|A| max|B|), the quantity Strassen's error bound is stated in
+        double normwise_error = 0;
+        double gemm_seconds = 0;
+        double strassen_seconds = 0;
+    };
+
+    /**
+     * Multiply a and b both ways and compare, to decide whether the
+     * accuracy of strassen is acceptable for matrices like these.
+     * */
+    template<typename dt>
+    StrassenReport strassen_report(Tensor<dt> const& a, Tensor<dt> const& b, ThreadPool* pool = nullptr){
+        assert(a.rank() == 2 && b.rank() == 2 && a.dim()[1] == b.dim()[0]);
+        u64 m = a.dim()[0], k = a.dim()[1], n = b.dim()[1];
+        Tensor<dt> c0({m, n}), c1({m, n});
+        typedef std::chrono::steady_clock clock;
+
+        StrassenReport r;
+        r.levels = strassen_levels(m, n, k);
+        auto t0 = clock::now();
+        gemm(false, false, m, n, k, dt(1), a.data(), k, b.data(), n, dt(0), c0.data(), n);
+        auto t1 = clock::now();
+        strassen(m, n, k, a.data(), k, b.data(), n, c1.data(), n, pool);
+        auto t2 = clock::now();
+        r.gemm_seconds = std::chrono::duration<double>(t1 - t0).count();
+        r.strassen_seconds = std::chrono::duration<double>(t2 - t1).count();
+
+        double amax = 0, bmax = 0, diff2 = 0, ref2 = 0;
+        for(u64 i = 0; i < a.nelem(); i++) amax = std::max(amax, static_cast<double>(std::abs(a[i])));
+        for(u64 i = 0; i < b.nelem(); i++) bmax = std::max(bmax, static_cast<double>(std::abs(b[i])));
+        for(u64 i = 0; i < c0.nelem(); i++){
+            double d = static_cast<double>(std::abs(c1[i] - c0[i]));
+            double c = static_cast<double>(std::abs(c0[i]));
+            r.max_abs_error = std::max(r.max_abs_error, d);
+            diff2 += d*d;
+            ref2 += c*c;
+        }
+        r.rel_frobenius_error = ref2 > 0 ? std::sqrt(diff2/ref2) : std::sqrt(diff2);
+        double scale = static_cast<double>(k)*amax*bmax;
+        r.normwise_error = scale > 0 ? r.max_abs_error/scale : 0;
+        return r;
+    }
+
+} // namespace Orion
+
+#endif // STRASSEN_H_
@@ -4,15 +4,52 @@
 #include <iostream>
 #include <vector>
 #include <cstdlib>
+#include <cstring>
 #include <ctime>
 #include <cassert>
 
+#include <complex>
 #include <type_traits>
 
 #include "Typedefs.hpp"
+#include "Profiler.hpp"
+#include "Memory.hpp"
+#include "Dispatch.hpp"
 
 namespace Orion{
 
+    namespace detail{
+        // scalar operations per element of an expression, defined in Expressions.hpp
+        template<typename E>
+        struct expr_ops;
+
+        // element types taken as a scalar operand by the tensor operators
+        template<typename T>
+        struct is_tensor_scalar : std::is_scalar<T>{};
+        template<typename T>
+        struct is_tensor_scalar<std::complex<T>> : std::true_type{};
+    } // namespace detail
+
+    class ThreadPool;
+
+    /**
+     * Splitting of expression evaluation over a thread pool.
+     * */
+    struct EvalParams{
+        // elements below which an assignment stays on the calling thread
+        u64 parallel_min = u64(1) << 15;
+        // elements evaluated per task
+        u64 grain = u64(1) << 14;
+    };
+
+    /**
+     * Process wide evaluation parameters.
+     * */
+    inline EvalParams& eval_params(){
+        static EvalParams params;
+        return params;
+    }
+
     class TensorPtr{
     };
 
@@ -21,7 +58,7 @@ namespace Orion{
         public:
         // typedef E::value_type value_type;
         
-        inline double operator[](size_t i) const{
+        inline auto operator[](size_t i) const{
 			return static_cast<E const&>(*this)[i];
 		}
 		inline const DimVec& dim() const{
@@ -34,7 +71,7 @@ namespace Orion{
 
     /**
      * Tensor is a general linear algebra object in Orion.
-     * dt = int, float, double etc...
+     * dt = int, float, double, std::complex<double> etc...
      * */
     template <typename dt>
     class Tensor : public TensorBase<Tensor<dt>>{
@@ -56,9 +93,18 @@ namespace Orion{
          * Create tensor with given dimensions and use given data.
          * User is responsible for keeping this data valid. Tensor
          * class doesn't make a copy of this data anywhere.
+         * Buffers allocated by Tensor itself are reference counted
+         * and freed with the last tensor or subtensor using them.
          * */
         Tensor(const DimVec& dim, dt* data);
 
+        /**
+         * Create tensor with given dimensions over owner.get(), sharing
+         * ownership of the buffer, eg : a view into a larger allocation made
+         * with the aliasing constructor of std::shared_ptr.
+         * */
+        Tensor(const DimVec& dim, std::shared_ptr<dt> owner);
+
         template<typename E>
         Tensor(const TensorBase<E>& expr) : m_dim(expr.dim()){
             m_nelem = 1;
@@ -66,13 +112,50 @@ namespace Orion{
                 m_nelem *= m_dim[i];
             }
 
-            m_data = reinterpret_cast<dt*>(malloc(sizeof(dt) * m_nelem));
-            
-            for(u64 i = 0; i < m_nelem; i++){
-                m_data[i] = expr[i];
-           }
+            ORION_PROFILE_SCOPE(prof, "materialize", "expr");
+            ORION_PROFILE_SHAPE(prof, m_dim);
+            ORION_PROFILE_FLOPS(prof, m_nelem*detail::expr_ops<E>::value);
+            m_owner = MemoryTracker::instance().allocate<dt>(m_nelem, m_dim);
+            m_data = m_owner.get();
+
+            eval(static_cast<E const&>(expr), 0, m_nelem);
+        }
+
+        /**
+         * Evaluate an expression of the same shape into the existing
+         * buffer of this tensor, without allocating.
+         * */
+        template<typename E>
+        Tensor& assign(const TensorBase<E>& expr){
+            assert(rank() == expr.rank());
+            for(u64 i = 0; i < rank(); i++)
+                assert(m_dim[i] == expr.dim()[i]);
+            ORION_PROFILE_SCOPE(prof, "assign", "expr");
+            ORION_PROFILE_SHAPE(prof, m_dim);
+            ORION_PROFILE_FLOPS(prof, m_nelem*detail::expr_ops<E>::value);
+            eval(static_cast<E const&>(expr), 0, m_nelem);
+            return *this;
         }
 
+        /**
+         * Evaluate only the elements [first, last) of an expression of the
+         * same shape, for threads splitting one assignment between them.
+         * */
+        template<typename E>
+        Tensor& assign(const TensorBase<E>& expr, u64 first, u64 last){
+            assert(rank() == expr.rank() && first <= last && last <= m_nelem);
+            eval(static_cast<E const&>(expr), first, last);
+            return *this;
+        }
+
+        /**
+         * assign with the elements split over the threads of a pool, in
+         * blocks of eval_params().grain. Tensors smaller than
+         * eval_params().parallel_min are evaluated on the calling thread.
+         * */
+        template<typename E>
+        Tensor& assign(const TensorBase<E>& expr, ThreadPool& pool);
+
         template<typename E>
         Tensor& operator+=(const TensorBase<E>& other){
             assert(rank() == other.rank());
@@ -111,21 +194,21 @@ namespace Orion{
             return *this;
         }
 
-        template<typename Scalar, std::enable_if_t<std::is_scalar<Scalar>::value, bool> = true>
+        template<typename Scalar, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
         Tensor& operator+=(Scalar other){
             for(u64 i = 0; i < m_nelem; i++){
                 m_data[i] += other;
             }
             return *this;
         }
-        template<typename Scalar, std::enable_if_t<std::is_scalar<Scalar>::value, bool> = true>
+        template<typename Scalar, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
         Tensor& operator-=(Scalar other){
             for(u64 i = 0; i < m_nelem; i++){
                 m_data[i] += other;
             }
             return *this;
         }
-        template<typename Scalar, std::enable_if_t<std::is_scalar<Scalar>::value, bool> = true>
+        template<typename Scalar, std::enable_if_t<detail::is_tensor_scalar<Scalar>::value, bool> = true>
         Tensor& operator%=(Scalar other){
             for(u64 i = 0; i < m_nelem; i++){
                 m_data[i] *= other;
@@ -165,6 +248,7 @@ namespace Orion{
          * @return dt*
          * */
         inline dt* data() { return m_data; }
+        inline const dt* data() const { return m_data; }
 
         /**
          * Get total number of scalar elements in tensor
@@ -207,6 +291,7 @@ namespace Orion{
             }else{
                 dt* _data = m_data + m_nelem*index/m_dim[0];
                 Tensor<dt> res(DimVec(m_dim.begin()+1, m_dim.end()), _data);
+                res.m_owner = m_owner;
                 return res;
             }
         }
@@ -223,6 +308,7 @@ namespace Orion{
         inline Tensor<dt> operator () (index_t index, indices_t... indices) const{
             dt* _data = m_data + m_nelem*index/m_dim[0];
             Tensor<dt> res(DimVec(m_dim.begin()+1, m_dim.end()), _data);
+            res.m_owner = m_owner;
             return res(indices...);
         }
 
@@ -230,11 +316,17 @@ namespace Orion{
         inline friend std::ostream& operator << (std::ostream& out, const Tensor<_dt>& m);
 
         template <typename _dt>
-        inline friend std::iostream& operator >> (std::iostream& in, Tensor<_dt>& m);
+        inline friend std::istream& operator >> (std::istream& in, Tensor<_dt>& m);
 
         //Transpose
         inline auto t();
 
+        /**
+         * Copy with the axes reordered, axis k of the result being axis
+         * perm[k] of this tensor, eg : {0, 2, 1} swaps the last two axes.
+         * */
+        inline Tensor<dt> permute(DimVec const& perm) const;
+
         // inline Tensor<dt> operator + (const Tensor<dt>& m);
 
         // inline Tensor<dt> operator + (dt m);
@@ -247,11 +339,34 @@ namespace Orion{
 
         // inline Tensor<dt> operator * (dt m);
     private:
+        // evaluated on the derived expression in fixed length chunks through
+        // a local buffer, so the inner loop has a known trip count, cannot
+        // alias the operands and is vectorized at -O2, for the best
+        // instruction set of the CPU
+        template<typename E>
+        void eval(E const& e, u64 first, u64 last){
+            isa_dispatch([&]{ eval_chunks(e, first, last); });
+        }
+        template<typename E>
+        ORION_VEC_INLINE void eval_chunks(E const& e, u64 first, u64 last){
+            constexpr u64 chunk = 16;
+            dt buf[chunk];
+            u64 i = first;
+            for(; i + chunk <= last; i += chunk){
+                for(u64 j = 0; j < chunk; j++) buf[j] = static_cast<dt>(e[i + j]);
+                std::memcpy(m_data + i, buf, sizeof(buf));
+            }
+            for(; i < last; i++) m_data[i] = static_cast<dt>(e[i]);
+        }
+
         union {
-            dt* m_data; // we store data of tensor as linear array
+            dt* m_data = nullptr; // we store data of tensor as linear array
             dt m_scalar; // if this is tensor of rank 0 then only scalar field is used
         };
 
+        // keeps the allocation alive, shared by copies and subtensors
+        std::shared_ptr<dt> m_owner;
+
         // stores information about tensor dimensions
         DimVec m_dim;
 
@@ -264,5 +379,6 @@ namespace Orion{
 #include "TensorImpl.hpp"
 #include "Expressions.hpp"
 #include "Operators.hpp"
+#include "FixedTensor.hpp"
 
 #endif // TENSOR_H_
@@ -2,6 +2,8 @@
 #define TENSORIMPL_H_
 
 #include "Tensor.hpp"
+#include "Transpose.hpp"
+#include "TextIO.hpp"
 
 #include <iomanip>
 #include <cstring>
@@ -16,7 +18,8 @@ namespace Orion{
             m_nelem *= m_dim[i];
         }
 
-        m_data = reinterpret_cast<dt*>(malloc(sizeof(dt) * m_nelem));
+        m_owner = MemoryTracker::instance().allocate<dt>(m_nelem, m_dim);
+        m_data = m_owner.get();
     }
 
     template <typename dt>
@@ -27,6 +30,11 @@ namespace Orion{
         }
     }
 
+    template <typename dt>
+    Tensor<dt>::Tensor(const DimVec& dim, std::shared_ptr<dt> owner) : Tensor(dim, owner.get()) {
+        m_owner = std::move(owner);
+    }
+
 
     template <typename dt>
     inline void Tensor<dt>::zeroes(){
@@ -52,7 +60,7 @@ namespace Orion{
             // if(max != 0) m_data[i] = min + (static_cast<dt>(rand()) - static_cast<float>(RAND_MAX)/2)*max/static_cast<dt>(RAND_MAX);
             // else m_data[i] = min + static_cast<dt>(rand()%RAND_MAX);
 
-            m_data[i] = (static_cast<dt>(rand())/RAND_MAX)*(max-min) + min;
+            m_data[i] = (static_cast<dt>(rand())/static_cast<dt>(RAND_MAX))*(max-min) + min;
         }
     }
 
@@ -63,57 +71,22 @@ namespace Orion{
         }
     }
 
-    template <typename dt>
-    inline std::ostream& operator << (std::ostream& out, const Tensor<dt>& t){
-        static u64 toprank = t.rank();
-        if(t.rank() == 0){
-            // print scalar
-            std::cout << "[" << std::setw(10) << t.m_scalar << "]";
-        }else if(t.rank() == 1){
-            dt* m_data = t.m_data;
-            const DimVec& m_dim = t.m_dim;
-
-            // print vector
-            std::cout << "[" << std::setw(10);
-            for(u64 i = 0; i < m_dim[0]; i++){
-                std::cout << m_data[i];
-                if(i != m_dim[0]-1) std::cout << ", ";
-            }
-            std::cout << "]";
-        }else{
-            const std::vector<u64>& m_dim = t.m_dim;
-            std::cout << "[";
-            for(u64 i = 0; i < m_dim[0]; i++){
-                if(i > 0) std::cout << std::string(toprank - t.rank() + 1, ' ');
-                std::cout << t(i);
-                if(i != m_dim[0]-1) std::cout << std::string(t.rank()-2, '\n');
-            }
-            std::cout << "]";
-        }
-
-        return out;
-    }
-
-    /*
-     * TODO: Neex to FIX this. We need tensor template too
-    template <typename dt>
-    template <typename index_t, typename... indices_t>
-    inline Tensor<> operator () (index_t index, indices_t... indices){
-
-    }
-    */
-
-    template <typename dt>
-    inline std::iostream& operator >> (std::iostream& in, Tensor<dt>& m){
-        dt* m_data = m.m_data;
-        u64 m_nelem = m.nr * m.nc;
-
-        // elements are taken in row major order
-        for(u64 i = 0; i < m_nelem; i++){
-            in >> m_data[i];
-        }
-
-        return in;
+    template<typename dt>
+    template<typename E>
+    inline Tensor<dt>& Tensor<dt>::assign(const TensorBase<E>& expr, ThreadPool& pool){
+        EvalParams const& ep = eval_params();
+        if(pool.size() < 2 || m_nelem < ep.parallel_min) return assign(expr);
+        assert(rank() == expr.rank());
+        for(u64 i = 0; i < rank(); i++)
+            assert(m_dim[i] == expr.dim()[i]);
+        ORION_PROFILE_SCOPE(prof, "assign", "expr");
+        ORION_PROFILE_SHAPE(prof, m_dim);
+        ORION_PROFILE_FLOPS(prof, m_nelem*detail::expr_ops<E>::value);
+        u64 grain = std::max<u64>(ep.grain, 16);
+        pool.parallel_for((m_nelem + grain - 1)/grain, [&](u64 b){
+            eval(static_cast<E const&>(expr), b*grain, std::min(m_nelem, (b + 1)*grain));
+        });
+        return *this;
     }
 
     template<typename dt>
@@ -122,15 +95,20 @@ namespace Orion{
         auto& shape = m_dim;
         size_t n = shape[0];
         size_t m = shape[1];
-        Tensor<dt> transpose({m , n});
-        auto d = transpose.data();
-        for(u64 i = 0; i < n; i++){
-            for(u64 j = 0; j < m; j++)
-               d[j*n + i]  = m_data[i*m + j];
-        }
+        Tensor<dt> res({m , n});
+        transpose(n, m, m_data, m, res.data(), n);
+        return res;
+    }
 
-        return transpose;
-    }    
+    template<typename dt>
+    inline Tensor<dt> Tensor<dt>::permute(DimVec const& perm) const{
+        assert(perm.size() == rank());
+        DimVec out(rank());
+        for(u64 k = 0; k < rank(); k++) out[k] = m_dim[perm[k]];
+        Tensor<dt> res(out);
+        Orion::permute(m_dim, perm, m_data, res.data());
+        return res;
+    }
 }
 
 #endif // TENSORIMPL_H_
@@ -0,0 +1,329 @@
+#ifndef TEXTIO_H_
+#define TEXTIO_H_
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <cmath>
+#include <complex>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+#include "Typedefs.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+#include "Tensor.hpp"
+
+/*
+ * Text input and output of tensors. Numbers are formatted with to_chars
+ * into large buffers handed to the stream in few writes, and parsed with
+ * from_chars straight from a memory mapped file, in parallel over chunks
+ * of whole lines. Both give the shortest text that reads back to the same
+ * value.
+ *
+ *     write_text(file, t, ',');                   // one row of the last axis per line
+ *     Tensor<double> u = read_text<double>("t.csv");
+ *     std::cout << t;                             // nested brackets
+ * */
+
+namespace Orion{
+
+    namespace detail{
+        // bytes formatted before a buffer is handed to the stream
+        constexpr size_t text_flush = size_t(1) << 20;
+        // bytes of input below which parsing stays on the calling thread
+        constexpr u64 text_parallel_min = u64(1) << 20;
+
+        template<typename dt>
+        inline void append_number(std::string& s, dt v){
+            char buf[64];
+            auto res = std::to_chars(buf, buf + sizeof(buf), v);
+            s.append(buf, res.ptr);
+        }
+
+        // complex numbers as 1.5-2j, the imaginary part always signed
+        template<typename T>
+        inline void append_number(std::string& s, std::complex<T> v){
+            append_number(s, v.real());
+            if(!std::signbit(v.imag())) s += '+';
+            append_number(s, v.imag());
+            s += 'j';
+        }
+
+        inline bool is_text_separator(char c){
+            return c == ' ' || c == ',' || c == '\t' || c == ';' || c == '\r';
+        }
+
+        // parse one number at p, returns the end of it or nullptr when there is none
+        template<typename dt>
+        inline const char* parse_number(const char* p, const char* end, dt& v){
+            if(std::is_floating_point<dt>::value && p < end && *p == '+') p++;
+            auto res = std::from_chars(p, end, v);
+            return res.ec == std::errc() ? res.ptr : nullptr;
+        }
+
+        // 1.5-2j, 1.5 or 2j
+        template<typename T>
+        inline const char* parse_number(const char* p, const char* end, std::complex<T>& v){
+            T re{}, im{};
+            const char* q = parse_number(p, end, re);
+            if(!q) return nullptr;
+            if(q < end && *q == 'j'){
+                v = std::complex<T>(0, re);
+                return q + 1;
+            }
+            if(q < end && (*q == '+' || *q == '-')){
+                const char* r = parse_number(q, end, im);
+                if(!r || r == end || *r != 'j') return nullptr;
+                v = std::complex<T>(re, im);
+                return r + 1;
+            }
+            v = std::complex<T>(re, 0);
+            return q;
+        }
+
+        /*
+         * Numbers of whole lines in [begin, end), separated by spaces, tabs,
+         * commas or semicolons. Blank lines are skipped. cols is the count
+         * of the first line, every line must have the same count. Parsing
+         * stops at the first invalid number or line of another length and
+         * marks the chunk bad.
+         * */
+        template<typename dt>
+        struct TextChunk{
+            std::vector<dt> values;
+            u64 rows = 0;
+            u64 cols = 0;
+            bool bad = false;
+        };
+
+        template<typename dt>
+        inline void parse_lines(const char* p, const char* end, TextChunk<dt>& chunk){
+            while(p < end){
+                u64 count = 0;
+                while(p < end && *p != '\n'){
+                    if(is_text_separator(*p)){
+                        p++;
+                        continue;
+                    }
+                    dt v;
+                    const char* q = parse_number(p, end, v);
+                    if(!q){
+                        chunk.bad = true;
+                        return;
+                    }
+                    chunk.values.push_back(v);
+                    count++;
+                    p = q;
+                }
+                p++;
+                if(count == 0) continue;
+                if(chunk.rows == 0) chunk.cols = count;
+                else if(count != chunk.cols){
+                    chunk.bad = true;
+                    return;
+                }
+                chunk.rows++;
+            }
+        }
+
+        // elements of axis k are followed by "," and rank - 1 - k newlines, innermost ones by ", "
+        template<typename dt>
+        inline void format_nested(std::ostream& out, std::string& s, const dt* data, DimVec const& dim, u64 axis, u64 stride){
+            s += '[';
+            u64 n = dim[axis];
+            u64 inner = n ? stride/n : 0;
+            for(u64 i = 0; i < n; i++){
+                if(i){
+                    if(axis + 1 == dim.size()) s += ", ";
+                    else{
+                        s += ',';
+                        s.append(dim.size() - 1 - axis, '\n');
+                        s.append(axis + 1, ' ');
+                    }
+                }
+                if(axis + 1 == dim.size()) append_number(s, data[i]);
+                else format_nested(out, s, data + i*inner, dim, axis + 1, inner);
+                if(s.size() >= text_flush){
+                    out.write(s.data(), static_cast<std::streamsize>(s.size()));
+                    s.clear();
+                }
+            }
+            s += ']';
+        }
+    } // namespace detail
+
+    /**
+     * Write t as text, one row of its last axis per line with its
+     * numbers separated by delimiter. Rows are formatted into buffers in
+     * parallel when a pool is given and written to out in order.
+     * */
+    template<typename dt>
+    void write_text(std::ostream& out, Tensor<dt> const& t, char delimiter = ' ', ThreadPool* pool = nullptr){
+        u64 cols = t.rank() ? t.dim()[t.rank() - 1] : 1;
+        u64 rows = cols ? t.nelem()/cols : 0;
+        const dt* data = t.rank() ? t.data() : nullptr;
+        dt scalar{};
+        if(t.rank() == 0){
+            scalar = Tensor<dt>(t).value();
+            data = &scalar;
+            rows = 1;
+        }
+        auto format = [&](std::string& s, u64 lo, u64 hi, bool flush){
+            for(u64 r = lo; r < hi; r++){
+                for(u64 c = 0; c < cols; c++){
+                    if(c) s += delimiter;
+                    detail::append_number(s, data[r*cols + c]);
+                }
+                s += '\n';
+                if(flush && s.size() >= detail::text_flush){
+                    out.write(s.data(), static_cast<std::streamsize>(s.size()));
+                    s.clear();
+                }
+            }
+        };
+        if(pool == nullptr || pool->size() < 2 || rows < 2){
+            std::string s;
+            s.reserve(detail::text_flush + 64*cols);
+            format(s, 0, rows, true);
+            out.write(s.data(), static_cast<std::streamsize>(s.size()));
+            return;
+        }
+        // a batch of blocks is formatted in parallel, then written in order
+        u64 block = std::max<u64>(1, (u64(1) << 16)/std::max<u64>(cols, 1));
+        u64 blocks = (rows + block - 1)/block;
+        u64 batch = pool->size()*2;
+        std::vector<std::string> bufs(batch);
+        for(u64 b0 = 0; b0 < blocks; b0 += batch){
+            u64 nb = std::min(batch, blocks - b0);
+            pool->parallel_for(nb, [&](u64 b){
+                bufs[b].clear();
+                format(bufs[b], (b0 + b)*block, std::min(rows, (b0 + b + 1)*block), false);
+            });
+            for(u64 b = 0; b < nb; b++) out.write(bufs[b].data(), static_cast<std::streamsize>(bufs[b].size()));
+        }
+    }
+
+    /**
+     * Parse rows of numbers from text in [begin, end) into a rows x cols
+     * tensor. Numbers are separated by spaces, tabs, commas or semicolons
+     * and rows by newlines, blank lines are skipped.
+     *
+     * @return an empty tensor if the text holds an invalid number or rows
+     * of different lengths.
+     * @param skip_rows lines at the start to ignore, such as a CSV header.
+     * @param pool threads parsing chunks of lines, or null.
+     * */
+    template<typename dt>
+    Tensor<dt> parse_text(const char* begin, const char* end, ThreadPool* pool = nullptr, u64 skip_rows = 0){
+        for(u64 r = 0; r < skip_rows && begin < end; r++){
+            const char* nl = static_cast<const char*>(std::memchr(begin, '\n', static_cast<size_t>(end - begin)));
+            begin = nl ? nl + 1 : end;
+        }
+        u64 bytes = static_cast<u64>(end - begin);
+        u64 chunks = pool && pool->size() > 1 && bytes >= detail::text_parallel_min ? pool->size()*4 : 1;
+
+        // chunk boundaries moved forward past the next newline
+        std::vector<const char*> cut(chunks + 1, end);
+        cut[0] = begin;
+        for(u64 c = 1; c < chunks; c++){
+            const char* p = std::max(cut[c - 1], begin + bytes*c/chunks);
+            const char* nl = p < end ? static_cast<const char*>(std::memchr(p, '\n', static_cast<size_t>(end - p))) : nullptr;
+            cut[c] = nl ? nl + 1 : end;
+        }
+
+        std::vector<detail::TextChunk<dt>> parts(chunks);
+        auto parse = [&](u64 c){
+            parts[c].values.reserve(static_cast<size_t>(cut[c + 1] - cut[c])/4);
+            detail::parse_lines(cut[c], cut[c + 1], parts[c]);
+        };
+        if(chunks == 1) parse(0);
+        else pool->parallel_for(chunks, parse);
+
+        u64 rows = 0, cols = 0;
+        std::vector<u64> offset(chunks, 0);
+        for(u64 c = 0; c < chunks; c++){
+            if(parts[c].bad) return Tensor<dt>();
+            if(parts[c].rows == 0) continue;
+            if(rows == 0) cols = parts[c].cols;
+            if(parts[c].cols != cols || parts[c].values.size() != parts[c].rows*cols) return Tensor<dt>();
+            offset[c] = rows*cols;
+            rows += parts[c].rows;
+        }
+        Tensor<dt> t(DimVec{rows, cols});
+        auto copy = [&](u64 c){
+            if(parts[c].rows)
+                std::memcpy(t.data() + offset[c], parts[c].values.data(), parts[c].rows*cols*sizeof(dt));
+        };
+        if(chunks == 1) copy(0);
+        else pool->parallel_for(chunks, copy);
+        return t;
+    }
+
+    /**
+     * Map the file at path and parse it with parse_text.
+     * */
+    template<typename dt>
+    Tensor<dt> read_text(std::string const& path, ThreadPool* pool = nullptr, u64 skip_rows = 0){
+        MappedFile f(path);
+        f.advise(false);
+        const char* p = reinterpret_cast<const char*>(f.data());
+        return parse_text<dt>(p, p + f.size(), pool, skip_rows);
+    }
+
+    /**
+     * Print t with nested brackets, one bracket level per axis.
+     * */
+    template <typename dt>
+    inline std::ostream& operator << (std::ostream& out, const Tensor<dt>& t){
+        std::string s;
+        if(t.rank() == 0){
+            s += '[';
+            detail::append_number(s, t.m_scalar);
+            s += ']';
+        }else{
+            detail::format_nested(out, s, t.m_data, t.m_dim, 0, t.m_nelem);
+        }
+        out.write(s.data(), static_cast<std::streamsize>(s.size()));
+        return out;
+    }
+
+    /**
+     * Read t.nelem() numbers into t in row major order. Brackets, commas
+     * and whitespace between them are skipped, so printed tensors read
+     * back. Sets failbit when the stream ends early.
+     * */
+    template <typename dt>
+    inline std::istream& operator >> (std::istream& in, Tensor<dt>& t){
+        std::streambuf* sb = in.rdbuf();
+        u64 n = t.rank() == 0 ? 1 : t.m_nelem;
+        char token[128];
+        for(u64 i = 0; i < n; i++){
+            int c = sb->sgetc();
+            while(c != EOF && (std::isspace(c) || c == '[' || c == ']' || detail::is_text_separator(static_cast<char>(c))))
+                c = sb->snextc();
+            size_t len = 0;
+            while(c != EOF && len < sizeof(token) && !std::isspace(c) && c != '[' && c != ']'
+                  && !detail::is_text_separator(static_cast<char>(c))){
+                token[len++] = static_cast<char>(c);
+                c = sb->snextc();
+            }
+            dt v{};
+            if(len == 0 || detail::parse_number(token, token + len, v) != token + len){
+                in.setstate(len == 0 ? std::ios::eofbit | std::ios::failbit : std::ios::failbit);
+                return in;
+            }
+            if(t.rank() == 0) t.m_scalar = v;
+            else t.m_data[i] = v;
+        }
+        return in;
+    }
+
+} // namespace Orion
+
+#endif // TEXTIO_H_
@@ -0,0 +1,161 @@
+#ifndef THREADPOOL_H_
+#define THREADPOOL_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Typedefs.hpp"
+
+namespace Orion{
+
+    /**
+     * Fixed set of threads running parallel loops. The calling thread
+     * takes part in every loop, so a pool of size n starts n - 1 threads.
+     *
+     * Idle threads also run independent tasks given to submit. A loop
+     * waits for every thread, including those finishing a task, so tasks
+     * must not start loops on their own pool.
+     * */
+    class ThreadPool{
+    public:
+        /**
+         * @param threads total threads per loop including the caller, 0 for one per hardware thread.
+         * */
+        explicit ThreadPool(u64 threads = 0){
+            if(threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+            m_size = threads;
+            for(u64 t = 1; t < threads; t++)
+                m_threads.emplace_back([this, t]{ work(t); });
+        }
+
+        ~ThreadPool(){
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_stop = true;
+            }
+            m_start.notify_all();
+            for(auto& t : m_threads) t.join();
+        }
+        ThreadPool(ThreadPool const&) = delete;
+        ThreadPool& operator=(ThreadPool const&) = delete;
+
+        u64 size() const{ return m_size; }
+
+        /**
+         * Run f(i) for every i in [0, n) and return once all calls are done.
+         * Indices are handed out one at a time, so uneven tasks balance.
+         * Loops must not be started concurrently on the same pool.
+         * */
+        void parallel_for(u64 n, std::function<void(u64)> const& f){
+            if(n == 0) return;
+            if(m_threads.empty() || n == 1){
+                for(u64 i = 0; i < n; i++) f(i);
+                return;
+            }
+            start(n, f, false);
+        }
+
+        /**
+         * Run f(t) exactly once on every thread t of the pool, the caller
+         * being thread 0. Unlike parallel_for the thread running an index
+         * is fixed, so work split this way touches the same memory from
+         * the same thread every time.
+         * */
+        void for_each_thread(std::function<void(u64)> const& f){
+            if(m_threads.empty()){
+                f(0);
+                return;
+            }
+            start(m_size, f, true);
+        }
+
+        /**
+         * Queue f to run once on one of the pool threads, never on the
+         * caller. Tasks start in submission order and the pool finishes
+         * queued tasks before it is destroyed. A pool of size 1 has no
+         * threads to run them.
+         * */
+        void submit(std::function<void()> f){
+            assert(!m_threads.empty() && "ThreadPool: submit needs a pool of at least two threads");
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_tasks.push_back(std::move(f));
+            }
+            m_start.notify_one();
+        }
+
+    private:
+        void start(u64 n, std::function<void(u64)> const& f, bool per_thread){
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_func = &f;
+                m_n = n;
+                m_per_thread = per_thread;
+                m_next.store(0);
+                m_pending = m_threads.size();
+                m_generation++;
+            }
+            m_start.notify_all();
+            run(0);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_done.wait(lock, [&]{ return m_pending == 0; });
+            m_func = nullptr;
+        }
+
+        void run(u64 self){
+            if(m_per_thread){
+                (*m_func)(self);
+                return;
+            }
+            for(u64 i; (i = m_next.fetch_add(1)) < m_n;) (*m_func)(i);
+        }
+
+        void work(u64 self){
+            u64 seen = 0;
+            while(true){
+                std::function<void()> task;
+                {
+                    std::unique_lock<std::mutex> lock(m_mutex);
+                    m_start.wait(lock, [&]{ return m_stop || m_generation != seen || !m_tasks.empty(); });
+                    // a started loop goes first, it is waiting for this thread
+                    if(m_generation != seen) seen = m_generation;
+                    else if(!m_tasks.empty()){
+                        task = std::move(m_tasks.front());
+                        m_tasks.pop_front();
+                    }
+                    else return;
+                }
+                if(task){
+                    task();
+                    continue;
+                }
+                run(self);
+                std::lock_guard<std::mutex> lock(m_mutex);
+                if(--m_pending == 0) m_done.notify_one();
+            }
+        }
+
+        u64 m_size;
+        std::vector<std::thread> m_threads;
+        std::mutex m_mutex;
+        std::condition_variable m_start, m_done;
+        std::function<void(u64)> const* m_func = nullptr;
+        std::deque<std::function<void()>> m_tasks;
+        u64 m_n = 0;
+        bool m_per_thread = false;
+        std::atomic<u64> m_next{0};
+        u64 m_pending = 0;
+        u64 m_generation = 0;
+        bool m_stop = false;
+    };
+
+} // namespace Orion
+
+#endif // THREADPOOL_H_
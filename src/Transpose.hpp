@@ -0,0 +1,254 @@
+#ifndef TRANSPOSE_H_
+#define TRANSPOSE_H_
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <vector>
+
+#include "Typedefs.hpp"
+#include "ThreadPool.hpp"
+
+/*
+ * Materialized layout changes: 2D transpose, in place square transpose and
+ * N-D permute. Large problems are split recursively until a block of the
+ * source and one of the destination fit in L1 together, so the kernels are
+ * cache oblivious, and blocks are moved as 8x8 tiles of 2x2 register
+ * blocks that the compiler rearranges with shuffles.
+ * */
+
+namespace Orion{
+
+    /**
+     * Blocking of the transpose kernels.
+     * */
+    struct TransposeParams{
+        // largest block side handled without splitting, two blocks of doubles fill 16 KB
+        u64 leaf = 32;
+        // elements below which threads are not worth waking
+        u64 parallel_min = u64(1) << 16;
+    };
+
+    /**
+     * Process wide transpose parameters.
+     * */
+    inline TransposeParams& transpose_params(){
+        static TransposeParams params;
+        return params;
+    }
+
+    namespace detail{
+        // side of the tile moved through registers
+        constexpr u64 transpose_tile = 8;
+
+        // 2x2 blocks of one tile stay in registers, each pair of loaded
+        // rows is written as pairs of output rows, which compiles to
+        // unpack shuffles on SSE2 and wider
+        template<typename dt>
+        ORION_VEC_INLINE void transpose_tile8(const dt* src, u64 lds, dt* dst, u64 ldd){
+            constexpr u64 B = transpose_tile;
+            for(u64 i = 0; i < B; i += 2)
+                for(u64 j = 0; j < B; j += 2){
+                    dt a0 = src[i*lds + j], a1 = src[i*lds + j + 1];
+                    dt b0 = src[(i + 1)*lds + j], b1 = src[(i + 1)*lds + j + 1];
+                    dst[j*ldd + i] = a0;
+                    dst[j*ldd + i + 1] = b0;
+                    dst[(j + 1)*ldd + i] = a1;
+                    dst[(j + 1)*ldd + i + 1] = b1;
+                }
+        }
+
+        template<typename dt>
+        ORION_VEC_FLATTEN void transpose_block(const dt* src, u64 lds, dt* dst, u64 ldd, u64 rows, u64 cols){
+            constexpr u64 B = transpose_tile;
+            u64 i = 0;
+            for(; i + B <= rows; i += B){
+                u64 j = 0;
+                for(; j + B <= cols; j += B)
+                    transpose_tile8(src + i*lds + j, lds, dst + j*ldd + i, ldd);
+                for(; j < cols; j++)
+                    for(u64 r = 0; r < B; r++) dst[j*ldd + i + r] = src[(i + r)*lds + j];
+            }
+            for(; i < rows; i++)
+                for(u64 j = 0; j < cols; j++) dst[j*ldd + i] = src[i*lds + j];
+        }
+
+        // halves the longer side, at a tile boundary, until the block is a leaf
+        template<typename dt>
+        void transpose_rec(const dt* src, u64 lds, dt* dst, u64 ldd, u64 rows, u64 cols, u64 leaf){
+            if(rows <= leaf && cols <= leaf){
+                transpose_block(src, lds, dst, ldd, rows, cols);
+            }else if(rows >= cols){
+                u64 h = (rows/2 + transpose_tile - 1)/transpose_tile*transpose_tile;
+                transpose_rec(src, lds, dst, ldd, h, cols, leaf);
+                transpose_rec(src + h*lds, lds, dst + h, ldd, rows - h, cols, leaf);
+            }else{
+                u64 h = (cols/2 + transpose_tile - 1)/transpose_tile*transpose_tile;
+                transpose_rec(src, lds, dst, ldd, rows, h, leaf);
+                transpose_rec(src + h, lds, dst + h*ldd, ldd, rows, cols - h, leaf);
+            }
+        }
+
+        // swap the tiles at (r, c) and (c, r) of a, transposing both, r == c for a diagonal tile
+        template<typename dt>
+        ORION_VEC_INLINE void transpose_swap_tiles(dt* a, u64 lda, u64 r, u64 c, u64 h, u64 w){
+            constexpr u64 B = transpose_tile;
+            dt t1[B][B], t2[B][B];
+            for(u64 i = 0; i < h; i++)
+                for(u64 j = 0; j < w; j++) t1[j][i] = a[(r + i)*lda + c + j];
+            for(u64 i = 0; i < w; i++)
+                for(u64 j = 0; j < h; j++) t2[j][i] = a[(c + i)*lda + r + j];
+            for(u64 j = 0; j < w; j++)
+                std::memcpy(a + (c + j)*lda + r, t1[j], h*sizeof(dt));
+            for(u64 j = 0; j < h; j++)
+                std::memcpy(a + (r + j)*lda + c, t2[j], w*sizeof(dt));
+        }
+    } // namespace detail
+
+    /**
+     * dst = transpose of src, src being rows x cols.
+     *
+     * @param lds distance between rows of src, at least cols.
+     * @param ldd distance between rows of dst, at least rows.
+     * @param pool threads to split large problems over, or null.
+     * */
+    template<typename dt>
+    void transpose(u64 rows, u64 cols, const dt* src, u64 lds, dt* dst, u64 ldd, ThreadPool* pool = nullptr){
+        assert(lds >= cols && ldd >= rows);
+        TransposeParams const& tp = transpose_params();
+        u64 leaf = std::max(tp.leaf, detail::transpose_tile);
+        if(pool == nullptr || pool->size() < 2 || rows*cols < tp.parallel_min){
+            detail::transpose_rec(src, lds, dst, ldd, rows, cols, leaf);
+            return;
+        }
+        // bands of whole tiles along the longer side, a few per thread
+        constexpr u64 B = detail::transpose_tile;
+        bool by_rows = rows >= cols;
+        u64 len = by_rows ? rows : cols;
+        u64 tiles = (len + B - 1)/B;
+        u64 bands = std::min(tiles, pool->size()*4);
+        pool->parallel_for(bands, [&](u64 b){
+            u64 lo = std::min(len, tiles*b/bands*B), hi = std::min(len, tiles*(b + 1)/bands*B);
+            if(by_rows) detail::transpose_rec(src + lo*lds, lds, dst + lo, ldd, hi - lo, cols, leaf);
+            else detail::transpose_rec(src + lo, lds, dst + lo*ldd, ldd, rows, hi - lo, leaf);
+        });
+    }
+
+    /**
+     * Transpose the n x n matrix a in place. Tiles mirrored about the
+     * diagonal are exchanged in pairs, each read and written once.
+     * */
+    template<typename dt>
+    void transpose_inplace(u64 n, dt* a, u64 lda, ThreadPool* pool = nullptr){
+        assert(lda >= n);
+        constexpr u64 B = detail::transpose_tile;
+        u64 tiles = (n + B - 1)/B;
+        // tile row r owns the pairs (r, c) with c >= r, so rows never touch the same tiles
+        auto row = [&](u64 tr){
+            u64 r = tr*B, h = std::min(B, n - r);
+            for(u64 c = r; c < n; c += B) detail::transpose_swap_tiles(a, lda, r, c, h, std::min(B, n - c));
+        };
+        if(pool == nullptr || pool->size() < 2 || n*n < transpose_params().parallel_min){
+            for(u64 tr = 0; tr < tiles; tr++) row(tr);
+            return;
+        }
+        pool->parallel_for(tiles, row);
+    }
+
+    /**
+     * dst = src with its axes permuted, output axis k being input axis
+     * perm[k]. Both are dense row major arrays. Axes that stay next to
+     * each other are merged first. When the innermost input axis stays
+     * innermost rows are copied whole, otherwise every 2D slice between
+     * the two innermost axes goes through the blocked transpose.
+     *
+     * @param dim shape of src.
+     * */
+    template<typename dt>
+    void permute(DimVec const& dim, DimVec const& perm, const dt* src, dt* dst, ThreadPool* pool = nullptr){
+        u64 rank = dim.size();
+        assert(perm.size() == rank);
+        u64 nelem = 1;
+        for(u64 d : dim) nelem *= d;
+        if(nelem == 0) return;
+
+        // drop unit axes, then merge input axes that stay consecutive in the output
+        {
+            std::vector<bool> seen(rank, false);
+            for(u64 p : perm){
+                assert(p < rank && !seen[p] && "permute: perm is not a permutation");
+                seen[p] = true;
+            }
+        }
+        DimVec order;
+        for(u64 p : perm)
+            if(dim[p] != 1) order.push_back(p);
+        DimVec in_dim, out_perm;
+        {
+            // groups of output consecutive, input consecutive axes
+            std::vector<std::pair<u64, u64>> groups; // first input axis, size
+            for(size_t k = 0; k < order.size(); k++){
+                if(k > 0){
+                    // next kept input axis after order[k - 1]
+                    u64 next = order[k - 1] + 1;
+                    while(next < rank && dim[next] == 1) next++;
+                    if(next == order[k]){
+                        groups.back().second *= dim[order[k]];
+                        continue;
+                    }
+                }
+                groups.push_back({order[k], dim[order[k]]});
+            }
+            // input order of the groups gives the reduced input shape
+            std::vector<size_t> by_input(groups.size());
+            for(size_t g = 0; g < groups.size(); g++) by_input[g] = g;
+            std::sort(by_input.begin(), by_input.end(), [&](size_t x, size_t y){ return groups[x].first < groups[y].first; });
+            DimVec rank_of(groups.size(), 0);
+            for(size_t i = 0; i < by_input.size(); i++){
+                rank_of[by_input[i]] = i;
+                in_dim.push_back(groups[by_input[i]].second);
+            }
+            for(size_t g = 0; g < groups.size(); g++) out_perm.push_back(rank_of[g]);
+        }
+        u64 r = in_dim.size();
+        if(r <= 1){
+            std::memcpy(dst, src, nelem*sizeof(dt));
+            return;
+        }
+
+        DimVec in_stride(r, 1), out_stride(r, 1), pos(r, 0);
+        for(u64 k = r - 1; k-- > 0;){
+            in_stride[k] = in_stride[k + 1]*in_dim[k + 1];
+            out_stride[k] = out_stride[k + 1]*in_dim[out_perm[k + 1]];
+        }
+        for(u64 k = 0; k < r; k++) pos[out_perm[k]] = k;
+
+        // axes walked by the outer loop, in input order
+        u64 last = r - 1, inner = out_perm[r - 1];
+        bool rows_stay = inner == last;
+        DimVec outer;
+        for(u64 ax = 0; ax < r; ax++)
+            if(ax != last && (rows_stay || ax != inner)) outer.push_back(ax);
+        u64 count = 1;
+        for(u64 ax : outer) count *= in_dim[ax];
+
+        auto slice = [&](u64 o, ThreadPool* p){
+            u64 so = 0, doff = 0;
+            for(size_t i = outer.size(); i-- > 0;){
+                u64 ax = outer[i], idx = o%in_dim[ax];
+                o /= in_dim[ax];
+                so += idx*in_stride[ax];
+                doff += idx*out_stride[pos[ax]];
+            }
+            if(rows_stay) std::memcpy(dst + doff, src + so, in_dim[last]*sizeof(dt));
+            else transpose(in_dim[inner], in_dim[last], src + so, in_stride[inner], dst + doff, out_stride[pos[last]], p);
+        };
+        if(pool != nullptr && pool->size() > 1 && count > 1 && nelem >= transpose_params().parallel_min)
+            pool->parallel_for(count, [&](u64 o){ slice(o, nullptr); });
+        else
+            for(u64 o = 0; o < count; o++) slice(o, pool);
+    }
+
+} // namespace Orion
+
+#endif // TRANSPOSE_H_
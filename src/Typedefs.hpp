@@ -5,9 +5,22 @@
 
 typedef uint32_t u32;
 typedef uint64_t u64;
+typedef int64_t i64;
 
 #include <vector>
 
-typedef std::vector<u64> DimVec;
+#include "SmallVector.hpp"
+
+// shapes of up to 6 dimensions are stored inline without a heap allocation
+typedef Orion::SmallVector<u64, 6> DimVec;
+
+// element kernels are large, without forcing them inline -O2 leaves calls in vectorizable loops
+#if defined(__GNUC__)
+#define ORION_VEC_INLINE inline __attribute__((always_inline))
+#define ORION_VEC_FLATTEN __attribute__((flatten))
+#else
+#define ORION_VEC_INLINE inline
+#define ORION_VEC_FLATTEN
+#endif
 
 #endif // TYPEDEFS_H_
@@ -0,0 +1,85 @@
+#ifndef DL_ATTENTION_H_
+#define DL_ATTENTION_H_
+
+#include "Backprop.hpp"
+#include "../Attention.hpp"
+
+namespace Orion{
+
+	/**
+	 * Fused scaled dot product attention of q, k, v, see attention().
+	 * Only the logsumexp of every query row is kept from the forward pass,
+	 * the backward pass recomputes the probabilities tile by tile.
+	 * */
+	class Attention : public Function{
+		public:
+			Attention(std::shared_ptr<TensorVar> const& q, std::shared_ptr<TensorVar> const& k, std::shared_ptr<TensorVar> const& v,
+					  AttentionParams const& params = {}, ten mask = ten()) : _params(params), _mask(std::move(mask)){
+				_in.emplace_back(q);
+				_in.emplace_back(k);
+				_in.emplace_back(v);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				ten ym = Orion::attention(_in[0]->value(), _in[1]->value(), _in[2]->value(), _params, mask(), &_lse);
+				bool requires_grad = _in[0]->requires_grad() || _in[1]->requires_grad() || _in[2]->requires_grad();
+				auto out = std::make_shared<TensorVar>(ym, requires_grad);
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				auto g = geometry();
+				ten& y = _out.lock()->value();
+				for(u64 b = 0; b < g.batch; b++){
+					detail::attention_forward(g, _in[0]->value().data() + b*g.lq*g.d, _in[1]->value().data() + b*g.lk*g.d,
+											  _in[2]->value().data() + b*g.lk*g.dv, mask_data(), y.data() + b*g.lq*g.dv, _lse.data() + b*g.lq);
+				}
+			}
+			void calc_grad(){
+				auto out = _out.lock();
+				auto g = geometry();
+				auto grad_of = [&](u64 i, u64 size){ return _in[i]->requires_grad() ? _in[i]->grad().data() + size : nullptr; };
+				for(u64 b = 0; b < g.batch; b++){
+					u64 qo = b*g.lq*g.d, ko = b*g.lk*g.d, vo = b*g.lk*g.dv, oo = b*g.lq*g.dv;
+					detail::attention_backward(g, _in[0]->value().data() + qo, _in[1]->value().data() + ko, _in[2]->value().data() + vo,
+											   mask_data(), out->value().data() + oo, _lse.data() + b*g.lq, out->grad().data() + oo,
+											   grad_of(0, qo), grad_of(1, ko), grad_of(2, vo));
+				}
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			detail::AttentionGeometry geometry() const{
+				return detail::attention_geometry(_in[0]->value().dim(), _in[1]->value().dim(), _in[2]->value().dim(), _params);
+			}
+			ten const* mask() const{
+				return _mask.nelem() ? &_mask : nullptr;
+			}
+			const double* mask_data() const{
+				return _mask.nelem() ? _mask.data() : nullptr;
+			}
+
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			AttentionParams _params;
+			ten _mask;
+			std::vector<double> _lse;
+	};
+
+	/**
+	 * Attention node, mask as in attention() with an empty tensor for none.
+	 * */
+	inline auto attention(std::shared_ptr<TensorVar> const& q, std::shared_ptr<TensorVar> const& k, std::shared_ptr<TensorVar> const& v,
+						  AttentionParams const& params = {}, ten const& mask = ten()){
+		return run_forward(std::make_shared<Attention>(q, k, v, params, mask));
+	}
+
+} // namespace Orion
+
+#endif // DL_ATTENTION_H_
@@ -1,4 +1,10 @@
+#ifndef BACKPROP_H_
+#define BACKPROP_H_
+
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
 #include "../Tensor.hpp"
@@ -12,23 +18,31 @@ namespace Orion{
 		private:
 			ten _value;
 			bool _requires_grad;
+			bool _has_grad = false;
 			ten _grad;
 			std::shared_ptr<Function> _func;
 			std::vector<std::weak_ptr<TensorVar>> _consumers;
 			bool _visited = false;
 		public:
-			TensorVar(const ten& t, bool require_grad = false) : _value(t), _requires_grad(require_grad), 
-														_grad(t.dim())
-			{
-				reset_grad();
-			}
+			TensorVar(const ten& t, bool require_grad = false) : _value(t), _requires_grad(require_grad){}
 			void reset_grad(){
-				_grad.fill(0);
+				if(_has_grad) _grad.fill(0);
 			}
 			ten& value(){
 				return _value;
 			}
+			/**
+			 * Zero gradient buffer. Outputs of functions get it with their
+			 * function, leaves on first use: inputs that are never
+			 * differentiated cost no memory and the gradients of
+			 * parameters count towards the backward pass creating them.
+			 * */
 			ten& grad(){
+				if(!_has_grad){
+					_grad = ten(_value.dim());
+					_grad.fill(0);
+					_has_grad = true;
+				}
 				return _grad;
 			}
 			bool requires_grad() const{
@@ -36,6 +50,7 @@ namespace Orion{
 			}
 			void set_func(std::shared_ptr<Function> func){
 				_func = func;
+				grad();
 			}
 			auto const& get_func() const{
 				return _func;
@@ -59,8 +74,73 @@ namespace Orion{
 			virtual std::shared_ptr<TensorVar> calc() = 0;
 			virtual std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const = 0;
 			virtual void calc_grad() = 0;
+			/**
+			 * Recompute the output of an earlier calc into its existing
+			 * buffer, used by graph replay. Inputs keep their shapes. Ops
+			 * implementing it say so with supports_replay, capture rejects
+			 * graphs with any other op.
+			 * */
+			virtual void recalc(){
+				assert(false && "Function: op does not support graph replay");
+			}
+			virtual bool supports_replay() const{
+				return false;
+			}
+			/**
+			 * Liveness hints for memory planning, the defaults are always safe.
+			 * Whether calc_grad reads the values of the inputs or of the output,
+			 * and whether element i of the output only depends on element i of
+			 * the inputs, so recalc may write over an input.
+			 * */
+			virtual bool grad_reads_inputs() const{
+				return true;
+			}
+			virtual bool grad_reads_output() const{
+				return true;
+			}
+			virtual bool elementwise() const{
+				return false;
+			}
+			/**
+			 * Gradients of the inputs from the gradient g of the output, built
+			 * out of TensorVar operations so they can be differentiated again,
+			 * used by grad with create_graph. Null for inputs that need no
+			 * gradient.
+			 * */
+			virtual std::vector<std::shared_ptr<TensorVar>> grad_graph(std::shared_ptr<TensorVar> const&){
+				assert(false && "Function: op does not support create_graph");
+				return {};
+			}
 	};
 
+	namespace detail{
+		// "in0, in1 -> out" shapes of a function node for the profiler
+		inline std::string function_shapes(Function const& f, TensorVar& out){
+			std::string s;
+			for(auto const& i : f.get_inputs()){
+				if(!s.empty()) s += ", ";
+				s += format_shape(i->value().dim());
+			}
+			return s + " -> " + format_shape(out.value().dim());
+		}
+	} // namespace detail
+
+	/**
+	 * Run the forward pass of a function node and attach it to its output.
+	 * */
+	template<typename F>
+	inline std::shared_ptr<TensorVar> run_forward(std::shared_ptr<F> const& f){
+		std::string const& name = detail::profile_name(typeid(F));
+		ORION_PROFILE_SCOPE(prof, name, "forward");
+		// ops built while differentiating another op, see grad, count as its backward
+		const char* outer = BackwardTag::op();
+		MemoryTag tag(outer ? "backward" : "forward", outer ? outer : name.c_str());
+		auto z = f->calc();
+		ORION_PROFILE_SHAPE(prof, detail::function_shapes(*f, *z));
+		z->set_func(f);
+		return z;
+	}
+
 	class SumBP : public Function{
 		public:
 			SumBP(std::shared_ptr<TensorVar> const& x1, std::shared_ptr<TensorVar> const& x2){
@@ -77,18 +157,33 @@ namespace Orion{
 				return out;
 			}
 
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				_out.lock()->value().assign(_in[0]->value() + _in[1]->value());
+			}
+
 			void calc_grad(){
 				auto& _x1 = *_in[0];
 				auto& _x2 = *_in[1];
-				ten t(_x1.value().dim());
-				t.fill(1);	
 				auto out = _out.lock();
 				if(_x1.requires_grad())
-					_x1.grad() += t%out->grad();
+					_x1.grad() += out->grad();
 				if(_x2.requires_grad())
-					_x2.grad() += t%out->grad();
+					_x2.grad() += out->grad();
 			}
 
+			bool grad_reads_inputs() const{
+				return false;
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			bool elementwise() const{
+				return true;
+			}
+			std::vector<std::shared_ptr<TensorVar>> grad_graph(std::shared_ptr<TensorVar> const& g);
 			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
 				return _in;
 			}
@@ -109,13 +204,18 @@ namespace Orion{
 			std::shared_ptr<TensorVar> calc(){
 				auto& _x1 = *_in[0];
 				auto& _x2 = *_in[1];
-				ten& ym = _x1.value();
-				ym %=_x2.value();
+				ten ym = _x1.value()%_x2.value();
 				bool requires_grad = _x1.requires_grad() || _x2.requires_grad();
 				auto out = std::make_shared<TensorVar>(ym, requires_grad);
 				_out = out;
 				return out;
 			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				_out.lock()->value().assign(_in[0]->value()%_in[1]->value());
+			}
 			void calc_grad(){
 				auto& _x1 = *_in[0];
 				auto& _x2 = *_in[1];
@@ -126,6 +226,13 @@ namespace Orion{
 				if(_x2.requires_grad())
 					_x2.grad() += _x1.value()%out->grad();
 			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			bool elementwise() const{
+				return true;
+			}
+			std::vector<std::shared_ptr<TensorVar>> grad_graph(std::shared_ptr<TensorVar> const& g);
 			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
 				return _in;
 			}
@@ -153,18 +260,32 @@ namespace Orion{
 				// _out->_func = make_shared<SumBP>(*this);
 				return out;
 			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				_out.lock()->value().assign(_in[0]->value() - _in[1]->value());
+			}
 			void calc_grad(){
 				auto& _x1 = *_in[0];
 				auto& _x2 = *_in[1];
-				ten t{_x1.value().dim()};
-				t.fill(1);
 
 				auto out = _out.lock();
 				if(_x1.requires_grad())
-					_x1.grad() += t%out->grad();
-				if(_x2.requires_grad())			
-					_x2.grad() -= t%out->grad();
+					_x1.grad() += out->grad();
+				if(_x2.requires_grad())
+					_x2.grad() -= out->grad();
+			}
+			bool grad_reads_inputs() const{
+				return false;
+			}
+			bool grad_reads_output() const{
+				return false;
 			}
+			bool elementwise() const{
+				return true;
+			}
+			std::vector<std::shared_ptr<TensorVar>> grad_graph(std::shared_ptr<TensorVar> const& g);
 			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
 				return _in;
 			}
@@ -189,14 +310,25 @@ namespace Orion{
 				_out = out;
 				return out;
 			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				_out.lock()->value().assign(Orion::pow(_in[0]->value(), _n));
+			}
 			void calc_grad(){
 				auto& _x1 = *_in[0];
-				ten g = Orion::pow(_x1.value(), _n - 1);
-				g %= _n;
 				auto out = _out.lock();
 				if(_x1.requires_grad())
-					_x1.grad() += g%out->grad();
+					_x1.grad() += (Orion::pow(_x1.value(), _n - 1)%static_cast<double>(_n))%out->grad();
 			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			bool elementwise() const{
+				return true;
+			}
+			std::vector<std::shared_ptr<TensorVar>> grad_graph(std::shared_ptr<TensorVar> const& g);
 			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
 				return _in;
 			}
@@ -219,13 +351,26 @@ namespace Orion{
 				auto out = std::make_shared<TensorVar>(ym, _x1.requires_grad());
 				_out = out;
 				return out;
-			}	
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				_out.lock()->value().assign(exp_t(_in[0]->value()));
+			}
 			void calc_grad(){
 				auto& _x1 = *_in[0];
 				auto out = _out.lock();
 				if(_x1.requires_grad())
 					_x1.grad() += out->value()%out->grad();
 			}
+			bool grad_reads_inputs() const{
+				return false;
+			}
+			bool elementwise() const{
+				return true;
+			}
+			std::vector<std::shared_ptr<TensorVar>> grad_graph(std::shared_ptr<TensorVar> const& g);
 			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
 				return _in;
 			}
@@ -237,6 +382,90 @@ namespace Orion{
 			std::weak_ptr<TensorVar> _out;
 	};
 
+	/**
+	 * Elementwise function with a derivative that only needs the input x
+	 * and the output y of the forward pass. Op supplies the forward functor
+	 * and a static grad(x, y).
+	 * */
+	template<typename Op>
+	class UnaryMath : public Function{
+		public:
+			UnaryMath(std::shared_ptr<TensorVar> const& x1){
+				_in.emplace_back(x1);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				auto& _x1 = *_in[0];
+				ten ym = UnaryExpr(_x1.value(), Op{});
+				auto out = std::make_shared<TensorVar>(ym, _x1.requires_grad());
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				_out.lock()->value().assign(UnaryExpr(_in[0]->value(), Op{}));
+			}
+			void calc_grad(){
+				auto& _x1 = *_in[0];
+				auto out = _out.lock();
+				if(!_x1.requires_grad())
+					return;
+				ten const& x = _x1.value();
+				ten const& y = out->value();
+				ten const& og = out->grad();
+				double* g = _x1.grad().data();
+				for(u64 i = 0; i < x.nelem(); i++)
+					g[i] += Op::grad(x.data()[i], y.data()[i])*og.data()[i];
+			}
+			bool elementwise() const{
+				return true;
+			}
+			std::vector<std::shared_ptr<TensorVar>> grad_graph(std::shared_ptr<TensorVar> const& g);
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+	};
+
+	struct LogOp : log_f{
+		static double grad(double x, double){ return 1/x; }
+	};
+	struct TanhOp : tanh_f{
+		static double grad(double, double y){ return 1 - y*y; }
+	};
+	struct SigmoidOp : sigmoid_f{
+		static double grad(double, double y){ return y*(1 - y); }
+	};
+	struct ErfOp : erf_f{
+		static double grad(double x, double){ return 1.12837916709551257390*vexp(-x*x); }
+	};
+	struct GeluOp : gelu_f{
+		// Phi(x) + x*phi(x)
+		static double grad(double x, double){
+			return 0.5*(1 + verf(x*0.70710678118654752440)) + x*0.39894228040143267794*vexp(-0.5*x*x);
+		}
+	};
+	struct SqrtOp : sqrt_f{
+		static double grad(double, double y){ return 0.5/y; }
+	};
+	struct RsqrtOp : rsqrt_f{
+		static double grad(double, double y){ return -0.5*y*y*y; }
+	};
+
+	typedef UnaryMath<LogOp> Log;
+	typedef UnaryMath<TanhOp> Tanh;
+	typedef UnaryMath<SigmoidOp> Sigmoid;
+	typedef UnaryMath<ErfOp> Erf;
+	typedef UnaryMath<GeluOp> Gelu;
+	typedef UnaryMath<SqrtOp> Sqrt;
+	typedef UnaryMath<RsqrtOp> Rsqrt;
+
 	class MatMul : public Function{
 		public:
 			MatMul(std::shared_ptr<TensorVar> const& x1, std::shared_ptr<TensorVar> const& x2){
@@ -251,17 +480,34 @@ namespace Orion{
 				_out = out;
 				return out;
 			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				ten const& a = _in[0]->value();
+				ten const& b = _in[1]->value();
+				u64 m = a.dim()[0], k = a.dim()[1], n = b.dim()[1];
+				gemm(false, false, m, n, k, 1.0, a.data(), k, b.data(), n, 0.0, _out.lock()->value().data(), n);
+			}
+			// dx1 += g x2^T, dx2 += x1^T g, accumulated by gemm without transposed copies
 			void calc_grad(){
 				auto& _x1 = *_in[0];
 				auto& _x2 = *_in[1];
 				auto out = _out.lock();
 				ten const& grad = out->grad();
+				ten const& a = _x1.value();
+				ten const& b = _x2.value();
+				u64 m = a.dim()[0], k = a.dim()[1], n = b.dim()[1];
 
 				if(_x1.requires_grad())
-					_x1.grad() += grad * _x2.value().t();
+					gemm(false, true, m, k, n, 1.0, grad.data(), n, b.data(), n, 1.0, _x1.grad().data(), k);
 				if(_x2.requires_grad())
-					_x2.grad() += _x1.value().t() * grad;
+					gemm(true, false, k, n, m, 1.0, a.data(), k, grad.data(), n, 1.0, _x2.grad().data(), n);
+			}
+			bool grad_reads_output() const{
+				return false;
 			}
+			std::vector<std::shared_ptr<TensorVar>> grad_graph(std::shared_ptr<TensorVar> const& g);
 			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
 				return _in;
 			}
@@ -288,6 +534,12 @@ namespace Orion{
 				_out = out;
 				return out;
 			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				_out.lock()->value().assign(_predicate%_in[0]->value() + (1-_predicate)%_in[1]->value());
+			}
 			void calc_grad(){
 				auto& _x1 = *_in[0];
 				auto& _x2 = *_in[1];
@@ -298,6 +550,16 @@ namespace Orion{
 				if(_x2.requires_grad())
 					_x2.grad() += (1 - _predicate)%out->grad();
 			}
+			bool grad_reads_inputs() const{
+				return false;
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			bool elementwise() const{
+				return true;
+			}
+			std::vector<std::shared_ptr<TensorVar>> grad_graph(std::shared_ptr<TensorVar> const& g);
 			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
 				return _in;
 			}
@@ -310,6 +572,96 @@ namespace Orion{
 			ten _predicate;
 	};
 
+	class Scale : public Function{
+		public:
+			Scale(std::shared_ptr<TensorVar> const& x1, double a) : _a(a){
+				_in.emplace_back(x1);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				auto& _x1 = *_in[0];
+				ten ym = _x1.value()%_a;
+				auto out = std::make_shared<TensorVar>(ym, _x1.requires_grad());
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				_out.lock()->value().assign(_in[0]->value()%_a);
+			}
+			void calc_grad(){
+				auto& _x1 = *_in[0];
+				auto out = _out.lock();
+				if(_x1.requires_grad())
+					_x1.grad() += out->grad()%_a;
+			}
+			bool grad_reads_inputs() const{
+				return false;
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			bool elementwise() const{
+				return true;
+			}
+			std::vector<std::shared_ptr<TensorVar>> grad_graph(std::shared_ptr<TensorVar> const& g);
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			double _a;
+	};
+
+	class Transpose : public Function{
+		public:
+			Transpose(std::shared_ptr<TensorVar> const& x1){
+				_in.emplace_back(x1);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				auto& _x1 = *_in[0];
+				ten ym = _x1.value().t();
+				auto out = std::make_shared<TensorVar>(ym, _x1.requires_grad());
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				ten const& x = _in[0]->value();
+				u64 m = x.dim()[0], n = x.dim()[1];
+				transpose(m, n, x.data(), n, _out.lock()->value().data(), m);
+			}
+			void calc_grad(){
+				auto& _x1 = *_in[0];
+				auto out = _out.lock();
+				if(_x1.requires_grad())
+					_x1.grad() += out->grad().t();
+			}
+			bool grad_reads_inputs() const{
+				return false;
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> grad_graph(std::shared_ptr<TensorVar> const& g);
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+	};
+
 	// class Mean : public Function{
 	// 	public:
 	// 		Mean(std::shared_ptr<TensorVar> const& x1){
@@ -341,17 +693,11 @@ namespace Orion{
 	// };
 
 	inline auto operator*(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& y){
-		auto m = std::make_shared<MatMul>(x, y);
-		auto z = m->calc();
-		z->set_func(m);
-		return z;
+		return run_forward(std::make_shared<MatMul>(x, y));
 	}
 
 	inline auto operator+(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& y){
-		auto s = std::make_shared<SumBP>(x, y);
-		auto z = s->calc();
-		z->set_func(s);
-		return z;
+		return run_forward(std::make_shared<SumBP>(x, y));
 	}
 
 	inline auto operator+(std::shared_ptr<TensorVar> const& x, double scalar){
@@ -367,10 +713,7 @@ namespace Orion{
 	}
 
 	inline auto operator-(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& y){
-		auto s = std::make_shared<Subtract>(x, y);
-		auto z = s->calc();
-		z->set_func(s);
-		return z;
+		return run_forward(std::make_shared<Subtract>(x, y));
 	}
 	inline auto operator-(std::shared_ptr<TensorVar> const& x, double scalar){
 		auto const& m = x->value();
@@ -398,33 +741,41 @@ namespace Orion{
 	}
 
 	inline auto operator%(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& y){
-		auto mut = std::make_shared<Multiply>(x, y);
-		auto z = mut->calc();
-		z->set_func(mut);
-		return z;
+		return run_forward(std::make_shared<Multiply>(x, y));
 	}
 
 	inline auto exp(std::shared_ptr<TensorVar> const& x){
-		auto e = std::make_shared<Exp>(x);
-		auto z = e->calc();
-		z->set_func(e);
-
-		return z;
+		return run_forward(std::make_shared<Exp>(x));
 	}
 	inline auto pow(std::shared_ptr<TensorVar> const& x, int pow){
-		auto p = std::make_shared<Power>(x, pow);
-		auto z = p->calc();
-		z->set_func(p);
+		return run_forward(std::make_shared<Power>(x, pow));
+	}
 
-		return z;
+	template<typename Op>
+	inline auto unary_math(std::shared_ptr<TensorVar> const& x){
+		return run_forward(std::make_shared<UnaryMath<Op>>(x));
 	}
+	inline auto log(std::shared_ptr<TensorVar> const& x){ return unary_math<LogOp>(x); }
+	inline auto tanh(std::shared_ptr<TensorVar> const& x){ return unary_math<TanhOp>(x); }
+	inline auto sigmoid(std::shared_ptr<TensorVar> const& x){ return unary_math<SigmoidOp>(x); }
+	inline auto erf(std::shared_ptr<TensorVar> const& x){ return unary_math<ErfOp>(x); }
+	inline auto gelu(std::shared_ptr<TensorVar> const& x){ return unary_math<GeluOp>(x); }
+	inline auto sqrt(std::shared_ptr<TensorVar> const& x){ return unary_math<SqrtOp>(x); }
+	inline auto rsqrt(std::shared_ptr<TensorVar> const& x){ return unary_math<RsqrtOp>(x); }
 
 	inline auto where(const ten &predicate, std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& y){
-		auto w = std::make_shared<Where>(predicate, x, y);
-		auto z = w->calc();
-		z->set_func(w);
+		return run_forward(std::make_shared<Where>(predicate, x, y));
+	}
 
-		return z;
+	inline auto operator*(double a, std::shared_ptr<TensorVar> const& x){
+		return run_forward(std::make_shared<Scale>(x, a));
+	}
+	inline auto operator*(std::shared_ptr<TensorVar> const& x, double a){
+		return a*x;
+	}
+
+	inline auto transpose(std::shared_ptr<TensorVar> const& x){
+		return run_forward(std::make_shared<Transpose>(x));
 	}
 
 	void display(std::shared_ptr<TensorVar> const& x){
@@ -474,11 +825,18 @@ namespace Orion{
 			}
 			x->set_visited(1);
 			auto const& func = x->get_func();
-			if(func != nullptr)
+			if(func != nullptr){
+				std::string const& name = detail::profile_name(typeid(*func));
+				ORION_PROFILE_SCOPE(prof, name, "backward");
+				MemoryTag tag("backward", name.c_str());
+				ORION_PROFILE_SHAPE(prof, detail::function_shapes(*func, *x));
 				func->calc_grad();
+			}
 		}
 	}
 	void backward(std::shared_ptr<TensorVar> const& z, std::vector<std::shared_ptr<TensorVar>> vx){
+		// high water mark of the pass, see MemoryTracker::stats
+		PeakWindow window;
 		find_consumers(z);
 
 		auto& grad = z->grad();
@@ -487,6 +845,211 @@ namespace Orion{
 		for(auto const& x : vx){
 			build_grad(x);
 		}
+		MemoryTracker::instance().record_backward(window.start_bytes(), window.peak_bytes());
+	}
+
+	/*
+	 * Derivative graphs of the gradients, defined here as they use the
+	 * operators above. g is the gradient of the output.
+	 * */
+	namespace detail{
+		typedef std::vector<std::shared_ptr<TensorVar>> VarVec;
+
+		// g for the inputs that need a gradient
+		inline VarVec pass_grad(VarVec const& in, VarVec grads){
+			for(u64 i = 0; i < in.size(); i++)
+				if(!in[i]->requires_grad()) grads[i] = nullptr;
+			return grads;
+		}
+
+		// dy/dx of the elementwise functions from their input x and output y
+		inline std::shared_ptr<TensorVar> derivative(LogOp, std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const&){
+			return pow(x, -1);
+		}
+		inline std::shared_ptr<TensorVar> derivative(TanhOp, std::shared_ptr<TensorVar> const&, std::shared_ptr<TensorVar> const& y){
+			return 1.0 - y%y;
+		}
+		inline std::shared_ptr<TensorVar> derivative(SigmoidOp, std::shared_ptr<TensorVar> const&, std::shared_ptr<TensorVar> const& y){
+			return y%(1.0 - y);
+		}
+		inline std::shared_ptr<TensorVar> derivative(ErfOp, std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const&){
+			return 1.12837916709551257390*exp(-1.0*(x%x));
+		}
+		inline std::shared_ptr<TensorVar> derivative(GeluOp, std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const&){
+			return (0.5 + 0.5*erf(0.70710678118654752440*x)) + (0.39894228040143267794*x)%exp(-0.5*(x%x));
+		}
+		inline std::shared_ptr<TensorVar> derivative(SqrtOp, std::shared_ptr<TensorVar> const&, std::shared_ptr<TensorVar> const& y){
+			return 0.5*pow(y, -1);
+		}
+		inline std::shared_ptr<TensorVar> derivative(RsqrtOp, std::shared_ptr<TensorVar> const&, std::shared_ptr<TensorVar> const& y){
+			return -0.5*pow(y, 3);
+		}
+	} // namespace detail
+
+	inline std::vector<std::shared_ptr<TensorVar>> SumBP::grad_graph(std::shared_ptr<TensorVar> const& g){
+		return detail::pass_grad(_in, {g, g});
+	}
+	inline std::vector<std::shared_ptr<TensorVar>> Subtract::grad_graph(std::shared_ptr<TensorVar> const& g){
+		return detail::pass_grad(_in, {g, _in[1]->requires_grad() ? -1.0*g : nullptr});
+	}
+	inline std::vector<std::shared_ptr<TensorVar>> Multiply::grad_graph(std::shared_ptr<TensorVar> const& g){
+		return {_in[0]->requires_grad() ? g%_in[1] : nullptr, _in[1]->requires_grad() ? g%_in[0] : nullptr};
+	}
+	inline std::vector<std::shared_ptr<TensorVar>> Power::grad_graph(std::shared_ptr<TensorVar> const& g){
+		if(!_in[0]->requires_grad()) return {nullptr};
+		return {g%(static_cast<double>(_n)*pow(_in[0], _n - 1))};
+	}
+	inline std::vector<std::shared_ptr<TensorVar>> Exp::grad_graph(std::shared_ptr<TensorVar> const& g){
+		if(!_in[0]->requires_grad()) return {nullptr};
+		return {g%_out.lock()};
+	}
+	template<typename Op>
+	inline std::vector<std::shared_ptr<TensorVar>> UnaryMath<Op>::grad_graph(std::shared_ptr<TensorVar> const& g){
+		if(!_in[0]->requires_grad()) return {nullptr};
+		return {g%detail::derivative(Op{}, _in[0], _out.lock())};
+	}
+	inline std::vector<std::shared_ptr<TensorVar>> MatMul::grad_graph(std::shared_ptr<TensorVar> const& g){
+		return {_in[0]->requires_grad() ? g*transpose(_in[1]) : nullptr, _in[1]->requires_grad() ? transpose(_in[0])*g : nullptr};
+	}
+	inline std::vector<std::shared_ptr<TensorVar>> Where::grad_graph(std::shared_ptr<TensorVar> const& g){
+		auto p = std::make_shared<TensorVar>(_predicate, false);
+		auto q = std::make_shared<TensorVar>(ten(1 - _predicate), false);
+		return {_in[0]->requires_grad() ? g%p : nullptr, _in[1]->requires_grad() ? g%q : nullptr};
+	}
+	inline std::vector<std::shared_ptr<TensorVar>> Scale::grad_graph(std::shared_ptr<TensorVar> const& g){
+		if(!_in[0]->requires_grad()) return {nullptr};
+		return {_a*g};
+	}
+	inline std::vector<std::shared_ptr<TensorVar>> Transpose::grad_graph(std::shared_ptr<TensorVar> const& g){
+		if(!_in[0]->requires_grad()) return {nullptr};
+		return {transpose(g)};
+	}
+
+	namespace detail{
+		// nodes that need a gradient in post order, inputs before the nodes using them
+		inline void grad_order(std::shared_ptr<TensorVar> const& x, std::unordered_set<TensorVar*>& seen, VarVec& order){
+			if(!x->requires_grad() || !seen.insert(x.get()).second) return;
+			if(auto const& f = x->get_func())
+				for(auto const& i : f->get_inputs()) grad_order(i, seen, order);
+			order.push_back(x);
+		}
+	} // namespace detail
+
+	/**
+	 * Gradients of the sum of the elements of every z, or of the sum of
+	 * z % v for the vectors v when given, with respect to each x.
+	 *
+	 * Unlike backward this leaves the grad() buffers alone and returns the
+	 * gradients as new variables. Without create_graph they are computed
+	 * by calc_grad into buffers swapped in for those of the graph, so any
+	 * op works. With create_graph they are outputs of a graph built from
+	 * the ops of the backward pass, so they can be differentiated again:
+	 * for Hessian vector products, see hvp, or for losses on gradients
+	 * such as gradient penalties. Every op on the path must then implement
+	 * Function::grad_graph. Allocations of the backward of an op are
+	 * tagged as such, see BackwardTag.
+	 *
+	 * eg : auto g = grad({loss}, {w}, true)[0];
+	 *      auto penalty = g % g;
+	 *      backward(penalty, {w});
+	 * */
+	inline std::vector<std::shared_ptr<TensorVar>> grad(std::vector<std::shared_ptr<TensorVar>> const& zs,
+														std::vector<std::shared_ptr<TensorVar>> const& xs, bool create_graph = false,
+														std::vector<std::shared_ptr<TensorVar>> const& vs = {}){
+		assert(vs.empty() || vs.size() == zs.size());
+		std::unordered_set<TensorVar*> seen;
+		detail::VarVec order;
+		for(auto const& z : zs) detail::grad_order(z, seen, order);
+		auto zero = [](std::shared_ptr<TensorVar> const& x){
+			ten t(x->value().dim());
+			t.fill(0);
+			return std::make_shared<TensorVar>(t, false);
+		};
+
+		if(!create_graph){
+			std::vector<ten> saved;
+			saved.reserve(order.size());
+			for(auto const& v : order){
+				saved.emplace_back(v->value().dim());
+				saved.back().fill(0);
+				std::swap(saved.back(), v->grad());
+			}
+			for(u64 i = 0; i < zs.size(); i++){
+				if(!zs[i]->requires_grad()) continue;
+				if(vs.empty()) zs[i]->grad() += 1.0;
+				else zs[i]->grad() += vs[i]->value();
+			}
+			for(auto it = order.rbegin(); it != order.rend(); ++it){
+				auto const& f = (*it)->get_func();
+				if(!f) continue;
+				BackwardTag tag(detail::profile_name(typeid(*f)).c_str());
+				f->calc_grad();
+			}
+			detail::VarVec res;
+			for(auto const& x : xs)
+				res.push_back(seen.count(x.get()) ? std::make_shared<TensorVar>(x->grad(), false) : zero(x));
+			for(u64 k = 0; k < order.size(); k++) std::swap(saved[k], order[k]->grad());
+			return res;
+		}
+
+		std::unordered_map<TensorVar*, std::shared_ptr<TensorVar>> grads;
+		auto accumulate = [&](std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& g){
+			auto& acc = grads[x.get()];
+			acc = acc ? acc + g : g;
+		};
+		for(u64 i = 0; i < zs.size(); i++){
+			if(!zs[i]->requires_grad()) continue;
+			if(!vs.empty()){
+				accumulate(zs[i], vs[i]);
+				continue;
+			}
+			ten ones(zs[i]->value().dim());
+			ones.fill(1);
+			accumulate(zs[i], std::make_shared<TensorVar>(ones, false));
+		}
+		for(auto it = order.rbegin(); it != order.rend(); ++it){
+			auto const& f = (*it)->get_func();
+			auto found = grads.find(it->get());
+			if(!f || found == grads.end()) continue;
+			auto const& inputs = f->get_inputs();
+			std::vector<std::shared_ptr<TensorVar>> gi;
+			{
+				BackwardTag tag(detail::profile_name(typeid(*f)).c_str());
+				gi = f->grad_graph(found->second);
+			}
+			for(u64 i = 0; i < inputs.size(); i++)
+				if(gi[i]) accumulate(inputs[i], gi[i]);
+		}
+
+		detail::VarVec res;
+		for(auto const& x : xs){
+			auto found = grads.find(x.get());
+			res.push_back(found == grads.end() ? zero(x) : found->second);
+		}
+		return res;
+	}
+
+	inline std::shared_ptr<TensorVar> grad(std::shared_ptr<TensorVar> const& z, std::shared_ptr<TensorVar> const& x, bool create_graph = false){
+		return grad(std::vector<std::shared_ptr<TensorVar>>{z}, {x}, create_graph)[0];
 	}
 
-}
\ No newline at end of file
+	/**
+	 * Hessian vector products H v, with H the Hessian of the sum of the
+	 * elements of loss and one v per x, from one pass through the graph of
+	 * the gradient instead of finite differences of gradients.
+	 * */
+	inline std::vector<ten> hvp(std::shared_ptr<TensorVar> const& loss, std::vector<std::shared_ptr<TensorVar>> const& xs,
+								std::vector<ten> const& vs){
+		assert(vs.size() == xs.size());
+		auto gs = grad(std::vector<std::shared_ptr<TensorVar>>{loss}, xs, true);
+		detail::VarVec vars;
+		for(auto const& v : vs) vars.push_back(std::make_shared<TensorVar>(v, false));
+		auto hv = grad(gs, xs, false, vars);
+		std::vector<ten> res;
+		for(auto const& h : hv) res.push_back(h->value());
+		return res;
+	}
+
+}
+
+#endif // BACKPROP_H_
@@ -0,0 +1,269 @@
+#ifndef DL_CONV_H_
+#define DL_CONV_H_
+
+#include "Backprop.hpp"
+#include "../Conv.hpp"
+
+namespace Orion{
+
+	class Conv2d : public Function{
+		public:
+			Conv2d(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& w,
+				   Conv2dParams const& params = {}, Layout layout = Layout::NCHW) : _params(params), _layout(layout){
+				_in.emplace_back(x);
+				_in.emplace_back(w);
+			}
+			Conv2d(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& w, std::shared_ptr<TensorVar> const& b,
+				   Conv2dParams const& params = {}, Layout layout = Layout::NCHW) : Conv2d(x, w, params, layout){
+				_in.emplace_back(b);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				auto& _x = *_in[0];
+				auto& _w = *_in[1];
+				bool requires_grad = _x.requires_grad() || _w.requires_grad();
+				ten ym;
+				if(_in.size() == 3){
+					ym = conv2d(_x.value(), _w.value(), _in[2]->value(), _params, _layout);
+					requires_grad = requires_grad || _in[2]->requires_grad();
+				}else{
+					ym = conv2d(_x.value(), _w.value(), _params, _layout);
+				}
+				auto out = std::make_shared<TensorVar>(ym, requires_grad);
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				auto g = detail::conv2d_geometry(_in[0]->value().dim(), _in[1]->value().dim(), _params, _layout);
+				const double* b = _in.size() == 3 ? _in[2]->value().data() : nullptr;
+				detail::conv_forward(g, _in[0]->value().data(), _in[1]->value().data(), b, _out.lock()->value().data());
+			}
+			void calc_grad(){
+				auto& _x = *_in[0];
+				auto& _w = *_in[1];
+				auto out = _out.lock();
+				ten const& grad = out->grad();
+
+				if(_x.requires_grad())
+					conv2d_backward_input(grad, _w.value(), _x.grad(), _params, _layout);
+				if(_w.requires_grad())
+					conv2d_backward_weight(grad, _x.value(), _w.grad(), _params, _layout);
+				if(_in.size() == 3 && _in[2]->requires_grad())
+					conv_backward_bias(grad, _in[2]->grad(), _layout);
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			Conv2dParams _params;
+			Layout _layout;
+	};
+
+	class Conv1d : public Function{
+		public:
+			Conv1d(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& w,
+				   Conv1dParams const& params = {}, Layout layout = Layout::NCHW) : _params(params), _layout(layout){
+				_in.emplace_back(x);
+				_in.emplace_back(w);
+			}
+			Conv1d(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& w, std::shared_ptr<TensorVar> const& b,
+				   Conv1dParams const& params = {}, Layout layout = Layout::NCHW) : Conv1d(x, w, params, layout){
+				_in.emplace_back(b);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				auto& _x = *_in[0];
+				auto& _w = *_in[1];
+				bool requires_grad = _x.requires_grad() || _w.requires_grad();
+				ten ym;
+				if(_in.size() == 3){
+					ym = conv1d(_x.value(), _w.value(), _in[2]->value(), _params, _layout);
+					requires_grad = requires_grad || _in[2]->requires_grad();
+				}else{
+					ym = conv1d(_x.value(), _w.value(), _params, _layout);
+				}
+				auto out = std::make_shared<TensorVar>(ym, requires_grad);
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				auto g = detail::conv1d_geometry(_in[0]->value().dim(), _in[1]->value().dim(), _params, _layout);
+				const double* b = _in.size() == 3 ? _in[2]->value().data() : nullptr;
+				detail::conv_forward(g, _in[0]->value().data(), _in[1]->value().data(), b, _out.lock()->value().data());
+			}
+			void calc_grad(){
+				auto& _x = *_in[0];
+				auto& _w = *_in[1];
+				auto out = _out.lock();
+				ten const& grad = out->grad();
+
+				if(_x.requires_grad())
+					conv1d_backward_input(grad, _w.value(), _x.grad(), _params, _layout);
+				if(_w.requires_grad())
+					conv1d_backward_weight(grad, _x.value(), _w.grad(), _params, _layout);
+				if(_in.size() == 3 && _in[2]->requires_grad())
+					conv_backward_bias(grad, _in[2]->grad(), _layout);
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			Conv1dParams _params;
+			Layout _layout;
+	};
+
+	/**
+	 * Max pooling over rank 3 (1D) or rank 4 (2D) inputs. The selected
+	 * input offsets are kept from the forward pass so backward is a scatter.
+	 * */
+	class MaxPool : public Function{
+		public:
+			MaxPool(std::shared_ptr<TensorVar> const& x, Pool2dParams const& params = {}, Layout layout = Layout::NCHW)
+				: _params(params), _layout(layout){
+				_in.emplace_back(x);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				auto& _x = *_in[0];
+				auto g = detail::pool_geometry(_x.value().dim(), _params, _layout);
+				ten ym = detail::max_pool(g, _x.value(), &_argmax, _x.value().rank() == 3);
+				auto out = std::make_shared<TensorVar>(ym, _x.requires_grad());
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				auto g = detail::pool_geometry(_in[0]->value().dim(), _params, _layout);
+				detail::max_pool_forward(g, _in[0]->value().data(), _out.lock()->value().data(), _argmax.data());
+			}
+			void calc_grad(){
+				auto& _x = *_in[0];
+				auto out = _out.lock();
+				if(_x.requires_grad())
+					pool_backward_max(out->grad(), _argmax, _x.grad());
+			}
+			bool grad_reads_inputs() const{
+				return false;
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			Pool2dParams _params;
+			Layout _layout;
+			std::vector<u64> _argmax;
+	};
+
+	/**
+	 * Average pooling over rank 3 (1D) or rank 4 (2D) inputs.
+	 * */
+	class AvgPool : public Function{
+		public:
+			AvgPool(std::shared_ptr<TensorVar> const& x, Pool2dParams const& params = {}, Layout layout = Layout::NCHW)
+				: _params(params), _layout(layout){
+				_in.emplace_back(x);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				auto& _x = *_in[0];
+				auto g = detail::pool_geometry(_x.value().dim(), _params, _layout);
+				ten ym = detail::avg_pool(g, _x.value(), _x.value().rank() == 3);
+				auto out = std::make_shared<TensorVar>(ym, _x.requires_grad());
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				auto g = detail::pool_geometry(_in[0]->value().dim(), _params, _layout);
+				detail::avg_pool_forward(g, _in[0]->value().data(), _out.lock()->value().data());
+			}
+			void calc_grad(){
+				auto& _x = *_in[0];
+				auto out = _out.lock();
+				if(_x.requires_grad())
+					detail::avg_pool_backward(detail::pool_geometry(_x.value().dim(), _params, _layout), out->grad(), _x.grad());
+			}
+			bool grad_reads_inputs() const{
+				return false;
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			Pool2dParams _params;
+			Layout _layout;
+	};
+
+	inline auto conv2d(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& w,
+					   Conv2dParams const& params = {}, Layout layout = Layout::NCHW){
+		return run_forward(std::make_shared<Conv2d>(x, w, params, layout));
+	}
+	inline auto conv2d(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& w, std::shared_ptr<TensorVar> const& b,
+					   Conv2dParams const& params = {}, Layout layout = Layout::NCHW){
+		return run_forward(std::make_shared<Conv2d>(x, w, b, params, layout));
+	}
+
+	inline auto conv1d(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& w,
+					   Conv1dParams const& params = {}, Layout layout = Layout::NCHW){
+		return run_forward(std::make_shared<Conv1d>(x, w, params, layout));
+	}
+	inline auto conv1d(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& w, std::shared_ptr<TensorVar> const& b,
+					   Conv1dParams const& params = {}, Layout layout = Layout::NCHW){
+		return run_forward(std::make_shared<Conv1d>(x, w, b, params, layout));
+	}
+
+	inline auto max_pool2d(std::shared_ptr<TensorVar> const& x, Pool2dParams const& params = {}, Layout layout = Layout::NCHW){
+		return run_forward(std::make_shared<MaxPool>(x, params, layout));
+	}
+	inline auto max_pool1d(std::shared_ptr<TensorVar> const& x, Pool1dParams const& params = {}, Layout layout = Layout::NCHW){
+		return max_pool2d(x, detail::pool1d_params(params), layout);
+	}
+
+	inline auto avg_pool2d(std::shared_ptr<TensorVar> const& x, Pool2dParams const& params = {}, Layout layout = Layout::NCHW){
+		return run_forward(std::make_shared<AvgPool>(x, params, layout));
+	}
+	inline auto avg_pool1d(std::shared_ptr<TensorVar> const& x, Pool1dParams const& params = {}, Layout layout = Layout::NCHW){
+		return avg_pool2d(x, detail::pool1d_params(params), layout);
+	}
+
+} // namespace Orion
+
+#endif // DL_CONV_H_
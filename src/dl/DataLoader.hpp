@@ -0,0 +1,375 @@
+#ifndef DL_DATALOADER_H_
+#define DL_DATALOADER_H_
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <numeric>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <sys/mman.h>
+
+#include "../MappedFile.hpp"
+#include "../Tensor.hpp"
+
+namespace Orion{
+
+	/*
+	 * Binary tensor file written by save_tensor_file:
+	 * "ORTN", u32 element size, u64 rank, rank u64 dims, then the raw
+	 * row major elements. The header is a multiple of 8 bytes so mapped
+	 * data stays aligned for any element type.
+	 * */
+	namespace detail{
+		constexpr char TENSOR_FILE_MAGIC[4] = {'O', 'R', 'T', 'N'};
+
+		inline u64 tensor_file_header(u64 rank){
+			return 16 + 8*rank;
+		}
+
+		/*
+		 * Read the dims of a mapped tensor file of size bytes into dim.
+		 * False if the magic, element size or rank are wrong or the file
+		 * is too short for its dims or data, nothing past size is read.
+		 * */
+		inline bool read_tensor_file_header(const unsigned char* p, u64 size, u32 elem, DimVec& dim){
+			if(size < 16 || std::memcmp(p, TENSOR_FILE_MAGIC, 4) != 0) return false;
+			u32 file_elem;
+			u64 rank;
+			std::memcpy(&file_elem, p + 4, sizeof(file_elem));
+			std::memcpy(&rank, p + 8, sizeof(rank));
+			if(file_elem != elem || rank == 0 || rank > (size - 16)/8) return false;
+			dim.resize(rank);
+			std::memcpy(dim.data(), p + 16, 8*rank);
+			u64 room = (size - tensor_file_header(rank))/elem;
+			u64 n = 1;
+			for(u64 d : dim){
+				if(d && n > room/d) return false;
+				n *= d;
+			}
+			return true;
+		}
+	} // namespace detail
+
+	template<typename dt>
+	inline void save_tensor_file(std::string const& path, Tensor<dt> const& t){
+		std::FILE* f = std::fopen(path.c_str(), "wb");
+		assert(f && "save_tensor_file: cannot open file");
+		u32 elem = sizeof(dt);
+		u64 rank = t.rank();
+		std::fwrite(detail::TENSOR_FILE_MAGIC, 1, 4, f);
+		std::fwrite(&elem, sizeof(elem), 1, f);
+		std::fwrite(&rank, sizeof(rank), 1, f);
+		std::fwrite(t.dim().data(), sizeof(u64), rank, f);
+		std::fwrite(t.data(), sizeof(dt), t.nelem(), f);
+		std::fclose(f);
+	}
+
+	/**
+	 * Samples stored back to back, the first dimension of the source
+	 * indexes samples. Data is either a tensor or a mapped file.
+	 * */
+	template<typename dt>
+	class DataSource{
+		public:
+			/**
+			 * Samples are the subtensors along the first dimension of t.
+			 * */
+			static DataSource from_tensor(Tensor<dt> const& t){
+				assert(t.rank() >= 1);
+				DataSource s;
+				s._tensor = t;
+				s._data = t.data();
+				s._n = t.dim()[0];
+				s._sample_dim.assign(t.dim().begin() + 1, t.dim().end());
+				s.update_size();
+				return s;
+			}
+
+			/**
+			 * Map a file written by save_tensor_file.
+			 *
+			 * @return an empty source without a file if it is not a tensor
+			 * file of dt, or is truncated.
+			 * */
+			static DataSource from_file(std::string const& path){
+				DataSource s;
+				auto file = std::make_shared<MappedFile>(path);
+				DimVec dim;
+				if(!detail::read_tensor_file_header(file->data(), file->size(), sizeof(dt), dim)) return s;
+				s._file = file;
+				s._data = reinterpret_cast<const dt*>(file->data() + detail::tensor_file_header(dim.size()));
+				s._n = dim[0];
+				s._sample_dim.assign(dim.begin() + 1, dim.end());
+				s.update_size();
+				return s;
+			}
+
+			/**
+			 * Map a headerless file of samples with the given shape.
+			 *
+			 * @param offset bytes to skip at the start of the file, a multiple of sizeof(dt).
+			 * */
+			static DataSource from_raw_file(std::string const& path, DimVec const& sample_dim, u64 offset = 0){
+				DataSource s;
+				s._file = std::make_shared<MappedFile>(path);
+				assert(offset%sizeof(dt) == 0 && offset <= s._file->size());
+				s._data = reinterpret_cast<const dt*>(s._file->data() + offset);
+				s._sample_dim = sample_dim;
+				s.update_size();
+				s._n = s._sample_size ? (s._file->size() - offset)/(s._sample_size*sizeof(dt)) : 0;
+				return s;
+			}
+
+			u64 size() const{
+				return _n;
+			}
+			DimVec const& sample_dim() const{
+				return _sample_dim;
+			}
+			u64 sample_size() const{
+				return _sample_size;
+			}
+			const dt* sample(u64 i) const{
+				return _data + i*_sample_size;
+			}
+			MappedFile const* file() const{
+				return _file.get();
+			}
+		private:
+			void update_size(){
+				_sample_size = 1;
+				for(u64 d : _sample_dim) _sample_size *= d;
+			}
+
+			Tensor<dt> _tensor;
+			std::shared_ptr<MappedFile> _file;
+			const dt* _data = nullptr;
+			u64 _n = 0;
+			DimVec _sample_dim;
+			u64 _sample_size = 0;
+	};
+
+	struct DataLoaderParams{
+		u64 batch_size = 32;
+		bool shuffle = true;
+		bool drop_last = false;
+		// batches assembled ahead of the one being consumed
+		u64 prefetch = 2;
+		u64 workers = 1;
+		u64 seed = 0;
+	};
+
+	/**
+	 * Minibatch loader assembling batches on background threads.
+	 *
+	 * Each source is one field of a sample (eg : inputs and labels), all
+	 * with the same number of samples. Batches are gathered into a fixed
+	 * ring of prefetch + 1 slots of page locked buffers, and each field of
+	 * a batch is a Tensor over its slot buffer. Batch b always goes to
+	 * slot b % slots. The slot sequence number says whether it is free
+	 * for batch b, ready with batch b or released, so batches come out in
+	 * order whatever the number of workers. A slot that is not ready is
+	 * waited for on its condition variable, a consumer slower than the
+	 * workers leaves them asleep rather than spinning.
+	 *
+	 *     loader.start_epoch();
+	 *     while(auto batch = loader.next()){ ... (*batch)[0] ... }
+	 *
+	 * Tensors returned by next stay valid until the following call.
+	 * */
+	template<typename dt>
+	class DataLoader{
+		public:
+			DataLoader(std::vector<DataSource<dt>> const& sources, DataLoaderParams const& params = {})
+				: _sources(sources), _params(params){
+				assert(!_sources.empty() && _params.batch_size > 0);
+				_n = _sources[0].size();
+				for(auto const& s : _sources){
+					assert(s.size() == _n && "DataLoader: sources differ in sample count");
+					if(s.file()) s.file()->advise(_params.shuffle);
+				}
+				_nbatches = _params.drop_last ? _n/_params.batch_size : (_n + _params.batch_size - 1)/_params.batch_size;
+				_order.resize(_n);
+				std::iota(_order.begin(), _order.end(), u64(0));
+
+				u64 nslots = std::max<u64>(1, _params.prefetch) + 1;
+				_slots = std::vector<Slot>(nslots);
+				for(u64 k = 0; k < nslots; k++){
+					Slot& slot = _slots[k];
+					slot.seq.store(k);
+					for(auto const& s : _sources){
+						u64 bytes = std::max<u64>(64, (_params.batch_size*s.sample_size()*sizeof(dt) + 63)/64*64);
+						dt* buf = static_cast<dt*>(std::aligned_alloc(64, bytes));
+						if(!buf) throw std::bad_alloc();
+						// pin the buffer so the consumer never faults it back in, best effort
+						::mlock(buf, bytes);
+						slot.buffers.push_back(buf);
+						slot.bytes.push_back(bytes);
+					}
+				}
+				for(u64 w = 0; w < std::max<u64>(1, _params.workers); w++)
+					_workers.emplace_back([this]{ work(); });
+			}
+
+			~DataLoader(){
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_stop = true;
+				}
+				_cv.notify_all();
+				for(auto& slot : _slots){
+					{
+						std::lock_guard<std::mutex> lock(slot.mutex);
+					}
+					slot.cv.notify_all();
+				}
+				for(auto& w : _workers) w.join();
+				for(auto& slot : _slots){
+					for(size_t i = 0; i < slot.buffers.size(); i++){
+						::munlock(slot.buffers[i], slot.bytes[i]);
+						std::free(slot.buffers[i]);
+					}
+				}
+			}
+			DataLoader(DataLoader const&) = delete;
+			DataLoader& operator=(DataLoader const&) = delete;
+
+			u64 batches_per_epoch() const{
+				return _nbatches;
+			}
+
+			/**
+			 * Reshuffle and start prefetching the next epoch. Batches of
+			 * the previous epoch that were not consumed are dropped.
+			 * */
+			void start_epoch(){
+				if(_started) while(next());
+				_held = false;
+				if(_params.shuffle){
+					std::mt19937_64 rng(_params.seed + _epoch);
+					std::shuffle(_order.begin(), _order.end(), rng);
+				}
+				for(u64 k = 0; k < _slots.size(); k++) publish(_slots[k], k);
+				_cur = 0;
+				{
+					std::lock_guard<std::mutex> lock(_mutex);
+					_next.store(0);
+					_epoch++;
+				}
+				_started = true;
+				_cv.notify_all();
+			}
+
+			/**
+			 * Next batch of the epoch in order, or nullptr at its end.
+			 * Waits only if the workers have fallen behind.
+			 * */
+			std::vector<Tensor<dt>> const* next(){
+				u64 nslots = _slots.size();
+				if(_held){
+					publish(_slots[(_cur - 1)%nslots], _cur - 1 + nslots);
+					_held = false;
+				}
+				if(!_started || _cur >= _nbatches) return nullptr;
+				Slot& slot = _slots[_cur%nslots];
+				wait_for(slot, _cur + 1);
+				_cur++;
+				_held = true;
+				return &slot.fields;
+			}
+
+		private:
+			struct Slot{
+				std::atomic<u64> seq{0};
+				// seq changes under mutex, waiters sleep on cv
+				std::mutex mutex;
+				std::condition_variable cv;
+				std::vector<dt*> buffers;
+				std::vector<u64> bytes;
+				std::vector<Tensor<dt>> fields;
+			};
+
+			void work(){
+				u64 epoch = 0;
+				while(true){
+					{
+						std::unique_lock<std::mutex> lock(_mutex);
+						_cv.wait(lock, [&]{ return _stop || _epoch != epoch; });
+						if(_stop) return;
+						epoch = _epoch;
+					}
+					u64 nslots = _slots.size();
+					for(u64 b; (b = _next.fetch_add(1)) < _nbatches;){
+						Slot& slot = _slots[b%nslots];
+						if(!wait_for(slot, b)) return;
+						fill(slot, b);
+						publish(slot, b + 1);
+					}
+				}
+			}
+
+			void publish(Slot& slot, u64 seq){
+				{
+					std::lock_guard<std::mutex> lock(slot.mutex);
+					slot.seq.store(seq, std::memory_order_release);
+				}
+				slot.cv.notify_all();
+			}
+
+			// false if the loader stopped first
+			bool wait_for(Slot& slot, u64 seq){
+				if(slot.seq.load(std::memory_order_acquire) == seq) return true;
+				std::unique_lock<std::mutex> lock(slot.mutex);
+				slot.cv.wait(lock, [&]{ return _stop || slot.seq.load(std::memory_order_acquire) == seq; });
+				return slot.seq.load(std::memory_order_acquire) == seq;
+			}
+
+			void fill(Slot& slot, u64 b){
+				u64 first = b*_params.batch_size;
+				u64 count = std::min(_params.batch_size, _n - first);
+				slot.fields.clear();
+				for(size_t f = 0; f < _sources.size(); f++){
+					DataSource<dt> const& src = _sources[f];
+					u64 ss = src.sample_size();
+					dt* buf = slot.buffers[f];
+					for(u64 i = 0; i < count; i++)
+						std::memcpy(buf + i*ss, src.sample(_order[first + i]), ss*sizeof(dt));
+					DimVec dim{count};
+					dim.insert(dim.end(), src.sample_dim().begin(), src.sample_dim().end());
+					slot.fields.emplace_back(dim, buf);
+				}
+			}
+
+			std::vector<DataSource<dt>> _sources;
+			DataLoaderParams _params;
+			u64 _n = 0;
+			u64 _nbatches = 0;
+			std::vector<u64> _order;
+			std::vector<Slot> _slots;
+
+			// consumer side
+			u64 _cur = 0;
+			bool _held = false;
+			bool _started = false;
+
+			std::atomic<u64> _next{0};
+			u64 _epoch = 0;
+			std::atomic<bool> _stop{false};
+			std::mutex _mutex;
+			std::condition_variable _cv;
+			std::vector<std::thread> _workers;
+	};
+
+} // namespace Orion
+
+#endif // DL_DATALOADER_H_
@@ -0,0 +1,142 @@
+#ifndef DL_DATAPARALLEL_H_
+#define DL_DATAPARALLEL_H_
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Backprop.hpp"
+#include "../ThreadPool.hpp"
+
+namespace Orion{
+
+	/**
+	 * Data parallel training on one machine. A minibatch is split by rows
+	 * across K replicas, each replica runs forward and backward on its own
+	 * graph on its own thread, and the replica gradients are all-reduced
+	 * into the gradients of the shared parameters.
+	 *
+	 * Replicas get fresh parameter TensorVars every step whose values are
+	 * shallow copies of the shared parameters, so they read the same
+	 * buffers and only own their gradients.
+	 *
+	 *     DataParallel dp({w, b}, 4);
+	 *     double loss = dp.step(rows, [&](u64 r, auto const& p){
+	 *         ten xs = DataParallel::shard(x, r, dp.replicas());
+	 *         return mean_loss(xs, p[0], p[1]);
+	 *     });
+	 *     // w->grad() and b->grad() now hold the full batch gradient
+	 * */
+	class DataParallel{
+		public:
+			typedef std::function<std::shared_ptr<TensorVar>(u64, std::vector<std::shared_ptr<TensorVar>> const&)> StepFunc;
+
+			/**
+			 * @param params parameters shared by all replicas.
+			 * @param replicas replica count, 0 for one per hardware thread.
+			 * */
+			DataParallel(std::vector<std::shared_ptr<TensorVar>> const& params, u64 replicas = 0)
+				: _params(params), _pool(replicas){
+				_k = _pool.size();
+				// every parameter is cut into one slice per replica for the reduction,
+				// slices are whole cache lines of gradients allocated on a cache line,
+				// see BUFFER_ALIGN, so no two threads write the same line
+				for(size_t p = 0; p < _params.size(); p++){
+					u64 n = _params[p]->value().nelem();
+					u64 line = 64/sizeof(double);
+					u64 len = std::max(line, ((n + _k - 1)/_k + line - 1)/line*line);
+					for(u64 lo = 0; lo < n; lo += len)
+						_slices.push_back({p, lo, std::min(n, lo + len)});
+				}
+			}
+
+			u64 replicas() const{
+				return _k;
+			}
+
+			/**
+			 * Rows [first, last) of a batch with the given row count handled by replica r.
+			 * */
+			static std::pair<u64, u64> shard_range(u64 rows, u64 r, u64 k){
+				return {rows*r/k, rows*(r + 1)/k};
+			}
+
+			/**
+			 * Rows of t handled by replica r, a view sharing the buffer of t.
+			 * */
+			template<typename dt>
+			static Tensor<dt> shard(Tensor<dt> const& t, u64 r, u64 k){
+				assert(t.rank() >= 1);
+				auto range = shard_range(t.dim()[0], r, k);
+				u64 row = t.dim()[0] ? t.nelem()/t.dim()[0] : 0;
+				DimVec dim = t.dim();
+				dim[0] = range.second - range.first;
+				return Tensor<dt>(dim, const_cast<dt*>(t.data()) + range.first*row);
+			}
+
+			/**
+			 * Run one data parallel forward and backward pass.
+			 *
+			 * f(r, params) builds the loss of replica r on its shard from the
+			 * replica parameters. Replica gradients are weighted by the share
+			 * of rows they handled, so with per shard mean losses the result
+			 * is the gradient of the full batch mean. It is added to the grad
+			 * of the shared parameters.
+			 *
+			 * @param rows minibatch rows, split with shard_range.
+			 * @return weighted sum of the replica losses.
+			 * */
+			double step(u64 rows, StepFunc const& f){
+				std::vector<std::vector<std::shared_ptr<TensorVar>>> reps(_k);
+				std::vector<double> weight(_k), loss(_k);
+				_pool.parallel_for(_k, [&](u64 r){
+					auto range = shard_range(rows, r, _k);
+					weight[r] = rows ? static_cast<double>(range.second - range.first)/static_cast<double>(rows) : 0;
+					for(auto const& p : _params)
+						reps[r].push_back(std::make_shared<TensorVar>(p->value(), p->requires_grad()));
+					if(weight[r] == 0) return;
+					auto z = f(r, reps[r]);
+					backward(z, reps[r]);
+					// parameters outside the graph of z get their zero gradient before the reduction reads it
+					for(auto const& p : reps[r]) p->grad();
+					ten const& v = z->value();
+					for(u64 i = 0; i < v.nelem(); i++) loss[r] += v[i];
+				});
+
+				for(auto const& p : _params) p->grad();
+				// reduce scatter: thread of slice s sums that slice over all replicas
+				// in replica order, so the result does not depend on scheduling
+				_pool.parallel_for(_slices.size(), [&](u64 s){
+					Slice const& sl = _slices[s];
+					if(!_params[sl.param]->requires_grad()) return;
+					double* g = _params[sl.param]->grad().data();
+					for(u64 r = 0; r < _k; r++){
+						if(weight[r] == 0) continue;
+						const double* gr = reps[r][sl.param]->grad().data();
+						double w = weight[r];
+						for(u64 i = sl.lo; i < sl.hi; i++) g[i] += w*gr[i];
+					}
+				});
+
+				double total = 0;
+				for(u64 r = 0; r < _k; r++) total += weight[r]*loss[r];
+				return total;
+			}
+
+		private:
+			struct Slice{
+				size_t param;
+				u64 lo, hi;
+			};
+
+			std::vector<std::shared_ptr<TensorVar>> _params;
+			ThreadPool _pool;
+			u64 _k;
+			std::vector<Slice> _slices;
+	};
+
+} // namespace Orion
+
+#endif // DL_DATAPARALLEL_H_
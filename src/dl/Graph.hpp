@@ -0,0 +1,264 @@
+#ifndef DL_GRAPH_H_
+#define DL_GRAPH_H_
+
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <numeric>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "Backprop.hpp"
+
+namespace Orion{
+
+	namespace detail{
+		/*
+		 * Buffer of a memory plan, live from forward / backward step first
+		 * to step last inclusive. Sizes and offsets are in elements.
+		 * */
+		struct PlanBuffer{
+			u64 size;
+			u64 first, last;
+			u64 offset = 0;
+		};
+
+		/*
+		 * Greedy by size placement. Buffers are placed largest first at the
+		 * lowest offset that overlaps no placed buffer live at the same time.
+		 * Returns the size of the slab holding all of them.
+		 * */
+		inline u64 place_buffers(std::vector<PlanBuffer>& bufs){
+			std::vector<size_t> order(bufs.size());
+			std::iota(order.begin(), order.end(), size_t(0));
+			std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b){ return bufs[a].size > bufs[b].size; });
+			std::vector<size_t> placed;
+			std::vector<std::pair<u64, u64>> taken;
+			u64 total = 0;
+			for(size_t i : order){
+				PlanBuffer& b = bufs[i];
+				taken.clear();
+				for(size_t j : placed){
+					PlanBuffer const& o = bufs[j];
+					if(o.first <= b.last && b.first <= o.last) taken.push_back({o.offset, o.offset + o.size});
+				}
+				std::sort(taken.begin(), taken.end());
+				u64 off = 0;
+				for(auto const& t : taken){
+					if(off + b.size <= t.first) break;
+					off = std::max(off, t.second);
+				}
+				b.offset = off;
+				placed.push_back(i);
+				total = std::max(total, off + b.size);
+			}
+			return total;
+		}
+	} // namespace detail
+
+	/**
+	 * Static plan of an autograd graph traced once, for steps that repeat
+	 * with the same shapes.
+	 *
+	 * Capturing walks the graph behind an output a single time and keeps
+	 * its function nodes in topological order. Every buffer is the one
+	 * allocated during the traced step, so a replay only runs kernels:
+	 * forward recomputes each node into its existing output and backward
+	 * clears the interior gradients and runs calc_grad in reverse order.
+	 * Nothing is allocated and no graph is built or traversed.
+	 *
+	 *     auto x = std::make_shared<TensorVar>(batch, false);
+	 *     Graph g = capture([&]{ return loss(model(x)); });
+	 *     for(...){
+	 *         copy the next batch into x->value().data()
+	 *         g.forward();
+	 *         g.backward();
+	 *     }
+	 *
+	 * plan_memory additionally packs the interior buffers into one slab by
+	 * their lifetimes over the replayed steps.
+	 * */
+	class Graph{
+		public:
+			Graph() = default;
+			explicit Graph(std::shared_ptr<TensorVar> const& output) : _output(output){
+				std::unordered_set<TensorVar*> seen;
+				visit(output, seen);
+
+				std::unordered_map<TensorVar*, u64> index;
+				for(u64 k = 0; k < _interior.size(); k++) index[_interior[k]] = k;
+				_consumers.resize(_nodes.size());
+				for(u64 c = 0; c < _nodes.size(); c++){
+					for(auto const& i : _nodes[c]->get_inputs()){
+						auto it = index.find(i.get());
+						if(it != index.end() && (_consumers[it->second].empty() || _consumers[it->second].back() != c))
+							_consumers[it->second].push_back(c);
+					}
+				}
+				// an interior gradient is cleared right before its last consumer, the first to run backward
+				_zero_before.resize(_nodes.size());
+				for(u64 k = 0; k + 1 < _nodes.size(); k++)
+					if(_interior[k]->requires_grad()) _zero_before[_consumers[k].back()].push_back(_interior[k]);
+			}
+
+			/**
+			 * Recompute every node from the current values of the leaves.
+			 * */
+			void forward(){
+				for(Function* f : _nodes) f->recalc();
+			}
+
+			/**
+			 * Backpropagate from the output as backward does. Gradients of
+			 * interior nodes are reset first, gradients of leaves accumulate
+			 * until zero_leaf_grads.
+			 * */
+			void backward(){
+				assert(_trainable && "Graph: memory was planned for inference only");
+				_output->grad().fill(1);
+				for(size_t i = _nodes.size(); i-- > 0;){
+					for(TensorVar* v : _zero_before[i]) v->reset_grad();
+					_nodes[i]->calc_grad();
+				}
+			}
+
+			void zero_leaf_grads(){
+				for(auto const& v : _leaves) v->reset_grad();
+			}
+
+			std::shared_ptr<TensorVar> const& output() const{
+				return _output;
+			}
+			// variables without a function, inputs and parameters, in first use order
+			std::vector<std::shared_ptr<TensorVar>> const& leaves() const{
+				return _leaves;
+			}
+			u64 nodes() const{
+				return _nodes.size();
+			}
+
+			/**
+			 * Rebind the values and gradients of interior variables to
+			 * offsets in one shared slab. Forward step k runs node k and
+			 * backward step 2n-1-k runs its calc_grad. A value lives from its
+			 * node to its last reader, forward consumers and the calc_grad
+			 * steps that read it per the Function hints. A gradient lives
+			 * from the calc_grad of its last consumer to that of its node.
+			 * Buffers with disjoint lifetimes share memory, and an elementwise
+			 * node whose input value dies at that node writes over it.
+			 * Leaves and the output value keep their own buffers.
+			 *
+			 * Values are not preserved, run forward before reading them.
+			 *
+			 * @param training plan for backward too. Without it values die at
+			 * their last forward use, interior gradients are released and
+			 * backward may no longer be called.
+			 * @return size of the slab in bytes.
+			 * */
+			inline u64 plan_memory(bool training = true);
+
+		private:
+			void visit(std::shared_ptr<TensorVar> const& v, std::unordered_set<TensorVar*>& seen){
+				if(!seen.insert(v.get()).second) return;
+				// gradients are allocated on first use, here rather than in the first replay
+				v->grad();
+				auto const& func = v->get_func();
+				if(func == nullptr){
+					_leaves.push_back(v);
+					return;
+				}
+				assert(func->supports_replay() && "Graph: op does not support graph replay");
+				for(auto const& i : func->get_inputs()) visit(i, seen);
+				_nodes.push_back(func.get());
+				_interior.push_back(v.get());
+			}
+
+			// the output owns the whole graph through its function and its inputs
+			std::shared_ptr<TensorVar> _output;
+			std::vector<Function*> _nodes;
+			// _interior[k] is the output of _nodes[k], consumed by the nodes in _consumers[k]
+			std::vector<TensorVar*> _interior;
+			std::vector<std::vector<u64>> _consumers;
+			std::vector<std::vector<TensorVar*>> _zero_before;
+			std::vector<std::shared_ptr<TensorVar>> _leaves;
+			std::shared_ptr<double> _slab;
+			bool _trainable = true;
+	};
+
+	inline u64 Graph::plan_memory(bool training){
+		u64 n = _nodes.size();
+		if(n == 0) return 0;
+		auto bwd = [&](u64 k){ return 2*n - 1 - k; };
+		// whole cache lines, so that neighbours in the slab never share one
+		auto lines = [](u64 nelem){ return std::max<u64>(8, (nelem + 7)/8*8); };
+
+		std::vector<detail::PlanBuffer> bufs;
+		std::vector<size_t> value_buf(n), grad_buf(n, SIZE_MAX);
+		for(u64 k = 0; k < n; k++){
+			value_buf[k] = SIZE_MAX;
+			// the output value keeps its own buffer
+			if(k + 1 == n) break;
+			u64 last = k;
+			for(u64 c : _consumers[k]){
+				last = std::max(last, c);
+				if(training && _nodes[c]->grad_reads_inputs()) last = std::max(last, bwd(c));
+			}
+			if(training && _nodes[k]->grad_reads_output()) last = std::max(last, bwd(k));
+
+			// write over an input that is read for the last time here
+			if(_nodes[k]->elementwise()){
+				for(auto const& in : _nodes[k]->get_inputs()){
+					if(in->get_func() == nullptr || in->value().nelem() != _interior[k]->value().nelem()) continue;
+					u64 j = static_cast<u64>(std::find(_interior.begin(), _interior.begin() + static_cast<i64>(k), in.get()) - _interior.begin());
+					detail::PlanBuffer& b = bufs[value_buf[j]];
+					if(b.last == k){
+						b.last = last;
+						value_buf[k] = value_buf[j];
+						break;
+					}
+				}
+			}
+			if(value_buf[k] == SIZE_MAX){
+				value_buf[k] = bufs.size();
+				bufs.push_back({lines(_interior[k]->value().nelem()), k, last});
+			}
+		}
+		if(training){
+			for(u64 k = 0; k < n; k++){
+				if(!_interior[k]->requires_grad()) continue;
+				u64 first = k + 1 == n ? n : bwd(_consumers[k].back());
+				grad_buf[k] = bufs.size();
+				bufs.push_back({lines(_interior[k]->grad().nelem()), first, bwd(k)});
+			}
+		}
+
+		u64 total = detail::place_buffers(bufs);
+		{
+			MemoryTag tag("graph", "slab");
+			_slab = MemoryTracker::instance().allocate<double>(total, DimVec{total});
+		}
+		// views share ownership of the slab, variables outliving the Graph keep it alive
+		auto view = [&](DimVec const& dim, size_t buf){ return ten(dim, std::shared_ptr<double>(_slab, _slab.get() + bufs[buf].offset)); };
+		for(u64 k = 0; k < n; k++){
+			TensorVar& v = *_interior[k];
+			if(value_buf[k] != SIZE_MAX) v.value() = view(v.value().dim(), value_buf[k]);
+			if(grad_buf[k] != SIZE_MAX) v.grad() = view(v.grad().dim(), grad_buf[k]);
+			else if(!training) v.grad() = ten();
+		}
+		_trainable = training;
+		return total*sizeof(double);
+	}
+
+	/**
+	 * Run step once, building its graph eagerly, and capture the result.
+	 * Every op of the graph must support replay, see Function::recalc.
+	 * */
+	inline Graph capture(std::function<std::shared_ptr<TensorVar>()> const& step){
+		return Graph(step());
+	}
+
+} // namespace Orion
+
+#endif // DL_GRAPH_H_
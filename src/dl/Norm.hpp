@@ -0,0 +1,130 @@
+#ifndef DL_NORM_H_
+#define DL_NORM_H_
+
+#include "Backprop.hpp"
+#include "../Norm.hpp"
+
+namespace Orion{
+
+	/**
+	 * Layer normalization over the last dimension of x, inputs x, gamma,
+	 * beta. The per row mean and 1/sqrt(var + eps) are kept from the
+	 * forward pass.
+	 * */
+	class LayerNorm : public Function{
+		public:
+			LayerNorm(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& gamma,
+					  std::shared_ptr<TensorVar> const& beta, double eps = 1e-5) : _eps(eps){
+				_in.emplace_back(x);
+				_in.emplace_back(gamma);
+				_in.emplace_back(beta);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				ten ym = Orion::layer_norm(_in[0]->value(), _in[1]->value(), _in[2]->value(), _eps, &_mean, &_rstd);
+				bool requires_grad = _in[0]->requires_grad() || _in[1]->requires_grad() || _in[2]->requires_grad();
+				auto out = std::make_shared<TensorVar>(ym, requires_grad);
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				ten const& x = _in[0]->value();
+				u64 n = x.dim().back();
+				detail::layer_norm_forward(n ? x.nelem()/n : 0, n, x.data(), _in[1]->value().data(), _in[2]->value().data(), _eps,
+										   _out.lock()->value().data(), _mean.data(), _rstd.data());
+			}
+			void calc_grad(){
+				auto out = _out.lock();
+				ten const& x = _in[0]->value();
+				u64 n = x.dim().back();
+				auto grad_of = [&](u64 i){ return _in[i]->requires_grad() ? _in[i]->grad().data() : nullptr; };
+				detail::layer_norm_backward(n ? x.nelem()/n : 0, n, x.data(), _in[1]->value().data(), _mean.data(), _rstd.data(),
+											out->grad().data(), grad_of(0), grad_of(1), grad_of(2));
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			double _eps;
+			std::vector<double> _mean, _rstd;
+	};
+
+	/**
+	 * Batch normalization of x per channel, inputs x, gamma, beta. The
+	 * running statistics are shared with the layer that owns them. In
+	 * training mode every forward pass, graph replay included, folds the
+	 * batch statistics into them.
+	 * */
+	class BatchNorm : public Function{
+		public:
+			BatchNorm(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& gamma, std::shared_ptr<TensorVar> const& beta,
+					  std::shared_ptr<BatchNormState<double>> state, bool training, Layout layout = Layout::NCHW)
+					  : _state(std::move(state)), _training(training), _layout(layout){
+				_in.emplace_back(x);
+				_in.emplace_back(gamma);
+				_in.emplace_back(beta);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				ten ym = Orion::batch_norm(_in[0]->value(), _in[1]->value(), _in[2]->value(), *_state, _training, _layout, &_mean, &_rstd);
+				bool requires_grad = _in[0]->requires_grad() || _in[1]->requires_grad() || _in[2]->requires_grad();
+				auto out = std::make_shared<TensorVar>(ym, requires_grad);
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				auto g = detail::norm_geometry(_in[0]->value().dim(), _layout);
+				detail::batch_norm_forward(g, _in[0]->value().data(), _in[1]->value().data(), _in[2]->value().data(), *_state, _training,
+										   _out.lock()->value().data(), _mean.data(), _rstd.data());
+			}
+			void calc_grad(){
+				auto out = _out.lock();
+				auto g = detail::norm_geometry(_in[0]->value().dim(), _layout);
+				auto grad_of = [&](u64 i){ return _in[i]->requires_grad() ? _in[i]->grad().data() : nullptr; };
+				detail::batch_norm_backward(g, _training, _in[0]->value().data(), _in[1]->value().data(), _mean.data(), _rstd.data(),
+											out->grad().data(), grad_of(0), grad_of(1), grad_of(2));
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			std::shared_ptr<BatchNormState<double>> _state;
+			bool _training;
+			Layout _layout;
+			std::vector<double> _mean, _rstd;
+	};
+
+	inline auto layer_norm(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& gamma,
+						   std::shared_ptr<TensorVar> const& beta, double eps = 1e-5){
+		return run_forward(std::make_shared<LayerNorm>(x, gamma, beta, eps));
+	}
+
+	inline auto batch_norm(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& gamma,
+						   std::shared_ptr<TensorVar> const& beta, std::shared_ptr<BatchNormState<double>> const& state,
+						   bool training, Layout layout = Layout::NCHW){
+		return run_forward(std::make_shared<BatchNorm>(x, gamma, beta, state, training, layout));
+	}
+
+} // namespace Orion
+
+#endif // DL_NORM_H_
@@ -0,0 +1,224 @@
+#ifndef DL_RECURRENT_H_
+#define DL_RECURRENT_H_
+
+#include "Backprop.hpp"
+#include "../Recurrent.hpp"
+
+namespace Orion{
+
+	/**
+	 * Fused LSTM step, inputs x, state, w, b as in lstm_cell. The output
+	 * is the new [h | c] state, fed to the next step as is; columns()
+	 * takes h out of it. Activated gates, tanh of the cell and [x | h] are
+	 * kept from the forward pass.
+	 * */
+	class LSTMCell : public Function{
+		public:
+			LSTMCell(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& state,
+					 std::shared_ptr<TensorVar> const& w, std::shared_ptr<TensorVar> const& b){
+				_in.emplace_back(x);
+				_in.emplace_back(state);
+				_in.emplace_back(w);
+				_in.emplace_back(b);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				ten const& x = _in[0]->value();
+				ten const& s = _in[1]->value();
+				assert(x.rank() == 2 && s.rank() == 2 && s.dim()[0] == x.dim()[0]);
+				_batch = x.dim()[0];
+				_n = x.dim()[1];
+				_h = s.dim()[1]/2;
+				assert(_in[2]->value().dim()[0] == _n + _h && _in[2]->value().dim()[1] == 4*_h && _in[3]->value().nelem() == 4*_h);
+				_xh = ten({_batch, _n + _h});
+				_gates = ten({_batch, 4*_h});
+				_tc = ten({_batch, _h});
+				ten ym({_batch, 2*_h});
+				forward(ym);
+				bool requires_grad = false;
+				for(auto const& i : _in) requires_grad = requires_grad || i->requires_grad();
+				auto out = std::make_shared<TensorVar>(ym, requires_grad);
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				forward(_out.lock()->value());
+			}
+			void calc_grad(){
+				auto out = _out.lock();
+				auto grad_of = [&](u64 i){ return _in[i]->requires_grad() ? _in[i]->grad().data() : nullptr; };
+				ten dgates({_batch, 4*_h}), dxh({_batch, _n + _h});
+				detail::lstm_backward(_batch, _n, _h, _in[1]->value().data(), _in[2]->value().data(), _xh.data(), _gates.data(), _tc.data(),
+									  out->grad().data(), dgates.data(), dxh.data(), grad_of(0), grad_of(1), grad_of(2), grad_of(3));
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			void forward(ten& y){
+				detail::lstm_forward(_batch, _n, _h, _in[0]->value().data(), _in[1]->value().data(), _in[2]->value().data(),
+									 _in[3]->value().data(), _xh.data(), _gates.data(), _tc.data(), y.data());
+			}
+
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			u64 _batch = 0, _n = 0, _h = 0;
+			ten _xh, _gates, _tc;
+	};
+
+	/**
+	 * Fused GRU step, inputs x, h, wx, wh, bx, bh as in gru_cell.
+	 * Activated gates and the hidden part of the candidate are kept from
+	 * the forward pass.
+	 * */
+	class GRUCell : public Function{
+		public:
+			GRUCell(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& h,
+					std::shared_ptr<TensorVar> const& wx, std::shared_ptr<TensorVar> const& wh,
+					std::shared_ptr<TensorVar> const& bx, std::shared_ptr<TensorVar> const& bh){
+				_in.emplace_back(x);
+				_in.emplace_back(h);
+				_in.emplace_back(wx);
+				_in.emplace_back(wh);
+				_in.emplace_back(bx);
+				_in.emplace_back(bh);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				ten const& x = _in[0]->value();
+				ten const& hs = _in[1]->value();
+				assert(x.rank() == 2 && hs.rank() == 2 && hs.dim()[0] == x.dim()[0]);
+				_batch = x.dim()[0];
+				_n = x.dim()[1];
+				_h = hs.dim()[1];
+				assert(_in[2]->value().dim()[0] == _n && _in[2]->value().dim()[1] == 3*_h);
+				assert(_in[3]->value().dim()[0] == _h && _in[3]->value().dim()[1] == 3*_h);
+				assert(_in[4]->value().nelem() == 3*_h && _in[5]->value().nelem() == 3*_h);
+				_gx = ten({_batch, 3*_h});
+				_gh = ten({_batch, 3*_h});
+				ten ym({_batch, _h});
+				forward(ym);
+				bool requires_grad = false;
+				for(auto const& i : _in) requires_grad = requires_grad || i->requires_grad();
+				auto out = std::make_shared<TensorVar>(ym, requires_grad);
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				forward(_out.lock()->value());
+			}
+			void calc_grad(){
+				auto out = _out.lock();
+				auto grad_of = [&](u64 i){ return _in[i]->requires_grad() ? _in[i]->grad().data() : nullptr; };
+				ten dgx({_batch, 3*_h}), dgh({_batch, 3*_h});
+				detail::gru_backward(_batch, _n, _h, _in[0]->value().data(), _in[1]->value().data(), _in[2]->value().data(),
+									 _in[3]->value().data(), _gx.data(), _gh.data(), out->grad().data(), dgx.data(), dgh.data(),
+									 grad_of(0), grad_of(1), grad_of(2), grad_of(3), grad_of(4), grad_of(5));
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			void forward(ten& y){
+				detail::gru_forward(_batch, _n, _h, _in[0]->value().data(), _in[1]->value().data(), _in[2]->value().data(),
+									_in[3]->value().data(), _in[4]->value().data(), _in[5]->value().data(), _gx.data(), _gh.data(), y.data());
+			}
+
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			u64 _batch = 0, _n = 0, _h = 0;
+			ten _gx, _gh;
+	};
+
+	/**
+	 * Columns [begin, end) of a matrix, eg. the hidden half of an LSTM state.
+	 * */
+	class Columns : public Function{
+		public:
+			Columns(std::shared_ptr<TensorVar> const& x1, u64 begin, u64 end) : _begin(begin), _end(end){
+				_in.emplace_back(x1);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				auto& _x1 = *_in[0];
+				assert(_x1.value().rank() == 2 && _begin <= _end && _end <= _x1.value().dim()[1]);
+				ten ym({_x1.value().dim()[0], _end - _begin});
+				forward(ym);
+				auto out = std::make_shared<TensorVar>(ym, _x1.requires_grad());
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				forward(_out.lock()->value());
+			}
+			void calc_grad(){
+				auto& _x1 = *_in[0];
+				auto out = _out.lock();
+				if(!_x1.requires_grad()) return;
+				u64 rows = _x1.value().dim()[0], cols = _x1.value().dim()[1], w = _end - _begin;
+				const double* g = out->grad().data();
+				double* dx = _x1.grad().data();
+				for(u64 r = 0; r < rows; r++)
+					for(u64 c = 0; c < w; c++) dx[r*cols + _begin + c] += g[r*w + c];
+			}
+			bool grad_reads_inputs() const{
+				return false;
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			void forward(ten& y){
+				ten const& x = _in[0]->value();
+				u64 rows = x.dim()[0], cols = x.dim()[1], w = _end - _begin;
+				for(u64 r = 0; r < rows; r++)
+					std::memcpy(y.data() + r*w, x.data() + r*cols + _begin, w*sizeof(double));
+			}
+
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			u64 _begin, _end;
+	};
+
+	inline auto lstm_cell(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& state,
+						  std::shared_ptr<TensorVar> const& w, std::shared_ptr<TensorVar> const& b){
+		return run_forward(std::make_shared<LSTMCell>(x, state, w, b));
+	}
+
+	inline auto gru_cell(std::shared_ptr<TensorVar> const& x, std::shared_ptr<TensorVar> const& h,
+						 std::shared_ptr<TensorVar> const& wx, std::shared_ptr<TensorVar> const& wh,
+						 std::shared_ptr<TensorVar> const& bx, std::shared_ptr<TensorVar> const& bh){
+		return run_forward(std::make_shared<GRUCell>(x, h, wx, wh, bx, bh));
+	}
+
+	inline auto columns(std::shared_ptr<TensorVar> const& x, u64 begin, u64 end){
+		return run_forward(std::make_shared<Columns>(x, begin, end));
+	}
+
+} // namespace Orion
+
+#endif // DL_RECURRENT_H_
@@ -0,0 +1,186 @@
+#ifndef DL_SOFTMAX_H_
+#define DL_SOFTMAX_H_
+
+#include "Backprop.hpp"
+#include "../Softmax.hpp"
+
+namespace Orion{
+
+	class Softmax : public Function{
+		public:
+			Softmax(std::shared_ptr<TensorVar> const& x1){
+				_in.emplace_back(x1);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				auto& _x1 = *_in[0];
+				ten ym = Orion::softmax(_x1.value());
+				auto out = std::make_shared<TensorVar>(ym, _x1.requires_grad());
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				ten const& x = _in[0]->value();
+				ten& y = _out.lock()->value();
+				u64 cols = x.dim().back();
+				u64 rows = cols ? x.nelem()/cols : 0;
+				isa_dispatch([&]{
+					for(u64 r = 0; r < rows; r++)
+						detail::row_softmax(x.data() + r*cols, y.data() + r*cols, cols);
+				});
+			}
+			// dx = y % (dy - rowsum(dy % y)), only the output is needed
+			void calc_grad(){
+				auto& _x1 = *_in[0];
+				auto out = _out.lock();
+				if(!_x1.requires_grad()) return;
+				ten const& y = out->value();
+				ten const& dy = out->grad();
+				u64 cols = y.dim().back();
+				u64 rows = cols ? y.nelem()/cols : 0;
+				double* dx = _x1.grad().data();
+				for(u64 r = 0; r < rows; r++){
+					const double* yr = y.data() + r*cols;
+					const double* gr = dy.data() + r*cols;
+					double dot = 0;
+					for(u64 i = 0; i < cols; i++) dot += gr[i]*yr[i];
+					for(u64 i = 0; i < cols; i++) dx[r*cols + i] += yr[i]*(gr[i] - dot);
+				}
+			}
+			bool grad_reads_inputs() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+	};
+
+	class LogSoftmax : public Function{
+		public:
+			LogSoftmax(std::shared_ptr<TensorVar> const& x1){
+				_in.emplace_back(x1);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				auto& _x1 = *_in[0];
+				ten ym = Orion::log_softmax(_x1.value());
+				auto out = std::make_shared<TensorVar>(ym, _x1.requires_grad());
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				ten const& x = _in[0]->value();
+				ten& y = _out.lock()->value();
+				u64 cols = x.dim().back();
+				u64 rows = cols ? x.nelem()/cols : 0;
+				isa_dispatch([&]{
+					for(u64 r = 0; r < rows; r++)
+						detail::row_log_softmax(x.data() + r*cols, y.data() + r*cols, cols);
+				});
+			}
+			// dx = dy - exp(y) * rowsum(dy), only the output is needed
+			void calc_grad(){
+				auto& _x1 = *_in[0];
+				auto out = _out.lock();
+				if(!_x1.requires_grad()) return;
+				ten const& y = out->value();
+				ten const& dy = out->grad();
+				u64 cols = y.dim().back();
+				u64 rows = cols ? y.nelem()/cols : 0;
+				double* dx = _x1.grad().data();
+				isa_dispatch([&]{
+					for(u64 r = 0; r < rows; r++){
+						const double* yr = y.data() + r*cols;
+						const double* gr = dy.data() + r*cols;
+						double sum = 0;
+						for(u64 i = 0; i < cols; i++) sum += gr[i];
+						for(u64 i = 0; i < cols; i++) dx[r*cols + i] += gr[i] - vexp(yr[i])*sum;
+					}
+				});
+			}
+			bool grad_reads_inputs() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+	};
+
+	/**
+	 * Fused softmax + cross entropy against integer class targets.
+	 * The output is the mean loss as a tensor of shape {1}. Only the per row
+	 * logsumexp is kept from the forward pass and the gradient is written
+	 * directly as softmax - onehot.
+	 * */
+	class CrossEntropy : public Function{
+		public:
+			CrossEntropy(std::shared_ptr<TensorVar> const& logits, std::vector<u64> targets) : _targets(std::move(targets)){
+				_in.emplace_back(logits);
+			}
+			std::shared_ptr<TensorVar> calc(){
+				auto& _x1 = *_in[0];
+				ten ym(DimVec{1});
+				ym.data()[0] = Orion::cross_entropy(_x1.value(), _targets, &_lse);
+				auto out = std::make_shared<TensorVar>(ym, _x1.requires_grad());
+				_out = out;
+				return out;
+			}
+			bool supports_replay() const{
+				return true;
+			}
+			void recalc(){
+				_out.lock()->value().data()[0] = Orion::cross_entropy(_in[0]->value(), _targets, &_lse);
+			}
+			void calc_grad(){
+				auto& _x1 = *_in[0];
+				auto out = _out.lock();
+				if(_x1.requires_grad())
+					cross_entropy_backward(_x1.value(), _targets, _lse, out->grad()[0], _x1.grad());
+			}
+			bool grad_reads_output() const{
+				return false;
+			}
+			std::vector<std::shared_ptr<TensorVar>> const& get_inputs() const{
+				return _in;
+			}
+			std::weak_ptr<TensorVar> const& get_out() const{
+				return _out;
+			}
+		private:
+			std::vector<std::shared_ptr<TensorVar>> _in;
+			std::weak_ptr<TensorVar> _out;
+			std::vector<u64> _targets;
+			std::vector<double> _lse;
+	};
+
+	inline auto softmax(std::shared_ptr<TensorVar> const& x){
+		return run_forward(std::make_shared<Softmax>(x));
+	}
+
+	inline auto log_softmax(std::shared_ptr<TensorVar> const& x){
+		return run_forward(std::make_shared<LogSoftmax>(x));
+	}
+
+	inline auto cross_entropy(std::shared_ptr<TensorVar> const& logits, std::vector<u64> const& targets){
+		return run_forward(std::make_shared<CrossEntropy>(logits, targets));
+	}
+
+} // namespace Orion
+
+#endif // DL_SOFTMAX_H_
@@ -0,0 +1,114 @@
+#include "src/dl/DataLoader.hpp"
+
+#include <set>
+
+using namespace std;
+using namespace Orion;
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    // sample i is a 3x4 block filled with i, its label is 2i
+    const u64 n = 103;
+    Tensor<float> x({n, 3, 4}), y({n, 1});
+    for(u64 i = 0; i < n; i++){
+        for(u64 j = 0; j < 12; j++) x.data()[i*12 + j] = static_cast<float>(i);
+        y.data()[i] = static_cast<float>(2*i);
+    }
+    string path = "test10_data.ortn";
+    save_tensor_file(path, x);
+
+    DataLoaderParams p;
+    p.batch_size = 8;
+    p.prefetch = 3;
+    p.workers = 2;
+    p.seed = 7;
+    DataLoader<float> loader({DataSource<float>::from_file(path), DataSource<float>::from_tensor(y)}, p);
+    check("batches per epoch", loader.batches_per_epoch() == 13);
+
+    vector<vector<u64>> orders;
+    for(int epoch = 0; epoch < 3; epoch++){
+        loader.start_epoch();
+        vector<u64> order;
+        bool shapes = true, paired = true;
+        u64 batches = 0;
+        while(auto batch = loader.next()){
+            Tensor<float> const& bx = (*batch)[0];
+            Tensor<float> const& by = (*batch)[1];
+            u64 count = batches == 12 ? 7 : 8;
+            shapes = shapes && bx.dim() == DimVec{count, 3, 4} && by.dim() == DimVec{count, 1};
+            for(u64 i = 0; i < bx.dim()[0]; i++){
+                u64 id = static_cast<u64>(bx[i*12]);
+                paired = paired && bx[i*12 + 11] == bx[i*12] && by[i] == static_cast<float>(2*id);
+                order.push_back(id);
+            }
+            batches++;
+        }
+        set<u64> seen(order.begin(), order.end());
+        check("epoch " + to_string(epoch) + " covers every sample once", order.size() == n && seen.size() == n);
+        check("epoch " + to_string(epoch) + " shapes", shapes && batches == 13);
+        check("epoch " + to_string(epoch) + " fields paired", paired);
+        orders.push_back(order);
+    }
+    check("epochs reshuffled", orders[0] != orders[1] && orders[1] != orders[2]);
+
+    // same seed, one worker, same order
+    p.workers = 1;
+    {
+        DataLoader<float> again({DataSource<float>::from_file(path), DataSource<float>::from_tensor(y)}, p);
+        again.start_epoch();
+        vector<u64> order;
+        while(auto batch = again.next())
+            for(u64 i = 0; i < (*batch)[0].dim()[0]; i++) order.push_back(static_cast<u64>((*batch)[0][i*12]));
+        check("deterministic order", order == orders[0]);
+    }
+
+    // headerless file, no shuffle, drop_last and an epoch abandoned half way
+    p.shuffle = false;
+    p.drop_last = true;
+    {
+        DataLoader<float> raw({DataSource<float>::from_raw_file(path, {3, 4}, 16 + 8*3)}, p);
+        check("raw drop_last", raw.batches_per_epoch() == 12);
+        raw.start_epoch();
+        raw.next();
+        raw.next();
+        raw.start_epoch();
+        bool sequential = true;
+        u64 k = 0;
+        while(auto batch = raw.next())
+            for(u64 i = 0; i < 8; i++) sequential = sequential && (*batch)[0][i*12] == static_cast<float>(k++);
+        check("raw sequential", sequential && k == 96);
+    }
+
+    // malformed files give an empty source
+    check("element size mismatch", DataSource<double>::from_file(path).file() == nullptr);
+    {
+        string cut = "test10_cut.ortn";
+        FILE* in = fopen(path.c_str(), "rb");
+        FILE* out = fopen(cut.c_str(), "wb");
+        vector<char> bytes(16 + 8*3 + 4*12*n - 1);
+        check("read file", fread(bytes.data(), 1, bytes.size(), in) == bytes.size());
+        fwrite(bytes.data(), 1, bytes.size(), out);
+        fclose(in);
+        fclose(out);
+        DataSource<float> truncated = DataSource<float>::from_file(cut);
+        check("truncated data", truncated.file() == nullptr && truncated.size() == 0);
+
+        // rank claiming more dims than the file holds
+        u64 rank = 1000;
+        out = fopen(cut.c_str(), "r+b");
+        fseek(out, 8, SEEK_SET);
+        fwrite(&rank, sizeof(rank), 1, out);
+        fclose(out);
+        check("truncated dims", DataSource<float>::from_file(cut).file() == nullptr);
+        remove(cut.c_str());
+    }
+    remove(path.c_str());
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,73 @@
+#include "src/dl/DataParallel.hpp"
+
+#include <atomic>
+#include <cmath>
+
+using namespace std;
+using namespace Orion;
+
+// mean over rows of (x*w - y)^2 and of tanh(x*w) as a second output
+shared_ptr<TensorVar> mse(ten const& x, ten const& y, shared_ptr<TensorVar> const& w, shared_ptr<TensorVar> const& v){
+    u64 rows = x.dim()[0];
+    ten avg({1, rows});
+    avg.fill(1.0/static_cast<double>(rows));
+    auto xv = make_shared<TensorVar>(x, false);
+    auto yv = make_shared<TensorVar>(y, false);
+    auto av = make_shared<TensorVar>(avg, false);
+    auto h = tanh(xv*w)*v;
+    return av*pow(h - yv, 2);
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    {
+        ThreadPool pool(4);
+        vector<atomic<int>> hits(1000);
+        for(int rep = 0; rep < 20; rep++)
+            pool.parallel_for(1000, [&](u64 i){ hits[i]++; });
+        bool all = true;
+        for(auto& h : hits) all = all && h == 20;
+        check("thread pool covers every index", all);
+    }
+
+    const u64 rows = 37, in = 5, hid = 3;
+    ten x({rows, in}), y({rows, 1}), w0({in, hid}), v0({hid, 1});
+    x.randomize(-1, 1);
+    y.randomize(-1, 1);
+    w0.randomize(-1, 1);
+    v0.randomize(-1, 1);
+
+    // reference, whole batch on one graph
+    ten wr = w0 + 0.0, vr = v0 + 0.0;
+    auto w = make_shared<TensorVar>(wr, true);
+    auto v = make_shared<TensorVar>(vr, true);
+    auto z = mse(x, y, w, v);
+    backward(z, {w, v});
+    double ref_loss = z->value()[0];
+
+    for(u64 k : {1, 2, 3, 8}){
+        auto wp = make_shared<TensorVar>(w0 + 0.0, true);
+        auto vp = make_shared<TensorVar>(v0 + 0.0, true);
+        DataParallel dp({wp, vp}, k);
+        double loss = 0;
+        for(int s = 0; s < 2; s++){
+            loss = dp.step(rows, [&](u64 r, vector<shared_ptr<TensorVar>> const& p){
+                return mse(DataParallel::shard(x, r, dp.replicas()), DataParallel::shard(y, r, dp.replicas()), p[0], p[1]);
+            });
+        }
+        double err = 0;
+        for(u64 i = 0; i < wr.nelem(); i++) err = max(err, abs(wp->grad()[i] - 2*w->grad()[i]));
+        for(u64 i = 0; i < vr.nelem(); i++) err = max(err, abs(vp->grad()[i] - 2*v->grad()[i]));
+        check("replicas " + to_string(k) + " gradient", err < 1e-12);
+        check("replicas " + to_string(k) + " loss", abs(loss - ref_loss) < 1e-12);
+        check("replicas " + to_string(k) + " shared values", wp->value().data() != nullptr && wp->value()[0] == w0[0]);
+    }
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,83 @@
+#include "src/dl/Graph.hpp"
+#include "src/dl/Conv.hpp"
+#include "src/dl/Softmax.hpp"
+#include "test_helpers.hpp"
+
+#include <cmath>
+
+using namespace std;
+using namespace Orion;
+
+// conv -> max pool -> log softmax, and dense -> gelu -> dense -> cross entropy
+shared_ptr<TensorVar> conv_model(shared_ptr<TensorVar> const& x, vector<shared_ptr<TensorVar>> const& p){
+    Conv2dParams cp;
+    cp.pad_h = cp.pad_w = 1;
+    return log_softmax(max_pool2d(conv2d(x, p[0], p[1], cp)));
+}
+
+shared_ptr<TensorVar> dense_model(vector<shared_ptr<TensorVar>> const& p, vector<u64> const& targets){
+    auto h = gelu(p[2]*p[3]);
+    auto a = h*p[4];
+    auto z = sigmoid(a) + exp(a) - pow(a, 2) % tanh(a);
+    return cross_entropy(z, targets);
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    ten x0({2, 3, 6, 6}), k({2, 3, 3, 3}), b({2}), d({4, 5}), w1({5, 6}), w2({6, 3});
+    for(ten* t : {&x0, &k, &b, &d, &w1, &w2}) t->randomize(-1, 1);
+    vector<u64> targets{2, 0, 1, 1};
+
+    auto params = [&](){
+        return vector<shared_ptr<TensorVar>>{make_shared<TensorVar>(copy_of(k), true), make_shared<TensorVar>(copy_of(b), true),
+                                             make_shared<TensorVar>(copy_of(d), true), make_shared<TensorVar>(copy_of(w1), true),
+                                             make_shared<TensorVar>(copy_of(w2), true)};
+    };
+
+    auto xg = make_shared<TensorVar>(copy_of(x0), false);
+    auto pg = params();
+    Graph gc = capture([&]{ return conv_model(xg, pg); });
+    Graph gd = capture([&]{ return dense_model(pg, targets); });
+    check("captured nodes", gc.nodes() == 3 && gd.nodes() == 11 && gd.leaves().size() == 3);
+
+    MemoryTracker& mt = MemoryTracker::instance();
+    for(int step = 0; step < 3; step++){
+        ten xn({2, 3, 6, 6}), dn({4, 5});
+        xn.randomize(-1, 1);
+        dn.randomize(-1, 1);
+
+        // replay on new inputs
+        u64 allocs = mt.stats().allocations;
+        memcpy(xg->value().data(), xn.data(), xn.nelem()*sizeof(double));
+        memcpy(pg[2]->value().data(), dn.data(), dn.nelem()*sizeof(double));
+        for(Graph* g : {&gc, &gd}){
+            g->zero_leaf_grads();
+            g->forward();
+            g->backward();
+        }
+        check("step " + to_string(step) + " replay allocates nothing", mt.stats().allocations == allocs);
+
+        // eager reference
+        auto xe = make_shared<TensorVar>(copy_of(xn), false);
+        auto pe = params();
+        memcpy(pe[2]->value().data(), dn.data(), dn.nelem()*sizeof(double));
+        auto ce = conv_model(xe, pe);
+        backward(ce, {pe[0], pe[1]});
+        auto de = dense_model(pe, targets);
+        backward(de, {pe[2], pe[3], pe[4]});
+
+        check("step " + to_string(step) + " outputs", max_abs_diff(gc.output()->value(), ce->value()) < 1e-12
+                                                      && abs(gd.output()->value()[0] - de->value()[0]) < 1e-12);
+        double err = 0;
+        for(size_t i = 0; i < pe.size(); i++) err = max(err, max_abs_diff(pg[i]->grad(), pe[i]->grad()));
+        check("step " + to_string(step) + " gradients", err < 1e-12);
+    }
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
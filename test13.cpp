@@ -0,0 +1,175 @@
+#include "src/dl/Graph.hpp"
+#include "src/dl/Conv.hpp"
+#include "src/dl/Softmax.hpp"
+#include "test_helpers.hpp"
+
+#include <cmath>
+
+using namespace std;
+using namespace Orion;
+
+// deep chain of dense layers with elementwise activations, then cross entropy
+shared_ptr<TensorVar> mlp(shared_ptr<TensorVar> const& x, vector<shared_ptr<TensorVar>> const& p, vector<u64> const& targets){
+    auto h = x;
+    for(size_t i = 0; i + 1 < p.size(); i++){
+        auto a = h*p[i];
+        h = tanh(a) + exp(a - a) - sigmoid(a);
+    }
+    return cross_entropy(h*p.back(), targets);
+}
+
+shared_ptr<TensorVar> conv_model(shared_ptr<TensorVar> const& x, shared_ptr<TensorVar> const& k, shared_ptr<TensorVar> const& b){
+    Conv2dParams cp;
+    cp.pad_h = cp.pad_w = 1;
+    return log_softmax(avg_pool2d(gelu(conv2d(x, k, b, cp))));
+}
+
+// an op without recalc, which capture must refuse
+class Opaque : public Function{
+    public:
+        explicit Opaque(shared_ptr<TensorVar> const& x){ _in.push_back(x); }
+        shared_ptr<TensorVar> calc(){ return make_shared<TensorVar>(_in[0]->value() + 0.0, _in[0]->requires_grad()); }
+        void calc_grad(){}
+        vector<shared_ptr<TensorVar>> const& get_inputs() const{ return _in; }
+    private:
+        vector<shared_ptr<TensorVar>> _in;
+};
+
+// bytes of the interior values and gradients before planning
+u64 interior_bytes(Graph const& g){
+    u64 total = 0;
+    vector<TensorVar*> stack{g.output().get()};
+    unordered_set<TensorVar*> seen;
+    while(!stack.empty()){
+        TensorVar* v = stack.back();
+        stack.pop_back();
+        if(!seen.insert(v).second || v->get_func() == nullptr) continue;
+        total += (v->value().nelem() + v->grad().nelem())*sizeof(double);
+        for(auto const& i : v->get_func()->get_inputs()) stack.push_back(i.get());
+    }
+    return total;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    const size_t layers = 6;
+    ten x0({16, 32});
+    x0.randomize(-1, 1);
+    vector<ten> w;
+    for(size_t i = 0; i < layers; i++){
+        w.emplace_back(DimVec{32, i + 1 < layers ? 32u : 4u});
+        w.back().randomize(-0.3, 0.3);
+    }
+    vector<u64> targets(16);
+    for(u64 i = 0; i < 16; i++) targets[i] = i%4;
+
+    auto params = [&](){
+        vector<shared_ptr<TensorVar>> p;
+        for(ten const& t : w) p.push_back(make_shared<TensorVar>(copy_of(t), true));
+        return p;
+    };
+
+    // eager reference
+    auto xe = make_shared<TensorVar>(copy_of(x0), false);
+    auto pe = params();
+    auto le = mlp(xe, pe, targets);
+    backward(le, pe);
+
+    // training plan
+    {
+        auto x = make_shared<TensorVar>(copy_of(x0), false);
+        auto p = params();
+        Graph g = capture([&]{ return mlp(x, p, targets); });
+        u64 unplanned = interior_bytes(g);
+        u64 slab = g.plan_memory();
+        check("training slab smaller", slab*2 < unplanned);
+
+        MemoryTracker& mt = MemoryTracker::instance();
+        for(int step = 0; step < 2; step++){
+            u64 allocs = mt.stats().allocations;
+            g.zero_leaf_grads();
+            g.forward();
+            g.backward();
+            check("step " + to_string(step) + " replay allocates nothing", mt.stats().allocations == allocs);
+            check("step " + to_string(step) + " loss", abs(g.output()->value()[0] - le->value()[0]) < 1e-12);
+            double err = 0;
+            for(size_t i = 0; i < p.size(); i++) err = max(err, max_abs_diff(p[i]->grad(), pe[i]->grad()));
+            check("step " + to_string(step) + " gradients", err < 1e-12);
+        }
+    }
+
+    // inference plan keeps only what forward needs
+    {
+        auto x = make_shared<TensorVar>(copy_of(x0), false);
+        auto p = params();
+        Graph g = capture([&]{ return mlp(x, p, targets); });
+        Graph t = capture([&]{ return mlp(x, p, targets); });
+        u64 inference = g.plan_memory(false);
+        u64 training = t.plan_memory(true);
+        check("inference slab smaller", inference < training);
+        g.forward();
+        check("inference loss", abs(g.output()->value()[0] - le->value()[0]) < 1e-12);
+    }
+
+    // the slab lives as long as the variables viewing it, the output value is not in it
+    {
+        MemoryTracker& mt = MemoryTracker::instance();
+        auto x = make_shared<TensorVar>(copy_of(x0), false);
+        auto p = params();
+        shared_ptr<TensorVar> out;
+        u64 slab;
+        {
+            Graph g = capture([&]{ return mlp(x, p, targets); });
+            slab = g.plan_memory();
+            g.zero_leaf_grads();
+            g.forward();
+            g.backward();
+            out = g.output();
+        }
+        u64 live = mt.stats().live_bytes;
+        TensorVar* hidden = out->get_func()->get_inputs()[0].get();
+        double sum = 0;
+        for(u64 i = 0; i < hidden->value().nelem(); i++) sum += hidden->value()[i];
+        check("slab outlives graph", std::isfinite(sum) && live >= slab);
+        out.reset();
+        check("slab freed with graph", mt.stats().live_bytes + slab <= live);
+
+        auto y = make_shared<TensorVar>(copy_of(x0), false);
+        Graph single = capture([&]{ return tanh(y); });
+        check("no slot for the output", single.plan_memory(false) == 0);
+    }
+
+    {
+        auto y = make_shared<TensorVar>(copy_of(x0), false);
+        auto z = tanh(y);
+        Opaque opaque(y);
+        check("replay support", z->get_func()->supports_replay() && !opaque.supports_replay());
+    }
+
+    // non elementwise ops
+    {
+        ten xc({2, 3, 6, 6}), k({4, 3, 3, 3}), b({4});
+        for(ten* t : {&xc, &k, &b}) t->randomize(-1, 1);
+        auto ke = make_shared<TensorVar>(copy_of(k), true), be = make_shared<TensorVar>(copy_of(b), true);
+        auto ce = conv_model(make_shared<TensorVar>(copy_of(xc), false), ke, be);
+        backward(ce, {ke, be});
+
+        auto kg = make_shared<TensorVar>(copy_of(k), true), bg = make_shared<TensorVar>(copy_of(b), true);
+        auto xg = make_shared<TensorVar>(copy_of(xc), false);
+        Graph g = capture([&]{ return conv_model(xg, kg, bg); });
+        g.plan_memory();
+        g.zero_leaf_grads();
+        g.forward();
+        g.backward();
+        check("conv outputs", max_abs_diff(g.output()->value(), ce->value()) < 1e-12);
+        check("conv gradients", max(max_abs_diff(kg->grad(), ke->grad()), max_abs_diff(bg->grad(), be->grad())) < 1e-12);
+    }
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
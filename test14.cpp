@@ -0,0 +1,85 @@
+#include "src/Tensor.hpp"
+
+#include <cmath>
+
+using namespace std;
+using namespace Orion;
+
+typedef FixedTensor<double, 3, 3> mat3;
+typedef FixedTensor<double, 3> vec3;
+
+static_assert(sizeof(mat3) == 9*sizeof(double), "fixed tensors hold only their elements");
+static_assert(mat3::rank() == 2 && mat3::nelem() == 9, "shape known at compile time");
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    // small buffer shapes
+    DimVec d{2, 3, 4};
+    check("dimvec inline", d.is_inline() && d.size() == 3 && d[2] == 4);
+    DimVec tail(d.begin() + 1, d.end());
+    check("dimvec slice", tail == DimVec{3, 4} && tail.is_inline());
+    DimVec big{1, 2, 3, 4, 5, 6, 7, 8};
+    DimVec moved = std::move(big);
+    check("dimvec heap", !moved.is_inline() && moved.size() == 8 && moved.back() == 8 && big.empty());
+    moved.erase(moved.begin(), moved.begin() + 4);
+    moved.insert(moved.begin(), d.begin(), d.end());
+    check("dimvec edit", moved == DimVec{2, 3, 4, 5, 6, 7, 8} && DimVec{1, 2} < DimVec{1, 3});
+    vector<u64> v = d;
+    check("dimvec vector", v.size() == 3 && DimVec(v) == d);
+
+    MemoryTracker& mt = MemoryTracker::instance();
+    u64 allocs = mt.stats().allocations;
+
+    mat3 r = {0, -1, 0,
+              1,  0, 0,
+              0,  0, 1};
+    vec3 p = {1, 2, 3};
+    vec3 q = r*p;
+    check("matvec", q(0) == -2 && q(1) == 1 && q(2) == 3);
+
+    mat3 rrt = r*r.transposed();
+    bool identity = true;
+    for(u64 i = 0; i < 3; i++)
+        for(u64 j = 0; j < 3; j++) identity = identity && rrt(i, j) == (i == j ? 1.0 : 0.0);
+    check("rotation is orthogonal", identity);
+
+    mat3 s = rrt % r + 2.0;
+    s += r;
+    s %= 0.5;
+    check("expressions", s(0, 1) == 0.5 && s(1, 0) == 1.5 && s(2, 2) == 2);
+    check("nothing allocated", mt.stats().allocations == allocs);
+
+    // mixed with dynamic tensors
+    Tensor<double> a({3, 3}), b({3, 3});
+    a.randomize(-1, 1);
+    b.randomize(-1, 1);
+    mat3 fa = a;
+    Tensor<double> sum = fa + b;
+    mat3 fb = b;
+    mat3 prod = fa*fb;
+    Tensor<double> ref = a*b;
+    double err = 0;
+    for(u64 i = 0; i < 9; i++){
+        err = max(err, abs(sum[i] - (a[i] + b[i])));
+        err = max(err, abs(prod[i] - ref[i]));
+    }
+    check("mixed with Tensor", err < 1e-12);
+    Tensor<double> view = fa.view();
+    view.fill(7);
+    check("view shares storage", fa(2, 1) == 7 && view.dim() == mat3::dim());
+
+    // larger shapes take the loop path
+    FixedTensor<double, 4, 32> big_a, big_b;
+    big_a.fill(2);
+    big_b.fill(3);
+    FixedTensor<double, 4, 32> big_c = big_a % big_b - 1.0;
+    check("large fixed", big_c(3, 31) == 5 && big_c(0, 0) == 5);
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
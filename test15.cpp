@@ -0,0 +1,69 @@
+#include "src/Tensor.hpp"
+#include "src/ThreadPool.hpp"
+
+#include <cmath>
+
+using namespace std;
+using namespace Orion;
+
+// returns an expression whose interior nodes were built inside this call
+template<typename E1, typename E2, typename E3>
+auto fused(TensorBase<E1> const& a, TensorBase<E2> const& b, TensorBase<E3> const& c){
+    return tanh_t((a + b) % c - 1.0) + 0.5;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    const u64 n = 1000;
+    const size_t jobs = 8;
+    vector<Tensor<double>> a, b, c;
+    for(size_t j = 0; j < jobs; j++){
+        a.emplace_back(DimVec{n});
+        b.emplace_back(DimVec{n});
+        c.emplace_back(DimVec{n});
+        a[j].randomize(-1, 1);
+        b[j].randomize(-1, 1);
+        c[j].randomize(-1, 1);
+    }
+
+    // trees are stored after the statements that built them have ended
+    typedef decltype(fused(a[0], b[0], c[0])) Expr;
+    vector<Expr> queued;
+    for(size_t j = 0; j < jobs; j++) queued.push_back(fused(a[j], b[j], c[j]));
+
+    // clobber the stack the temporaries lived on
+    volatile double scratch[256];
+    for(int i = 0; i < 256; i++) scratch[i] = -1e300;
+    static_cast<void>(scratch);
+
+    ThreadPool pool(4);
+    vector<Tensor<double>> out(jobs);
+    pool.parallel_for(jobs, [&](u64 j){ out[j] = Tensor<double>(queued[j]); });
+
+    double err = 0;
+    for(size_t j = 0; j < jobs; j++)
+        for(u64 i = 0; i < n; i++)
+            err = max(err, abs(out[j][i] - (tanh((a[j][i] + b[j][i])*c[j][i] - 1.0) + 0.5)));
+    check("deferred evaluation on a pool", err < 1e-12);
+
+    // leaves are referenced, later writes to them are seen
+    auto e = a[0]%2.0 + b[0];
+    a[0].fill(1);
+    Tensor<double> r = e;
+    check("leaves by reference", abs(r[3] - (2.0 + b[0][3])) < 1e-15);
+
+    // fixed tensors are leaves too
+    FixedTensor<double, 2, 2> f = {1, 2, 3, 4};
+    auto fe = exp_t(f - 1.0);
+    f.fill(1);
+    FixedTensor<double, 2, 2> g = fe;
+    check("fixed leaves", g(1, 1) == 1.0);
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,89 @@
+#include "src/Async.hpp"
+#include "test_helpers.hpp"
+
+#include <cmath>
+#include <mutex>
+
+using namespace std;
+using namespace Orion;
+
+#ifdef ORION_HAS_COROUTINES
+// coroutine that starts eagerly and is never awaited itself
+struct Detached{
+    struct promise_type{
+        Detached get_return_object(){ return {}; }
+        suspend_never initial_suspend(){ return {}; }
+        suspend_never final_suspend() noexcept{ return {}; }
+        void return_void(){}
+        void unhandled_exception(){ terminate(); }
+    };
+};
+
+Detached scaled_sum(Stream& s, AsyncTensor<double> a, AsyncTensor<double> b, double* out){
+    Tensor<double> x = co_await s.map([](auto const& u, auto const& v){ return u + v; }, a, b);
+    double sum = 0;
+    for(u64 i = 0; i < x.nelem(); i++) sum += x[i];
+    *out = sum;
+}
+#endif
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    Tensor<double> a({32, 24}), b({24, 16}), c({32, 24}), d({24, 16});
+    for(Tensor<double>* t : {&a, &b, &c, &d}) t->randomize(-1, 1);
+
+    // independent products on two streams joined by an element wise chain
+    Stream s1, s2;
+    AsyncTensor<double> p = s1.matmul<double>(a, b);
+    AsyncTensor<double> q = s2.matmul<double>(c, d);
+    auto r = s1.map([](auto const& x, auto const& y){ return tanh_t(x - y) % 2.0; }, p, q);
+    check("shape known at once", r.dim() == DimVec{32, 16});
+    Tensor<double> pe = a*b, qe = c*d;
+    Tensor<double> re = tanh_t(pe - qe) % 2.0;
+    check("results", max_abs_diff(r.get(), re) < 1e-12);
+
+    // data preparation feeding a dependent op on another stream
+    Stream prep;
+    AsyncTensor<double> x = prep.enqueue<double>(DimVec{24, 16}, [](Tensor<double>& out){ out.fill(0.5); });
+    AsyncTensor<double> y = s2.matmul<double>(a, x);
+    Tensor<double> half({24, 16});
+    half.fill(0.5);
+    Tensor<double> ye = a*half;
+    check("cross stream dependency", max_abs_diff(y.get(), ye) < 1e-12);
+
+    // ops of one stream run in order
+    vector<int> order;
+    mutex m;
+    Stream s3;
+    for(int i = 0; i < 50; i++) s3.run([&order, &m, i]{ lock_guard<mutex> lock(m); order.push_back(i); });
+    s3.sync();
+    bool in_order = order.size() == 50;
+    for(int i = 0; in_order && i < 50; i++) in_order = order[size_t(i)] == i;
+    check("stream order", in_order);
+
+    // global barrier
+    vector<AsyncTensor<double>> many;
+    Stream s4;
+    for(int i = 0; i < 20; i++) many.push_back((i%2 ? s2 : s4).matmul<double>(a, b));
+    Orion::sync();
+    bool all_ready = true;
+    for(auto const& h : many) all_ready = all_ready && h.ready();
+    check("sync", all_ready);
+
+#ifdef ORION_HAS_COROUTINES
+    double sum = 0;
+    scaled_sum(s1, p, q, &sum);
+    Orion::sync();
+    double sum_e = 0;
+    for(u64 i = 0; i < pe.nelem(); i++) sum_e += pe[i] + qe[i];
+    check("co_await", abs(sum - sum_e) < 1e-9);
+#endif
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+#include "src/Tensor.hpp"
+#include "src/Transpose.hpp"
+
+#include <chrono>
+#include <cmath>
+
+using namespace std;
+using namespace Orion;
+
+typedef Tensor<double> TD;
+
+// reference permute by full index arithmetic
+TD permute_ref(TD const& x, DimVec const& perm){
+    DimVec dim = x.dim(), out(dim.size());
+    for(size_t k = 0; k < perm.size(); k++) out[k] = dim[perm[k]];
+    TD y(out);
+    DimVec idx(dim.size(), 0);
+    for(u64 i = 0; i < x.nelem(); i++){
+        u64 rem = i;
+        for(size_t a = dim.size(); a-- > 0;){
+            idx[a] = rem%dim[a];
+            rem /= dim[a];
+        }
+        u64 o = 0;
+        for(size_t k = 0; k < perm.size(); k++) o = o*out[k] + idx[perm[k]];
+        y.data()[o] = x[i];
+    }
+    return y;
+}
+
+template<typename F>
+double seconds(F f, int reps){
+    auto t0 = chrono::steady_clock::now();
+    for(int r = 0; r < reps; r++) f();
+    return chrono::duration<double>(chrono::steady_clock::now() - t0).count()/reps;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    // odd shapes and leading dimensions cover the partial tiles
+    bool ok = true;
+    for(u64 rows : {1, 7, 8, 13, 64, 100})
+        for(u64 cols : {1, 5, 8, 33, 70}){
+            u64 lds = cols + 3, ldd = rows + 2;
+            vector<double> src(rows*lds), dst(cols*ldd, -1);
+            for(size_t i = 0; i < src.size(); i++) src[i] = double(i);
+            transpose(rows, cols, src.data(), lds, dst.data(), ldd);
+            for(u64 i = 0; i < rows; i++)
+                for(u64 j = 0; j < cols; j++) ok = ok && dst[j*ldd + i] == src[i*lds + j];
+        }
+    check("strided transpose", ok);
+
+    TD m({300, 257});
+    m.randomize(-1, 1);
+    TD mt = m.t();
+    ok = mt.dim() == DimVec{257, 300};
+    for(u64 i = 0; ok && i < 300; i++)
+        for(u64 j = 0; j < 257; j++) ok = ok && mt[j*300 + i] == m[i*257 + j];
+    check("Tensor::t", ok);
+
+    ThreadPool pool(4);
+    TD big({700, 900}), bt({900, 700});
+    big.randomize(-1, 1);
+    transpose(700, 900, big.data(), 900, bt.data(), 700, &pool);
+    ok = true;
+    for(u64 i = 0; ok && i < 700; i++)
+        for(u64 j = 0; j < 900; j++) ok = ok && bt[j*700 + i] == big[i*900 + j];
+    check("threaded transpose", ok);
+
+    ok = true;
+    for(u64 n : {1, 3, 8, 19, 64, 301}){
+        TD a({n, n});
+        a.randomize(-1, 1);
+        TD at = a.t();
+        transpose_inplace(n, a.data(), n, n > 64 ? &pool : nullptr);
+        for(u64 i = 0; i < n*n; i++) ok = ok && a[i] == at[i];
+    }
+    check("in place square", ok);
+
+    TD x({3, 1, 17, 10, 9});
+    x.randomize(-1, 1);
+    ok = true;
+    for(DimVec const& perm : {DimVec{0, 1, 2, 3, 4}, DimVec{4, 3, 2, 1, 0}, DimVec{0, 2, 1, 4, 3}, DimVec{2, 3, 0, 1, 4},
+                              DimVec{1, 0, 2, 4, 3}, DimVec{3, 4, 0, 1, 2}, DimVec{4, 0, 1, 2, 3}}){
+        TD y = x.permute(perm), r = permute_ref(x, perm);
+        ok = ok && y.dim() == r.dim();
+        for(u64 i = 0; ok && i < y.nelem(); i++) ok = ok && y[i] == r[i];
+        TD z(r.dim());
+        permute(x.dim(), perm, x.data(), z.data(), &pool);
+        for(u64 i = 0; ok && i < z.nelem(); i++) ok = ok && z[i] == r[i];
+    }
+    check("permute", ok);
+
+    // bandwidth against a naive loop and memcpy, reported only
+    const u64 n = 2048;
+    TD s({n, n}), d({n, n});
+    s.randomize(-1, 1);
+    double t_copy = seconds([&]{ memcpy(d.data(), s.data(), n*n*sizeof(double)); }, 5);
+    double t_naive = seconds([&]{
+        double* dd = d.data();
+        const double* ss = s.data();
+        for(u64 i = 0; i < n; i++)
+            for(u64 j = 0; j < n; j++) dd[j*n + i] = ss[i*n + j];
+    }, 5);
+    double t_blocked = seconds([&]{ transpose(n, n, s.data(), n, d.data(), n); }, 5);
+    double t_inplace = seconds([&]{ transpose_inplace(n, d.data(), n); }, 5);
+    double gb = 2.0*double(n*n*sizeof(double))/1e9;
+    cout << "2048x2048 GB/s  memcpy " << gb/t_copy << "  naive " << gb/t_naive << "  blocked " << gb/t_blocked
+         << "  in place " << gb/t_inplace << endl;
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
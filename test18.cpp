@@ -0,0 +1,99 @@
+#include "src/Tensor.hpp"
+#include "src/TextIO.hpp"
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace Orion;
+
+typedef Tensor<double> TD;
+
+bool same(TD const& a, TD const& b){
+    if(!(a.dim() == b.dim())) return false;
+    for(u64 i = 0; i < a.nelem(); i++)
+        if(a[i] != b[i]) return false;
+    return true;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    // printing goes to the given stream, repeatedly the same way
+    TD m({2, 3});
+    for(u64 i = 0; i < 6; i++) m.data()[i] = double(i) + 0.5;
+    ostringstream o1, o2;
+    o1 << m;
+    o2 << m;
+    check("print matrix", o1.str() == "[[0.5, 1.5, 2.5],\n [3.5, 4.5, 5.5]]" && o1.str() == o2.str());
+    TD c({2, 2, 2});
+    for(u64 i = 0; i < 8; i++) c.data()[i] = double(i);
+    ostringstream o3;
+    o3 << c << m(1);
+    check("print cube", o3.str() == "[[[0, 1],\n  [2, 3]],\n\n [[4, 5],\n  [6, 7]]][3.5, 4.5, 5.5]");
+
+    // printed tensors read back exactly
+    TD r({3, 4, 5});
+    r.randomize(-1e3, 1e3);
+    stringstream io;
+    io << r;
+    TD back({3, 4, 5});
+    io >> back;
+    check("stream round trip", !io.fail() && same(r, back));
+    TD more({2});
+    istringstream short_in("1.5");
+    short_in >> more;
+    check("short input fails", short_in.fail());
+
+    // CSV with a header, odd spacing and blank lines
+    const char* csv = "a,b,c\n1, 2.5 ,-3e2\r\n\n+4,5,6\n7;8\t9";
+    TD p = parse_text<double>(csv, csv + strlen(csv), nullptr, 1);
+    check("parse csv", p.dim() == DimVec{3, 3} && p[2] == -300 && p[3] == 4 && p[8] == 9);
+
+    // malformed text gives an empty tensor instead of writing past it
+    for(const char* bad : {"1 2\n3 4 5\n", "1 2\n3 x\n", "1 2 3\n4 5\n", "x\n"}){
+        TD e = parse_text<double>(bad, bad + strlen(bad));
+        check(string("malformed ") + to_string(strlen(bad)), e.nelem() == 0);
+    }
+    {
+        // chunks parsed in parallel, one row of another length or with a bad token in a later chunk
+        ThreadPool p4(4);
+        for(string odd : {"1,2,3", "1,z"}){
+            string text;
+            for(int i = 0; i < 400000; i++) text += (i == 300000 ? odd : "1,2") + "\n";
+            TD e = parse_text<double>(text.data(), text.data() + text.size(), &p4);
+            check("malformed chunks " + odd, e.nelem() == 0);
+        }
+    }
+
+    // large file through the mapped parallel path
+    ThreadPool pool(4);
+    TD big({200000, 8});
+    big.randomize(-1, 1);
+    string path = "test18_big.csv";
+    auto t0 = chrono::steady_clock::now();
+    {
+        ofstream f(path, ios::binary);
+        write_text(f, big, ',', &pool);
+    }
+    auto t1 = chrono::steady_clock::now();
+    TD loaded = read_text<double>(path, &pool);
+    auto t2 = chrono::steady_clock::now();
+    TD serial = read_text<double>(path);
+    ifstream sz(path, ios::binary | ios::ate);
+    double mb = double(sz.tellg())/1e6;
+    remove(path.c_str());
+    check("file round trip", same(big, loaded) && same(big, serial));
+    cout << mb << " MB  write " << mb/chrono::duration<double>(t1 - t0).count() << " MB/s  read "
+         << mb/chrono::duration<double>(t2 - t1).count() << " MB/s" << endl;
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
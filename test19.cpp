@@ -0,0 +1,81 @@
+#include "src/Tensor.hpp"
+#include "src/Numa.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+using namespace Orion;
+
+typedef Tensor<double> TD;
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    NumaTopology const& topo = NumaTopology::instance();
+    bool cpus_ok = topo.nodes() >= 1;
+    for(u64 n = 0; n < topo.nodes(); n++) cpus_ok = cpus_ok && !topo.cpus(n).empty();
+    check("topology", cpus_ok && topo.node_of_cpu(topo.cpu_for_thread(0)) == topo.node_for_thread(0));
+
+    ThreadPool pool(4);
+    vector<atomic<int>> hits(pool.size());
+    for(auto& h : hits) h.store(0);
+    pool.for_each_thread([&](u64 t){ hits[t].fetch_add(1); });
+    bool once = true;
+    for(auto& h : hits) once = once && h.load() == 1;
+    check("for_each_thread once per thread", once);
+
+    // every thread then stays on the CPU it was given
+    bool pinned = pin_threads(pool);
+    vector<int> seen(pool.size(), -1);
+    pool.for_each_thread([&](u64 t){ seen[t] = sched_getcpu(); });
+    bool where = true;
+    for(u64 t = 0; t < pool.size(); t++) where = where && seen[t] == topo.cpu_for_thread(t);
+    check("pinned threads", !pinned || where);
+
+    // shares cover the buffer in order, split only on page boundaries
+    TD x({1000, 100});
+    bool cover = true;
+    u64 prev = 0;
+    for(u64 t = 0; t < pool.size(); t++){
+        auto r = numa_partition(x.data(), x.nelem(), t, pool.size());
+        cover = cover && r.first == prev && r.first <= r.second;
+        if(r.first != 0 && r.first != x.nelem())
+            cover = cover && reinterpret_cast<std::uintptr_t>(x.data() + r.first)%detail::page_size() == 0;
+        prev = r.second;
+    }
+    check("partition", cover && prev == x.nelem());
+
+    for(u64 i = 0; i < x.nelem(); i++) x.data()[i] = 1;
+    numa_first_touch(x, pool);
+    bool zero = true;
+    for(u64 i = 0; i < x.nelem(); i++) zero = zero && x[i] == 0;
+    check("first touch", zero);
+
+    TD a({1000, 100}), b({1000, 100}), y({1000, 100});
+    for(u64 i = 0; i < a.nelem(); i++){
+        a.data()[i] = double(i%17) - 8;
+        b.data()[i] = double(i%5) + 0.25;
+    }
+    parallel_assign(x, a%b + a%2.0, pool);
+    y.assign(a%b + a%2.0);
+    bool same = true;
+    for(u64 i = 0; i < x.nelem(); i++) same = same && x[i] == y[i];
+    check("parallel assign", same);
+
+    // placement needs kernel support, the data must survive it either way
+    bool bound = numa_bind_shares(x, pool);
+    bool interleaved = numa_interleave(a.data(), a.nelem()*sizeof(double));
+    cout << "bind " << (bound ? "applied" : "unsupported") << ", interleave " << (interleaved ? "applied" : "unsupported") << endl;
+    bool kept = true;
+    for(u64 i = 0; i < x.nelem(); i++) kept = kept && x[i] == y[i] && a[i] == double(i%17) - 8;
+    check("placement keeps data", kept);
+
+    cout << (failed ? "SOME FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
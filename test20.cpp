@@ -0,0 +1,66 @@
+#include "src/Tensor.hpp"
+#include "src/OutOfCore.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+
+using namespace std;
+using namespace Orion;
+
+typedef Tensor<double> TD;
+
+string temp_path(string name){
+    const char* dir = getenv("TMPDIR");
+    return string(dir ? dir : "/tmp") + "/orion_test20_" + name + ".bin";
+}
+
+double max_diff(TD const& a, TD const& b){
+    double d = 0;
+    for(u64 i = 0; i < a.nelem(); i++) d = max(d, fabs(a[i] - b[i]));
+    return d;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    u64 m = 70, k = 45, n = 53, tile = 16;
+    TD a({m, k}), b({k, n});
+    for(u64 i = 0; i < a.nelem(); i++) a.data()[i] = double(i%13) - 6;
+    for(u64 i = 0; i < b.nelem(); i++) b.data()[i] = double(i%7)*0.5 - 1;
+
+    string pa = temp_path("a"), pb = temp_path("b"), pc = temp_path("c");
+    {
+        TiledTensor<double> ta(pa, m, k, tile), tb(pb, k, n, tile);
+        ta.from_tensor(a);
+        tb.from_tensor(b);
+        check("tiles", ta.tile_rows() == 5 && ta.tile_cols() == 3 && ta.tile_height(4) == 6 && ta.tile_width(2) == 13);
+        check("round trip", max_diff(ta.to_tensor(), a) == 0);
+    }
+
+    // reopened from the header, C larger than the few tiles allowed in memory
+    TiledTensor<double> ta(pa), tb(pb), tc(pc, m, n, tile);
+    check("reopen", ta.rows() == m && ta.cols() == k && ta.tile() == tile);
+    TD ref({m, n});
+    gemm(false, false, m, n, k, 1.0, a.data(), k, b.data(), n, 0.0, ref.data(), n);
+    ooc_gemm(tc, ta, tb, 6*tc.tile_bytes());
+    check("gemm in six tiles", max_diff(tc.to_tensor(), ref) < 1e-9);
+
+    ThreadPool pool(3);
+    TiledTensor<double> td(temp_path("d"), m, n, tile);
+    ooc_gemm(td, ta, tb, 40*td.tile_bytes(), &pool);
+    check("gemm in larger blocks", max_diff(td.to_tensor(), ref) < 1e-9);
+
+    // element wise, the result overwriting one of its inputs
+    ooc_map(td, [](auto const& x, auto const& y){ return x%y + 1.0; }, tc, td);
+    TD e = ref%ref + 1.0;
+    check("map", max_diff(td.to_tensor(), e) < 1e-9);
+
+    for(string p : {pa, pb, pc, temp_path("d")}) remove(p.c_str());
+    cout << (failed ? "SOME FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,132 @@
+#include "src/Tensor.hpp"
+#include "src/FFT.hpp"
+
+#include <cmath>
+#include <complex>
+#include <cstdio>
+#include <sstream>
+
+using namespace std;
+using namespace Orion;
+
+typedef complex<double> cd;
+typedef Tensor<cd> TC;
+
+// direct DFT of the lines of x along axis
+TC naive_dft(TC const& x, u64 axis, bool inverse){
+    TC res(x.dim());
+    u64 n = x.dim()[axis], outer = 1, inner = 1;
+    for(u64 i = 0; i < axis; i++) outer *= x.dim()[i];
+    for(u64 i = axis + 1; i < x.rank(); i++) inner *= x.dim()[i];
+    double sign = inverse ? 1 : -1;
+    for(u64 o = 0; o < outer; o++)
+        for(u64 c = 0; c < inner; c++)
+            for(u64 k = 0; k < n; k++){
+                cd s = 0;
+                for(u64 j = 0; j < n; j++)
+                    s += x[(o*n + j)*inner + c]*polar(1.0, sign*2*M_PI*double((j*k)%n)/double(n));
+                res.data()[(o*n + k)*inner + c] = inverse ? s/double(n) : s;
+            }
+    return res;
+}
+
+TC random_complex(DimVec const& dim, u64 seed){
+    TC x(dim);
+    for(u64 i = 0; i < x.nelem(); i++){
+        seed = seed*6364136223846793005ull + 1442695040888963407ull;
+        double re = double(seed >> 40)/double(1 << 24) - 0.5;
+        double im = double((seed >> 16)&0xffffff)/double(1 << 24) - 0.5;
+        x.data()[i] = cd(re, im);
+    }
+    return x;
+}
+
+double max_diff(TC const& a, TC const& b){
+    double d = 0;
+    for(u64 i = 0; i < a.nelem(); i++) d = max(d, abs(a[i] - b[i]));
+    return d;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    // element wise expressions on complex elements
+    TC a({2, 2}), b({2, 2});
+    for(u64 i = 0; i < 4; i++){
+        a.data()[i] = cd(double(i), 1);
+        b.data()[i] = cd(1, -double(i));
+    }
+    TC e = a%b + cd(0, 2);
+    bool expr = true;
+    for(u64 i = 0; i < 4; i++) expr = expr && abs(e[i] - (a[i]*b[i] + cd(0, 2))) < 1e-15;
+    Tensor<double> mag = abs_t(a), re = real_t(a%b), im = imag_t(conj_t(a));
+    for(u64 i = 0; i < 4; i++) expr = expr && mag[i] == abs(a[i]) && re[i] == (a[i]*b[i]).real() && im[i] == -1;
+    check("complex expressions", expr);
+    TC p = a*b;
+    check("complex matmul", abs(p[1] - (a[0]*b[1] + a[1]*b[3])) < 1e-15);
+
+    // every radix, generic primes and Bluestein lengths
+    bool lengths = true;
+    for(u64 n : {1, 2, 3, 4, 5, 6, 7, 8, 12, 15, 16, 30, 49, 60, 64, 74, 97, 120, 128, 210, 1000}){
+        TC x = random_complex({3, n}, n);
+        double d1 = max_diff(fft(x), naive_dft(x, 1, false));
+        double d2 = max_diff(ifft(fft(x)), x);
+        if(d1 > 1e-9*double(n) || d2 > 1e-12*double(n)){
+            cout << "  length " << n << " : " << d1 << " " << d2 << endl;
+            lengths = false;
+        }
+    }
+    check("1D lengths", lengths);
+
+    Tensor<complex<float>> xf({1, 48});
+    for(u64 i = 0; i < 48; i++) xf.data()[i] = complex<float>(float(i%5), float(i%3));
+    auto yf = ifft(fft(xf));
+    float df = 0;
+    for(u64 i = 0; i < 48; i++) df = max(df, abs(yf[i] - xf[i]));
+    check("float", df < 1e-5f);
+
+    // strided axes, in parallel or not
+    ThreadPool pool(3);
+    TC cube = random_complex({6, 20, 35}, 7);
+    check("middle axis", max_diff(fft(cube, 1), naive_dft(cube, 1, false)) < 1e-10);
+    check("first axis in parallel", max_diff(fft(cube, 0, &pool), naive_dft(cube, 0, false)) < 1e-10);
+    TC img = random_complex({2, 36, 50}, 11);
+    TC f2 = fft2(img, &pool);
+    check("2D", max_diff(f2, naive_dft(naive_dft(img, 2, false), 1, false)) < 1e-9);
+    check("2D inverse", max_diff(ifft2(f2), img) < 1e-12);
+    check("N-D", max_diff(ifftn(fftn(cube, &pool), &pool), cube) < 1e-12
+                 && max_diff(fftn(cube), naive_dft(naive_dft(naive_dft(cube, 2, false), 1, false), 0, false)) < 1e-9);
+
+    Tensor<double> r({16});
+    for(u64 i = 0; i < 16; i++) r.data()[i] = double(i%4);
+    TC fr = fft(r);
+    check("real input", abs(fr[0] - cd(24, 0)) < 1e-12 && abs(fr[4] - cd(-8, 8)) < 1e-12);
+
+    Tensor<double> u({37}), v({11});
+    for(u64 i = 0; i < 37; i++) u.data()[i] = sin(double(i));
+    for(u64 i = 0; i < 11; i++) v.data()[i] = double(i) - 5;
+    Tensor<double> conv = fft_convolve(u, v);
+    double dc = 0;
+    for(u64 k = 0; k < 47; k++){
+        double s = 0;
+        for(u64 j = 0; j < 37; j++)
+            if(k >= j && k - j < 11) s += u[j]*v[k - j];
+        dc = max(dc, fabs(conv[k] - s));
+    }
+    check("convolution", conv.nelem() == 47 && dc < 1e-10 && fft_fast_size(47) == 48);
+
+    // printed complex tensors read back
+    ostringstream out;
+    out << a;
+    TC back({2, 2});
+    istringstream in(out.str());
+    in >> back;
+    check("print and read", out.str() == "[[0+1j, 1+1j],\n [2+1j, 3+1j]]" && bool(in) && max_diff(back, a) == 0);
+
+    cout << (failed ? "SOME FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
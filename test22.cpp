@@ -0,0 +1,72 @@
+#include "src/Tensor.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+using namespace Orion;
+
+typedef Tensor<double> TD;
+
+TD random_matrix(u64 m, u64 n, u64 seed){
+    TD x({m, n});
+    for(u64 i = 0; i < x.nelem(); i++){
+        seed = seed*6364136223846793005ull + 1442695040888963407ull;
+        x.data()[i] = double(seed >> 40)/double(1 << 24) - 0.5;
+    }
+    return x;
+}
+
+double max_diff(TD const& a, TD const& b){
+    double d = 0;
+    for(u64 i = 0; i < a.nelem(); i++) d = max(d, fabs(a[i] - b[i]));
+    return d;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    // a small cutoff runs several levels on small matrices
+    strassen_cutoff() = 16;
+    bool shapes = true;
+    for(auto s : {DimVec{64, 64, 64}, DimVec{37, 53, 41}, DimVec{100, 33, 70}, DimVec{16, 16, 16}, DimVec{15, 80, 90}}){
+        u64 m = s[0], k = s[1], n = s[2];
+        TD a = random_matrix(m, k, m), b = random_matrix(k, n, n), c0({m, n}), c1({m, n});
+        gemm(false, false, m, n, k, 1.0, a.data(), k, b.data(), n, 0.0, c0.data(), n);
+        strassen(m, n, k, a.data(), k, b.data(), n, c1.data(), n);
+        if(max_diff(c0, c1) > 1e-12){
+            cout << "  shape " << m << " " << k << " " << n << " : " << max_diff(c0, c1) << endl;
+            shapes = false;
+        }
+    }
+    check("sequential shapes", shapes);
+    check("levels", strassen_levels(64, 64, 64) == 3 && strassen_levels(15, 80, 90) == 0);
+
+    // the parallel top level, with a workspace given up front
+    ThreadPool pool(3);
+    TD a = random_matrix(90, 77, 1), b = random_matrix(77, 65, 2), c0({90, 65}), c1({90, 65});
+    gemm(false, false, 90, 65, 77, 1.0, a.data(), 77, b.data(), 65, 0.0, c0.data(), 65);
+    vector<double> ws(strassen_workspace(90, 65, 77, &pool));
+    strassen(90, 65, 77, a.data(), 77, b.data(), 65, c1.data(), 65, &pool, ws.data());
+    check("parallel", max_diff(c0, c1) < 1e-12);
+
+    // operator* once selected
+    TD x = random_matrix(128, 96, 3), y = random_matrix(96, 112, 4);
+    TD p0 = x*y;
+    matmul_algorithm() = MatmulAlgorithm::Strassen;
+    TD p1 = x*y;
+    matmul_algorithm() = MatmulAlgorithm::Classical;
+    check("operator*", max_diff(p0, p1) < 1e-12);
+
+    StrassenReport r = strassen_report(x, y, &pool);
+    cout << "levels " << r.levels << ", max abs " << r.max_abs_error << ", relative " << r.rel_frobenius_error
+         << ", normwise " << r.normwise_error << endl;
+    check("report", r.levels == 3 && r.max_abs_error < 1e-12 && r.normwise_error < 1e-14 && r.rel_frobenius_error > 0);
+
+    cout << (failed ? "SOME FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,109 @@
+#include "src/Tensor.hpp"
+#include "src/Autotune.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+using namespace std;
+using namespace Orion;
+
+typedef Tensor<double> TD;
+
+TD matrix(u64 m, u64 n, u64 seed){
+    TD x({m, n});
+    for(u64 i = 0; i < x.nelem(); i++) x.data()[i] = double((i*seed)%31) - 15;
+    return x;
+}
+
+double max_diff(TD const& a, TD const& b){
+    double d = 0;
+    for(u64 i = 0; i < a.nelem(); i++) d = max(d, fabs(a[i] - b[i]));
+    return d;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    TD a = matrix(70, 50, 3), b = matrix(50, 60, 7);
+    TD p0 = a*b, t0 = a.t();
+    Tuning defaults = current_tuning();
+
+    // small benchmarks, the point is that tuned values are valid and results unchanged
+    AutotuneOptions opt;
+    opt.gemm_size = 96;
+    opt.strassen_max = 128;
+    opt.transpose_size = 128;
+    opt.eval_max = u64(1) << 14;
+    opt.reps = 1;
+    ThreadPool pool(2);
+    Tuning t = autotune(&pool, opt);
+    cout << "mc " << t.gemm.mc << " kc " << t.gemm.kc << " nc " << t.gemm.nc << " strassen " << t.strassen_cutoff
+         << " leaf " << t.transpose.leaf << " eval " << t.eval.parallel_min << "/" << t.eval.grain << endl;
+    check("tuned values", t.gemm.mc >= 32 && t.gemm.kc >= 64 && t.gemm.nc >= 256 && t.strassen_cutoff >= 64
+                          && t.transpose.leaf >= 8 && t.eval.grain >= 4096);
+    check("results after tuning", max_diff(a*b, p0) == 0 && max_diff(a.t(), t0) == 0);
+
+    // evaluation split over the pool gives the same elements
+    eval_params().parallel_min = 1;
+    eval_params().grain = 100;
+    TD x = matrix(1, 1001, 5), y({1, 1001}), z({1, 1001});
+    y.assign(x%x + 1.0, pool);
+    z.assign(x%x + 1.0);
+    check("parallel assign", max_diff(y, z) == 0);
+
+    string path = string(getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp") + "/orion_test23/tuning";
+    apply_tuning(t);
+    check("save", save_tuning(path));
+    apply_tuning(defaults);
+    check("load", load_tuning(path) && current_tuning().gemm.kc == t.gemm.kc && current_tuning().transpose.leaf == t.transpose.leaf
+                  && strassen_cutoff() == t.strassen_cutoff && eval_params().grain == t.eval.grain);
+
+    // startup tuning is the cache named by the environment, loaded by the first call only
+    apply_tuning(defaults);
+    setenv("ORION_TUNE_CACHE", path.c_str(), 1);
+    unsetenv("ORION_AUTOTUNE");
+    check("init", init_tuning() && current_tuning().gemm.kc == t.gemm.kc && strassen_cutoff() == t.strassen_cutoff);
+    apply_tuning(defaults);
+    check("init once", init_tuning() && current_tuning().gemm.kc == defaults.gemm.kc);
+
+    // a cache from another machine is ignored
+    stringstream text;
+    {
+        ifstream in(path);
+        text << in.rdbuf();
+    }
+    string s = text.str();
+    s.replace(s.find("host ") + 5, 0, "other ");
+    {
+        ofstream out(path);
+        out << s;
+    }
+    apply_tuning(defaults);
+    check("other host", !load_tuning(path) && current_tuning().gemm.kc == defaults.gemm.kc);
+    check("missing file", !load_tuning(path + ".none"));
+
+    // out of range entries keep the defaults, valid ones still apply
+    {
+        ofstream out(path);
+        out << "host " << detail::tune_host() << "\n"
+            << "gemm.mc 0\ngemm.kc 128\ngemm.nc 0\nstrassen.cutoff 1\n"
+            << "transpose.leaf 2\neval.grain 0\neval.parallel_min 4096\n";
+    }
+    apply_tuning(defaults);
+    Tuning bad = load_tuning(path) ? current_tuning() : defaults;
+    check("out of range entries", bad.gemm.mc == defaults.gemm.mc && bad.gemm.nc == defaults.gemm.nc
+                                  && bad.strassen_cutoff == defaults.strassen_cutoff && bad.transpose.leaf == defaults.transpose.leaf
+                                  && bad.eval.grain == defaults.eval.grain && bad.gemm.kc == 128 && bad.eval.parallel_min == 4096);
+    apply_tuning(defaults);
+    remove(path.c_str());
+
+    cout << (failed ? "SOME FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,72 @@
+#include "src/Tensor.hpp"
+#include "src/Softmax.hpp"
+#include "src/Dispatch.hpp"
+
+#include <cmath>
+#include <cstdio>
+
+using namespace std;
+using namespace Orion;
+
+typedef Tensor<double> TD;
+typedef Tensor<float> TF;
+
+template<typename T>
+Tensor<T> random_matrix(u64 m, u64 n, u64 seed){
+    Tensor<T> x({m, n});
+    for(u64 i = 0; i < x.nelem(); i++){
+        seed = seed*6364136223846793005ull + 1442695040888963407ull;
+        x.data()[i] = T(double(seed >> 40)/double(1 << 24) - 0.5);
+    }
+    return x;
+}
+
+template<typename T>
+double max_rel(Tensor<T> const& a, Tensor<T> const& b){
+    double d = 0;
+    for(u64 i = 0; i < a.nelem(); i++) d = max(d, fabs(double(a[i]) - double(b[i]))/(1 + fabs(double(b[i]))));
+    return d;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    Isa best = active_isa();
+    cout << "detected " << isa_name(detected_isa()) << ", active " << isa_name(best) << endl;
+    check("active within detected", best <= detected_isa());
+    check("names", isa_from_name("avx2", Isa::generic) == Isa::avx2 && isa_from_name("sse4.2", Isa::generic) == Isa::sse42
+                   && isa_from_name("avx512", Isa::generic) == Isa::avx512 && isa_from_name("neon", Isa::sse42) == Isa::sse42);
+
+    // every version the CPU runs against the generic one
+    TD a = random_matrix<double>(67, 45, 1), b = random_matrix<double>(45, 39, 2), x = random_matrix<double>(9, 301, 3);
+    TF af = random_matrix<float>(33, 70, 4), bf = random_matrix<float>(70, 50, 5);
+    active_isa() = Isa::generic;
+    TD p0 = a*b, e0 = exp_t(x)%x + tanh_t(x), s0 = softmax(x), l0 = log_softmax(x);
+    TF pf0 = af*bf, ef0 = sigmoid_t(af) - af%af;
+    vector<u64> targets(9);
+    for(u64 r = 0; r < 9; r++) targets[r] = r*31;
+    double ce0 = cross_entropy(x, targets);
+
+    for(Isa isa : {Isa::sse42, Isa::avx2, Isa::avx512}){
+        if(isa > detected_isa()) continue;
+        active_isa() = isa;
+        string n = isa_name(isa);
+        check(n + " matmul", max_rel(TD(a*b), p0) < 1e-13 && max_rel(TF(af*bf), pf0) < 1e-5f);
+        check(n + " expressions", max_rel(TD(exp_t(x)%x + tanh_t(x)), e0) < 1e-13 && max_rel(TF(sigmoid_t(af) - af%af), ef0) < 1e-5);
+        check(n + " softmax", max_rel(softmax(x), s0) < 1e-13 && max_rel(log_softmax(x), l0) < 1e-13
+                              && fabs(cross_entropy(x, targets) - ce0) < 1e-12);
+        TD y({9, 301});
+        vexp(x.data(), y.data(), x.nelem());
+        bool ok = true;
+        for(u64 i = 0; i < x.nelem(); i++) ok = ok && fabs(y.data()[i] - exp(x.data()[i])) < 1e-15*exp(x.data()[i]) + 1e-300;
+        check(n + " vexp", ok);
+    }
+    active_isa() = best;
+
+    cout << (failed ? "SOME FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
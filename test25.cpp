@@ -0,0 +1,181 @@
+#include "src/dl/Recurrent.hpp"
+#include "src/dl/Attention.hpp"
+#include "test_helpers.hpp"
+
+#include <cmath>
+#include <functional>
+
+using namespace std;
+using namespace Orion;
+
+double sigm(double x){ return 1/(1 + std::exp(-x)); }
+
+// unfused LSTM step, state [h | c]
+ten lstm_ref(const ten& x, const ten& s, const ten& w, const ten& b){
+    u64 B = x.dim()[0], n = x.dim()[1], h = s.dim()[1]/2;
+    ten out({B, 2*h});
+    for(u64 r = 0; r < B; r++){
+        vector<double> g(4*h);
+        for(u64 j = 0; j < 4*h; j++){
+            double a = b[j];
+            for(u64 i = 0; i < n; i++) a += x[r*n + i]*w[i*4*h + j];
+            for(u64 i = 0; i < h; i++) a += s[r*2*h + i]*w[(n + i)*4*h + j];
+            g[j] = a;
+        }
+        for(u64 j = 0; j < h; j++){
+            double c = sigm(g[h + j])*s[r*2*h + h + j] + sigm(g[j])*std::tanh(g[2*h + j]);
+            out.data()[r*2*h + j] = sigm(g[3*h + j])*std::tanh(c);
+            out.data()[r*2*h + h + j] = c;
+        }
+    }
+    return out;
+}
+
+// unfused GRU step
+ten gru_ref(const ten& x, const ten& hs, const ten& wx, const ten& wh, const ten& bx, const ten& bh){
+    u64 B = x.dim()[0], n = x.dim()[1], h = hs.dim()[1];
+    ten out({B, h});
+    for(u64 r = 0; r < B; r++){
+        vector<double> a(3*h), u(3*h);
+        for(u64 j = 0; j < 3*h; j++){
+            a[j] = bx[j];
+            u[j] = bh[j];
+            for(u64 i = 0; i < n; i++) a[j] += x[r*n + i]*wx[i*3*h + j];
+            for(u64 i = 0; i < h; i++) u[j] += hs[r*h + i]*wh[i*3*h + j];
+        }
+        for(u64 j = 0; j < h; j++){
+            double rg = sigm(a[j] + u[j]), zg = sigm(a[h + j] + u[h + j]);
+            double ng = std::tanh(a[2*h + j] + rg*u[2*h + j]);
+            out.data()[r*h + j] = (1 - zg)*ng + zg*hs[r*h + j];
+        }
+    }
+    return out;
+}
+
+// naive softmax(scale q k^T + mask) v per batch entry, fully masked rows give zeros
+ten attention_ref(const ten& q, const ten& k, const ten& v, AttentionParams p, const ten* mask){
+    u64 batch = q.dim()[0], lq = q.dim()[1], d = q.dim()[2], lk = k.dim()[1], dv = v.dim()[2];
+    double scale = p.scale != 0 ? p.scale : 1/std::sqrt(double(d));
+    ten out({batch, lq, dv});
+    out.fill(0);
+    for(u64 b = 0; b < batch; b++)
+    for(u64 i = 0; i < lq; i++){
+        vector<double> s(lk);
+        double m = -1e300;
+        for(u64 j = 0; j < lk; j++){
+            bool hidden = (p.causal && j > i) || (mask && (*mask)[i*lk + j] == 0);
+            double a = 0;
+            for(u64 c = 0; c < d; c++) a += q[(b*lq + i)*d + c]*k[(b*lk + j)*d + c];
+            s[j] = hidden ? -1e300 : a*scale;
+            m = max(m, s[j]);
+        }
+        if(m == -1e300) continue;
+        double sum = 0;
+        for(u64 j = 0; j < lk; j++){
+            s[j] = s[j] == -1e300 ? 0 : std::exp(s[j] - m);
+            sum += s[j];
+        }
+        for(u64 j = 0; j < lk; j++)
+            for(u64 c = 0; c < dv; c++) out.data()[(b*lq + i)*dv + c] += s[j]/sum*v[(b*lk + j)*dv + c];
+    }
+    return out;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, double err, double tol){
+        cout << name << " : " << err << endl;
+        if(!(err < tol)){
+            cout << "FAILED " << name << endl;
+            failed++;
+        }
+    };
+
+    // LSTM, two steps through the packed state, loss on the last hidden state
+    {
+        u64 B = 3, n = 5, h = 4;
+        ten x1 = random_tensor({B, n}), x2 = random_tensor({B, n}), s0 = random_tensor({B, 2*h});
+        ten w = random_tensor({n + h, 4*h}), b = random_tensor({4*h}), r = random_tensor({B, h});
+        check("lstm forward", max_abs_diff(lstm_cell(x1, s0, w, b), lstm_ref(x1, s0, w, b)), 1e-13);
+
+        auto vx1 = make_shared<TensorVar>(x1, true), vx2 = make_shared<TensorVar>(x2, true), vs0 = make_shared<TensorVar>(s0, true);
+        auto vw = make_shared<TensorVar>(w, true), vb = make_shared<TensorVar>(b, true);
+        auto s2 = lstm_cell(vx2, lstm_cell(vx1, vs0, vw, vb), vw, vb);
+        auto z = columns(s2, 0, h) % make_shared<TensorVar>(r, false);
+        backward(z, {vx1, vx2, vs0, vw, vb});
+        auto loss = [&]{
+            ten s = lstm_ref(x2, lstm_ref(x1, s0, w, b), w, b);
+            double l = 0;
+            for(u64 i = 0; i < B; i++)
+                for(u64 j = 0; j < h; j++) l += s[i*2*h + j]*r[i*h + j];
+            return l;
+        };
+        check("lstm grad x1", grad_err(x1, vx1->grad(), loss), 1e-7);
+        check("lstm grad x2", grad_err(x2, vx2->grad(), loss), 1e-7);
+        check("lstm grad state", grad_err(s0, vs0->grad(), loss), 1e-7);
+        check("lstm grad w", grad_err(w, vw->grad(), loss), 1e-7);
+        check("lstm grad b", grad_err(b, vb->grad(), loss), 1e-7);
+    }
+
+    // GRU, two steps
+    {
+        u64 B = 3, n = 4, h = 5;
+        ten x1 = random_tensor({B, n}), x2 = random_tensor({B, n}), h0 = random_tensor({B, h});
+        ten wx = random_tensor({n, 3*h}), wh = random_tensor({h, 3*h}), bx = random_tensor({3*h}), bh = random_tensor({3*h});
+        ten r = random_tensor({B, h});
+        check("gru forward", max_abs_diff(gru_cell(x1, h0, wx, wh, bx, bh), gru_ref(x1, h0, wx, wh, bx, bh)), 1e-13);
+
+        auto vx1 = make_shared<TensorVar>(x1, true), vx2 = make_shared<TensorVar>(x2, true), vh0 = make_shared<TensorVar>(h0, true);
+        auto vwx = make_shared<TensorVar>(wx, true), vwh = make_shared<TensorVar>(wh, true);
+        auto vbx = make_shared<TensorVar>(bx, true), vbh = make_shared<TensorVar>(bh, true);
+        auto h2 = gru_cell(vx2, gru_cell(vx1, vh0, vwx, vwh, vbx, vbh), vwx, vwh, vbx, vbh);
+        auto z = h2 % make_shared<TensorVar>(r, false);
+        backward(z, {vx1, vx2, vh0, vwx, vwh, vbx, vbh});
+        auto loss = [&]{ return dot(gru_ref(x2, gru_ref(x1, h0, wx, wh, bx, bh), wx, wh, bx, bh), r); };
+        check("gru grad x1", grad_err(x1, vx1->grad(), loss), 1e-7);
+        check("gru grad x2", grad_err(x2, vx2->grad(), loss), 1e-7);
+        check("gru grad h", grad_err(h0, vh0->grad(), loss), 1e-7);
+        check("gru grad wx", grad_err(wx, vwx->grad(), loss), 1e-7);
+        check("gru grad wh", grad_err(wh, vwh->grad(), loss), 1e-7);
+        check("gru grad bx", grad_err(bx, vbx->grad(), loss), 1e-7);
+        check("gru grad bh", grad_err(bh, vbh->grad(), loss), 1e-7);
+    }
+
+    // attention over several query and key blocks, with a causal and an explicit mask
+    {
+        u64 batch = 2, lq = 70, lk = 130, d = 6, dv = 5;
+        ten q = random_tensor({batch, lq, d}), k = random_tensor({batch, lk, d}), v = random_tensor({batch, lk, dv});
+        ten mask({lq, lk});
+        for(u64 i = 0; i < mask.nelem(); i++) mask.data()[i] = (i*7919)%5 == 0 ? 0 : 1;
+        // a row that sees nothing
+        for(u64 j = 0; j < lk; j++) mask.data()[3*lk + j] = 0;
+        AttentionParams causal;
+        causal.causal = true;
+        check("attention forward", max_abs_diff(attention(q, k, v), attention_ref(q, k, v, {}, nullptr)), 1e-13);
+        check("attention causal", max_abs_diff(attention(q, k, v, causal), attention_ref(q, k, v, causal, nullptr)), 1e-13);
+        check("attention mask", max_abs_diff(attention(q, k, v, {}, &mask), attention_ref(q, k, v, {}, &mask)), 1e-13);
+
+        for(bool use_mask : {false, true}){
+            string tag = use_mask ? "masked " : "causal ";
+            AttentionParams p;
+            p.causal = !use_mask;
+            p.scale = 0.7;
+            ten r = random_tensor({batch, lq, dv});
+            auto vq = make_shared<TensorVar>(q, true), vk = make_shared<TensorVar>(k, true), vv = make_shared<TensorVar>(v, true);
+            auto y = attention(vq, vk, vv, p, use_mask ? mask : ten());
+            backward(y % make_shared<TensorVar>(r, false), {vq, vk, vv});
+            auto loss = [&]{ return dot(attention_ref(q, k, v, p, use_mask ? &mask : nullptr), r); };
+            check(tag + "attention grad q", grad_err(q, vq->grad(), loss), 1e-7);
+            check(tag + "attention grad k", grad_err(k, vk->grad(), loss), 1e-7);
+            check(tag + "attention grad v", grad_err(v, vv->grad(), loss), 1e-7);
+
+            // replay into the existing output after the inputs change
+            q.data()[0] += 0.5;
+            y->get_func()->recalc();
+            check(tag + "attention recalc", max_abs_diff(y->value(), attention_ref(q, k, v, p, use_mask ? &mask : nullptr)), 1e-13);
+        }
+    }
+
+    cout << (failed ? "SOME FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,153 @@
+#include "src/dl/Norm.hpp"
+#include "test_helpers.hpp"
+
+#include <cmath>
+#include <functional>
+
+using namespace std;
+using namespace Orion;
+
+// two pass reference, per row
+ten layer_norm_ref(const ten& x, const ten& gamma, const ten& beta, double eps){
+    u64 n = x.dim().back(), rows = x.nelem()/n;
+    ten y(x.dim());
+    for(u64 r = 0; r < rows; r++){
+        double mean = 0, var = 0;
+        for(u64 i = 0; i < n; i++) mean += x[r*n + i];
+        mean /= double(n);
+        for(u64 i = 0; i < n; i++) var += (x[r*n + i] - mean)*(x[r*n + i] - mean);
+        var /= double(n);
+        for(u64 i = 0; i < n; i++) y.data()[r*n + i] = (x[r*n + i] - mean)/std::sqrt(var + eps)*gamma[i] + beta[i];
+    }
+    return y;
+}
+
+// two pass reference for NCHW or {N, C}, returns the batch mean and biased variance too
+ten batch_norm_ref(const ten& x, const ten& gamma, const ten& beta, double eps, vector<double>& mean, vector<double>& var){
+    u64 n = x.dim()[0], c = x.dim()[1], inner = x.nelem()/(n*c);
+    mean.assign(c, 0);
+    var.assign(c, 0);
+    for(u64 b = 0; b < n; b++) for(u64 k = 0; k < c; k++) for(u64 i = 0; i < inner; i++) mean[k] += x[(b*c + k)*inner + i];
+    for(u64 k = 0; k < c; k++) mean[k] /= double(n*inner);
+    for(u64 b = 0; b < n; b++) for(u64 k = 0; k < c; k++) for(u64 i = 0; i < inner; i++){
+        double d = x[(b*c + k)*inner + i] - mean[k];
+        var[k] += d*d;
+    }
+    for(u64 k = 0; k < c; k++) var[k] /= double(n*inner);
+    ten y(x.dim());
+    for(u64 b = 0; b < n; b++) for(u64 k = 0; k < c; k++) for(u64 i = 0; i < inner; i++){
+        u64 j = (b*c + k)*inner + i;
+        y.data()[j] = (x[j] - mean[k])/std::sqrt(var[k] + eps)*gamma[k] + beta[k];
+    }
+    return y;
+}
+
+// NCHW -> NHWC
+ten to_nhwc(const ten& x){
+    u64 n = x.dim()[0], c = x.dim()[1], h = x.dim()[2], w = x.dim()[3];
+    ten y({n, h, w, c});
+    for(u64 b = 0; b < n; b++) for(u64 k = 0; k < c; k++) for(u64 i = 0; i < h*w; i++)
+        y.data()[(b*h*w + i)*c + k] = x[(b*c + k)*h*w + i];
+    return y;
+}
+
+// running statistics copied, so a training pass on the copy leaves the original alone
+BatchNormState<double> clone(BatchNormState<double> const& st){
+    BatchNormState<double> s = st;
+    s.running_mean = ten(st.running_mean.dim());
+    s.running_var = ten(st.running_var.dim());
+    s.running_mean.assign(st.running_mean);
+    s.running_var.assign(st.running_var);
+    return s;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, double err, double tol){
+        cout << name << " : " << err << endl;
+        if(!(err < tol)){
+            cout << "FAILED " << name << endl;
+            failed++;
+        }
+    };
+
+    // welford keeps the variance of data far from zero
+    {
+        vector<double> v(1001);
+        for(u64 i = 0; i < v.size(); i++) v[i] = 1e9 + double(i%7);
+        Moments<double> m = detail::run_moments(v.data(), v.size());
+        double mean = 0, var = 0;
+        for(double a : v) mean += a - 1e9;
+        mean /= double(v.size());
+        for(double a : v) var += (a - 1e9 - mean)*(a - 1e9 - mean);
+        var /= double(v.size());
+        check("welford offset", abs(m.var() - var) + abs(m.mean - 1e9 - mean), 1e-6);
+    }
+
+    // layer norm
+    {
+        ten x = random_tensor({2, 3, 37}), gamma = random_tensor({37}), beta = random_tensor({37}), r = random_tensor({2, 3, 37});
+        check("layer norm forward", max_abs_diff(layer_norm(x, gamma, beta, 1e-5), layer_norm_ref(x, gamma, beta, 1e-5)), 1e-12);
+        auto vx = make_shared<TensorVar>(x, true), vg = make_shared<TensorVar>(gamma, true), vb = make_shared<TensorVar>(beta, true);
+        auto y = layer_norm(vx, vg, vb);
+        backward(y % make_shared<TensorVar>(r, false), {vx, vg, vb});
+        auto loss = [&]{ return dot(layer_norm_ref(x, gamma, beta, 1e-5), r); };
+        check("layer norm grad x", grad_err(x, vx->grad(), loss, 3), 1e-7);
+        check("layer norm grad gamma", grad_err(gamma, vg->grad(), loss, 3), 1e-7);
+        check("layer norm grad beta", grad_err(beta, vb->grad(), loss, 3), 1e-7);
+    }
+
+    // batch norm, NCHW, NHWC and {N, C}
+    for(int kind = 0; kind < 3; kind++){
+        string tag = kind == 0 ? "nchw " : kind == 1 ? "nhwc " : "2d ";
+        u64 c = 5;
+        ten x = kind == 2 ? random_tensor({13, c}, 2, 5) : random_tensor({3, c, 4, 6}, 2, 5);
+        ten gamma = random_tensor({c}), beta = random_tensor({c});
+        Layout layout = kind == 1 ? Layout::NHWC : Layout::NCHW;
+        auto input = [&]{ return kind == 1 ? to_nhwc(x) : x; };
+        auto st = make_shared<BatchNormState<double>>(c);
+        st->momentum = 0.5;
+        vector<double> mean, var;
+        ten ref = batch_norm_ref(x, gamma, beta, st->eps, mean, var);
+        ten y = batch_norm(input(), gamma, beta, *st, true, layout);
+        check(tag + "batch norm forward", max_abs_diff(y, kind == 1 ? to_nhwc(ref) : ref), 1e-12);
+        double count = double(x.nelem()/c), err = 0;
+        for(u64 k = 0; k < c; k++){
+            err = max(err, abs(st->running_mean[k] - 0.5*mean[k]));
+            err = max(err, abs(st->running_var[k] - (0.5 + 0.5*var[k]*count/(count - 1))));
+        }
+        check(tag + "running stats", err, 1e-12);
+
+        // inference normalizes with the running statistics and leaves them alone
+        ten rm = st->running_mean, rv = st->running_var;
+        ten yi = batch_norm(input(), gamma, beta, *st, false, layout);
+        err = 0;
+        ten xi = input();
+        for(u64 j = 0; j < xi.nelem(); j++){
+            u64 k = kind == 1 ? j%c : (j/(xi.nelem()/(xi.dim()[0]*c)))%c;
+            err = max(err, abs(yi[j] - ((xi[j] - rm[k])/std::sqrt(rv[k] + st->eps)*gamma[k] + beta[k])));
+        }
+        check(tag + "inference", err + abs(st->running_mean[0] - rm[0]), 1e-12);
+
+        // gradients in training and inference mode
+        for(bool training : {true, false}){
+            ten xv = input();
+            ten r = random_tensor(xv.dim());
+            auto copy = make_shared<BatchNormState<double>>(clone(*st));
+            auto vx = make_shared<TensorVar>(xv, true), vg = make_shared<TensorVar>(gamma, true), vb = make_shared<TensorVar>(beta, true);
+            auto out = batch_norm(vx, vg, vb, copy, training, layout);
+            backward(out % make_shared<TensorVar>(r, false), {vx, vg, vb});
+            auto loss = [&]{
+                BatchNormState<double> s = clone(*st);
+                return dot(batch_norm(xv, gamma, beta, s, training, layout), r);
+            };
+            string mode = training ? "train " : "eval ";
+            check(tag + mode + "grad x", grad_err(xv, vx->grad(), loss, 3), 1e-7);
+            check(tag + mode + "grad gamma", grad_err(gamma, vg->grad(), loss, 3), 1e-7);
+            check(tag + mode + "grad beta", grad_err(beta, vb->grad(), loss, 3), 1e-7);
+        }
+    }
+
+    cout << (failed ? "SOME FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
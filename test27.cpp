@@ -0,0 +1,124 @@
+#include "src/dl/Backprop.hpp"
+#include "src/dl/Softmax.hpp"
+#include "test_helpers.hpp"
+
+#include <cmath>
+#include <functional>
+
+using namespace std;
+using namespace Orion;
+
+typedef shared_ptr<TensorVar> var;
+
+double max_abs(const ten& a){
+    double m = 0;
+    for(u64 i = 0; i < a.nelem(); i++) m = max(m, abs(a[i]));
+    return m;
+}
+
+// a loss touching every op with a second derivative graph
+var model(var const& x, var const& w, ten const& pred){
+    var h = tanh(w*x);
+    var a = sigmoid(transpose(h))*x;
+    var b = exp(0.3*a) - pow(a, 3);
+    var c = where(pred, erf(b), gelu(b));
+    var d = sqrt(c%c + 1.0) + rsqrt(2.0 + a%a) + log(3.0 + sigmoid(c));
+    return d%d;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, double err, double tol){
+        cout << name << " : " << err << endl;
+        if(!(err < tol)){
+            cout << "FAILED " << name << endl;
+            failed++;
+        }
+    };
+
+    ten xt = random_tensor({4, 3}), wt = random_tensor({4, 4}), pred({3, 3});
+    for(u64 i = 0; i < pred.nelem(); i++) pred.data()[i] = double(i%2);
+
+    // first order grad matches backward
+    {
+        auto x = make_shared<TensorVar>(copy_of(xt), true), w = make_shared<TensorVar>(copy_of(wt), true);
+        auto g = grad({model(x, w, pred)}, {x, w});
+        auto x2 = make_shared<TensorVar>(copy_of(xt), true), w2 = make_shared<TensorVar>(copy_of(wt), true);
+        backward(model(x2, w2, pred), {x2, w2});
+        check("grad matches backward", max_abs_diff(g[0]->value(), x2->grad()) + max_abs_diff(g[1]->value(), w2->grad()), 1e-12);
+        check("grad leaves buffers", max_abs(x->grad()), 1e-15);
+        check("detached", g[0]->requires_grad() ? 1 : 0, 0.5);
+    }
+
+    // hessian vector product against central differences of the gradient
+    {
+        ten vx = random_tensor({4, 3}), vw = random_tensor({4, 4});
+        auto x = make_shared<TensorVar>(copy_of(xt), true), w = make_shared<TensorVar>(copy_of(wt), true);
+        auto hv = hvp(model(x, w, pred), {x, w}, {vx, vw});
+        auto gradient_at = [&](double e){
+            auto xe = make_shared<TensorVar>(ten(xt + vx%e), true), we = make_shared<TensorVar>(ten(wt + vw%e), true);
+            auto g = grad({model(xe, we, pred)}, {xe, we});
+            return make_pair(g[0]->value(), g[1]->value());
+        };
+        auto gp = gradient_at(1e-5), gm = gradient_at(-1e-5);
+        check("hvp x", max_abs_diff(hv[0], ten((gp.first - gm.first)%(1/2e-5))), 1e-6);
+        check("hvp w", max_abs_diff(hv[1], ten((gp.second - gm.second)%(1/2e-5))), 1e-6);
+    }
+
+    // gradient penalty, sum(dloss/dx ^ 2) differentiated w.r.t. w by backward
+    {
+        auto x = make_shared<TensorVar>(copy_of(xt), true), w = make_shared<TensorVar>(copy_of(wt), true);
+        auto g = grad(model(x, w, pred), x, true);
+        check("create_graph", g->requires_grad() ? 0 : 1, 0.5);
+        backward(g%g, {w});
+        auto penalty = [&]{
+            auto xe = make_shared<TensorVar>(copy_of(xt), true), we = make_shared<TensorVar>(copy_of(wt), false);
+            ten ge = grad(model(xe, we, pred), xe)->value();
+            double s = 0;
+            for(u64 i = 0; i < ge.nelem(); i++) s += ge[i]*ge[i];
+            return s;
+        };
+        double err = 0;
+        for(u64 i = 0; i < wt.nelem(); i++){
+            double old = wt.data()[i];
+            wt.data()[i] = old + 1e-6;
+            double lp = penalty();
+            wt.data()[i] = old - 1e-6;
+            double lm = penalty();
+            wt.data()[i] = old;
+            err = max(err, abs((lp - lm)/2e-6 - w->grad()[i]));
+        }
+        check("gradient penalty", err, 1e-5);
+    }
+
+    // third derivative of sum(x^4) is 24 x
+    {
+        auto x = make_shared<TensorVar>(copy_of(xt), true);
+        auto g1 = grad(pow(x, 4), x, true);
+        auto g2 = grad(g1, x, true);
+        auto g3 = grad(g2, x);
+        check("third order", max_abs_diff(g3->value(), ten(xt%24.0)), 1e-12);
+    }
+
+    // fused ops have no gradient graph, without create_graph grad runs their calc_grad
+    {
+        vector<u64> targets{2, 0, 1, 1};
+        auto head = [&](var const& x, var const& w){ return cross_entropy(log_softmax(w*x) + softmax(tanh(w*x)), targets); };
+        auto x = make_shared<TensorVar>(copy_of(xt), true), w = make_shared<TensorVar>(copy_of(wt), true);
+        auto g = grad({head(x, w)}, {x, w});
+        auto x2 = make_shared<TensorVar>(copy_of(xt), true), w2 = make_shared<TensorVar>(copy_of(wt), true);
+        backward(head(x2, w2), {x2, w2});
+        check("fused grad matches backward", max_abs_diff(g[0]->value(), x2->grad()) + max_abs_diff(g[1]->value(), w2->grad()), 1e-12);
+        check("fused grad leaves buffers", max_abs(x->grad()) + max_abs(w->grad()), 1e-15);
+    }
+
+    // inputs the outputs do not depend on get zeros
+    {
+        auto x = make_shared<TensorVar>(copy_of(xt), true), u = make_shared<TensorVar>(copy_of(wt), true);
+        auto g = grad(exp(x), u);
+        check("unused input", max_abs(g->value()), 1e-15);
+    }
+
+    cout << (failed ? "SOME FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
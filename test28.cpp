@@ -0,0 +1,124 @@
+#include "src/dl/Softmax.hpp"
+#include "test_helpers.hpp"
+
+#include <cmath>
+#include <functional>
+#include <limits>
+
+using namespace std;
+using namespace Orion;
+
+const double inf = numeric_limits<double>::infinity();
+
+// naive two pass reference over the last dimension, long double sums
+ten softmax_ref(const ten& x, bool log_space){
+    u64 n = x.dim().back(), rows = x.nelem()/n;
+    ten y(x.dim());
+    for(u64 r = 0; r < rows; r++){
+        const double* xr = x.data() + r*n;
+        double m = -inf;
+        for(u64 i = 0; i < n; i++) m = max(m, xr[i]);
+        long double s = 0;
+        for(u64 i = 0; i < n; i++) s += std::exp(static_cast<long double>(xr[i] - m));
+        for(u64 i = 0; i < n; i++){
+            double v = static_cast<double>(std::exp(static_cast<long double>(xr[i] - m))/s);
+            y.data()[r*n + i] = log_space ? static_cast<double>(xr[i] - m - std::log(s)) : v;
+        }
+    }
+    return y;
+}
+
+double cross_entropy_ref(const ten& x, vector<u64> const& targets){
+    ten l = softmax_ref(x, true);
+    u64 n = x.dim().back();
+    double loss = 0;
+    for(u64 r = 0; r < targets.size(); r++) loss -= l[r*n + targets[r]];
+    return loss/static_cast<double>(targets.size());
+}
+
+// largest difference relative to the magnitude of the reference
+double rel_diff(const ten& a, const ten& b){
+    double err = 0;
+    for(u64 i = 0; i < a.nelem(); i++) err = max(err, abs(a[i] - b[i])/max(1.0, abs(b[i])));
+    return err;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, double err, double tol){
+        cout << name << " : " << err << endl;
+        if(!(err < tol)){
+            cout << "FAILED " << name << endl;
+            failed++;
+        }
+    };
+
+    // row lengths around the block size, one row offset by 700 where
+    // log_softmax cancels to within an ulp of the logits
+    for(u64 n : {1u, 7u, 63u, 64u, 65u, 200u}){
+        ten x({3, n});
+        x.randomize(-30, 30);
+        for(u64 i = 0; i < n; i++) x.data()[2*n + i] += 700;
+        vector<u64> targets{0, n/2, n - 1};
+        string s = " n=" + to_string(n);
+        check("softmax" + s, rel_diff(softmax(x), softmax_ref(x, false)), 1e-14);
+        check("log_softmax" + s, rel_diff(log_softmax(x), softmax_ref(x, true)), 2e-13);
+        check("cross_entropy" + s, abs(cross_entropy(x, targets) - cross_entropy_ref(x, targets)), 1e-13);
+    }
+
+    // -inf entries: a whole first block, scattered ones, and a row that is all -inf
+    {
+        u64 n = 150;
+        ten x = random_tensor({3, n});
+        for(u64 i = 0; i < 70; i++) x.data()[i] = -inf;
+        for(u64 i = 0; i < n; i += 3) x.data()[n + i] = -inf;
+        for(u64 i = 0; i < n; i++) x.data()[2*n + i] = -inf;
+        ten y = softmax(x), l = log_softmax(x);
+        ten yr = softmax_ref(x, false), lr = softmax_ref(x, true);
+        double err = 0, lerr = 0;
+        for(u64 i = 0; i < 2*n; i++){
+            err = max(err, abs(y[i] - yr[i]));
+            lerr = max(lerr, x[i] == -inf ? (l[i] == -inf ? 0 : 1) : abs(l[i] - lr[i]));
+        }
+        check("softmax partial -inf rows", err, 1e-15);
+        check("log_softmax partial -inf rows", lerr, 1e-14);
+        double row = 0;
+        for(u64 i = 2*n; i < 3*n; i++) row = max(row, abs(y[i]) + (l[i] == -inf ? 0 : 1));
+        check("all -inf row gives zeros and -inf", row, 1e-300);
+
+        vector<double> lse;
+        double loss = cross_entropy(x, {100, 1, 0}, &lse);
+        check("cross_entropy all -inf row", loss == inf && lse[2] == -inf ? 0 : 1, 0.5);
+        ten d({3, n});
+        d.fill(0);
+        cross_entropy_backward(x, {100, 1, 0}, lse, 1.0, d);
+        double derr = 0;
+        for(u64 i = 0; i < 3*n; i++) derr = max(derr, std::isfinite(d[i]) ? 0.0 : 1.0);
+        derr = max(derr, abs(d[2*n] + 1.0/3));
+        check("cross_entropy all -inf row gradient", derr, 1e-15);
+    }
+
+    // gradients of the autograd nodes against finite differences
+    {
+        ten x = random_tensor({4, 70}), r = random_tensor({4, 70});
+        auto vx = make_shared<TensorVar>(x, true);
+        backward(softmax(vx) % make_shared<TensorVar>(r, false), {vx});
+        check("Softmax grad", grad_err(x, vx->grad(), [&]{ return dot(softmax_ref(x, false), r); }), 1e-7);
+    }
+    {
+        ten x = random_tensor({4, 70}), r = random_tensor({4, 70});
+        auto vx = make_shared<TensorVar>(x, true);
+        backward(log_softmax(vx) % make_shared<TensorVar>(r, false), {vx});
+        check("LogSoftmax grad", grad_err(x, vx->grad(), [&]{ return dot(softmax_ref(x, true), r); }), 1e-7);
+    }
+    {
+        ten x = random_tensor({5, 70});
+        vector<u64> targets{0, 13, 64, 69, 1};
+        auto vx = make_shared<TensorVar>(x, true);
+        backward(cross_entropy(vx, targets), {vx});
+        check("CrossEntropy grad", grad_err(x, vx->grad(), [&]{ return cross_entropy_ref(x, targets); }), 1e-7);
+    }
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
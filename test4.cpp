@@ -0,0 +1,63 @@
+#include "src/Linalg.hpp"
+#include "test_helpers.hpp"
+
+#include <cmath>
+
+using namespace std;
+
+using TD = Orion::Tensor<double>;
+
+TD scale_columns(const TD& u, const TD& s){
+    TD r(u.dim());
+    u64 n = u.dim()[1];
+    for(u64 i = 0; i < u.nelem(); i++)
+        r.data()[i] = u[i]*s[i%n];
+    return r;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](const char* name, double err, double tol){
+        cout << name << " : " << err << endl;
+        if(!(err < tol)){
+            cout << "FAILED " << name << endl;
+            failed++;
+        }
+    };
+
+    TD a({150, 70});
+    a.randomize(-1, 1);
+
+    auto f = Orion::qr(a);
+    check("qr reconstruction", max_abs_diff(f.Q*f.R, a), 1e-10);
+    check("qr orthogonality", max_abs_diff(TD(f.Q).t()*f.Q, [](){
+        TD eye({70, 70});
+        eye.fill(0);
+        for(u64 i = 0; i < 70; i++) eye.data()[i*70 + i] = 1;
+        return eye;
+    }()), 1e-10);
+
+    TD x({70, 3});
+    x.randomize(-1, 1);
+    TD b = a*x;
+    check("lstsq", max_abs_diff(Orion::lstsq(a, b), x), 1e-9);
+
+    TD sym = TD(a).t()*a;
+    auto e = Orion::eigh(sym);
+    check("eigh reconstruction", max_abs_diff(scale_columns(e.vectors, e.values)*TD(e.vectors).t(), sym), 1e-9);
+
+    auto s = Orion::svd(a);
+    check("svd reconstruction", max_abs_diff(scale_columns(s.U, s.S)*s.Vt, a), 1e-10);
+    auto st = Orion::svd(TD(a).t());
+    check("svd wide matrix", max_abs_diff(st.S, s.S), 1e-10);
+
+    // low rank matrix is recovered exactly by the randomized path
+    TD l({150, 8}), r({8, 70});
+    l.randomize(-1, 1);
+    r.randomize(-1, 1);
+    TD low = l*r;
+    auto sr = Orion::svd_randomized(low, 8);
+    check("randomized svd", max_abs_diff(scale_columns(sr.U, sr.S)*sr.Vt, low), 1e-9);
+
+    return failed;
+}
@@ -0,0 +1,75 @@
+#include "src/Einsum.hpp"
+#include "test_helpers.hpp"
+
+#include <cmath>
+
+using namespace std;
+
+using TD = Orion::Tensor<double>;
+
+int main(){
+    int failed = 0;
+    auto check = [&](const char* name, double err){
+        cout << name << " : " << err << endl;
+        if(!(err < 1e-10)){
+            cout << "FAILED " << name << endl;
+            failed++;
+        }
+    };
+
+    TD a({4, 5, 6}), b({4, 6, 3});
+    a.randomize(-1, 1);
+    b.randomize(-1, 1);
+
+    // batched matmul against explicit slicing
+    TD c = Orion::einsum("bij,bjk->bik", a, b);
+    double err = 0;
+    for(u64 i = 0; i < 4; i++)
+        err = max(err, max_abs_diff(c(i), a(i)*b(i)));
+    check("batched matmul", err);
+
+    // transpose and trace of a single operand
+    TD m({7, 7});
+    m.randomize(-1, 1);
+    check("transpose", max_abs_diff(Orion::einsum("ij->ji", m), TD(m).t()));
+    double trace = 0;
+    for(u64 i = 0; i < 7; i++) trace += m[i*7 + i];
+    check("trace", abs(Orion::einsum("ii", m).value() - trace));
+
+    // chain of three matrices with implicit output
+    TD x({3, 9}), y({9, 11}), z({11, 2});
+    x.randomize(-1, 1);
+    y.randomize(-1, 1);
+    z.randomize(-1, 1);
+    check("chain", max_abs_diff(Orion::einsum("ij,jk,kl", x, y, z), x*y*z));
+
+    // contraction over two indices with permuted output
+    TD p({3, 4, 5}), q({5, 4, 2});
+    p.randomize(-1, 1);
+    q.randomize(-1, 1);
+    TD r = Orion::einsum("ijk,kjl->li", p, q);
+    err = 0;
+    for(u64 l = 0; l < 2; l++){
+        for(u64 i = 0; i < 3; i++){
+            double s = 0;
+            for(u64 j = 0; j < 4; j++)
+                for(u64 k = 0; k < 5; k++)
+                    s += p[(i*4 + j)*5 + k]*q[(k*4 + j)*2 + l];
+            err = max(err, abs(r[l*3 + i] - s));
+        }
+    }
+    check("double contraction", err);
+
+    // outer product with a summed away index
+    TD u({3}), v({4, 2});
+    u.randomize(-1, 1);
+    v.randomize(-1, 1);
+    TD o = Orion::einsum("i,jk->ij", u, v);
+    err = 0;
+    for(u64 i = 0; i < 3; i++)
+        for(u64 j = 0; j < 4; j++)
+            err = max(err, abs(o[i*4 + j] - u[i]*(v[j*2] + v[j*2 + 1])));
+    check("outer with sum", err);
+
+    return failed;
+}
@@ -0,0 +1,164 @@
+#include "src/dl/Conv.hpp"
+#include "test_helpers.hpp"
+
+#include <cmath>
+
+using namespace std;
+using namespace Orion;
+
+// NCHW reference convolution
+ten conv_ref(const ten& x, const ten& w, const Conv2dParams& p){
+    u64 n = x.dim()[0], c = x.dim()[1], h = x.dim()[2], wd = x.dim()[3];
+    u64 co = w.dim()[0], kh = w.dim()[2], kw = w.dim()[3];
+    u64 oh = (h + 2*p.pad_h - p.dilation_h*(kh - 1) - 1)/p.stride_h + 1;
+    u64 ow = (wd + 2*p.pad_w - p.dilation_w*(kw - 1) - 1)/p.stride_w + 1;
+    ten y({n, co, oh, ow});
+    y.fill(0);
+    for(u64 b = 0; b < n; b++)
+    for(u64 o = 0; o < co; o++)
+    for(u64 i = 0; i < oh; i++)
+    for(u64 j = 0; j < ow; j++){
+        double s = 0;
+        for(u64 ci = 0; ci < c; ci++)
+        for(u64 a = 0; a < kh; a++)
+        for(u64 d = 0; d < kw; d++){
+            i64 ih = static_cast<i64>(i*p.stride_h + a*p.dilation_h) - static_cast<i64>(p.pad_h);
+            i64 iw = static_cast<i64>(j*p.stride_w + d*p.dilation_w) - static_cast<i64>(p.pad_w);
+            if(ih < 0 || iw < 0 || ih >= static_cast<i64>(h) || iw >= static_cast<i64>(wd)) continue;
+            s += x[((b*c + ci)*h + static_cast<u64>(ih))*wd + static_cast<u64>(iw)]*w[((o*c + ci)*kh + a)*kw + d];
+        }
+        y.data()[((b*co + o)*oh + i)*ow + j] = s;
+    }
+    return y;
+}
+
+// permute rank 4 tensor dims with perm, out dim i = in dim perm[i]
+ten permute(const ten& x, array<u64, 4> perm){
+    auto const& d = x.dim();
+    ten y({d[perm[0]], d[perm[1]], d[perm[2]], d[perm[3]]});
+    array<u64, 4> st{d[1]*d[2]*d[3], d[2]*d[3], d[3], 1};
+    u64 k = 0;
+    for(u64 a = 0; a < y.dim()[0]; a++)
+    for(u64 b = 0; b < y.dim()[1]; b++)
+    for(u64 c = 0; c < y.dim()[2]; c++)
+    for(u64 e = 0; e < y.dim()[3]; e++)
+        y.data()[k++] = x[a*st[perm[0]] + b*st[perm[1]] + c*st[perm[2]] + e*st[perm[3]]];
+    return y;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, double err, double tol){
+        cout << name << " : " << err << endl;
+        if(!(err < tol)){
+            cout << "FAILED " << name << endl;
+            failed++;
+        }
+    };
+
+    Conv2dParams p;
+    p.stride_h = 2; p.pad_h = 1; p.pad_w = 2; p.dilation_w = 2;
+    for(u64 c : {2ul, 16ul}){
+        ten x({2, c, 9, 11}), w({5, c, 3, 3});
+        x.randomize(-1, 1);
+        w.randomize(-1, 1);
+        ten ref = conv_ref(x, w, p);
+        for(ConvAlgo algo : {ConvAlgo::Direct, ConvAlgo::Im2col}){
+            p.algo = algo;
+            string tag = string(algo == ConvAlgo::Direct ? "direct" : "im2col") + " c=" + to_string(c);
+            check("nchw " + tag, max_abs_diff(conv2d(x, w, p), ref), 1e-12);
+            ten yh = conv2d(permute(x, {0, 2, 3, 1}), permute(w, {0, 2, 3, 1}), p, Layout::NHWC);
+            check("nhwc " + tag, max_abs_diff(yh, permute(ref, {0, 2, 3, 1})), 1e-12);
+        }
+    }
+
+    // gradients of sum(y % r) against finite differences, for both layouts
+    for(Layout layout : {Layout::NCHW, Layout::NHWC}){
+        string tag = layout == Layout::NCHW ? "nchw" : "nhwc";
+        Conv2dParams q;
+        q.pad_h = 1; q.pad_w = 1; q.stride_w = 2;
+        ten xt = layout == Layout::NCHW ? ten({2, 3, 6, 7}) : ten({2, 6, 7, 3});
+        ten wt = layout == Layout::NCHW ? ten({4, 3, 3, 3}) : ten({4, 3, 3, 3});
+        ten bt({4});
+        xt.randomize(-1, 1);
+        wt.randomize(-1, 1);
+        bt.randomize(-1, 1);
+        auto x = make_shared<TensorVar>(xt, true);
+        auto w = make_shared<TensorVar>(wt, true);
+        auto b = make_shared<TensorVar>(bt, true);
+        auto y = conv2d(x, w, b, q, layout);
+        ten rt(y->value().dim());
+        rt.randomize(-1, 1);
+        auto loss = [&](){
+            ten yy = conv2d(xt, wt, bt, q, layout);
+            double s = 0;
+            for(u64 i = 0; i < yy.nelem(); i++) s += yy[i]*rt[i];
+            return s;
+        };
+        auto z = y % make_shared<TensorVar>(rt, false);
+        backward(z, {x, w, b});
+
+        auto numeric = [&](ten& t, const ten& g){
+            double err = 0;
+            for(u64 i = 0; i < t.nelem(); i += 7){
+                double old = t.data()[i];
+                t.data()[i] = old + 1e-6;
+                double lp = loss();
+                t.data()[i] = old - 1e-6;
+                double lm = loss();
+                t.data()[i] = old;
+                err = max(err, abs((lp - lm)/2e-6 - g[i]));
+            }
+            return err;
+        };
+        check(tag + " grad input", numeric(xt, x->grad()), 1e-6);
+        check(tag + " grad weight", numeric(wt, w->grad()), 1e-6);
+        check(tag + " grad bias", numeric(bt, b->grad()), 1e-6);
+    }
+
+    // pooling
+    ten px({1, 2, 4, 5});
+    px.randomize(-1, 1);
+    auto pv = make_shared<TensorVar>(px, true);
+    Pool2dParams pp;
+    pp.pad_w = 1;
+    auto pm = max_pool2d(pv, pp);
+    double err = 0;
+    for(u64 c = 0; c < 2; c++)
+    for(u64 i = 0; i < 2; i++)
+    for(u64 j = 0; j < 3; j++){
+        double m = -1e9;
+        for(u64 a = 0; a < 2; a++)
+        for(u64 d = 0; d < 2; d++){
+            i64 iw = static_cast<i64>(2*j + d) - 1;
+            if(iw >= 0 && iw < 5) m = max(m, px[(c*4 + 2*i + a)*5 + static_cast<u64>(iw)]);
+        }
+        err = max(err, abs(pm->value()[(c*2 + i)*3 + j] - m));
+    }
+    check("max pool", err, 1e-15);
+    backward(pm, {pv});
+    double gsum = 0;
+    for(u64 i = 0; i < px.nelem(); i++) gsum += pv->grad()[i];
+    check("max pool grad", abs(gsum - 12), 1e-12);
+
+    // windows of -inf and windows entirely in the padding
+    {
+        const double inf = numeric_limits<double>::infinity();
+        ten nx({1, 1, 1, 4});
+        nx.data()[0] = -inf; nx.data()[1] = -inf; nx.data()[2] = 3; nx.data()[3] = 1;
+        Pool2dParams np;
+        np.kh = 1;
+        np.pad_w = 2;
+        vector<u64> arg;
+        ten ny = max_pool2d(nx, np, Layout::NCHW, &arg);
+        bool ok = ny.nelem() == 4 && ny[0] == -inf && ny[1] == -inf && ny[2] == 3 && ny[3] == -inf;
+        ok = ok && arg[0] == detail::POOL_NO_ARGMAX && arg[1] == 0 && arg[2] == 2 && arg[3] == detail::POOL_NO_ARGMAX;
+        check("max pool empty windows", ok ? 0 : 1, 0.5);
+        auto nv = make_shared<TensorVar>(nx, true);
+        backward(max_pool2d(nv, np), {nv});
+        ten const& ng = nv->grad();
+        check("max pool empty windows grad", abs(ng[0] - 1) + abs(ng[1]) + abs(ng[2] - 1) + abs(ng[3]), 1e-15);
+    }
+
+    return failed;
+}
@@ -0,0 +1,115 @@
+#include "src/dl/Backprop.hpp"
+#include "src/VecMath.hpp"
+
+#include <cmath>
+#include <functional>
+
+using namespace std;
+using namespace Orion;
+
+// max error in units of the last place of the reference, over n samples in [lo, hi]
+template<typename T>
+double max_ulp(function<T(T)> f, function<double(double)> ref, double lo, double hi, int n = 100000){
+    double worst = 0;
+    for(int i = 0; i <= n; i++){
+        T x = static_cast<T>(lo + (hi - lo)*i/n);
+        double r = ref(static_cast<double>(x));
+        T rt = static_cast<T>(r);
+        double ulp = static_cast<double>(nextafter(abs(rt), numeric_limits<T>::infinity()) - abs(rt));
+        worst = max(worst, abs(static_cast<double>(f(x)) - r)/ulp);
+    }
+    return worst;
+}
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, double err, double tol){
+        cout << name << " : " << err << endl;
+        if(!(err < tol)){
+            cout << "FAILED " << name << endl;
+            failed++;
+        }
+    };
+
+    // float results are compared against the double libm value
+    check("exp float", max_ulp<float>([](float v){ return vexp(v); }, [](double x){ return exp(x); }, -87, 88), 2);
+    check("log float", max_ulp<float>([](float v){ return vlog(v); }, [](double x){ return log(x); }, 1e-3, 1e4), 1);
+    check("tanh float", max_ulp<float>([](float v){ return vtanh(v); }, [](double x){ return tanh(x); }, -10, 10), 3);
+    check("sigmoid float", max_ulp<float>([](float v){ return vsigmoid(v); }, [](double x){ return 1/(1 + exp(-x)); }, -20, 20), 3);
+    check("sqrt float", max_ulp<float>([](float v){ return vsqrt(v); }, [](double x){ return sqrt(x); }, 1e-3, 1e6), 1);
+    check("rsqrt float", max_ulp<float>([](float v){ return vrsqrt(v); }, [](double x){ return 1/sqrt(x); }, 1e-3, 1e6), 3);
+    check("erf float", max_ulp<float>([](float v){ return verf(v); }, [](double x){ return erf(x); }, -0.49, 0.49), 3);
+    double erf_float_err = 0;
+    for(float x = -8; x <= 8; x += 1e-4f)
+        erf_float_err = max(erf_float_err, abs(static_cast<double>(verf(x)) - erf(static_cast<double>(x))));
+    check("erf float absolute", erf_float_err, 2e-7);
+
+    // double results against libm, which is itself within 1 ulp
+    check("exp double", max_ulp<double>([](double v){ return vexp(v); }, [](double x){ return exp(x); }, -700, 700), 2);
+    check("expm1 double", max_ulp<double>([](double v){ return vexpm1(v); }, [](double x){ return expm1(x); }, -1, 1), 3);
+    check("log double", max_ulp<double>([](double v){ return vlog(v); }, [](double x){ return log(x); }, 1e-3, 1e4), 2);
+    check("tanh double", max_ulp<double>([](double v){ return vtanh(v); }, [](double x){ return tanh(x); }, -10, 10), 4);
+    check("sqrt double", max_ulp<double>([](double v){ return vsqrt(v); }, [](double x){ return sqrt(x); }, 1e-3, 1e6), 2);
+    check("erf double", max_ulp<double>([](double v){ return verf(v); }, [](double x){ return erf(x); }, -7, 7, 1000000), 2);
+    check("erf double tiny", max_ulp<double>([](double v){ return verf(v); }, [](double x){ return erf(x); }, 1e-300, 1e-290), 2);
+    double gelu_err = 0;
+    for(double x = -10; x <= 10; x += 1e-4)
+        gelu_err = max(gelu_err, abs(vgelu(x) - 0.5*x*(1 + erf(x*0.70710678118654752440)))/abs(x));
+    check("gelu double", gelu_err, 4e-16);
+    float gelu_float_err = 0;
+    for(float x = -10; x <= 10; x += 1e-3f)
+        gelu_float_err = max(gelu_float_err, abs(vgelu(x) - static_cast<float>(0.5*x*(1 + erf(x*0.70710678118654752440))))/abs(x));
+    check("gelu float", gelu_float_err, 2e-7);
+
+    check("exp overflow", vexp(1000.0) == numeric_limits<double>::infinity() ? 0 : 1, 0.5);
+    check("exp underflow", abs(vexp(-740.0) - exp(-740.0)), 1e-323);
+    check("log zero", vlog(0.0) == -numeric_limits<double>::infinity() ? 0 : 1, 0.5);
+    check("log negative", std::isnan(vlog(-1.0)) ? 0 : 1, 0.5);
+
+    // expression functors
+    ten a({3, 37});
+    a.randomize(0.1, 2);
+    ten e = exp_t(a), l = log_t(a), p3 = pow<3>(a), pm = pow(a, -2);
+    double ferr = 0;
+    for(u64 i = 0; i < a.nelem(); i++){
+        ferr = max(ferr, abs(e[i] - exp(a[i]))/exp(a[i]));
+        ferr = max(ferr, abs(l[i] - log(a[i])));
+        ferr = max(ferr, abs(p3[i] - a[i]*a[i]*a[i]));
+        ferr = max(ferr, abs(pm[i] - 1/(a[i]*a[i])));
+    }
+    check("functors", ferr, 1e-14);
+
+    // gradients of sum(f(x) % r) against central differences
+    vector<pair<string, function<shared_ptr<TensorVar>(shared_ptr<TensorVar> const&)>>> ops{
+        {"log", [](auto const& v){ return Orion::log(v); }},
+        {"tanh", [](auto const& v){ return Orion::tanh(v); }},
+        {"sigmoid", [](auto const& v){ return Orion::sigmoid(v); }},
+        {"erf", [](auto const& v){ return Orion::erf(v); }},
+        {"gelu", [](auto const& v){ return Orion::gelu(v); }},
+        {"sqrt", [](auto const& v){ return Orion::sqrt(v); }},
+        {"rsqrt", [](auto const& v){ return Orion::rsqrt(v); }},
+    };
+    for(auto const& op : ops){
+        ten xt({4, 5}), rt({4, 5});
+        xt.randomize(0.2, 1.5);
+        rt.randomize(-1, 1);
+        auto x = make_shared<TensorVar>(xt, true);
+        auto z = op.second(x) % make_shared<TensorVar>(rt, false);
+        backward(z, {x});
+        double err = 0;
+        for(u64 i = 0; i < xt.nelem(); i++){
+            double old = xt.data()[i];
+            auto f = [&](double v){
+                xt.data()[i] = v;
+                double r = op.second(make_shared<TensorVar>(xt, false))->value()[i]*rt[i];
+                xt.data()[i] = old;
+                return r;
+            };
+            err = max(err, abs((f(old + 1e-6) - f(old - 1e-6))/2e-6 - x->grad()[i]));
+        }
+        check(op.first + " grad", err, 1e-6);
+    }
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
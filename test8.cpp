@@ -0,0 +1,71 @@
+#define ORION_ENABLE_PROFILER
+#include "src/dl/Backprop.hpp"
+
+#include <sstream>
+
+using namespace std;
+using namespace Orion;
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    Profiler& prof = Profiler::instance();
+    prof.clear();
+
+    ten a({8, 16}), b({16, 4});
+    a.randomize(-1, 1);
+    b.randomize(-1, 1);
+    auto x = make_shared<TensorVar>(a, true);
+    auto w = make_shared<TensorVar>(b, true);
+    auto z = tanh(x*w) + x*w;
+    backward(z, {x, w});
+
+    auto evs = prof.events();
+    u64 gemm_flops = 0, fwd = 0, bwd = 0, mat = 0;
+    bool matmul_shape = false, matmul_bytes = false, nested = true;
+    for(auto const& e : evs){
+        string cat = e.category;
+        if(cat == "gemm") gemm_flops += e.flops;
+        if(cat == "forward") fwd++;
+        if(cat == "backward") bwd++;
+        if(cat == "expr") mat++;
+        if(cat == "forward" && e.name == "MatMul"){
+            matmul_shape = matmul_shape || e.shape == "[8, 16], [16, 4] -> [8, 4]";
+            // output value and gradient tensors
+            matmul_bytes = matmul_bytes || e.bytes >= 2*8*4*sizeof(double);
+            nested = nested && e.flops == 2*8*16*4;
+        }
+        if(e.self_ns > e.dur_ns) nested = false;
+    }
+    check("forward events", fwd == 4);
+    check("backward events", bwd == 4);
+    check("materialize events", mat > 0);
+    check("gemm flops", gemm_flops >= 2*2*8*16*4);
+    check("matmul shape", matmul_shape);
+    check("matmul bytes", matmul_bytes);
+    check("nested flops and time", nested);
+
+    stringstream trace;
+    prof.write_chrome_trace(trace);
+    string t = trace.str();
+    check("trace format", t.find("{\"traceEvents\":[") == 0 && t.find("\"name\":\"UnaryMath<TanhOp>\"") != string::npos
+                          && t.find("\"ph\":\"X\"") != string::npos);
+
+    stringstream table;
+    prof.write_summary(table);
+    cout << table.str();
+    check("summary rows", table.str().find("backward MatMul") != string::npos && table.str().find("gemm gemm") != string::npos);
+
+    prof.enable(false);
+    prof.clear();
+    ten c = a + a;
+    check("disabled", prof.events().empty());
+    prof.enable(true);
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
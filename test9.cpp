@@ -0,0 +1,108 @@
+#include "src/dl/Backprop.hpp"
+
+#include <sstream>
+
+using namespace std;
+using namespace Orion;
+
+int main(){
+    int failed = 0;
+    auto check = [&](string name, bool ok){
+        cout << name << " : " << (ok ? "ok" : "FAILED") << endl;
+        if(!ok) failed++;
+    };
+
+    MemoryTracker& mt = MemoryTracker::instance();
+    mt.track_sites(true);
+    u64 base = mt.stats().live_bytes;
+
+    {
+        Tensor<float> a({100, 10});
+        check("live after alloc", mt.stats().live_bytes == base + 4000);
+        Tensor<float> row = a(3);
+        Tensor<float> copy = a;
+        check("views share the buffer", mt.stats().live_bytes == base + 4000);
+    }
+    check("freed with last owner", mt.stats().live_bytes == base);
+
+    Tensor<float> keep;
+    {
+        Tensor<float> a({4, 8});
+        keep = a(1);
+        keep.fill(2);
+    }
+    check("subtensor keeps buffer", mt.stats().live_bytes == base + 128 && keep[7] == 2);
+    keep = Tensor<float>();
+    check("subtensor release", mt.stats().live_bytes == base);
+
+    {
+        Tensor<double> a({1000});
+        Tensor<double> b = a + a;
+        mt.reset_peak();
+        {
+            Tensor<double> c({1000});
+        }
+        check("peak", mt.stats().peak_bytes == mt.stats().live_bytes + 8000);
+    }
+
+    {
+        // windows that overlap without nesting, as concurrent backward passes do
+        auto first = make_unique<PeakWindow>();
+        {
+            Tensor<double> a({1000});
+        }
+        auto second = make_unique<PeakWindow>();
+        {
+            Tensor<double> b({500});
+        }
+        check("outer window keeps its peak", first->peak_bytes() == first->start_bytes() + 8000);
+        first.reset();
+        check("overlapping windows", second->peak_bytes() == second->start_bytes() + 4000);
+        auto third = make_unique<PeakWindow>();
+        {
+            Tensor<double> c({2000});
+        }
+        check("window outlives later ones", second->peak_bytes() == second->start_bytes() + 16000 &&
+                                            third->peak_bytes() == third->start_bytes() + 16000);
+    }
+
+    {
+        ten a({8, 16}), b({16, 4});
+        a.randomize(-1, 1);
+        b.randomize(-1, 1);
+        auto x = make_shared<TensorVar>(a, true);
+        auto w = make_shared<TensorVar>(b, true);
+        auto z = tanh(x*w);
+        u64 before = mt.stats().live_bytes;
+        mt.reset_peak();
+        backward(z, {x, w});
+        MemoryStats s = mt.stats();
+        check("backward window", s.backward_start_bytes == before && s.backward_peak_bytes > before);
+
+        bool fwd = false, bwd = false;
+        for(auto const& site : mt.sites()){
+            if(site.tag == "forward MatMul" && site.shape == DimVec{8, 4} && site.live_buffers >= 2) fwd = true;
+            if(site.tag == "backward MatMul") bwd = true;
+        }
+        check("sites tagged by op", fwd && bwd);
+
+        stringstream report;
+        mt.write_report(report);
+        cout << report.str();
+        check("report", report.str().find("forward MatMul [8, 4]") != string::npos);
+    }
+    check("graph freed", mt.stats().live_bytes == base);
+
+    {
+        // a second, smaller pass is the last one, the first keeps the highest mark
+        MemoryStats s = mt.stats();
+        auto y = make_shared<TensorVar>(ten({4}), true);
+        backward(tanh(y), {y});
+        MemoryStats t = mt.stats();
+        check("backward passes", t.backward_passes == 2 && t.backward_peak_bytes < s.backward_peak_bytes &&
+                                 t.backward_max_peak_bytes == s.backward_peak_bytes);
+    }
+
+    cout << (failed ? "FAILED" : "ALL PASSED") << endl;
+    return failed ? 1 : 0;
+}
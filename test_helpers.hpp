@@ -0,0 +1,53 @@
+#ifndef TEST_HELPERS_H_
+#define TEST_HELPERS_H_
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+
+#include "src/Tensor.hpp"
+
+/*
+ * Helpers shared by the tests.
+ * */
+
+inline double max_abs_diff(const Orion::Tensor<double>& a, const Orion::Tensor<double>& b){
+    double err = 0;
+    for(u64 i = 0; i < a.nelem(); i++)
+        err = std::max(err, std::abs(a[i] - b[i]));
+    return err;
+}
+
+inline Orion::Tensor<double> random_tensor(DimVec d, double lo = -1, double hi = 1){
+    Orion::Tensor<double> t(d);
+    t.randomize(lo, hi);
+    return t;
+}
+
+inline double dot(const Orion::Tensor<double>& a, const Orion::Tensor<double>& b){
+    double s = 0;
+    for(u64 i = 0; i < a.nelem(); i++) s += a[i]*b[i];
+    return s;
+}
+
+// largest error of analytic gradient g of loss() w.r.t. every step-th element of t, against central differences
+inline double grad_err(Orion::Tensor<double>& t, const Orion::Tensor<double>& g, std::function<double()> loss, u64 step = 5){
+    double err = 0;
+    for(u64 i = 0; i < t.nelem(); i += step){
+        double old = t.data()[i];
+        t.data()[i] = old + 1e-6;
+        double lp = loss();
+        t.data()[i] = old - 1e-6;
+        double lm = loss();
+        t.data()[i] = old;
+        err = std::max(err, std::abs((lp - lm)/2e-6 - g[i]));
+    }
+    return err;
+}
+
+// a copy with its own buffer
+inline Orion::Tensor<double> copy_of(const Orion::Tensor<double>& t){
+    return t + 0.0;
+}
+
+#endif // TEST_HELPERS_H_